@@ -0,0 +1,106 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+
+#include "analyze-benchmark.h"
+#include "bus-error.h"
+#include "log.h"
+#include "manager.h"
+#include "special.h"
+#include "strv.h"
+#include "time-util.h"
+
+static int benchmark_transaction(Manager *m, const char *name, bool isolate, unsigned iterations) {
+        _cleanup_(sd_bus_error_free) sd_bus_error err = SD_BUS_ERROR_NULL;
+        char ts_min[FORMAT_TIMESPAN_MAX], ts_avg[FORMAT_TIMESPAN_MAX], ts_max[FORMAT_TIMESPAN_MAX];
+        usec_t min = USEC_INFINITY, max = 0, sum = 0;
+        unsigned n_jobs = 0, k;
+        Unit *u;
+        int r;
+
+        assert(m);
+        assert(name);
+        assert(iterations > 0);
+
+        r = manager_load_unit(m, name, NULL, &err, &u);
+        if (r < 0)
+                return log_error_errno(r, "Failed to load %s: %s", name, bus_error_message(&err, r));
+
+        /* Loading the unit pulled in all of its dependencies already, hence we only measure building, verifying and
+         * applying the transaction here. The jobs are never run, we simply cancel them again after each round. */
+
+        for (k = 0; k < iterations; k++) {
+                usec_t start, d;
+
+                start = now(CLOCK_MONOTONIC);
+                r = manager_add_job(m, JOB_START, u, isolate ? JOB_ISOLATE : JOB_REPLACE, &err, NULL);
+                d = now(CLOCK_MONOTONIC) - start;
+                if (r < 0)
+                        return log_error_errno(r, "Failed to create %s/start: %s", name, bus_error_message(&err, r));
+
+                n_jobs = hashmap_size(m->jobs);
+                manager_clear_jobs(m);
+
+                min = MIN(min, d);
+                max = MAX(max, d);
+                sum += d;
+        }
+
+        printf("%s: %u jobs, min %s, avg %s, max %s (%u iterations)\n",
+               name, n_jobs,
+               format_timespan(ts_min, sizeof(ts_min), min, 1),
+               format_timespan(ts_avg, sizeof(ts_avg), sum / iterations, 1),
+               format_timespan(ts_max, sizeof(ts_max), max, 1),
+               iterations);
+
+        return 0;
+}
+
+int benchmark_transactions(char **names, UnitFileScope scope, bool isolate, unsigned iterations) {
+        Manager *m = NULL;
+        char **name;
+        int r;
+
+        if (strv_isempty(names))
+                names = STRV_MAKE(SPECIAL_DEFAULT_TARGET);
+
+        r = manager_new(scope, true, &m);
+        if (r < 0)
+                return log_error_errno(r, "Failed to initialize manager: %m");
+
+        log_debug("Starting manager...");
+
+        r = manager_startup(m, NULL, NULL);
+        if (r < 0) {
+                log_error_errno(r, "Failed to start manager: %m");
+                goto finish;
+        }
+
+        manager_clear_jobs(m);
+
+        STRV_FOREACH(name, names) {
+                r = benchmark_transaction(m, *name, isolate, iterations);
+                if (r < 0)
+                        goto finish;
+        }
+
+finish:
+        manager_free(m);
+
+        return r;
+}
@@ -0,0 +1,189 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc-util.h"
+#include "analyze-critical-path.h"
+#include "strv.h"
+#include "util.h"
+
+PathUnit *path_graph_add(PathGraph *g, const char *name) {
+        PathUnit *u;
+
+        assert(g);
+        assert(name);
+
+        if (!GREEDY_REALLOC0(g->units, g->n_allocated, g->n_units + 1))
+                return NULL;
+
+        u = g->units + g->n_units;
+
+        u->name = strdup(name);
+        if (!u->name)
+                return NULL;
+
+        g->n_units++;
+        return u;
+}
+
+static int path_unit_compare(const void *_a, const void *_b) {
+        const PathUnit *a = _a, *b = _b;
+
+        if (a->activating != b->activating)
+                return a->activating < b->activating ? -1 : 1;
+
+        if (a->finished != b->finished)
+                return a->finished < b->finished ? -1 : 1;
+
+        return strcmp(a->name, b->name);
+}
+
+int path_graph_build(PathGraph *g) {
+        PathUnit *u;
+        unsigned i, n = 0;
+        int r;
+
+        assert(g);
+        assert(!g->by_name);
+
+        /* Drop everything that wasn't started, or hasn't finished starting yet. Units which went away again
+         * right after starting (e.g. oneshot services) are considered finished when they became inactive. */
+        for (i = 0; i < g->n_units; i++) {
+                u = g->units + i;
+
+                if (u->activated > 0 && u->activated >= u->activating)
+                        u->finished = u->activated;
+                else if (u->deactivated > 0 && u->deactivated >= u->activating)
+                        u->finished = u->deactivated;
+
+                if (u->activating == 0 || u->finished == 0) {
+                        free(u->name);
+                        strv_free(u->after);
+                        continue;
+                }
+
+                g->units[n++] = *u;
+        }
+        g->n_units = n;
+
+        /* Sorting by start time gives us a topological order: we only consider edges from units which finished
+         * before the depending unit started, and those always point forward in this order. Hence the graph is
+         * free of cycles by construction and both passes below are simple linear walks. */
+        qsort_safe(g->units, g->n_units, sizeof(PathUnit), path_unit_compare);
+
+        g->by_name = hashmap_new(&string_hash_ops);
+        if (!g->by_name)
+                return -ENOMEM;
+
+        for (i = 0; i < g->n_units; i++) {
+                r = hashmap_put(g->by_name, g->units[i].name, g->units + i);
+                if (r < 0)
+                        return r;
+        }
+
+        for (u = g->units; u < g->units + g->n_units; u++) {
+                char **a;
+
+                if (strv_isempty(u->after))
+                        continue;
+
+                u->preds = new(PathUnit*, strv_length(u->after));
+                if (!u->preds)
+                        return -ENOMEM;
+
+                STRV_FOREACH(a, u->after) {
+                        PathUnit *v;
+
+                        v = hashmap_get(g->by_name, *a);
+                        if (!v || v >= u || v->finished > u->activating)
+                                continue;
+
+                        u->preds[u->n_preds++] = v;
+
+                        if (!u->blocker || v->finished > u->blocker->finished)
+                                u->blocker = v;
+                }
+        }
+
+        return 0;
+}
+
+int path_graph_compute(PathGraph *g, const char *target, PathUnit **ret) {
+        PathUnit *t, *u;
+        unsigned i, j;
+
+        assert(g);
+        assert(g->by_name);
+        assert(target);
+
+        t = hashmap_get(g->by_name, target);
+        if (!t)
+                return -ENOENT;
+
+        for (u = g->units; u < g->units + g->n_units; u++) {
+                u->latest_finish = USEC_INFINITY;
+                u->relevant = false;
+        }
+
+        t->latest_finish = t->finished;
+        t->relevant = true;
+
+        /* Walk backwards from the target: a unit may finish as late as its earliest depending unit could have
+         * started without delaying the target. Only units the target (transitively) waited for are marked
+         * relevant, nothing sorted after the target can be among them. */
+        for (j = t - g->units + 1; j > 0; j--) {
+                usec_t latest_start;
+
+                u = g->units + j - 1;
+                if (!u->relevant)
+                        continue;
+
+                latest_start = u->latest_finish - (u->finished - u->activating);
+
+                for (i = 0; i < u->n_preds; i++) {
+                        PathUnit *v = u->preds[i];
+
+                        v->relevant = true;
+                        v->latest_finish = MIN(v->latest_finish, latest_start);
+                }
+        }
+
+        if (ret)
+                *ret = t;
+
+        return 0;
+}
+
+void path_graph_done(PathGraph *g) {
+        unsigned i;
+
+        assert(g);
+
+        for (i = 0; i < g->n_units; i++) {
+                free(g->units[i].name);
+                strv_free(g->units[i].after);
+                free(g->units[i].preds);
+        }
+
+        g->units = mfree(g->units);
+        g->n_units = 0;
+        g->n_allocated = 0;
+        g->by_name = hashmap_free(g->by_name);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdbool.h>
+
+#include "hashmap.h"
+#include "time-util.h"
+
+typedef struct PathUnit PathUnit;
+
+struct PathUnit {
+        char *name;
+        char **after;
+        usec_t activating;
+        usec_t activated;
+        usec_t deactivated;
+
+        /* Everything below is filled in by path_graph_build() and path_graph_compute() */
+        usec_t finished;
+
+        /* The After= dependencies that had finished before this unit was started */
+        PathUnit **preds;
+        unsigned n_preds;
+
+        /* The predecessor that finished last, i.e. the one this unit waited for */
+        PathUnit *blocker;
+
+        /* The latest time this unit could have finished without delaying the target */
+        usec_t latest_finish;
+        bool relevant;
+};
+
+typedef struct PathGraph {
+        PathUnit *units;
+        unsigned n_units;
+        size_t n_allocated;
+
+        Hashmap *by_name;
+} PathGraph;
+
+PathUnit *path_graph_add(PathGraph *g, const char *name);
+int path_graph_build(PathGraph *g);
+int path_graph_compute(PathGraph *g, const char *target, PathUnit **ret);
+void path_graph_done(PathGraph *g);
+
+static inline usec_t path_unit_slack(const PathUnit *u) {
+        return u->latest_finish - u->finished;
+}
@@ -26,6 +26,8 @@
 #include "sd-bus.h"
 
 #include "alloc-util.h"
+#include "analyze-benchmark.h"
+#include "analyze-critical-path.h"
 #include "analyze-verify.h"
 #include "bus-error.h"
 #include "bus-unit-util.h"
@@ -79,6 +81,8 @@ static BusTransport arg_transport = BUS_TRANSPORT_LOCAL;
 static char *arg_host = NULL;
 static bool arg_user = false;
 static bool arg_man = true;
+static bool arg_isolate = false;
+static unsigned arg_iterations = 10;
 
 struct boot_times {
         usec_t firmware_time;
@@ -433,6 +437,85 @@ fail:
         return r;
 }
 
+static int acquire_generator_times(sd_bus *bus, struct unit_times **out) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        struct boot_times *boot_times = NULL;
+        struct unit_times *generator_times = NULL;
+        size_t size = 0;
+        const char *path;
+        uint64_t start, finish;
+        int r, c = 0;
+
+        r = acquire_boot_times(bus, &boot_times);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_get_property(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "GeneratorTimings",
+                        &error, &reply,
+                        "a(stt)");
+        if (r < 0) {
+                /* Older managers do not record per-generator times */
+                if (sd_bus_error_has_name(&error, SD_BUS_ERROR_UNKNOWN_PROPERTY)) {
+                        *out = NULL;
+                        return 0;
+                }
+
+                log_error("Failed to get generator timings: %s", bus_error_message(&error, r));
+                return r;
+        }
+
+        r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "(stt)");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        while ((r = sd_bus_message_read(reply, "(stt)", &path, &start, &finish)) > 0) {
+                struct unit_times *t;
+
+                if (start == 0 || finish < start)
+                        continue;
+
+                if (!GREEDY_REALLOC0(generator_times, size, c+1)) {
+                        r = log_oom();
+                        goto fail;
+                }
+
+                t = generator_times+c;
+
+                t->name = strdup(basename(path));
+                if (!t->name) {
+                        r = log_oom();
+                        goto fail;
+                }
+
+                t->activating = start;
+                t->activated = t->deactivating = t->deactivated = finish;
+                subtract_timestamp(&t->activating, boot_times->reverse_offset);
+                subtract_timestamp(&t->activated, boot_times->reverse_offset);
+                subtract_timestamp(&t->deactivating, boot_times->reverse_offset);
+                subtract_timestamp(&t->deactivated, boot_times->reverse_offset);
+                t->time = finish - start;
+                c++;
+        }
+        if (r < 0) {
+                bus_log_parse_error(r);
+                goto fail;
+        }
+
+        *out = generator_times;
+        return c;
+
+fail:
+        if (generator_times)
+                free_unit_times(generator_times, (unsigned) c);
+        return r;
+}
+
 static int acquire_host_info(sd_bus *bus, struct host_info **hi) {
         static const struct bus_properties_map hostname_map[] = {
                 { "Hostname",                  "s", NULL, offsetof(struct host_info, hostname)       },
@@ -540,9 +623,9 @@ static void svg_graph_box(double height, double begin, double end) {
 
 static int analyze_plot(sd_bus *bus) {
         _cleanup_(free_host_infop) struct host_info *host = NULL;
-        struct unit_times *times;
+        struct unit_times *times, *generators = NULL;
         struct boot_times *boot;
-        int n, m = 1, y=0;
+        int n, g, m = 1, y=0;
         double width;
         _cleanup_free_ char *pretty_times = NULL;
         struct unit_times *u;
@@ -563,7 +646,14 @@ static int analyze_plot(sd_bus *bus) {
         if (n <= 0)
                 return n;
 
+        g = acquire_generator_times(bus, &generators);
+        if (g < 0) {
+                free_unit_times(times, (unsigned) n);
+                return g;
+        }
+
         qsort(times, n, sizeof(struct unit_times), compare_unit_start);
+        qsort_safe(generators, g, sizeof(struct unit_times), compare_unit_start);
 
         width = SCALE_X * (boot->firmware_time + boot->finish_time);
         if (width < 800.0)
@@ -581,6 +671,9 @@ static int analyze_plot(sd_bus *bus) {
         if (boot->kernel_time)
                 m++;
 
+        /* Each generator gets a row of its own right below the systemd one */
+        m += g;
+
         for (u = times; u < times + n; u++) {
                 double text_start, text_width;
 
@@ -694,6 +787,15 @@ static int analyze_plot(sd_bus *bus) {
         svg_text(true, boot->userspace_time, y, "systemd");
         y++;
 
+        for (u = generators; u < generators + g; u++) {
+                char ts[FORMAT_TIMESPAN_MAX];
+
+                svg_bar("generators", u->activating, u->activated, y);
+                svg_text(u->activating * SCALE_X < width / 2, u->activating, y, "%s (%s)",
+                         u->name, format_timespan(ts, sizeof(ts), u->time, USEC_PER_MSEC));
+                y++;
+        }
+
         for (u = times; u < times + n; u++) {
                 char ts[FORMAT_TIMESPAN_MAX];
                 bool b;
@@ -744,6 +846,8 @@ static int analyze_plot(sd_bus *bus) {
         svg("</svg>\n");
 
         free_unit_times(times, (unsigned) n);
+        if (generators)
+                free_unit_times(generators, (unsigned) g);
 
         n = 0;
         return n;
@@ -978,16 +1082,302 @@ static int analyze_critical_chain(sd_bus *bus, char *names[]) {
         return 0;
 }
 
+static const struct bus_properties_map path_unit_map[] = {
+        { "InactiveExitTimestampMonotonic", "t",  NULL, offsetof(PathUnit, activating)  },
+        { "ActiveEnterTimestampMonotonic",  "t",  NULL, offsetof(PathUnit, activated)   },
+        { "InactiveEnterTimestampMonotonic", "t", NULL, offsetof(PathUnit, deactivated) },
+        { "After",                          "as", NULL, offsetof(PathUnit, after)       },
+        {}
+};
+
+static int acquire_path_graph_one_by_one(sd_bus *bus, PathGraph *g) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        UnitInfo info;
+        int r;
+
+        r = sd_bus_call_method(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "ListUnits",
+                        &error, &reply,
+                        NULL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to list units: %s", bus_error_message(&error, r));
+
+        r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "(ssssssouso)");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        while ((r = bus_parse_unit_info(reply, &info)) > 0) {
+                PathUnit *u;
+
+                u = path_graph_add(g, info.id);
+                if (!u)
+                        return log_oom();
+
+                r = bus_map_all_properties(bus, "org.freedesktop.systemd1", info.unit_path, path_unit_map, u);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to get properties of %s: %m", info.id);
+        }
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        return 0;
+}
+
+static int acquire_path_graph(sd_bus *bus, PathGraph *g) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        struct boot_times *boot;
+        PathUnit *u;
+        int r;
+
+        r = acquire_boot_times(bus, &boot);
+        if (r < 0)
+                return r;
+
+        /* Fetch the timestamps and ordering dependencies of all units in a single call */
+        r = sd_bus_message_new_method_call(
+                        bus,
+                        &m,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "ListUnitsWithProperties");
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_message_append(m, "asasas", 0, 0, 0);
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_message_append_strv(m, STRV_MAKE("InactiveExitTimestampMonotonic",
+                                                    "ActiveEnterTimestampMonotonic",
+                                                    "InactiveEnterTimestampMonotonic",
+                                                    "After"));
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_call(bus, m, 0, &error, &reply);
+        if (r < 0) {
+                if (!sd_bus_error_has_name(&error, SD_BUS_ERROR_UNKNOWN_METHOD) &&
+                    !sd_bus_error_has_name(&error, SD_BUS_ERROR_ACCESS_DENIED) &&
+                    !sd_bus_error_has_name(&error, SD_BUS_ERROR_LIMITS_EXCEEDED))
+                        return log_error_errno(r, "Failed to list units with properties: %s", bus_error_message(&error, r));
+
+                log_debug_errno(r, "Failed to list units with properties: %s Querying units one by one.", bus_error_message(&error, r));
+
+                r = acquire_path_graph_one_by_one(bus, g);
+                if (r < 0)
+                        return r;
+        } else {
+                r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "(sa{sv})");
+                if (r < 0)
+                        return bus_log_parse_error(r);
+
+                while ((r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_STRUCT, "sa{sv}")) > 0) {
+                        const char *name;
+
+                        r = sd_bus_message_read(reply, "s", &name);
+                        if (r < 0)
+                                return bus_log_parse_error(r);
+
+                        u = path_graph_add(g, name);
+                        if (!u)
+                                return log_oom();
+
+                        r = bus_message_map_all_properties(reply, path_unit_map, u);
+                        if (r < 0)
+                                return bus_log_parse_error(r);
+
+                        r = sd_bus_message_exit_container(reply);
+                        if (r < 0)
+                                return bus_log_parse_error(r);
+                }
+                if (r < 0)
+                        return bus_log_parse_error(r);
+        }
+
+        for (u = g->units; u < g->units + g->n_units; u++) {
+                subtract_timestamp(&u->activating, boot->reverse_offset);
+                subtract_timestamp(&u->activated, boot->reverse_offset);
+                subtract_timestamp(&u->deactivated, boot->reverse_offset);
+        }
+
+        r = path_graph_build(g);
+        if (r < 0)
+                return log_error_errno(r, "Failed to build unit graph: %m");
+
+        return 0;
+}
+
+static int path_unit_compare_slack(const void *_a, const void *_b) {
+        const PathUnit *a = *(const PathUnit**) _a, *b = *(const PathUnit**) _b;
+        int r;
+
+        r = compare(path_unit_slack(a), path_unit_slack(b));
+        if (r != 0)
+                return r;
+
+        return compare(a->activating, b->activating);
+}
+
+static void critical_path_print_unit(const PathUnit *u, struct boot_times *boot) {
+        char ts[FORMAT_TIMESPAN_MAX], ts2[FORMAT_TIMESPAN_MAX], ts3[FORMAT_TIMESPAN_MAX];
+        usec_t start;
+
+        start = u->activating > boot->userspace_time ? u->activating - boot->userspace_time : 0;
+
+        printf("%s%s @%s +%s%s",
+               u->finished > u->activating ? ansi_highlight_red() : "",
+               u->name,
+               format_timespan(ts, sizeof(ts), start, USEC_PER_MSEC),
+               format_timespan(ts2, sizeof(ts2), u->finished - u->activating, USEC_PER_MSEC),
+               u->finished > u->activating ? ansi_normal() : "");
+
+        if (u->blocker && u->activating > u->blocker->finished)
+                printf(" (started %s after %s)",
+                       format_timespan(ts3, sizeof(ts3), u->activating - u->blocker->finished, USEC_PER_MSEC),
+                       u->blocker->name);
+
+        printf("\n");
+}
+
+static int critical_path_one(sd_bus *bus, PathGraph *g, const char *name) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_free_ PathUnit **chain = NULL, **relevant = NULL;
+        _cleanup_free_ char *path = NULL, *id = NULL;
+        char ts[FORMAT_TIMESPAN_MAX];
+        struct boot_times *boot;
+        unsigned n_chain = 0, n_relevant = 0, i;
+        PathUnit *t, *u;
+        int r;
+
+        r = acquire_boot_times(bus, &boot);
+        if (r < 0)
+                return r;
+
+        /* Resolve aliases such as default.target */
+        path = unit_dbus_path_from_name(name);
+        if (!path)
+                return log_oom();
+
+        r = sd_bus_get_property_string(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        path,
+                        "org.freedesktop.systemd1.Unit",
+                        "Id",
+                        &error,
+                        &id);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get ID of %s: %s", name, bus_error_message(&error, r));
+
+        r = path_graph_compute(g, id, &t);
+        if (r == -ENOENT) {
+                log_error("%s was not started, or has not finished starting yet.", id);
+                return r;
+        }
+        if (r < 0)
+                return log_error_errno(r, "Failed to compute critical path to %s: %m", id);
+
+        for (u = t; u; u = u->blocker)
+                n_chain++;
+
+        chain = new(PathUnit*, n_chain);
+        if (!chain)
+                return log_oom();
+
+        for (u = t, i = n_chain; u; u = u->blocker)
+                chain[--i] = u;
+
+        printf("Critical path to %s (%u units):\n", id, n_chain);
+        for (i = 0; i < n_chain; i++) {
+                printf("%s", special_glyph(i + 1 < n_chain ? TREE_BRANCH : TREE_RIGHT));
+                critical_path_print_unit(chain[i], boot);
+        }
+
+        relevant = new(PathUnit*, g->n_units);
+        if (!relevant)
+                return log_oom();
+
+        for (u = g->units; u < g->units + g->n_units; u++)
+                if (u->relevant)
+                        relevant[n_relevant++] = u;
+
+        qsort_safe(relevant, n_relevant, sizeof(PathUnit*), path_unit_compare_slack);
+
+        /* Units without any slack are the ones holding the target back, as is the ordering dependency on the unit
+         * they waited for */
+        printf("\nSlack of the units %s waited for:\n", id);
+        for (i = 0; i < n_relevant; i++) {
+                u = relevant[i];
+
+                printf("%s%16s %s%s",
+                       path_unit_slack(u) == 0 ? ansi_highlight_red() : "",
+                       format_timespan(ts, sizeof(ts), path_unit_slack(u), USEC_PER_MSEC),
+                       u->name,
+                       path_unit_slack(u) == 0 ? ansi_normal() : "");
+
+                if (u->blocker)
+                        printf(" (after %s)", u->blocker->name);
+
+                printf("\n");
+        }
+
+        return 0;
+}
+
+static int analyze_critical_path(sd_bus *bus, char *names[]) {
+        _cleanup_(path_graph_done) PathGraph g = {};
+        char **name;
+        int r;
+
+        r = acquire_path_graph(bus, &g);
+        if (r < 0)
+                return r;
+
+        pager_open(arg_no_pager, false);
+
+        puts("The time when the unit was started is printed after the \"@\" character.\n"
+             "The time the unit takes to start is printed after the \"+\" character.\n"
+             "The slack is how much later a unit could have finished without delaying the target.\n");
+
+        if (strv_isempty(names))
+                return critical_path_one(bus, &g, SPECIAL_DEFAULT_TARGET);
+
+        STRV_FOREACH(name, names) {
+                r = critical_path_one(bus, &g, *name);
+                if (r < 0)
+                        return r;
+
+                if (name[1])
+                        printf("\n");
+        }
+
+        return 0;
+}
+
 static int analyze_blame(sd_bus *bus) {
-        struct unit_times *times;
+        struct unit_times *times, *generators = NULL;
         unsigned i;
-        int n;
+        int n, g;
 
         n = acquire_time_data(bus, &times);
         if (n <= 0)
                 return n;
 
+        g = acquire_generator_times(bus, &generators);
+        if (g < 0) {
+                free_unit_times(times, (unsigned) n);
+                return g;
+        }
+
         qsort(times, n, sizeof(struct unit_times), compare_unit_time);
+        qsort_safe(generators, g, sizeof(struct unit_times), compare_unit_time);
 
         pager_open(arg_no_pager, false);
 
@@ -998,6 +1388,18 @@ static int analyze_blame(sd_bus *bus) {
                         printf("%16s %s\n", format_timespan(ts, sizeof(ts), times[i].time, USEC_PER_MSEC), times[i].name);
         }
 
+        if (g > 0) {
+                printf("\nGenerators:\n");
+
+                for (i = 0; i < (unsigned) g; i++) {
+                        char ts[FORMAT_TIMESPAN_MAX];
+
+                        printf("%16s %s\n", format_timespan(ts, sizeof(ts), generators[i].time, USEC_PER_MSEC), generators[i].name);
+                }
+
+                free_unit_times(generators, (unsigned) g);
+        }
+
         free_unit_times(times, (unsigned) n);
         return 0;
 }
@@ -1014,6 +1416,36 @@ static int analyze_time(sd_bus *bus) {
         return 0;
 }
 
+static int analyze_unit_cache(sd_bus *bus) {
+        uint64_t hits = 0, misses = 0;
+        int r;
+
+        r = bus_get_uint64_property(bus,
+                                    "/org/freedesktop/systemd1",
+                                    "org.freedesktop.systemd1.Manager",
+                                    "UnitPathCacheHits",
+                                    &hits);
+        if (r < 0)
+                return r;
+
+        r = bus_get_uint64_property(bus,
+                                    "/org/freedesktop/systemd1",
+                                    "org.freedesktop.systemd1.Manager",
+                                    "UnitPathCacheMisses",
+                                    &misses);
+        if (r < 0)
+                return r;
+
+        printf("Unit directory listings reused: %" PRIu64 "\n"
+               "Unit directory listings read:   %" PRIu64 "\n",
+               hits, misses);
+
+        if (hits + misses > 0)
+                printf("Hit rate:                       %.1f%%\n", 100.0 * hits / (hits + misses));
+
+        return 0;
+}
+
 static int graph_one_property(sd_bus *bus, const UnitInfo *u, const char* prop, const char *color, char* patterns[], char* from_patterns[], char* to_patterns[]) {
         _cleanup_strv_free_ char **units = NULL;
         char **unit;
@@ -1354,18 +1786,24 @@ static void help(void) {
                "     --to-pattern=GLOB     Show only destinations in the graph\n"
                "     --fuzz=SECONDS        Also print also services which finished SECONDS\n"
                "                           earlier than the latest in the branch\n"
-               "     --man[=BOOL]          Do [not] check for existence of man pages\n\n"
+               "     --man[=BOOL]          Do [not] check for existence of man pages\n"
+               "     --iterations=N        Repeat benchmarks N times\n"
+               "     --isolate             Benchmark isolating instead of starting units\n\n"
                "Commands:\n"
                "  time                     Print time spent in the kernel\n"
                "  blame                    Print list of running units ordered by time to init\n"
                "  critical-chain           Print a tree of the time critical chain of units\n"
+               "  critical-path [UNIT...]  Print the critical path and slack of units\n"
                "  plot                     Output SVG graphic showing service initialization\n"
                "  dot                      Output dependency graph in dot(1) format\n"
                "  set-log-level LEVEL      Set logging threshold for manager\n"
                "  set-log-target TARGET    Set logging target for manager\n"
                "  dump                     Output state serialization of service manager\n"
+               "  unit-cache               Show hit rate of the unit directory cache\n"
                "  syscall-filter [NAME...] Print list of syscalls in seccomp filter\n"
                "  verify FILE...           Check unit files for correctness\n"
+               "  benchmark-transaction [UNIT...]\n"
+               "                           Measure time to build start transactions\n"
                , program_invocation_short_name);
 
         /* When updating this list, including descriptions, apply
@@ -1385,6 +1823,8 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_FUZZ,
                 ARG_NO_PAGER,
                 ARG_MAN,
+                ARG_ITERATIONS,
+                ARG_ISOLATE,
         };
 
         static const struct option options[] = {
@@ -1399,6 +1839,8 @@ static int parse_argv(int argc, char *argv[]) {
                 { "fuzz",         required_argument, NULL, ARG_FUZZ             },
                 { "no-pager",     no_argument,       NULL, ARG_NO_PAGER         },
                 { "man",          optional_argument, NULL, ARG_MAN              },
+                { "iterations",   required_argument, NULL, ARG_ITERATIONS       },
+                { "isolate",      no_argument,       NULL, ARG_ISOLATE          },
                 { "host",         required_argument, NULL, 'H'                  },
                 { "machine",      required_argument, NULL, 'M'                  },
                 {}
@@ -1481,6 +1923,19 @@ static int parse_argv(int argc, char *argv[]) {
 
                         break;
 
+                case ARG_ITERATIONS:
+                        r = safe_atou(optarg, &arg_iterations);
+                        if (r < 0 || arg_iterations == 0) {
+                                log_error("Failed to parse --iterations= argument: %s", optarg);
+                                return -EINVAL;
+                        }
+
+                        break;
+
+                case ARG_ISOLATE:
+                        arg_isolate = true;
+                        break;
+
                 case '?':
                         return -EINVAL;
 
@@ -1507,6 +1962,11 @@ int main(int argc, char *argv[]) {
                 r = verify_units(argv+optind+1,
                                  arg_user ? UNIT_FILE_USER : UNIT_FILE_SYSTEM,
                                  arg_man);
+        else if (streq_ptr(argv[optind], "benchmark-transaction"))
+                r = benchmark_transactions(argv+optind+1,
+                                           arg_user ? UNIT_FILE_USER : UNIT_FILE_SYSTEM,
+                                           arg_isolate,
+                                           arg_iterations);
         else {
                 _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
 
@@ -1522,12 +1982,16 @@ int main(int argc, char *argv[]) {
                         r = analyze_blame(bus);
                 else if (streq(argv[optind], "critical-chain"))
                         r = analyze_critical_chain(bus, argv+optind+1);
+                else if (streq(argv[optind], "critical-path"))
+                        r = analyze_critical_path(bus, argv+optind+1);
                 else if (streq(argv[optind], "plot"))
                         r = analyze_plot(bus);
                 else if (streq(argv[optind], "dot"))
                         r = dot(bus, argv+optind+1);
                 else if (streq(argv[optind], "dump"))
                         r = dump(bus, argv+optind+1);
+                else if (streq(argv[optind], "unit-cache"))
+                        r = analyze_unit_cache(bus);
                 else if (streq(argv[optind], "set-log-level"))
                         r = set_log_level(bus, argv+optind+1);
                 else if (streq(argv[optind], "set-log-target"))
@@ -0,0 +1,135 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+
+#include "analyze-critical-path.h"
+#include "log.h"
+#include "macro.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "strv.h"
+
+#define N_UNITS 10000U
+
+static PathUnit *add(PathGraph *g, const char *name, usec_t activating, usec_t activated, usec_t deactivated, char **after) {
+        PathUnit *u;
+
+        assert_se(u = path_graph_add(g, name));
+        u->activating = activating * USEC_PER_MSEC;
+        u->activated = activated * USEC_PER_MSEC;
+        u->deactivated = deactivated * USEC_PER_MSEC;
+        assert_se(u->after = strv_copy(after));
+
+        return u;
+}
+
+static PathUnit *get(PathGraph *g, const char *name) {
+        PathUnit *u;
+
+        assert_se(u = hashmap_get(g->by_name, name));
+        return u;
+}
+
+static void test_slack(void) {
+        _cleanup_(path_graph_done) PathGraph g = {};
+        PathUnit *t;
+
+        add(&g, "a.service", 10, 100, 0, NULL);
+        add(&g, "b.service", 10, 50, 0, NULL);
+        add(&g, "c.service", 100, 200, 0, STRV_MAKE("a.service", "b.service"));
+        add(&g, "d.service", 50, 60, 0, STRV_MAKE("b.service"));
+        add(&g, "oneshot.service", 20, 0, 40, NULL);
+        add(&g, "never.service", 0, 0, 0, NULL);
+        add(&g, "late.service", 300, 310, 0, STRV_MAKE("target.target"));
+        add(&g, "target.target", 200, 200, 0, STRV_MAKE("c.service", "d.service", "oneshot.service", "never.service", "late.service"));
+
+        assert_se(path_graph_build(&g) >= 0);
+        assert_se(g.n_units == 7);
+        assert_se(!hashmap_get(g.by_name, "never.service"));
+
+        assert_se(path_graph_compute(&g, "never.service", NULL) == -ENOENT);
+        assert_se(path_graph_compute(&g, "target.target", &t) >= 0);
+
+        /* The critical path is a → c → target */
+        assert_se(streq(t->name, "target.target"));
+        assert_se(t->blocker == get(&g, "c.service"));
+        assert_se(t->blocker->blocker == get(&g, "a.service"));
+        assert_se(!t->blocker->blocker->blocker);
+
+        assert_se(path_unit_slack(t) == 0);
+        assert_se(path_unit_slack(get(&g, "c.service")) == 0);
+        assert_se(path_unit_slack(get(&g, "a.service")) == 0);
+        assert_se(path_unit_slack(get(&g, "b.service")) == 50 * USEC_PER_MSEC);
+        assert_se(path_unit_slack(get(&g, "d.service")) == 140 * USEC_PER_MSEC);
+        assert_se(path_unit_slack(get(&g, "oneshot.service")) == 160 * USEC_PER_MSEC);
+
+        /* Units started after the target are not something it waited for */
+        assert_se(!get(&g, "late.service")->relevant);
+
+        /* Computing for another target starts from scratch */
+        assert_se(path_graph_compute(&g, "d.service", &t) >= 0);
+        assert_se(path_unit_slack(get(&g, "b.service")) == 0);
+        assert_se(!get(&g, "a.service")->relevant);
+}
+
+static void test_many(unsigned n_units) {
+        _cleanup_(path_graph_done) PathGraph g = {};
+        char name[sizeof("unit-.service") + DECIMAL_STR_MAX(unsigned)];
+        char ts[FORMAT_TIMESPAN_MAX];
+        usec_t start;
+        PathUnit *t, *u;
+        unsigned i, n = 0;
+
+        /* Every unit is ordered after its three predecessors, the one right before it takes the longest */
+        for (i = 0; i < n_units; i++) {
+                _cleanup_strv_free_ char **after = NULL;
+                unsigned k;
+
+                for (k = 1; k <= 3 && k <= i; k++) {
+                        xsprintf(name, "unit-%u.service", i - k);
+                        assert_se(strv_extend(&after, name) >= 0);
+                }
+
+                xsprintf(name, "unit-%u.service", i);
+                add(&g, name, 1 + 2 * i, 3 + 2 * i, 0, after);
+        }
+
+        start = now(CLOCK_MONOTONIC);
+        assert_se(path_graph_build(&g) >= 0);
+        assert_se(path_graph_compute(&g, name, &t) >= 0);
+        log_info("Computed critical path over %u units in %s.",
+                 n_units, format_timespan(ts, sizeof(ts), now(CLOCK_MONOTONIC) - start, 1));
+
+        for (u = t; u; u = u->blocker) {
+                assert_se(path_unit_slack(u) == 0);
+                n++;
+        }
+
+        assert_se(n == n_units);
+}
+
+int main(int argc, char *argv[]) {
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        test_slack();
+        test_many(N_UNITS);
+
+        return 0;
+}
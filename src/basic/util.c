@@ -32,6 +32,7 @@
 #include <sys/statfs.h>
 #include <sys/sysmacros.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include "alloc-util.h"
@@ -81,10 +82,60 @@ size_t page_size(void) {
         return pgsz;
 }
 
-static int do_execute(char **directories, usec_t timeout, char *argv[]) {
-        _cleanup_hashmap_free_free_ Hashmap *pids = NULL;
+typedef struct ExecuteChild {
+        char *path;
+        usec_t start;
+} ExecuteChild;
+
+static ExecuteChild* execute_child_free(ExecuteChild *c) {
+        if (!c)
+                return NULL;
+
+        free(c->path);
+        return mfree(c);
+}
+
+static int execute_reap_one(Hashmap *pids, int timings_fd) {
+        ExecuteChild *c;
+        siginfo_t si = {};
+        usec_t finish;
+
+        assert(pids);
+
+        /* Wait for whichever child finishes first, but leave it around as zombie, so that
+         * wait_for_terminate_and_warn() can reap it and log its exit status for us. */
+        for (;;) {
+                if (waitid(P_ALL, 0, &si, WEXITED|WNOWAIT) >= 0)
+                        break;
+                if (errno != EINTR)
+                        return log_error_errno(errno, "Failed to wait for children: %m");
+        }
+
+        finish = now(CLOCK_MONOTONIC);
+
+        c = hashmap_remove(pids, PID_TO_PTR(si.si_pid));
+        if (!c) {
+                /* Not one of ours, just reap it */
+                (void) wait_for_terminate(si.si_pid, NULL);
+                return 0;
+        }
+
+        wait_for_terminate_and_warn(c->path, si.si_pid, true);
+
+        if (timings_fd >= 0)
+                (void) dprintf(timings_fd, USEC_FMT " " USEC_FMT " %s\n", c->start, finish, c->path);
+
+        execute_child_free(c);
+        return 0;
+}
+
+static int do_execute(char **directories, usec_t timeout, char *argv[], unsigned max_parallel, int timings_fd) {
+        _cleanup_hashmap_free_ Hashmap *pids = NULL;
         _cleanup_set_free_free_ Set *seen = NULL;
-        char **directory;
+        _cleanup_strv_free_ char **paths = NULL;
+        char **directory, **path;
+        ExecuteChild *c;
+        int r = 0;
 
         /* We fork this all off from a child process so that we can
          * somewhat cleanly make use of SIGALRM to set a time limit */
@@ -115,9 +166,7 @@ static int do_execute(char **directories, usec_t timeout, char *argv[]) {
                 }
 
                 FOREACH_DIRENT(de, d, break) {
-                        _cleanup_free_ char *path = NULL;
-                        pid_t pid;
-                        int r;
+                        _cleanup_free_ char *p = NULL;
 
                         if (!dirent_is_file(de))
                                 continue;
@@ -131,41 +180,19 @@ static int do_execute(char **directories, usec_t timeout, char *argv[]) {
                         if (r < 0)
                                 return log_oom();
 
-                        path = strjoin(*directory, "/", de->d_name);
-                        if (!path)
+                        p = strjoin(*directory, "/", de->d_name);
+                        if (!p)
                                 return log_oom();
 
-                        if (null_or_empty_path(path)) {
-                                log_debug("%s is empty (a mask).", path);
+                        if (null_or_empty_path(p)) {
+                                log_debug("%s is empty (a mask).", p);
                                 continue;
                         }
 
-                        pid = fork();
-                        if (pid < 0) {
-                                log_error_errno(errno, "Failed to fork: %m");
-                                continue;
-                        } else if (pid == 0) {
-                                char *_argv[2];
-
-                                assert_se(prctl(PR_SET_PDEATHSIG, SIGTERM) == 0);
-
-                                if (!argv) {
-                                        _argv[0] = path;
-                                        _argv[1] = NULL;
-                                        argv = _argv;
-                                } else
-                                        argv[0] = path;
-
-                                execv(path, argv);
-                                return log_error_errno(errno, "Failed to execute %s: %m", path);
-                        }
-
-                        log_debug("Spawned %s as " PID_FMT ".", path, pid);
-
-                        r = hashmap_put(pids, PID_TO_PTR(pid), path);
+                        r = strv_consume(&paths, p);
                         if (r < 0)
                                 return log_oom();
-                        path = NULL;
+                        p = NULL;
                 }
         }
 
@@ -176,23 +203,77 @@ static int do_execute(char **directories, usec_t timeout, char *argv[]) {
         if (timeout != USEC_INFINITY)
                 alarm((timeout + USEC_PER_SEC - 1) / USEC_PER_SEC);
 
-        while (!hashmap_isempty(pids)) {
-                _cleanup_free_ char *path = NULL;
+        STRV_FOREACH(path, paths) {
                 pid_t pid;
 
-                pid = PTR_TO_PID(hashmap_first_key(pids));
-                assert(pid > 0);
+                /* If we are at the limit, wait for one of the running binaries to finish
+                 * before starting the next one */
+                while (max_parallel > 0 && hashmap_size(pids) >= max_parallel) {
+                        r = execute_reap_one(pids, timings_fd);
+                        if (r < 0)
+                                goto finish;
+                }
 
-                path = hashmap_remove(pids, PID_TO_PTR(pid));
-                assert(path);
+                c = new0(ExecuteChild, 1);
+                if (!c) {
+                        r = log_oom();
+                        goto finish;
+                }
+
+                c->start = now(CLOCK_MONOTONIC);
+
+                pid = fork();
+                if (pid < 0) {
+                        log_error_errno(errno, "Failed to fork: %m");
+                        execute_child_free(c);
+                        continue;
+                } else if (pid == 0) {
+                        char *_argv[2];
 
-                wait_for_terminate_and_warn(path, pid, true);
+                        assert_se(prctl(PR_SET_PDEATHSIG, SIGTERM) == 0);
+
+                        if (!argv) {
+                                _argv[0] = *path;
+                                _argv[1] = NULL;
+                                argv = _argv;
+                        } else
+                                argv[0] = *path;
+
+                        execv(*path, argv);
+                        return log_error_errno(errno, "Failed to execute %s: %m", *path);
+                }
+
+                log_debug("Spawned %s as " PID_FMT ".", *path, pid);
+
+                c->path = strdup(*path);
+                if (!c->path) {
+                        execute_child_free(c);
+                        r = log_oom();
+                        goto finish;
+                }
+
+                r = hashmap_put(pids, PID_TO_PTR(pid), c);
+                if (r < 0) {
+                        execute_child_free(c);
+                        r = log_oom();
+                        goto finish;
+                }
         }
 
-        return 0;
+        r = 0;
+
+finish:
+        while (!hashmap_isempty(pids))
+                if (execute_reap_one(pids, timings_fd) < 0)
+                        break;
+
+        while ((c = hashmap_steal_first(pids)))
+                execute_child_free(c);
+
+        return r;
 }
 
-void execute_directories(const char* const* directories, usec_t timeout, char *argv[]) {
+void execute_directories_full(const char* const* directories, usec_t timeout, char *argv[], unsigned max_parallel, int timings_fd) {
         pid_t executor_pid;
         int r;
         char *name;
@@ -203,10 +284,13 @@ void execute_directories(const char* const* directories, usec_t timeout, char *a
         name = basename(dirs[0]);
         assert(!isempty(name));
 
-        /* Executes all binaries in the directories in parallel and waits
-         * for them to finish. Optionally a timeout is applied. If a file
+        /* Executes all binaries in the directories in parallel, but at
+         * most max_parallel at a time (0 means no limit), and waits for
+         * them to finish. Optionally a timeout is applied. If a file
          * with the same name exists in more than one directory, the
-         * earliest one wins. */
+         * earliest one wins. If timings_fd is valid, a line of the form
+         * "<start> <finish> <path>" with CLOCK_MONOTONIC timestamps is
+         * appended to it for each binary that finished. */
 
         executor_pid = fork();
         if (executor_pid < 0) {
@@ -214,13 +298,17 @@ void execute_directories(const char* const* directories, usec_t timeout, char *a
                 return;
 
         } else if (executor_pid == 0) {
-                r = do_execute(dirs, timeout, argv);
+                r = do_execute(dirs, timeout, argv, max_parallel, timings_fd);
                 _exit(r < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
         }
 
         wait_for_terminate_and_warn(name, executor_pid, true);
 }
 
+void execute_directories(const char* const* directories, usec_t timeout, char *argv[]) {
+        execute_directories_full(directories, timeout, argv, 0, -1);
+}
+
 bool plymouth_running(void) {
         return access("/run/plymouth/pid", F_OK) >= 0;
 }
@@ -66,6 +66,7 @@ static inline const char* enable_disable(bool b) {
 }
 
 void execute_directories(const char* const* directories, usec_t timeout, char *argv[]);
+void execute_directories_full(const char* const* directories, usec_t timeout, char *argv[], unsigned max_parallel, int timings_fd);
 
 bool plymouth_running(void);
 
@@ -36,6 +36,13 @@
 
 #define CGROUP_CPU_QUOTA_PERIOD_USEC ((usec_t) 100 * USEC_PER_MSEC)
 
+/* How many units to realize per event loop iteration */
+#define CGROUP_QUEUE_BATCH 64U
+
+/* How much to read from the cgroup inotify fd at once, and how often to check cgroups we couldn't get a watch for */
+#define CGROUP_INOTIFY_BUFFER_SIZE (16U*1024U)
+#define CGROUP_POLL_USEC (2*USEC_PER_SEC)
+
 static void cgroup_compat_warn(void) {
         static bool cgroup_compat_warned = false;
 
@@ -255,6 +262,110 @@ void cgroup_context_dump(CGroupContext *c, FILE* f, const char *prefix) {
         }
 }
 
+static void unit_flush_cgroup_attributes(Unit *u, CGroupMask mask) {
+        Iterator i;
+        char *key;
+        void *v;
+
+        assert(u);
+
+        /* Forgets what we wrote to the attribute files of the specified controllers, for example because the
+         * cgroup was removed from their hierarchies. The attribute names are prefixed by the controller name. */
+
+        HASHMAP_FOREACH_KEY(v, key, u->cgroup_attributes, i) {
+                _cleanup_free_ char *controller = NULL;
+                CGroupController c;
+
+                controller = strndup(key, strcspn(key, "."));
+                if (!controller)
+                        continue;
+
+                c = cgroup_controller_from_string(controller);
+                if (c >= 0 && !(mask & CGROUP_CONTROLLER_TO_MASK(c)))
+                        continue;
+
+                hashmap_remove(u->cgroup_attributes, key);
+                free(key);
+                free(v);
+        }
+}
+
+static void unit_forget_cgroup_attribute(Unit *u, const char *key) {
+        char *k, *v;
+
+        v = hashmap_remove2(u->cgroup_attributes, key, (void**) &k);
+        if (!v)
+                return;
+
+        free(k);
+        free(v);
+}
+
+static int unit_remember_cgroup_attribute(Unit *u, const char *key, const char *value) {
+        _cleanup_free_ char *k = NULL, *v = NULL;
+        char *old_key, *old;
+        int r;
+
+        v = strdup(value);
+        if (!v)
+                return -ENOMEM;
+
+        old = hashmap_get2(u->cgroup_attributes, key, (void**) &old_key);
+        if (old) {
+                r = hashmap_update(u->cgroup_attributes, old_key, v);
+                if (r < 0)
+                        return r;
+
+                free(old);
+                v = NULL;
+                return 0;
+        }
+
+        r = hashmap_ensure_allocated(&u->cgroup_attributes, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        k = strdup(key);
+        if (!k)
+                return -ENOMEM;
+
+        r = hashmap_put(u->cgroup_attributes, k, v);
+        if (r < 0)
+                return r;
+
+        k = v = NULL;
+        return 0;
+}
+
+static int unit_set_cgroup_attribute(Unit *u, const char *controller, const char *attribute, const char *value, bool per_device) {
+        const char *key = attribute;
+        int r;
+
+        assert(u);
+        assert(controller);
+        assert(attribute);
+        assert(value);
+
+        /* Writes a cgroup attribute, unless we know it has the value already. Per-device attributes take a list of
+         * "major:minor value" lines, for those we remember the value for each device. */
+
+        if (per_device)
+                key = strjoina(attribute, " ", strndupa(value, strcspn(value, WHITESPACE)));
+
+        if (streq_ptr(hashmap_get(u->cgroup_attributes, key), value))
+                return 0;
+
+        r = cg_set_attribute(controller, u->cgroup_path, attribute, value);
+        if (r < 0) {
+                unit_forget_cgroup_attribute(u, key);
+                return r;
+        }
+
+        /* Not knowing the value only means we write it again next time */
+        (void) unit_remember_cgroup_attribute(u, key, value);
+        return 1;
+}
+
 static int lookup_block_device(const char *p, dev_t *dev) {
         struct stat st;
         int r;
@@ -427,7 +538,7 @@ static void cgroup_apply_unified_cpu_config(Unit *u, uint64_t weight, uint64_t q
         int r;
 
         xsprintf(buf, "%" PRIu64 "\n", weight);
-        r = cg_set_attribute("cpu", u->cgroup_path, "cpu.weight", buf);
+        r = unit_set_cgroup_attribute(u, "cpu", "cpu.weight", buf, false);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set cpu.weight: %m");
@@ -438,7 +549,7 @@ static void cgroup_apply_unified_cpu_config(Unit *u, uint64_t weight, uint64_t q
         else
                 xsprintf(buf, "max " USEC_FMT "\n", CGROUP_CPU_QUOTA_PERIOD_USEC);
 
-        r = cg_set_attribute("cpu", u->cgroup_path, "cpu.max", buf);
+        r = unit_set_cgroup_attribute(u, "cpu", "cpu.max", buf, false);
 
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
@@ -450,22 +561,22 @@ static void cgroup_apply_legacy_cpu_config(Unit *u, uint64_t shares, uint64_t qu
         int r;
 
         xsprintf(buf, "%" PRIu64 "\n", shares);
-        r = cg_set_attribute("cpu", u->cgroup_path, "cpu.shares", buf);
+        r = unit_set_cgroup_attribute(u, "cpu", "cpu.shares", buf, false);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set cpu.shares: %m");
 
         xsprintf(buf, USEC_FMT "\n", CGROUP_CPU_QUOTA_PERIOD_USEC);
-        r = cg_set_attribute("cpu", u->cgroup_path, "cpu.cfs_period_us", buf);
+        r = unit_set_cgroup_attribute(u, "cpu", "cpu.cfs_period_us", buf, false);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set cpu.cfs_period_us: %m");
 
         if (quota != USEC_INFINITY) {
                 xsprintf(buf, USEC_FMT "\n", quota * CGROUP_CPU_QUOTA_PERIOD_USEC / USEC_PER_SEC);
-                r = cg_set_attribute("cpu", u->cgroup_path, "cpu.cfs_quota_us", buf);
+                r = unit_set_cgroup_attribute(u, "cpu", "cpu.cfs_quota_us", buf, false);
         } else
-                r = cg_set_attribute("cpu", u->cgroup_path, "cpu.cfs_quota_us", "-1");
+                r = unit_set_cgroup_attribute(u, "cpu", "cpu.cfs_quota_us", "-1", false);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set cpu.cfs_quota_us: %m");
@@ -537,7 +648,7 @@ static void cgroup_apply_io_device_weight(Unit *u, const char *dev_path, uint64_
                 return;
 
         xsprintf(buf, "%u:%u %" PRIu64 "\n", major(dev), minor(dev), io_weight);
-        r = cg_set_attribute("io", u->cgroup_path, "io.weight", buf);
+        r = unit_set_cgroup_attribute(u, "io", "io.weight", buf, true);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set io.weight: %m");
@@ -553,7 +664,7 @@ static void cgroup_apply_blkio_device_weight(Unit *u, const char *dev_path, uint
                 return;
 
         xsprintf(buf, "%u:%u %" PRIu64 "\n", major(dev), minor(dev), blkio_weight);
-        r = cg_set_attribute("blkio", u->cgroup_path, "blkio.weight_device", buf);
+        r = unit_set_cgroup_attribute(u, "blkio", "blkio.weight_device", buf, true);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set blkio.weight_device: %m");
@@ -583,7 +694,7 @@ static unsigned cgroup_apply_io_device_limit(Unit *u, const char *dev_path, uint
         xsprintf(buf, "%u:%u rbps=%s wbps=%s riops=%s wiops=%s\n", major(dev), minor(dev),
                  limit_bufs[CGROUP_IO_RBPS_MAX], limit_bufs[CGROUP_IO_WBPS_MAX],
                  limit_bufs[CGROUP_IO_RIOPS_MAX], limit_bufs[CGROUP_IO_WIOPS_MAX]);
-        r = cg_set_attribute("io", u->cgroup_path, "io.max", buf);
+        r = unit_set_cgroup_attribute(u, "io", "io.max", buf, true);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set io.max: %m");
@@ -603,7 +714,7 @@ static unsigned cgroup_apply_blkio_device_limit(Unit *u, const char *dev_path, u
         if (rbps != CGROUP_LIMIT_MAX)
                 n++;
         sprintf(buf, "%u:%u %" PRIu64 "\n", major(dev), minor(dev), rbps);
-        r = cg_set_attribute("blkio", u->cgroup_path, "blkio.throttle.read_bps_device", buf);
+        r = unit_set_cgroup_attribute(u, "blkio", "blkio.throttle.read_bps_device", buf, true);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set blkio.throttle.read_bps_device: %m");
@@ -611,7 +722,7 @@ static unsigned cgroup_apply_blkio_device_limit(Unit *u, const char *dev_path, u
         if (wbps != CGROUP_LIMIT_MAX)
                 n++;
         sprintf(buf, "%u:%u %" PRIu64 "\n", major(dev), minor(dev), wbps);
-        r = cg_set_attribute("blkio", u->cgroup_path, "blkio.throttle.write_bps_device", buf);
+        r = unit_set_cgroup_attribute(u, "blkio", "blkio.throttle.write_bps_device", buf, true);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set blkio.throttle.write_bps_device: %m");
@@ -630,7 +741,7 @@ static void cgroup_apply_unified_memory_limit(Unit *u, const char *file, uint64_
         if (v != CGROUP_LIMIT_MAX)
                 xsprintf(buf, "%" PRIu64 "\n", v);
 
-        r = cg_set_attribute("memory", u->cgroup_path, file, buf);
+        r = unit_set_cgroup_attribute(u, "memory", file, buf, false);
         if (r < 0)
                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                               "Failed to set %s: %m", file);
@@ -724,7 +835,7 @@ static void cgroup_context_apply(Unit *u, CGroupMask mask, ManagerState state) {
                                 weight = CGROUP_WEIGHT_DEFAULT;
 
                         xsprintf(buf, "default %" PRIu64 "\n", weight);
-                        r = cg_set_attribute("io", path, "io.weight", buf);
+                        r = unit_set_cgroup_attribute(u, "io", "io.weight", buf, false);
                         if (r < 0)
                                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                                               "Failed to set io.weight: %m");
@@ -801,7 +912,7 @@ static void cgroup_context_apply(Unit *u, CGroupMask mask, ManagerState state) {
                                 weight = CGROUP_BLKIO_WEIGHT_DEFAULT;
 
                         xsprintf(buf, "%" PRIu64 "\n", weight);
-                        r = cg_set_attribute("blkio", path, "blkio.weight", buf);
+                        r = unit_set_cgroup_attribute(u, "blkio", "blkio.weight", buf, false);
                         if (r < 0)
                                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                                               "Failed to set blkio.weight: %m");
@@ -881,7 +992,7 @@ static void cgroup_context_apply(Unit *u, CGroupMask mask, ManagerState state) {
                         else
                                 xsprintf(buf, "%" PRIu64 "\n", val);
 
-                        r = cg_set_attribute("memory", path, "memory.limit_in_bytes", buf);
+                        r = unit_set_cgroup_attribute(u, "memory", "memory.limit_in_bytes", buf, false);
                         if (r < 0)
                                 log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
                                               "Failed to set memory.limit_in_bytes: %m");
@@ -960,9 +1071,9 @@ static void cgroup_context_apply(Unit *u, CGroupMask mask, ManagerState state) {
                         char buf[DECIMAL_STR_MAX(uint64_t) + 2];
 
                         sprintf(buf, "%" PRIu64 "\n", c->tasks_max);
-                        r = cg_set_attribute("pids", path, "pids.max", buf);
+                        r = unit_set_cgroup_attribute(u, "pids", "pids.max", buf, false);
                 } else
-                        r = cg_set_attribute("pids", path, "pids.max", "max");
+                        r = unit_set_cgroup_attribute(u, "pids", "pids.max", "max", false);
 
                 if (r < 0)
                         log_unit_full(u, IN_SET(r, -ENOENT, -EROFS, -EACCES) ? LOG_DEBUG : LOG_WARNING, r,
@@ -1045,7 +1156,7 @@ CGroupMask unit_get_members_mask(Unit *u) {
                 Unit *member;
                 Iterator i;
 
-                SET_FOREACH(member, u->dependencies[UNIT_BEFORE], i) {
+                UNIT_FOREACH_DEPENDENCY(member, u, UNIT_BEFORE, i) {
 
                         if (member == u)
                                 continue;
@@ -1237,6 +1348,123 @@ int unit_set_cgroup_path(Unit *u, const char *path) {
         return 1;
 }
 
+static void unit_add_to_cgroup_empty_queue(Unit *u) {
+        assert(u);
+
+        if (u->in_cgroup_empty_queue)
+                return;
+
+        LIST_PREPEND(cgroup_empty_queue, u->manager->cgroup_empty_queue, u);
+        u->in_cgroup_empty_queue = true;
+}
+
+static void manager_dispatch_cgroup_empty_queue(Manager *m) {
+        Unit *u;
+
+        assert(m);
+
+        /* Every unit in here got at least one cgroup.events change since we last looked, but we check each
+         * of them only once, no matter how many notifications piled up for it in the meantime. */
+
+        while ((u = m->cgroup_empty_queue)) {
+                assert(u->in_cgroup_empty_queue);
+
+                LIST_REMOVE(cgroup_empty_queue, m->cgroup_empty_queue, u);
+                u->in_cgroup_empty_queue = false;
+
+                (void) unit_notify_cgroup_empty(u);
+        }
+}
+
+static int on_cgroup_poll_timer(sd_event_source *s, usec_t usec, void *userdata) {
+        _cleanup_set_free_ Set *units = NULL;
+        Manager *m = userdata;
+        Unit *u;
+        int r;
+
+        assert(s);
+        assert(m);
+
+        /* Take the current set over, so that units which still can't get a watch may be added back to a fresh
+         * one while we iterate. */
+        units = m->cgroup_poll_units;
+        m->cgroup_poll_units = NULL;
+
+        while ((u = set_steal_first(units))) {
+                /* Maybe watches have been freed up in the meantime, try to move back to inotify */
+                (void) unit_watch_cgroup(u);
+
+                /* Either way, the notification might have happened while we weren't watching */
+                unit_add_to_cgroup_empty_queue(u);
+        }
+
+        manager_dispatch_cgroup_empty_queue(m);
+
+        if (set_isempty(m->cgroup_poll_units))
+                return 0;
+
+        r = sd_event_source_set_time(s, usec + CGROUP_POLL_USEC);
+        if (r < 0)
+                return log_error_errno(r, "Failed to rearm control group poll timer: %m");
+
+        return sd_event_source_set_enabled(s, SD_EVENT_ONESHOT);
+}
+
+static int unit_poll_cgroup(Unit *u) {
+        static bool warned = false;
+        Manager *m;
+        int r;
+
+        assert(u);
+
+        m = u->manager;
+
+        r = set_ensure_allocated(&m->cgroup_poll_units, NULL);
+        if (r < 0)
+                return log_oom();
+
+        r = set_put(m->cgroup_poll_units, u);
+        if (r < 0)
+                return log_oom();
+
+        if (!warned) {
+                log_notice("Out of inotify watches, falling back to polling some control groups for emptiness. "
+                           "Consider raising fs.inotify.max_user_watches.");
+                warned = true;
+        } else
+                log_unit_debug(u, "Out of inotify watches, polling control group %s for emptiness.", u->cgroup_path);
+
+        if (m->cgroup_poll_event_source) {
+                int enabled;
+
+                r = sd_event_source_get_enabled(m->cgroup_poll_event_source, &enabled);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to check whether control group poll timer is enabled: %m");
+                if (enabled != SD_EVENT_OFF)
+                        return 0;
+
+                r = sd_event_source_set_time(m->cgroup_poll_event_source, now(CLOCK_MONOTONIC) + CGROUP_POLL_USEC);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to rearm control group poll timer: %m");
+
+                r = sd_event_source_set_enabled(m->cgroup_poll_event_source, SD_EVENT_ONESHOT);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to enable control group poll timer: %m");
+
+                return 0;
+        }
+
+        r = sd_event_add_time(m->event, &m->cgroup_poll_event_source, CLOCK_MONOTONIC,
+                              now(CLOCK_MONOTONIC) + CGROUP_POLL_USEC, 0,
+                              on_cgroup_poll_timer, m);
+        if (r < 0)
+                return log_error_errno(r, "Failed to add control group poll timer: %m");
+
+        (void) sd_event_source_set_description(m->cgroup_poll_event_source, "cgroup-poll");
+
+        return 0;
+}
+
 int unit_watch_cgroup(Unit *u) {
         _cleanup_free_ char *events = NULL;
         int r;
@@ -1276,9 +1504,14 @@ int unit_watch_cgroup(Unit *u) {
                                       * it, so this is not an error */
                         return 0;
 
+                if (errno == ENOSPC) /* Out of watches, check for emptiness periodically instead */
+                        return unit_poll_cgroup(u);
+
                 return log_unit_error_errno(u, errno, "Failed to add inotify watch descriptor for control group %s: %m", u->cgroup_path);
         }
 
+        (void) set_remove(u->manager->cgroup_poll_units, u);
+
         r = hashmap_put(u->manager->cgroup_inotify_wd_unit, INT_TO_PTR(u->cgroup_inotify_wd), u);
         if (r < 0)
                 return log_unit_error_errno(u, r, "Failed to add inotify watch descriptor to hash map: %m");
@@ -1319,6 +1552,10 @@ static int unit_create_cgroup(
         if (r < 0)
                 return log_unit_error_errno(u, r, "Failed to create cgroup %s: %m", u->cgroup_path);
 
+        /* The group is removed from the hierarchies of controllers we don't need anymore, and starts out with the
+         * kernel's defaults when it is created there again */
+        unit_flush_cgroup_attributes(u, ~target_mask);
+
         /* Start watching it */
         (void) unit_watch_cgroup(u);
 
@@ -1443,9 +1680,12 @@ unsigned manager_dispatch_cgroup_queue(Manager *m) {
         Unit *i;
         int r;
 
+        /* Realizes at most CGROUP_QUEUE_BATCH units, so that the event loop gets to run in between if a slice with
+         * thousands of units below it changed */
+
         state = manager_state(m);
 
-        while ((i = m->cgroup_queue)) {
+        while (n < CGROUP_QUEUE_BATCH && (i = m->cgroup_queue)) {
                 assert(i->in_cgroup_queue);
 
                 r = unit_realize_cgroup_now(i, state);
@@ -1469,7 +1709,7 @@ static void unit_queue_siblings(Unit *u) {
                 Iterator i;
                 Unit *m;
 
-                SET_FOREACH(m, slice->dependencies[UNIT_BEFORE], i) {
+                UNIT_FOREACH_DEPENDENCY(m, slice, UNIT_BEFORE, i) {
                         if (m == u)
                                 continue;
 
@@ -1530,6 +1770,8 @@ void unit_release_cgroup(Unit *u) {
                 u->cgroup_path = mfree(u->cgroup_path);
         }
 
+        u->cgroup_attributes = hashmap_free_free_free(u->cgroup_attributes);
+
         if (u->cgroup_inotify_wd >= 0) {
                 if (inotify_rm_watch(u->manager->cgroup_inotify_fd, u->cgroup_inotify_wd) < 0)
                         log_unit_debug_errno(u, errno, "Failed to remove cgroup inotify watch %i for %s, ignoring", u->cgroup_inotify_wd, u->id);
@@ -1537,6 +1779,8 @@ void unit_release_cgroup(Unit *u) {
                 (void) hashmap_remove(u->manager->cgroup_inotify_wd_unit, INT_TO_PTR(u->cgroup_inotify_wd));
                 u->cgroup_inotify_wd = -1;
         }
+
+        (void) set_remove(u->manager->cgroup_poll_units, u);
 }
 
 void unit_prune_cgroup(Unit *u) {
@@ -1701,29 +1945,46 @@ int unit_notify_cgroup_empty(Unit *u) {
 
 static int on_cgroup_inotify_event(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
         Manager *m = userdata;
+        int r = 0;
 
         assert(s);
         assert(fd >= 0);
         assert(m);
 
         for (;;) {
-                union inotify_event_buffer buffer;
+                /* Our watches never carry a file name, hence each event is just the bare header. Read many of
+                 * them at once, so that a burst of exiting scopes doesn't cost us one read() per scope. */
+                union {
+                        struct inotify_event ev;
+                        uint8_t raw[CGROUP_INOTIFY_BUFFER_SIZE];
+                } buffer;
                 struct inotify_event *e;
                 ssize_t l;
 
                 l = read(fd, &buffer, sizeof(buffer));
                 if (l < 0) {
-                        if (errno == EINTR || errno == EAGAIN)
-                                return 0;
+                        if (errno != EINTR && errno != EAGAIN)
+                                r = log_error_errno(errno, "Failed to read control group inotify events: %m");
 
-                        return log_error_errno(errno, "Failed to read control group inotify events: %m");
+                        break;
                 }
 
                 FOREACH_INOTIFY_EVENT(e, buffer, l) {
                         Unit *u;
 
+                        if (e->mask & IN_Q_OVERFLOW) {
+                                Iterator i;
+
+                                /* We lost events, hence recheck everything we watch */
+                                log_debug("Control group inotify queue overflowed, rechecking all watched control groups.");
+
+                                HASHMAP_FOREACH(u, m->cgroup_inotify_wd_unit, i)
+                                        unit_add_to_cgroup_empty_queue(u);
+
+                                continue;
+                        }
+
                         if (e->wd < 0)
-                                /* Queue overflow has no watch descriptor */
                                 continue;
 
                         if (e->mask & IN_IGNORED)
@@ -1738,9 +1999,13 @@ static int on_cgroup_inotify_event(sd_event_source *s, int fd, uint32_t revents,
                                  * this here safely. */
                                 continue;
 
-                        (void) unit_notify_cgroup_empty(u);
+                        unit_add_to_cgroup_empty_queue(u);
                 }
         }
+
+        manager_dispatch_cgroup_empty_queue(m);
+
+        return r;
 }
 
 int manager_setup_cgroup(Manager *m) {
@@ -1886,6 +2151,9 @@ void manager_shutdown_cgroup(Manager *m, bool delete) {
 
         m->cgroup_inotify_wd_unit = hashmap_free(m->cgroup_inotify_wd_unit);
 
+        m->cgroup_poll_event_source = sd_event_source_unref(m->cgroup_poll_event_source);
+        m->cgroup_poll_units = set_free(m->cgroup_poll_units);
+
         m->cgroup_inotify_event_source = sd_event_source_unref(m->cgroup_inotify_event_source);
         m->cgroup_inotify_fd = safe_close(m->cgroup_inotify_fd);
 
@@ -2021,6 +2289,81 @@ int unit_get_tasks_current(Unit *u, uint64_t *ret) {
         return safe_atou64(v, ret);
 }
 
+int unit_get_io_bytes(Unit *u, uint64_t *ret_read, uint64_t *ret_write) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *p = NULL;
+        uint64_t rd = 0, wr = 0;
+        bool unified;
+        int r;
+
+        assert(u);
+        assert(ret_read);
+        assert(ret_write);
+
+        if (!u->cgroup_path)
+                return -ENODATA;
+
+        unified = cg_all_unified() > 0;
+
+        if ((u->cgroup_realized_mask & (unified ? CGROUP_MASK_IO : CGROUP_MASK_BLKIO)) == 0)
+                return -ENODATA;
+
+        r = cg_get_path(unified ? "io" : "blkio", u->cgroup_path, unified ? "io.stat" : "blkio.io_service_bytes", &p);
+        if (r < 0)
+                return r;
+
+        f = fopen(p, "re");
+        if (!f) {
+                if (errno == ENOENT)
+                        return -ENODATA;
+                return -errno;
+        }
+
+        for (;;) {
+                char line[LINE_MAX], *l;
+                uint64_t k, *q;
+
+                if (!fgets(line, sizeof(line), f))
+                        break;
+
+                /* Trim and skip the device */
+                l = strstrip(line);
+                l += strcspn(l, WHITESPACE);
+                l += strspn(l, WHITESPACE);
+
+                if (unified) {
+                        while (!isempty(l)) {
+                                if (sscanf(l, "rbytes=%" SCNu64, &k))
+                                        rd += k;
+                                else if (sscanf(l, "wbytes=%" SCNu64, &k))
+                                        wr += k;
+
+                                l += strcspn(l, WHITESPACE);
+                                l += strspn(l, WHITESPACE);
+                        }
+                } else {
+                        if (first_word(l, "Read")) {
+                                l += 4;
+                                q = &rd;
+                        } else if (first_word(l, "Write")) {
+                                l += 5;
+                                q = &wr;
+                        } else
+                                continue;
+
+                        l += strspn(l, WHITESPACE);
+                        if (safe_atou64(l, &k) < 0)
+                                continue;
+
+                        *q += k;
+                }
+        }
+
+        *ret_read = rd;
+        *ret_write = wr;
+        return 0;
+}
+
 static int unit_get_cpu_usage_raw(Unit *u, nsec_t *ret) {
         _cleanup_free_ char *v = NULL;
         uint64_t ns;
@@ -2152,6 +2495,19 @@ void unit_invalidate_cgroup(Unit *u, CGroupMask m) {
         unit_add_to_cgroup_queue(u);
 }
 
+void manager_forget_cgroup_attributes(Manager *m) {
+        Iterator i;
+        Unit *u;
+
+        assert(m);
+
+        /* Attributes might have been changed behind our back. Like a full reload, which starts out with new unit
+         * objects, the next time units are realized all attributes are written again, repairing such changes. */
+
+        HASHMAP_FOREACH(u, m->units, i)
+                u->cgroup_attributes = hashmap_free_free_free(u->cgroup_attributes);
+}
+
 void manager_invalidate_startup_units(Manager *m) {
         Iterator i;
         Unit *u;
@@ -2162,6 +2518,157 @@ void manager_invalidate_startup_units(Manager *m) {
                 unit_invalidate_cgroup(u, CGROUP_MASK_CPU|CGROUP_MASK_IO|CGROUP_MASK_BLKIO);
 }
 
+CGroupResourceSamples *cgroup_resource_samples_new(unsigned size) {
+        CGroupResourceSamples *s;
+
+        assert(size > 0);
+
+        s = malloc0(offsetof(CGroupResourceSamples, samples) + size * sizeof(CGroupResourceSample));
+        if (!s)
+                return NULL;
+
+        s->size = size;
+        return s;
+}
+
+void cgroup_resource_samples_push(CGroupResourceSamples *s, const CGroupResourceSample *sample) {
+        assert(s);
+        assert(sample);
+
+        /* Once the ring is full, the oldest sample is overwritten */
+
+        s->samples[s->next] = *sample;
+        s->next = (s->next + 1) % s->size;
+
+        if (s->n < s->size)
+                s->n++;
+}
+
+const CGroupResourceSample *cgroup_resource_samples_get(const CGroupResourceSamples *s, unsigned i) {
+        assert(s);
+
+        /* Returns the i-th sample, counting from the oldest one */
+
+        if (i >= s->n)
+                return NULL;
+
+        return s->samples + (s->next + s->size - s->n + i) % s->size;
+}
+
+int unit_sample_resources(Unit *u) {
+        CGroupResourceSample sample = {
+                .cpu_usage = NSEC_INFINITY,
+                .memory = (uint64_t) -1,
+                .tasks = (uint64_t) -1,
+                .io_read_bytes = (uint64_t) -1,
+                .io_write_bytes = (uint64_t) -1,
+        };
+        unsigned size;
+
+        assert(u);
+
+        if (!u->cgroup_path)
+                return 0;
+
+        size = u->manager->resource_sample_count;
+        if (size <= 0)
+                return 0;
+
+        /* The ring is reallocated if the configured size changed, dropping the old history */
+        if (u->resource_samples && u->resource_samples->size != size)
+                u->resource_samples = mfree(u->resource_samples);
+
+        if (!u->resource_samples) {
+                u->resource_samples = cgroup_resource_samples_new(size);
+                if (!u->resource_samples)
+                        return -ENOMEM;
+        }
+
+        /* Whatever isn't accounted for this unit is recorded as unset, i.e. all bits on */
+        sample.timestamp = now(CLOCK_REALTIME);
+        (void) unit_get_cpu_usage(u, &sample.cpu_usage);
+        (void) unit_get_memory_current(u, &sample.memory);
+        (void) unit_get_tasks_current(u, &sample.tasks);
+        if (unit_get_io_bytes(u, &sample.io_read_bytes, &sample.io_write_bytes) < 0)
+                sample.io_read_bytes = sample.io_write_bytes = (uint64_t) -1;
+
+        cgroup_resource_samples_push(u->resource_samples, &sample);
+        return 1;
+}
+
+static int on_resource_sample_timer(sd_event_source *s, usec_t usec, void *userdata) {
+        Manager *m = userdata;
+        unsigned n = 0;
+        const char *k;
+        usec_t start;
+        Iterator i;
+        Unit *u;
+        int r;
+
+        assert(s);
+        assert(m);
+
+        start = now(CLOCK_MONOTONIC);
+
+        HASHMAP_FOREACH_KEY(u, k, m->units, i) {
+                if (k != u->id)
+                        continue;
+
+                /* Don't return early on failure, the timer has to be rearmed below either way */
+                r = unit_sample_resources(u);
+                if (r < 0) {
+                        log_oom();
+                        break;
+                }
+                if (r > 0)
+                        n++;
+        }
+
+        if (n > 0) {
+                char ts[FORMAT_TIMESPAN_MAX];
+
+                log_debug("Sampled resource usage of %u units in %s.",
+                          n, format_timespan(ts, sizeof(ts), now(CLOCK_MONOTONIC) - start, 1));
+        }
+
+        r = sd_event_source_set_time(s, usec + m->resource_sample_interval_usec);
+        if (r < 0)
+                return log_error_errno(r, "Failed to rearm resource sample timer: %m");
+
+        return sd_event_source_set_enabled(s, SD_EVENT_ONESHOT);
+}
+
+int manager_setup_resource_sampler(Manager *m) {
+        int r;
+
+        assert(m);
+
+        if (m->resource_sample_interval_usec <= 0 ||
+            m->resource_sample_interval_usec == USEC_INFINITY ||
+            m->resource_sample_count <= 0) {
+                m->resource_sample_event_source = sd_event_source_unref(m->resource_sample_event_source);
+                return 0;
+        }
+
+        if (m->resource_sample_event_source)
+                return 0;
+
+        r = sd_event_add_time(m->event, &m->resource_sample_event_source, CLOCK_MONOTONIC,
+                              now(CLOCK_MONOTONIC) + m->resource_sample_interval_usec, 0,
+                              on_resource_sample_timer, m);
+        if (r < 0)
+                return log_error_errno(r, "Failed to add resource sample timer: %m");
+
+        /* Sampling is a background job, anything else goes first */
+        r = sd_event_source_set_priority(m->resource_sample_event_source, SD_EVENT_PRIORITY_IDLE);
+        if (r < 0)
+                return log_error_errno(r, "Failed to set priority of resource sample timer: %m");
+
+        (void) sd_event_source_set_description(m->resource_sample_event_source, "resource-sample");
+
+        return 0;
+}
+
 static const char* const cgroup_device_policy_table[_CGROUP_DEVICE_POLICY_MAX] = {
         [CGROUP_AUTO] = "auto",
         [CGROUP_CLOSED] = "closed",
@@ -31,6 +31,8 @@ typedef struct CGroupIODeviceWeight CGroupIODeviceWeight;
 typedef struct CGroupIODeviceLimit CGroupIODeviceLimit;
 typedef struct CGroupBlockIODeviceWeight CGroupBlockIODeviceWeight;
 typedef struct CGroupBlockIODeviceBandwidth CGroupBlockIODeviceBandwidth;
+typedef struct CGroupResourceSample CGroupResourceSample;
+typedef struct CGroupResourceSamples CGroupResourceSamples;
 
 typedef enum CGroupDevicePolicy {
 
@@ -123,6 +125,24 @@ struct CGroupContext {
         bool delegate;
 };
 
+/* One sample of a unit's resource usage. Counters that aren't available are set to all bits on. */
+struct CGroupResourceSample {
+        usec_t timestamp; /* CLOCK_REALTIME */
+        nsec_t cpu_usage;
+        uint64_t memory;
+        uint64_t tasks;
+        uint64_t io_read_bytes;
+        uint64_t io_write_bytes;
+};
+
+/* Ring buffer of the most recent samples of a unit */
+struct CGroupResourceSamples {
+        unsigned size;
+        unsigned n;
+        unsigned next;
+        CGroupResourceSample samples[];
+};
+
 #include "unit.h"
 
 void cgroup_context_init(CGroupContext *c);
@@ -171,6 +191,7 @@ int unit_watch_all_pids(Unit *u);
 
 int unit_get_memory_current(Unit *u, uint64_t *ret);
 int unit_get_tasks_current(Unit *u, uint64_t *ret);
+int unit_get_io_bytes(Unit *u, uint64_t *ret_read, uint64_t *ret_write);
 int unit_get_cpu_usage(Unit *u, nsec_t *ret);
 int unit_reset_cpu_usage(Unit *u);
 
@@ -181,6 +202,14 @@ int manager_notify_cgroup_empty(Manager *m, const char *group);
 
 void unit_invalidate_cgroup(Unit *u, CGroupMask m);
 
+CGroupResourceSamples *cgroup_resource_samples_new(unsigned size);
+void cgroup_resource_samples_push(CGroupResourceSamples *s, const CGroupResourceSample *sample);
+const CGroupResourceSample *cgroup_resource_samples_get(const CGroupResourceSamples *s, unsigned i);
+
+int unit_sample_resources(Unit *u);
+int manager_setup_resource_sampler(Manager *m);
+
+void manager_forget_cgroup_attributes(Manager *m);
 void manager_invalidate_startup_units(Manager *m);
 
 const char* cgroup_device_policy_to_string(CGroupDevicePolicy i) _const_;
@@ -891,6 +891,10 @@ int bus_exec_context_set_transient_property(
         assert(name);
         assert(message);
 
+        /* The compiled seccomp filters might be based on what is changed here */
+        if (mode != UNIT_CHECK)
+                exec_context_flush_seccomp(c);
+
         if (streq(name, "User")) {
                 const char *uu;
 
@@ -25,6 +25,8 @@
 #include "architecture.h"
 #include "build.h"
 #include "bus-common-errors.h"
+#include "bus-internal.h"
+#include "bus-message.h"
 #include "clock-util.h"
 #include "dbus-execute.h"
 #include "dbus-job.h"
@@ -35,6 +37,7 @@
 #include "fd-util.h"
 #include "fileio.h"
 #include "format-util.h"
+#include "glob-util.h"
 #include "install.h"
 #include "log.h"
 #include "path-util.h"
@@ -293,6 +296,39 @@ static int property_get_n_jobs(
         return sd_bus_message_append(reply, "u", (uint32_t) hashmap_size(m->jobs));
 }
 
+static int property_get_generator_timings(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        Manager *m = userdata;
+        unsigned i;
+        int r;
+
+        assert(bus);
+        assert(reply);
+        assert(m);
+
+        r = sd_bus_message_open_container(reply, 'a', "(stt)");
+        if (r < 0)
+                return r;
+
+        for (i = 0; i < m->n_generator_timings; i++) {
+                r = sd_bus_message_append(reply, "(stt)",
+                                          m->generator_timings[i].path,
+                                          m->generator_timings[i].start,
+                                          m->generator_timings[i].finish);
+                if (r < 0)
+                        return r;
+        }
+
+        return sd_bus_message_close_container(reply);
+}
+
 static int property_get_progress(
                 sd_bus *bus,
                 const char *path,
@@ -1165,6 +1201,289 @@ static int method_list_units_by_patterns(sd_bus_message *message, void *userdata
         return list_units_filtered(message, userdata, error, states, patterns);
 }
 
+static int unit_compare_by_id(const void *a, const void *b) {
+        Unit * const *x = a, * const *y = b;
+
+        return strcmp((*x)->id, (*y)->id);
+}
+
+static bool unit_matches_states_and_types(Unit *u, char **states, char **types) {
+        assert(u);
+
+        if (!strv_isempty(states) &&
+            !strv_contains(states, unit_load_state_to_string(u->load_state)) &&
+            !strv_contains(states, unit_active_state_to_string(unit_active_state(u))) &&
+            !strv_contains(states, unit_sub_state_to_string(u)))
+                return false;
+
+        if (!strv_isempty(types) &&
+            !strv_contains(types, unit_type_to_string(u->type)))
+                return false;
+
+        return true;
+}
+
+static int reply_unit_with_properties(sd_bus_message *reply, Unit *u, char **properties, sd_bus_error *error) {
+        int r;
+
+        assert(reply);
+        assert(u);
+
+        r = sd_bus_message_open_container(reply, 'r', "sa{sv}");
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append(reply, "s", u->id);
+        if (r < 0)
+                return r;
+
+        r = bus_unit_append_all_properties(u, reply, properties, error);
+        if (r < 0)
+                return r;
+
+        return sd_bus_message_close_container(reply);
+}
+
+static int reply_units_with_properties(
+                Manager *m,
+                sd_bus_message *message,
+                sd_bus_message *reply,
+                Set *seen,
+                const char *pattern,
+                char **states,
+                char **types,
+                char **properties,
+                sd_bus_error *error) {
+
+        _cleanup_free_ Unit **units = NULL;
+        size_t n = 0, j;
+        Unit *u;
+        int r;
+
+        assert(m);
+        assert(reply);
+        assert(seen);
+
+        if (pattern && !string_is_glob(pattern)) {
+                /* Plain unit names are loaded if necessary, like accessing their object would */
+                r = manager_load_unit(m, pattern, NULL, error, &u);
+                if (r < 0)
+                        return r;
+
+                units = new(Unit*, 1);
+                if (!units)
+                        return -ENOMEM;
+
+                units[n++] = u;
+        } else {
+                const char *k;
+                Iterator i;
+
+                /* Globs only match units already loaded */
+                units = new(Unit*, MAX(hashmap_size(m->units), 1U));
+                if (!units)
+                        return -ENOMEM;
+
+                HASHMAP_FOREACH_KEY(u, k, m->units, i) {
+                        if (k != u->id)
+                                continue;
+
+                        if (pattern && fnmatch(pattern, u->id, FNM_NOESCAPE) != 0)
+                                continue;
+
+                        units[n++] = u;
+                }
+
+                qsort_safe(units, n, sizeof(Unit*), unit_compare_by_id);
+        }
+
+        for (j = 0; j < n; j++) {
+                _cleanup_(sd_bus_error_free) sd_bus_error access_error = SD_BUS_ERROR_NULL;
+
+                if (!unit_matches_states_and_types(units[j], states, types))
+                        continue;
+
+                /* The same check as for reading the properties of the unit's object, units the caller may not
+                 * look at are left out */
+                r = mac_selinux_unit_access_check(units[j], message, "status", &access_error);
+                if (sd_bus_error_has_name(&access_error, SD_BUS_ERROR_ACCESS_DENIED))
+                        continue;
+                if (r < 0)
+                        return r;
+
+                r = set_put(seen, units[j]);
+                if (r < 0)
+                        return r;
+                if (r == 0) /* Already matched by an earlier pattern */
+                        continue;
+
+                r = reply_unit_with_properties(reply, units[j], properties, error);
+                if (r < 0)
+                        return r;
+
+                /* Don't send what the receiver would refuse, callers ask for fewer units at once then */
+                if (BUS_MESSAGE_SIZE(reply) >= BUS_MESSAGE_SIZE_MAX)
+                        return sd_bus_error_setf(error, SD_BUS_ERROR_LIMITS_EXCEEDED,
+                                                 "Too many units and properties for one reply.");
+        }
+
+        return 0;
+}
+
+static int method_list_units_with_properties(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_strv_free_ char **states = NULL, **patterns = NULL, **types = NULL, **properties = NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_set_free_ Set *seen = NULL;
+        Manager *m = userdata;
+        char **p;
+        int r;
+
+        assert(message);
+        assert(m);
+
+        /* Anyone can call this method */
+
+        r = mac_selinux_access_check(message, "status", error);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_read_strv(message, &states);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_read_strv(message, &patterns);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_read_strv(message, &types);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_read_strv(message, &properties);
+        if (r < 0)
+                return r;
+
+        STRV_FOREACH(p, types)
+                if (unit_type_from_string(*p) < 0)
+                        return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Invalid unit type: %s", *p);
+
+        seen = set_new(NULL);
+        if (!seen)
+                return -ENOMEM;
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(sa{sv})");
+        if (r < 0)
+                return r;
+
+        /* Units are returned in the order of the patterns they match, and sorted by name among the matches of
+         * the same glob. No pattern at all matches all loaded units. */
+
+        if (strv_isempty(patterns)) {
+                r = reply_units_with_properties(m, message, reply, seen, NULL, states, types, properties, error);
+                if (r < 0)
+                        return r;
+        }
+
+        STRV_FOREACH(p, patterns) {
+                r = reply_units_with_properties(m, message, reply, seen, *p, states, types, properties, error);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
+static int method_get_unit_resource_samples(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_strv_free_ char **patterns = NULL;
+        Manager *m = userdata;
+        const char *k;
+        Iterator i;
+        Unit *u;
+        int r;
+
+        assert(message);
+        assert(m);
+
+        /* Anyone can call this method */
+
+        r = mac_selinux_access_check(message, "status", error);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_read_strv(message, &patterns);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(sa(tttttt))");
+        if (r < 0)
+                return r;
+
+        HASHMAP_FOREACH_KEY(u, k, m->units, i) {
+                const CGroupResourceSample *s;
+                unsigned n;
+
+                if (k != u->id)
+                        continue;
+
+                if (!u->resource_samples)
+                        continue;
+
+                if (!strv_fnmatch_or_empty(patterns, u->id, FNM_NOESCAPE))
+                        continue;
+
+                r = sd_bus_message_open_container(reply, 'r', "sa(tttttt)");
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_append(reply, "s", u->id);
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_open_container(reply, 'a', "(tttttt)");
+                if (r < 0)
+                        return r;
+
+                for (n = 0; (s = cgroup_resource_samples_get(u->resource_samples, n)); n++) {
+                        r = sd_bus_message_append(reply, "(tttttt)",
+                                                  s->timestamp,
+                                                  s->cpu_usage,
+                                                  s->memory,
+                                                  s->tasks,
+                                                  s->io_read_bytes,
+                                                  s->io_write_bytes);
+                        if (r < 0)
+                                return r;
+                }
+
+                r = sd_bus_message_close_container(reply);
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_close_container(reply);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
 static int method_list_jobs(sd_bus_message *message, void *userdata, sd_bus_error *error) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         Manager *m = userdata;
@@ -1343,6 +1662,43 @@ static int method_reload(sd_bus_message *message, void *userdata, sd_bus_error *
         return 1;
 }
 
+static int method_reload_incremental(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        Manager *m = userdata;
+        int r;
+
+        assert(message);
+        assert(m);
+
+        r = mac_selinux_access_check(message, "reload", error);
+        if (r < 0)
+                return r;
+
+        r = bus_verify_reload_daemon_async(m, message, error);
+        if (r < 0)
+                return r;
+        if (r == 0)
+                return 1; /* No authorization for now, but the async polkit stuff will call us again when it has it */
+
+        r = manager_reload_incremental(m);
+        if (r >= 0)
+                return sd_bus_reply_method_return(message, NULL);
+
+        if (r == -EBUSY)
+                log_debug("Incremental reload not possible, doing a full reload.");
+        else
+                log_warning_errno(r, "Incremental reload failed, doing a full reload: %m");
+
+        /* Fall back to a full reload, and send the reply once it is finished, like method_reload() does. */
+        assert(!m->queued_message);
+        r = sd_bus_message_new_method_return(message, &m->queued_message);
+        if (r < 0)
+                return r;
+
+        m->exit_code = MANAGER_RELOAD;
+
+        return 1;
+}
+
 static int method_reexecute(sd_bus_message *message, void *userdata, sd_bus_error *error) {
         Manager *m = userdata;
         int r;
@@ -2323,6 +2679,8 @@ const sd_bus_vtable bus_manager_vtable[] = {
         BUS_PROPERTY_DUAL_TIMESTAMP("SecurityFinishTimestamp", offsetof(Manager, security_finish_timestamp), SD_BUS_VTABLE_PROPERTY_CONST),
         BUS_PROPERTY_DUAL_TIMESTAMP("GeneratorsStartTimestamp", offsetof(Manager, generators_start_timestamp), SD_BUS_VTABLE_PROPERTY_CONST),
         BUS_PROPERTY_DUAL_TIMESTAMP("GeneratorsFinishTimestamp", offsetof(Manager, generators_finish_timestamp), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("GeneratorTimings", "a(stt)", property_get_generator_timings, 0, 0),
+        SD_BUS_PROPERTY("MaxParallelGenerators", "u", bus_property_get_unsigned, offsetof(Manager, max_parallel_generators), SD_BUS_VTABLE_PROPERTY_CONST),
         BUS_PROPERTY_DUAL_TIMESTAMP("UnitsLoadStartTimestamp", offsetof(Manager, units_load_start_timestamp), SD_BUS_VTABLE_PROPERTY_CONST),
         BUS_PROPERTY_DUAL_TIMESTAMP("UnitsLoadFinishTimestamp", offsetof(Manager, units_load_finish_timestamp), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_WRITABLE_PROPERTY("LogLevel", "s", property_get_log_level, property_set_log_level, 0, 0),
@@ -2389,6 +2747,10 @@ const sd_bus_vtable bus_manager_vtable[] = {
         SD_BUS_PROPERTY("DefaultLimitRTTIMESoft", "t", bus_property_get_rlimit, offsetof(Manager, rlimit[RLIMIT_RTTIME]), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("DefaultTasksMax", "t", NULL, offsetof(Manager, default_tasks_max), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("TimerSlackNSec", "t", property_get_timer_slack_nsec, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("UnitPathCacheHits", "t", NULL, offsetof(Manager, unit_path_cache_hits), 0),
+        SD_BUS_PROPERTY("UnitPathCacheMisses", "t", NULL, offsetof(Manager, unit_path_cache_misses), 0),
+        SD_BUS_PROPERTY("ResourceSampleIntervalUSec", "t", bus_property_get_usec, offsetof(Manager, resource_sample_interval_usec), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("ResourceSampleCount", "u", bus_property_get_unsigned, offsetof(Manager, resource_sample_count), SD_BUS_VTABLE_PROPERTY_CONST),
 
         SD_BUS_METHOD("GetUnit", "s", "o", method_get_unit, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("GetUnitByPID", "u", "o", method_get_unit_by_pid, SD_BUS_VTABLE_UNPRIVILEGED),
@@ -2419,6 +2781,8 @@ const sd_bus_vtable bus_manager_vtable[] = {
         SD_BUS_METHOD("ListUnitsFiltered", "as", "a(ssssssouso)", method_list_units_filtered, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("ListUnitsByPatterns", "asas", "a(ssssssouso)", method_list_units_by_patterns, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("ListUnitsByNames", "as", "a(ssssssouso)", method_list_units_by_names, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("ListUnitsWithProperties", "asasasas", "a(sa{sv})", method_list_units_with_properties, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("GetUnitResourceSamples", "as", "a(sa(tttttt))", method_get_unit_resource_samples, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("ListJobs", NULL, "a(usssoo)", method_list_jobs, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Subscribe", NULL, NULL, method_subscribe, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Unsubscribe", NULL, NULL, method_unsubscribe, SD_BUS_VTABLE_UNPRIVILEGED),
@@ -2426,6 +2790,7 @@ const sd_bus_vtable bus_manager_vtable[] = {
         SD_BUS_METHOD("CreateSnapshot", "sb", "o", method_refuse_snapshot, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("RemoveSnapshot", "s", NULL, method_refuse_snapshot, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Reload", NULL, NULL, method_reload, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("ReloadIncremental", NULL, NULL, method_reload_incremental, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Reexecute", NULL, NULL, method_reexecute, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Exit", NULL, NULL, method_exit, 0),
         SD_BUS_METHOD("Reboot", NULL, NULL, method_reboot, SD_BUS_VTABLE_CAPABILITY(CAP_SYS_BOOT)),
@@ -1259,6 +1259,21 @@ static void rename_process_from_path(const char *path) {
         rename_process(process_name);
 }
 
+static bool context_has_address_families(const ExecContext *c) {
+        assert(c);
+
+        return c->address_families_whitelist ||
+                !set_isempty(c->address_families);
+}
+
+static bool context_has_syscall_filters(const ExecContext *c) {
+        assert(c);
+
+        return c->syscall_whitelist ||
+                !set_isempty(c->syscall_filter) ||
+                !set_isempty(c->syscall_archs);
+}
+
 #ifdef HAVE_SECCOMP
 
 static bool skip_seccomp_unavailable(const Unit* u, const char* msg) {
@@ -1272,7 +1287,7 @@ static bool skip_seccomp_unavailable(const Unit* u, const char* msg) {
         return true;
 }
 
-static int apply_seccomp(const Unit* u, const ExecContext *c) {
+static int build_syscall_filter(const ExecContext *c, scmp_filter_ctx *ret) {
         uint32_t negative_action, action;
         scmp_filter_ctx seccomp;
         Iterator i;
@@ -1280,9 +1295,7 @@ static int apply_seccomp(const Unit* u, const ExecContext *c) {
         int r;
 
         assert(c);
-
-        if (skip_seccomp_unavailable(u, "syscall filtering"))
-                return 0;
+        assert(ret);
 
         negative_action = c->syscall_errno == 0 ? SCMP_ACT_KILL : SCMP_ACT_ERRNO(c->syscall_errno);
 
@@ -1317,22 +1330,21 @@ static int apply_seccomp(const Unit* u, const ExecContext *c) {
         if (r < 0)
                 goto finish;
 
-        r = seccomp_load(seccomp);
+        *ret = seccomp;
+        return 0;
 
 finish:
         seccomp_release(seccomp);
         return r;
 }
 
-static int apply_address_families(const Unit* u, const ExecContext *c) {
+static int build_address_families(const ExecContext *c, scmp_filter_ctx *ret) {
         scmp_filter_ctx seccomp;
         Iterator i;
         int r;
 
         assert(c);
-
-        if (skip_seccomp_unavailable(u, "RestrictAddressFamilies="))
-                return 0;
+        assert(ret);
 
         r = seccomp_init_conservative(&seccomp, SCMP_ACT_ALLOW);
         if (r < 0)
@@ -1433,21 +1445,20 @@ static int apply_address_families(const Unit* u, const ExecContext *c) {
                 }
         }
 
-        r = seccomp_load(seccomp);
+        *ret = seccomp;
+        return 0;
 
 finish:
         seccomp_release(seccomp);
         return r;
 }
 
-static int apply_memory_deny_write_execute(const Unit* u, const ExecContext *c) {
+static int build_memory_deny_write_execute(const ExecContext *c, scmp_filter_ctx *ret) {
         scmp_filter_ctx seccomp;
         int r;
 
         assert(c);
-
-        if (skip_seccomp_unavailable(u, "MemoryDenyWriteExecute="))
-                return 0;
+        assert(ret);
 
         r = seccomp_init_conservative(&seccomp, SCMP_ACT_ALLOW);
         if (r < 0)
@@ -1480,14 +1491,15 @@ static int apply_memory_deny_write_execute(const Unit* u, const ExecContext *c)
         if (r < 0)
                 goto finish;
 
-        r = seccomp_load(seccomp);
+        *ret = seccomp;
+        return 0;
 
 finish:
         seccomp_release(seccomp);
         return r;
 }
 
-static int apply_restrict_realtime(const Unit* u, const ExecContext *c) {
+static int build_restrict_realtime(const ExecContext *c, scmp_filter_ctx *ret) {
         static const int permitted_policies[] = {
                 SCHED_OTHER,
                 SCHED_BATCH,
@@ -1499,9 +1511,7 @@ static int apply_restrict_realtime(const Unit* u, const ExecContext *c) {
         int r, p, max_policy = 0;
 
         assert(c);
-
-        if (skip_seccomp_unavailable(u, "RestrictRealtime="))
-                return 0;
+        assert(ret);
 
         r = seccomp_init_conservative(&seccomp, SCMP_ACT_ALLOW);
         if (r < 0)
@@ -1549,25 +1559,24 @@ static int apply_restrict_realtime(const Unit* u, const ExecContext *c) {
         if (r < 0)
                 goto finish;
 
-        r = seccomp_load(seccomp);
+        *ret = seccomp;
+        return 0;
 
 finish:
         seccomp_release(seccomp);
         return r;
 }
 
-static int apply_protect_sysctl(const Unit *u, const ExecContext *c) {
+static int build_protect_sysctl(const ExecContext *c, scmp_filter_ctx *ret) {
         scmp_filter_ctx seccomp;
         int r;
 
         assert(c);
+        assert(ret);
 
         /* Turn off the legacy sysctl() system call. Many distributions turn this off while building the kernel, but
          * let's protect even those systems where this is left on in the kernel. */
 
-        if (skip_seccomp_unavailable(u, "ProtectKernelTunables="))
-                return 0;
-
         r = seccomp_init_conservative(&seccomp, SCMP_ACT_ALLOW);
         if (r < 0)
                 return r;
@@ -1580,49 +1589,296 @@ static int apply_protect_sysctl(const Unit *u, const ExecContext *c) {
         if (r < 0)
                 goto finish;
 
-        r = seccomp_load(seccomp);
+        *ret = seccomp;
+        return 0;
 
 finish:
         seccomp_release(seccomp);
         return r;
 }
 
-static int apply_protect_kernel_modules(const Unit *u, const ExecContext *c) {
+static int build_protect_kernel_modules(const ExecContext *c, scmp_filter_ctx *ret) {
         assert(c);
 
         /* Turn off module syscalls on ProtectKernelModules=yes */
 
-        if (skip_seccomp_unavailable(u, "ProtectKernelModules="))
-                return 0;
-
-        return seccomp_load_filter_set(SCMP_ACT_ALLOW, syscall_filter_sets + SYSCALL_FILTER_SET_MODULE, SCMP_ACT_ERRNO(EPERM));
+        return seccomp_build_filter_set(SCMP_ACT_ALLOW, syscall_filter_sets + SYSCALL_FILTER_SET_MODULE, SCMP_ACT_ERRNO(EPERM), ret);
 }
 
-static int apply_private_devices(const Unit *u, const ExecContext *c) {
+static int build_private_devices(const ExecContext *c, scmp_filter_ctx *ret) {
         assert(c);
 
         /* If PrivateDevices= is set, also turn off iopl and all @raw-io syscalls. */
 
-        if (skip_seccomp_unavailable(u, "PrivateDevices="))
-                return 0;
+        return seccomp_build_filter_set(SCMP_ACT_ALLOW, syscall_filter_sets + SYSCALL_FILTER_SET_RAW_IO, SCMP_ACT_ERRNO(EPERM), ret);
+}
+
+static int build_restrict_namespaces(const ExecContext *c, scmp_filter_ctx *ret) {
+        assert(c);
+
+        return seccomp_build_restrict_namespaces(c->restrict_namespaces, ret);
+}
+
+static bool context_has_memory_deny_write_execute(const ExecContext *c) {
+        return c->memory_deny_write_execute;
+}
+
+static bool context_has_restrict_realtime(const ExecContext *c) {
+        return c->restrict_realtime;
+}
+
+static bool context_has_protect_kernel_tunables(const ExecContext *c) {
+        return c->protect_kernel_tunables;
+}
+
+static bool context_has_protect_kernel_modules(const ExecContext *c) {
+        return c->protect_kernel_modules;
+}
+
+static bool context_has_private_devices(const ExecContext *c) {
+        return c->private_devices;
+}
+
+/* The filters in the order they are loaded. The system call filter really should remain the last one, to make sure
+ * our own code is unaffected by it as little as possible. */
+static const struct {
+        const char *setting;
+        bool (*needed)(const ExecContext *c);
+        int (*build)(const ExecContext *c, scmp_filter_ctx *ret);
+        int exit_status;
+} seccomp_filters[] = {
+        { "RestrictAddressFamilies=", context_has_address_families,           build_address_families,           EXIT_ADDRESS_FAMILIES },
+        { "MemoryDenyWriteExecute=",  context_has_memory_deny_write_execute,  build_memory_deny_write_execute,  EXIT_SECCOMP          },
+        { "RestrictRealtime=",        context_has_restrict_realtime,          build_restrict_realtime,          EXIT_SECCOMP          },
+        { "RestrictNamespaces=",      exec_context_restrict_namespaces_set,   build_restrict_namespaces,        EXIT_SECCOMP          },
+        { "ProtectKernelTunables=",   context_has_protect_kernel_tunables,    build_protect_sysctl,             EXIT_SECCOMP          },
+        { "ProtectKernelModules=",    context_has_protect_kernel_modules,     build_protect_kernel_modules,     EXIT_SECCOMP          },
+        { "PrivateDevices=",          context_has_private_devices,            build_private_devices,            EXIT_SECCOMP          },
+        { "syscall filtering",        context_has_syscall_filters,            build_syscall_filter,             EXIT_SECCOMP          },
+};
 
-        return seccomp_load_filter_set(SCMP_ACT_ALLOW, syscall_filter_sets + SYSCALL_FILTER_SET_RAW_IO, SCMP_ACT_ERRNO(EPERM));
+/* BPF programs generated by the manager, so that forked off processes only have to hand them to the kernel. Shared by
+ * all execution contexts with the same seccomp settings, and dropped with the last of them. */
+struct ExecSeccompCache {
+        unsigned n_ref;
+        Manager *manager;
+        char *key;
+        struct sock_fprog programs[ELEMENTSOF(seccomp_filters)];
+};
+
+static ExecSeccompCache *exec_seccomp_cache_unref(ExecSeccompCache *cache) {
+        unsigned k;
+
+        if (!cache)
+                return NULL;
+
+        assert(cache->n_ref > 0);
+        cache->n_ref--;
+        if (cache->n_ref > 0)
+                return NULL;
+
+        if (cache->manager && cache->key)
+                (void) hashmap_remove_value(cache->manager->seccomp_filters, cache->key, cache);
+
+        for (k = 0; k < ELEMENTSOF(cache->programs); k++)
+                seccomp_program_done(cache->programs + k);
+
+        free(cache->key);
+        return mfree(cache);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(ExecSeccompCache*, exec_seccomp_cache_unref);
+
+static int int_compare(const void *a, const void *b) {
+        const int *x = a, *y = b;
+
+        return *x < *y ? -1 : *x > *y ? 1 : 0;
+}
+
+static int seccomp_key_put_set(FILE *f, const char *name, Set *s) {
+        _cleanup_free_ int *a = NULL;
+        Iterator i;
+        size_t n = 0, k;
+        void *p;
+
+        /* The iteration order of a set depends on how it was filled, hence sort it */
+
+        if (!set_isempty(s)) {
+                a = new(int, set_size(s));
+                if (!a)
+                        return -ENOMEM;
+        }
+
+        SET_FOREACH(p, s, i)
+                a[n++] = PTR_TO_INT(p);
+
+        qsort_safe(a, n, sizeof(int), int_compare);
+
+        fprintf(f, "%s=", name);
+        for (k = 0; k < n; k++)
+                fprintf(f, "%s%i", k > 0 ? "," : "", a[k]);
+        fputc(';', f);
+
+        return 0;
 }
 
-static int apply_restrict_namespaces(Unit *u, const ExecContext *c) {
+/* Describes everything the filters are built from, contexts with the same description get the same filters */
+static int exec_context_seccomp_key(const ExecContext *c, char **ret) {
+        _cleanup_free_ char *key = NULL;
+        FILE *f;
+        size_t size;
+        int r;
+
         assert(c);
+        assert(ret);
 
-        if (!exec_context_restrict_namespaces_set(c))
+        f = open_memstream(&key, &size);
+        if (!f)
+                return -ENOMEM;
+
+        fprintf(f, "af-whitelist=%i;", c->address_families_whitelist);
+        r = seccomp_key_put_set(f, "af", c->address_families);
+        if (r >= 0) {
+                fprintf(f, "mdwe=%i;realtime=%i;namespaces=%lx;tunables=%i;modules=%i;devices=%i;",
+                        c->memory_deny_write_execute,
+                        c->restrict_realtime,
+                        c->restrict_namespaces,
+                        c->protect_kernel_tunables,
+                        c->protect_kernel_modules,
+                        c->private_devices);
+                fprintf(f, "syscall-whitelist=%i;syscall-errno=%i;", c->syscall_whitelist, c->syscall_errno);
+                r = seccomp_key_put_set(f, "syscalls", c->syscall_filter);
+        }
+        if (r >= 0)
+                r = seccomp_key_put_set(f, "archs", c->syscall_archs);
+        if (r >= 0 && fflush(f) != 0)
+                r = -ENOMEM;
+
+        /* Only after closing the stream the buffer is ours */
+        if (fclose(f) != 0 && r >= 0)
+                r = -ENOMEM;
+        if (r < 0)
+                return r;
+
+        *ret = key;
+        key = NULL;
+        return 0;
+}
+
+static int apply_seccomp(const Unit *u, const ExecContext *c, int *exit_status) {
+        unsigned k;
+        int r;
+
+        assert(c);
+        assert(exit_status);
+
+        for (k = 0; k < ELEMENTSOF(seccomp_filters); k++) {
+                scmp_filter_ctx seccomp = NULL;
+
+                if (!seccomp_filters[k].needed(c))
+                        continue;
+
+                if (skip_seccomp_unavailable(u, seccomp_filters[k].setting))
+                        continue;
+
+                if (c->seccomp_cache && c->seccomp_cache->programs[k].filter)
+                        r = seccomp_program_load(c->seccomp_cache->programs + k);
+                else {
+                        r = seccomp_filters[k].build(c, &seccomp);
+                        if (r >= 0 && seccomp) {
+                                r = seccomp_load(seccomp);
+                                seccomp_release(seccomp);
+                        }
+                }
+                if (r < 0) {
+                        *exit_status = seccomp_filters[k].exit_status;
+                        return r;
+                }
+        }
+
+        return 0;
+}
+
+static int exec_context_compile_seccomp(Manager *m, ExecContext *c) {
+        _cleanup_(exec_seccomp_cache_unrefp) ExecSeccompCache *cache = NULL;
+        _cleanup_free_ char *key = NULL;
+        unsigned k;
+        int r;
+
+        assert(m);
+        assert(c);
+
+        if (c->seccomp_cache)
+                return 0;
+
+        if (!is_seccomp_available())
                 return 0;
 
-        if (skip_seccomp_unavailable(u, "RestrictNamespaces="))
+        r = exec_context_seccomp_key(c, &key);
+        if (r < 0)
+                return r;
+
+        cache = hashmap_get(m->seccomp_filters, key);
+        if (cache) {
+                cache->n_ref++;
+                c->seccomp_cache = cache;
+                cache = NULL;
+
                 return 0;
+        }
+
+        r = hashmap_ensure_allocated(&m->seccomp_filters, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        cache = new0(ExecSeccompCache, 1);
+        if (!cache)
+                return -ENOMEM;
 
-        return seccomp_restrict_namespaces(c->restrict_namespaces);
+        cache->n_ref = 1;
+
+        for (k = 0; k < ELEMENTSOF(seccomp_filters); k++) {
+                scmp_filter_ctx seccomp = NULL;
+
+                if (!seccomp_filters[k].needed(c))
+                        continue;
+
+                r = seccomp_filters[k].build(c, &seccomp);
+                if (r < 0)
+                        return r;
+                if (!seccomp)
+                        continue;
+
+                r = seccomp_program_compile(seccomp, cache->programs + k);
+                seccomp_release(seccomp);
+                if (r < 0)
+                        return r;
+        }
+
+        r = hashmap_put(m->seccomp_filters, key, cache);
+        if (r < 0)
+                return r;
+
+        cache->manager = m;
+        cache->key = key;
+        key = NULL;
+
+        c->seccomp_cache = cache;
+        cache = NULL;
+
+        return 1;
 }
 
 #endif
 
+void exec_context_flush_seccomp(ExecContext *c) {
+        assert(c);
+
+#ifdef HAVE_SECCOMP
+        c->seccomp_cache = exec_seccomp_cache_unref(c->seccomp_cache);
+#endif
+}
+
 static void do_idle_pipe_dance(int idle_pipe[4]) {
         assert(idle_pipe);
 
@@ -2252,21 +2508,6 @@ static int close_remaining_fds(
         return close_all_fds(dont_close, n_dont_close);
 }
 
-static bool context_has_address_families(const ExecContext *c) {
-        assert(c);
-
-        return c->address_families_whitelist ||
-                !set_isempty(c->address_families);
-}
-
-static bool context_has_syscall_filters(const ExecContext *c) {
-        assert(c);
-
-        return c->syscall_whitelist ||
-                !set_isempty(c->syscall_filter) ||
-                !set_isempty(c->syscall_archs);
-}
-
 static bool context_has_no_new_privileges(const ExecContext *c) {
         assert(c);
 
@@ -2840,69 +3081,11 @@ static int exec_child(
                         }
 
 #ifdef HAVE_SECCOMP
-                if (context_has_address_families(context)) {
-                        r = apply_address_families(unit, context);
-                        if (r < 0) {
-                                *exit_status = EXIT_ADDRESS_FAMILIES;
-                                return r;
-                        }
-                }
-
-                if (context->memory_deny_write_execute) {
-                        r = apply_memory_deny_write_execute(unit, context);
-                        if (r < 0) {
-                                *exit_status = EXIT_SECCOMP;
-                                return r;
-                        }
-                }
-
-                if (context->restrict_realtime) {
-                        r = apply_restrict_realtime(unit, context);
-                        if (r < 0) {
-                                *exit_status = EXIT_SECCOMP;
-                                return r;
-                        }
-                }
-
-                r = apply_restrict_namespaces(unit, context);
-                if (r < 0) {
-                        *exit_status = EXIT_SECCOMP;
-                        return r;
-                }
-
-                if (context->protect_kernel_tunables) {
-                        r = apply_protect_sysctl(unit, context);
-                        if (r < 0) {
-                                *exit_status = EXIT_SECCOMP;
-                                return r;
-                        }
-                }
-
-                if (context->protect_kernel_modules) {
-                        r = apply_protect_kernel_modules(unit, context);
-                        if (r < 0) {
-                                *exit_status = EXIT_SECCOMP;
-                                return r;
-                        }
-                }
-
-                if (context->private_devices) {
-                        r = apply_private_devices(unit, context);
-                        if (r < 0) {
-                                *exit_status = EXIT_SECCOMP;
-                                return r;
-                        }
-                }
-
                 /* This really should remain the last step before the execve(), to make sure our own code is unaffected
-                 * by the filter as little as possible. */
-                if (context_has_syscall_filters(context)) {
-                        r = apply_seccomp(unit, context);
-                        if (r < 0) {
-                                *exit_status = EXIT_SECCOMP;
-                                return r;
-                        }
-                }
+                 * by the filters as little as possible. */
+                r = apply_seccomp(unit, context, exit_status);
+                if (r < 0)
+                        return r;
 #endif
         }
 
@@ -2934,7 +3117,7 @@ static int exec_child(
 
 int exec_spawn(Unit *unit,
                ExecCommand *command,
-               const ExecContext *context,
+               ExecContext *context,
                const ExecParameters *params,
                ExecRuntime *runtime,
                DynamicCreds *dcreds,
@@ -2945,6 +3128,8 @@ int exec_spawn(Unit *unit,
         _cleanup_free_ char *line = NULL;
         int socket_fd, r;
         int named_iofds[3] = { -1, -1, -1 };
+        char ts[FORMAT_TIMESPAN_MAX];
+        usec_t start, n;
         char **argv;
         pid_t pid;
 
@@ -2955,6 +3140,8 @@ int exec_spawn(Unit *unit,
         assert(params);
         assert(params->fds || params->n_fds <= 0);
 
+        start = now(CLOCK_MONOTONIC);
+
         if (context->std_input == EXEC_INPUT_SOCKET ||
             context->std_output == EXEC_OUTPUT_SOCKET ||
             context->std_error == EXEC_OUTPUT_SOCKET) {
@@ -2989,6 +3176,15 @@ int exec_spawn(Unit *unit,
                    LOG_UNIT_MESSAGE(unit, "About to execute: %s", line),
                    "EXECUTABLE=%s", command->path,
                    NULL);
+
+#ifdef HAVE_SECCOMP
+        if ((params->flags & EXEC_APPLY_PERMISSIONS) && !command->privileged) {
+                r = exec_context_compile_seccomp(unit->manager, context);
+                if (r < 0)
+                        log_unit_debug_errno(unit, r, "Failed to compile seccomp filters, leaving it to the child: %m");
+        }
+#endif
+
         pid = fork();
         if (pid < 0)
                 return log_unit_error_errno(unit, errno, "Failed to fork: %m");
@@ -3024,7 +3220,15 @@ int exec_spawn(Unit *unit,
                 _exit(exit_status);
         }
 
-        log_unit_debug(unit, "Forked %s as "PID_FMT, command->path, pid);
+        n = now(CLOCK_MONOTONIC) - start;
+        unit->spawn_latency_last = n;
+        unit->spawn_latency_max = MAX(unit->spawn_latency_max, n);
+        unit->spawn_latency_total += n;
+        unit->n_spawned++;
+
+        log_unit_debug(unit, "Forked %s as "PID_FMT" in %s.",
+                       command->path, pid,
+                       format_timespan(ts, sizeof(ts), n, USEC_PER_MSEC / 10));
 
         /* We add the new process to the cgroup both in the child (so
          * that we can be sure that no user code is ever executed
@@ -3096,6 +3300,7 @@ void exec_context_done(ExecContext *c) {
         c->syscall_filter = set_free(c->syscall_filter);
         c->syscall_archs = set_free(c->syscall_archs);
         c->address_families = set_free(c->address_families);
+        exec_context_flush_seccomp(c);
 
         c->runtime_directory = strv_free(c->runtime_directory);
 }
@@ -24,6 +24,7 @@ typedef struct ExecCommand ExecCommand;
 typedef struct ExecContext ExecContext;
 typedef struct ExecRuntime ExecRuntime;
 typedef struct ExecParameters ExecParameters;
+typedef struct ExecSeccompCache ExecSeccompCache;
 
 #include <sched.h>
 #include <stdbool.h>
@@ -212,6 +213,9 @@ struct ExecContext {
         bool memory_deny_write_execute;
         bool restrict_realtime;
 
+        /* Seccomp filters compiled on first use, dropped when the settings change */
+        ExecSeccompCache *seccomp_cache;
+
         bool oom_score_adjust_set:1;
         bool nice_set:1;
         bool ioprio_set:1;
@@ -269,7 +273,7 @@ struct ExecParameters {
 
 int exec_spawn(Unit *unit,
                ExecCommand *command,
-               const ExecContext *context,
+               ExecContext *context,
                const ExecParameters *exec_params,
                ExecRuntime *runtime,
                DynamicCreds *dynamic_creds,
@@ -291,6 +295,7 @@ int exec_command_append(ExecCommand *c, const char *path, ...);
 
 void exec_context_init(ExecContext *c);
 void exec_context_done(ExecContext *c);
+void exec_context_flush_seccomp(ExecContext *c);
 void exec_context_dump(ExecContext *c, FILE* f, const char *prefix);
 
 int exec_context_destroy_runtime_directory(ExecContext *c, const char *runtime_root);
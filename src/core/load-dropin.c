@@ -43,6 +43,48 @@ static int add_dependency_consumer(
         return 0;
 }
 
+int unit_find_dependency_dirs(Unit *u, char ***dirs) {
+        _cleanup_strv_free_ char **l = NULL;
+        Iterator i;
+        char *t, **p;
+
+        assert(u);
+        assert(dirs);
+
+        SET_FOREACH(t, u->names, i)
+                STRV_FOREACH(p, u->manager->lookup_paths.search_path) {
+                        unit_file_process_dir(u->manager->unit_path_cache, *p, t, ".wants", _UNIT_DEPENDENCY_INVALID,
+                                              NULL, NULL, &l);
+                        unit_file_process_dir(u->manager->unit_path_cache, *p, t, ".requires", _UNIT_DEPENDENCY_INVALID,
+                                              NULL, NULL, &l);
+                }
+
+        /* Without the unit path cache the above lists all candidate directories, hence filter out the ones that
+         * don't exist */
+        if (!u->manager->unit_path_cache) {
+                _cleanup_strv_free_ char **existing = NULL;
+
+                STRV_FOREACH(p, l) {
+                        if (access(*p, F_OK) < 0)
+                                continue;
+
+                        if (strv_extend(&existing, *p) < 0)
+                                return log_oom();
+                }
+
+                strv_free(l);
+                l = existing;
+                existing = NULL;
+        }
+
+        strv_sort(l);
+
+        *dirs = l;
+        l = NULL;
+
+        return !strv_isempty(*dirs);
+}
+
 int unit_load_dropin(Unit *u) {
         _cleanup_strv_free_ char **l = NULL;
         Iterator i;
@@ -51,6 +93,10 @@ int unit_load_dropin(Unit *u) {
 
         assert(u);
 
+        /* Take the timestamp before reading anything, so that
+         * modifications racing with us are detected later on */
+        u->dropin_mtime = now(CLOCK_REALTIME);
+
         /* Load dependencies from supplementary drop-in directories */
 
         SET_FOREACH(t, u->names, i) {
@@ -64,6 +110,9 @@ int unit_load_dropin(Unit *u) {
                 }
         }
 
+        u->dependency_dirs = strv_free(u->dependency_dirs);
+        (void) unit_find_dependency_dirs(u, &u->dependency_dirs);
+
         r = unit_find_dropin_paths(u, &l);
         if (r <= 0)
                 return 0;
@@ -84,7 +133,5 @@ int unit_load_dropin(Unit *u) {
                              false, false, false, u);
         }
 
-        u->dropin_mtime = now(CLOCK_REALTIME);
-
         return 0;
 }
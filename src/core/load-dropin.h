@@ -31,4 +31,5 @@ static inline int unit_find_dropin_paths(Unit *u, char ***paths) {
                                            paths);
 }
 
+int unit_find_dependency_dirs(Unit *u, char ***dirs);
 int unit_load_dropin(Unit *u);
@@ -124,6 +124,9 @@ static struct rlimit *arg_default_rlimit[_RLIMIT_MAX] = {};
 static uint64_t arg_capability_bounding_set = CAP_ALL;
 static nsec_t arg_timer_slack_nsec = NSEC_INFINITY;
 static usec_t arg_default_timer_accuracy_usec = 1 * USEC_PER_MINUTE;
+static usec_t arg_resource_sample_interval_usec = 0;
+static unsigned arg_resource_sample_count = 60;
+static unsigned arg_max_parallel_generators = 0;
 static Set* arg_syscall_archs = NULL;
 static FILE* arg_serialization = NULL;
 static bool arg_default_cpu_accounting = false;
@@ -728,6 +731,9 @@ static int parse_config_file(void) {
                 { "Manager", "DefaultTasksAccounting",    config_parse_bool,             0, &arg_default_tasks_accounting          },
                 { "Manager", "DefaultTasksMax",           config_parse_tasks_max,        0, &arg_default_tasks_max                 },
                 { "Manager", "CtrlAltDelBurstAction",     config_parse_emergency_action, 0, &arg_cad_burst_action                  },
+                { "Manager", "ResourceSampleIntervalSec", config_parse_sec,              0, &arg_resource_sample_interval_usec     },
+                { "Manager", "ResourceSampleCount",       config_parse_unsigned,         0, &arg_resource_sample_count             },
+                { "Manager", "MaxParallelGenerators",     config_parse_unsigned,         0, &arg_max_parallel_generators           },
                 {}
         };
 
@@ -771,6 +777,9 @@ static void manager_set_defaults(Manager *m) {
         m->default_memory_accounting = arg_default_memory_accounting;
         m->default_tasks_accounting = arg_default_tasks_accounting;
         m->default_tasks_max = arg_default_tasks_max;
+        m->resource_sample_interval_usec = arg_resource_sample_interval_usec;
+        m->resource_sample_count = arg_resource_sample_count;
+        m->max_parallel_generators = arg_max_parallel_generators;
 
         manager_set_default_rlimits(m, arg_default_rlimit);
         manager_environment_add(m, NULL, arg_default_environment);
@@ -90,6 +90,12 @@
 #define NOTIFY_RCVBUF_SIZE (8*1024*1024)
 #define CGROUPS_AGENT_RCVBUF_SIZE (8*1024*1024)
 
+/* How many notification messages to receive in one go */
+#define NOTIFY_BATCH_MAX 16U
+
+/* How many units to collect exited children for before dispatching them */
+#define SIGCHLD_BATCH_MAX 128U
+
 /* Initial delay and the interval for printing status messages about running jobs */
 #define JOBS_IN_PROGRESS_WAIT_USEC (5*USEC_PER_SEC)
 #define JOBS_IN_PROGRESS_PERIOD_USEC (USEC_PER_SEC / 3)
@@ -104,6 +110,8 @@ static int manager_dispatch_user_lookup_fd(sd_event_source *source, int fd, uint
 static int manager_dispatch_jobs_in_progress(sd_event_source *source, usec_t usec, void *userdata);
 static int manager_dispatch_run_queue(sd_event_source *source, void *userdata);
 static int manager_run_generators(Manager *m);
+static void manager_free_generator_timings(Manager *m);
+static void manager_flush_unit_path_cache_dirs(Manager *m);
 
 static void manager_watch_jobs_in_progress(Manager *m) {
         usec_t next;
@@ -929,7 +937,7 @@ static void unit_gc_mark_good(Unit *u, unsigned gc_marker) {
         u->gc_marker = gc_marker + GC_OFFSET_GOOD;
 
         /* Recursively mark referenced units as GOOD as well */
-        SET_FOREACH(other, u->dependencies[UNIT_REFERENCES], i)
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_REFERENCES, i)
                 if (other->gc_marker == gc_marker + GC_OFFSET_UNSURE)
                         unit_gc_mark_good(other, gc_marker);
 }
@@ -957,7 +965,7 @@ static void unit_gc_sweep(Unit *u, unsigned gc_marker) {
 
         is_bad = true;
 
-        SET_FOREACH(other, u->dependencies[UNIT_REFERENCED_BY], i) {
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_REFERENCED_BY, i) {
                 unit_gc_sweep(other, gc_marker);
 
                 if (other->gc_marker == gc_marker + GC_OFFSET_GOOD)
@@ -1106,6 +1114,10 @@ Manager* manager_free(Manager *m) {
         set_free(m->startup_units);
         set_free(m->failed_units);
 
+        /* The execution contexts of the units dropped their filters already */
+        assert(hashmap_isempty(m->seccomp_filters));
+        hashmap_free(m->seccomp_filters);
+
         sd_event_source_unref(m->signal_event_source);
         sd_event_source_unref(m->notify_event_source);
         sd_event_source_unref(m->cgroups_agent_event_source);
@@ -1113,6 +1125,9 @@ Manager* manager_free(Manager *m) {
         sd_event_source_unref(m->jobs_in_progress_event_source);
         sd_event_source_unref(m->run_queue_event_source);
         sd_event_source_unref(m->user_lookup_event_source);
+        sd_event_source_unref(m->resource_sample_event_source);
+
+        manager_free_generator_timings(m);
 
         safe_close(m->signal_fd);
         safe_close(m->notify_fd);
@@ -1128,12 +1143,14 @@ Manager* manager_free(Manager *m) {
         sd_event_unref(m->event);
 
         free(m->notify_socket);
+        free(m->notify_messages);
 
         lookup_paths_free(&m->lookup_paths);
         strv_free(m->environment);
 
         hashmap_free(m->cgroup_unit);
-        set_free_free(m->unit_path_cache);
+        set_free(m->unit_path_cache);
+        manager_flush_unit_path_cache_dirs(m);
 
         free(m->switch_root);
         free(m->switch_root_init);
@@ -1193,14 +1210,168 @@ static void manager_coldplug(Manager *m) {
         }
 }
 
+typedef struct UnitPathCacheDir {
+        char *path;
+
+        /* Identifies the version of the directory we read the entries from */
+        dev_t dev;
+        ino_t ino;
+        nsec_t mtime;
+
+        char **entries;
+        size_t n_entries;
+} UnitPathCacheDir;
+
+static UnitPathCacheDir* unit_path_cache_dir_free(UnitPathCacheDir *d) {
+        if (!d)
+                return NULL;
+
+        free(d->path);
+        strv_free(d->entries);
+
+        return mfree(d);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(UnitPathCacheDir*, unit_path_cache_dir_free);
+
+static bool unit_path_cache_dir_is_current(UnitPathCacheDir *d, const struct stat *st) {
+        assert(st);
+
+        if (!d)
+                return false;
+
+        return d->dev == st->st_dev &&
+                d->ino == st->st_ino &&
+                d->mtime == timespec_load_nsec(&st->st_mtim);
+}
+
+static int unit_path_cache_dir_read(const char *path, const struct stat *st, UnitPathCacheDir **ret) {
+        _cleanup_(unit_path_cache_dir_freep) UnitPathCacheDir *d = NULL;
+        _cleanup_closedir_ DIR *dir = NULL;
+        size_t n_allocated = 0;
+        struct dirent *de;
+
+        assert(path);
+        assert(st);
+        assert(ret);
+
+        dir = opendir(path);
+        if (!dir)
+                return -errno;
+
+        d = new0(UnitPathCacheDir, 1);
+        if (!d)
+                return -ENOMEM;
+
+        d->path = strdup(path);
+        if (!d->path)
+                return -ENOMEM;
+
+        /* Note that the stat data is taken before we read the
+         * directory, so that any modification racing with us bumps
+         * the mtime past the one we record. */
+        d->dev = st->st_dev;
+        d->ino = st->st_ino;
+        d->mtime = timespec_load_nsec(&st->st_mtim);
+
+        /* File systems with coarse timestamps might not bump the
+         * mtime for modifications done right after ours, hence
+         * don't trust listings of directories that were modified
+         * very recently and read them again next time. */
+        if (d->mtime + NSEC_PER_SEC > now_nsec(CLOCK_REALTIME))
+                d->mtime = NSEC_INFINITY;
+
+        FOREACH_DIRENT(de, dir, return -errno) {
+                char *p;
+
+                p = strjoin(streq(path, "/") ? "" : path, "/", de->d_name);
+                if (!p)
+                        return -ENOMEM;
+
+                if (!GREEDY_REALLOC(d->entries, n_allocated, d->n_entries + 2)) {
+                        free(p);
+                        return -ENOMEM;
+                }
+
+                d->entries[d->n_entries++] = p;
+                d->entries[d->n_entries] = NULL;
+        }
+
+        *ret = d;
+        d = NULL;
+
+        return 0;
+}
+
+static int manager_get_unit_path_cache_dir(Manager *m, const char *path, UnitPathCacheDir **ret) {
+        UnitPathCacheDir *d, *n;
+        struct stat st;
+        int r;
+
+        assert(m);
+        assert(path);
+        assert(ret);
+
+        d = hashmap_get(m->unit_path_cache_dirs, path);
+
+        if (stat(path, &st) < 0) {
+                r = -errno;
+                goto drop;
+        }
+
+        if (unit_path_cache_dir_is_current(d, &st)) {
+                m->unit_path_cache_hits++;
+                *ret = d;
+                return 0;
+        }
+
+        r = unit_path_cache_dir_read(path, &st, &n);
+        if (r < 0)
+                goto drop;
+
+        m->unit_path_cache_misses++;
+
+        r = hashmap_ensure_allocated(&m->unit_path_cache_dirs, &string_hash_ops);
+        if (r < 0)
+                goto fail;
+
+        unit_path_cache_dir_free(hashmap_remove(m->unit_path_cache_dirs, path));
+
+        r = hashmap_put(m->unit_path_cache_dirs, n->path, n);
+        if (r < 0)
+                goto fail;
+
+        *ret = n;
+        return 1;
+
+fail:
+        unit_path_cache_dir_free(n);
+drop:
+        unit_path_cache_dir_free(hashmap_remove(m->unit_path_cache_dirs, path));
+        return r;
+}
+
+static void manager_flush_unit_path_cache_dirs(Manager *m) {
+        UnitPathCacheDir *d;
+
+        while ((d = hashmap_steal_first(m->unit_path_cache_dirs)))
+                unit_path_cache_dir_free(d);
+
+        m->unit_path_cache_dirs = hashmap_free(m->unit_path_cache_dirs);
+}
+
 static void manager_build_unit_path_cache(Manager *m) {
+        UnitPathCacheDir *d;
+        Iterator j;
         char **i;
         int r;
 
         assert(m);
 
-        set_free_free(m->unit_path_cache);
+        set_free(m->unit_path_cache);
 
+        /* The set only references the entries owned by the
+         * directory listings in m->unit_path_cache_dirs */
         m->unit_path_cache = set_new(&string_hash_ops);
         if (!m->unit_path_cache) {
                 r = -ENOMEM;
@@ -1208,39 +1379,43 @@ static void manager_build_unit_path_cache(Manager *m) {
         }
 
         /* This simply builds a list of files we know exist, so that
-         * we don't always have to go to disk */
+         * we don't always have to go to disk. Directories that
+         * didn't change since the last time we looked at them are
+         * not read again. */
 
         STRV_FOREACH(i, m->lookup_paths.search_path) {
-                _cleanup_closedir_ DIR *d = NULL;
-                struct dirent *de;
+                char **k;
 
-                d = opendir(*i);
-                if (!d) {
-                        if (errno != ENOENT)
-                                log_warning_errno(errno, "Failed to open directory %s, ignoring: %m", *i);
+                r = manager_get_unit_path_cache_dir(m, *i, &d);
+                if (r == -ENOENT)
+                        continue;
+                if (r < 0) {
+                        log_warning_errno(r, "Failed to read directory %s, ignoring: %m", *i);
                         continue;
                 }
 
-                FOREACH_DIRENT(de, d, r = -errno; goto fail) {
-                        char *p;
-
-                        p = strjoin(streq(*i, "/") ? "" : *i, "/", de->d_name);
-                        if (!p) {
-                                r = -ENOMEM;
-                                goto fail;
-                        }
-
-                        r = set_consume(m->unit_path_cache, p);
+                STRV_FOREACH(k, d->entries) {
+                        r = set_put(m->unit_path_cache, *k);
                         if (r < 0)
                                 goto fail;
                 }
         }
 
+        /* Forget about directories that are not in the search path anymore */
+        HASHMAP_FOREACH(d, m->unit_path_cache_dirs, j)
+                if (!strv_contains(m->lookup_paths.search_path, d->path)) {
+                        hashmap_remove(m->unit_path_cache_dirs, d->path);
+                        unit_path_cache_dir_free(d);
+                }
+
+        log_debug("Unit path cache: %" PRIu64 " directory listings reused, %" PRIu64 " read from disk.",
+                  m->unit_path_cache_hits, m->unit_path_cache_misses);
+
         return;
 
 fail:
         log_warning_errno(r, "Failed to build unit path cache, proceeding without: %m");
-        m->unit_path_cache = set_free_free(m->unit_path_cache);
+        m->unit_path_cache = set_free(m->unit_path_cache);
 }
 
 static void manager_distribute_fds(Manager *m, FDSet *fds) {
@@ -1321,6 +1496,10 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
         if (q < 0 && r == 0)
                 r = q;
 
+        q = manager_setup_resource_sampler(m);
+        if (q < 0 && r == 0)
+                r = q;
+
         /* Let's connect to the bus now. */
         (void) manager_connect_bus(m, !!serialization);
 
@@ -1694,79 +1873,92 @@ static int manager_dispatch_cgroups_agent_fd(sd_event_source *source, int fd, ui
         return 0;
 }
 
-static void manager_invoke_notify_message(Manager *m, Unit *u, pid_t pid, const char *buf, FDSet *fds) {
+typedef enum NotifyMessageKind {
+        NOTIFY_MESSAGE_OTHER,
+        NOTIFY_MESSAGE_WATCHDOG,  /* Just WATCHDOG=1 */
+        NOTIFY_MESSAGE_STATUS,    /* Just STATUS=… */
+} NotifyMessageKind;
+
+struct NotifyMessage {
+        char buf[NOTIFY_BUFFER_MAX+1];
+        union {
+                struct cmsghdr cmsghdr;
+                uint8_t buf[CMSG_SPACE(sizeof(struct ucred)) +
+                            CMSG_SPACE(sizeof(int) * NOTIFY_FD_MAX)];
+        } control;
+        struct iovec iovec;
+
+        /* Filled in once received */
+        bool valid;
+        pid_t pid;
+        FDSet *fds;
+        NotifyMessageKind kind;
+};
+
+static void manager_invoke_notify_message(Manager *m, Unit *u, NotifyMessage *msg) {
         _cleanup_strv_free_ char **tags = NULL;
 
         assert(m);
         assert(u);
-        assert(buf);
+        assert(msg);
+
+        /* Watchdog keep-alives are by far the most frequent message, hence let the unit type handle them
+         * without splitting and matching the message first */
+        if (msg->kind == NOTIFY_MESSAGE_WATCHDOG && UNIT_VTABLE(u)->notify_watchdog) {
+                UNIT_VTABLE(u)->notify_watchdog(u, msg->pid);
+                return;
+        }
 
-        tags = strv_split(buf, "\n\r");
+        tags = strv_split(msg->buf, "\n\r");
         if (!tags) {
                 log_oom();
                 return;
         }
 
         if (UNIT_VTABLE(u)->notify_message)
-                UNIT_VTABLE(u)->notify_message(u, pid, tags, fds);
+                UNIT_VTABLE(u)->notify_message(u, msg->pid, tags, msg->fds);
         else if (_unlikely_(log_get_max_level() >= LOG_DEBUG)) {
                 _cleanup_free_ char *x = NULL, *y = NULL;
 
-                x = cescape(buf);
+                x = cescape(msg->buf);
                 if (x)
                         y = ellipsize(x, 20, 90);
                 log_unit_debug(u, "Got notification message \"%s\", ignoring.", strnull(y));
         }
 }
 
-static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+static NotifyMessageKind notify_message_kind(const char *buf, FDSet *fds) {
+        const char *e;
 
-        _cleanup_fdset_free_ FDSet *fds = NULL;
-        Manager *m = userdata;
-        char buf[NOTIFY_BUFFER_MAX+1];
-        struct iovec iovec = {
-                .iov_base = buf,
-                .iov_len = sizeof(buf)-1,
-        };
-        union {
-                struct cmsghdr cmsghdr;
-                uint8_t buf[CMSG_SPACE(sizeof(struct ucred)) +
-                            CMSG_SPACE(sizeof(int) * NOTIFY_FD_MAX)];
-        } control = {};
-        struct msghdr msghdr = {
-                .msg_iov = &iovec,
-                .msg_iovlen = 1,
-                .msg_control = &control,
-                .msg_controllen = sizeof(control),
-        };
+        assert(buf);
+
+        if (fdset_size(fds) > 0)
+                return NOTIFY_MESSAGE_OTHER;
+
+        /* Only single-line messages, optionally with trailing newlines, may be coalesced or take the fast path */
+        e = buf + strcspn(buf, NEWLINE);
+        if (e[strspn(e, NEWLINE)] != 0)
+                return NOTIFY_MESSAGE_OTHER;
+
+        if (startswith(buf, "WATCHDOG=1") && IN_SET(buf[strlen("WATCHDOG=1")], 0, '\n', '\r'))
+                return NOTIFY_MESSAGE_WATCHDOG;
+
+        if (startswith(buf, "STATUS="))
+                return NOTIFY_MESSAGE_STATUS;
 
+        return NOTIFY_MESSAGE_OTHER;
+}
+
+static int notify_message_parse(NotifyMessage *msg, struct msghdr *msghdr, size_t n) {
         struct cmsghdr *cmsg;
         struct ucred *ucred = NULL;
-        Unit *u1, *u2, *u3;
         int r, *fd_array = NULL;
         unsigned n_fds = 0;
-        ssize_t n;
-
-        assert(m);
-        assert(m->notify_fd == fd);
-
-        if (revents != EPOLLIN) {
-                log_warning("Got unexpected poll event for notify fd.");
-                return 0;
-        }
-
-        n = recvmsg(m->notify_fd, &msghdr, MSG_DONTWAIT|MSG_CMSG_CLOEXEC|MSG_TRUNC);
-        if (n < 0) {
-                if (IN_SET(errno, EAGAIN, EINTR))
-                        return 0; /* Spurious wakeup, try again */
 
-                /* If this is any other, real error, then let's stop processing this socket. This of course means we
-                 * won't take notification messages anymore, but that's still better than busy looping around this:
-                 * being woken up over and over again but being unable to actually read the message off the socket. */
-                return log_error_errno(errno, "Failed to receive notification message: %m");
-        }
+        assert(msg);
+        assert(msghdr);
 
-        CMSG_FOREACH(cmsg, &msghdr) {
+        CMSG_FOREACH(cmsg, msghdr) {
                 if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
 
                         fd_array = (int*) CMSG_DATA(cmsg);
@@ -1783,83 +1975,205 @@ static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t
         if (n_fds > 0) {
                 assert(fd_array);
 
-                r = fdset_new_array(&fds, fd_array, n_fds);
+                r = fdset_new_array(&msg->fds, fd_array, n_fds);
                 if (r < 0) {
                         close_many(fd_array, n_fds);
-                        log_oom();
-                        return 0;
+                        return log_oom();
                 }
         }
 
         if (!ucred || ucred->pid <= 0) {
                 log_warning("Received notify message without valid credentials. Ignoring.");
-                return 0;
+                return -EINVAL;
         }
 
-        if ((size_t) n >= sizeof(buf) || (msghdr.msg_flags & MSG_TRUNC)) {
+        if (n >= sizeof(msg->buf) || (msghdr->msg_flags & MSG_TRUNC)) {
                 log_warning("Received notify message exceeded maximum size. Ignoring.");
-                return 0;
+                return -EMSGSIZE;
         }
 
         /* As extra safety check, let's make sure the string we get doesn't contain embedded NUL bytes. We permit one
          * trailing NUL byte in the message, but don't expect it. */
-        if (n > 1 && memchr(buf, 0, n-1)) {
+        if (n > 1 && memchr(msg->buf, 0, n-1)) {
                 log_warning("Received notify message with embedded NUL bytes. Ignoring.");
-                return 0;
+                return -EINVAL;
         }
 
         /* Make sure it's NUL-terminated. */
-        buf[n] = 0;
+        msg->buf[n] = 0;
+
+        msg->pid = ucred->pid;
+        msg->kind = notify_message_kind(msg->buf, msg->fds);
+        msg->valid = true;
+
+        return 0;
+}
+
+static void manager_dispatch_notify_message(Manager *m, NotifyMessage *msg) {
+        Unit *u1, *u2, *u3;
+
+        assert(m);
+        assert(msg);
 
         /* Notify every unit that might be interested, but try
          * to avoid notifying the same one multiple times. */
-        u1 = manager_get_unit_by_pid_cgroup(m, ucred->pid);
+        u1 = manager_get_unit_by_pid_cgroup(m, msg->pid);
         if (u1)
-                manager_invoke_notify_message(m, u1, ucred->pid, buf, fds);
+                manager_invoke_notify_message(m, u1, msg);
 
-        u2 = hashmap_get(m->watch_pids1, PID_TO_PTR(ucred->pid));
+        u2 = hashmap_get(m->watch_pids1, PID_TO_PTR(msg->pid));
         if (u2 && u2 != u1)
-                manager_invoke_notify_message(m, u2, ucred->pid, buf, fds);
+                manager_invoke_notify_message(m, u2, msg);
 
-        u3 = hashmap_get(m->watch_pids2, PID_TO_PTR(ucred->pid));
+        u3 = hashmap_get(m->watch_pids2, PID_TO_PTR(msg->pid));
         if (u3 && u3 != u2 && u3 != u1)
-                manager_invoke_notify_message(m, u3, ucred->pid, buf, fds);
+                manager_invoke_notify_message(m, u3, msg);
 
         if (!u1 && !u2 && !u3)
-                log_warning("Cannot find unit for notify message of PID "PID_FMT".", ucred->pid);
+                log_warning("Cannot find unit for notify message of PID "PID_FMT".", msg->pid);
+}
 
-        if (fdset_size(fds) > 0)
-                log_warning("Got extra auxiliary fds with notification message, closing them.");
+static bool notify_message_superseded(NotifyMessage *messages, unsigned n, unsigned i) {
+        unsigned j;
+
+        assert(messages);
+        assert(i < n);
+
+        /* A watchdog keep-alive or status update is pointless if the same process sent another one later in
+         * the same batch, only the last one counts. */
+
+        if (messages[i].kind == NOTIFY_MESSAGE_OTHER)
+                return false;
+
+        for (j = i + 1; j < n; j++)
+                if (messages[j].valid &&
+                    messages[j].pid == messages[i].pid &&
+                    messages[j].kind == messages[i].kind)
+                        return true;
+
+        return false;
+}
+
+static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        struct mmsghdr mmsghdr[NOTIFY_BATCH_MAX] = {};
+        Manager *m = userdata;
+        unsigned i;
+        int n;
+
+        assert(m);
+        assert(m->notify_fd == fd);
+
+        if (revents != EPOLLIN) {
+                log_warning("Got unexpected poll event for notify fd.");
+                return 0;
+        }
+
+        /* The buffers are large, hence allocate them once and keep them around */
+        if (!m->notify_messages) {
+                m->notify_messages = new(NotifyMessage, NOTIFY_BATCH_MAX);
+                if (!m->notify_messages)
+                        return log_oom();
+        }
+
+        for (i = 0; i < NOTIFY_BATCH_MAX; i++) {
+                NotifyMessage *msg = m->notify_messages + i;
+
+                msg->iovec = (struct iovec) {
+                        .iov_base = msg->buf,
+                        .iov_len = sizeof(msg->buf)-1,
+                };
+                msg->valid = false;
+                msg->fds = NULL;
+
+                mmsghdr[i].msg_hdr = (struct msghdr) {
+                        .msg_iov = &msg->iovec,
+                        .msg_iovlen = 1,
+                        .msg_control = &msg->control,
+                        .msg_controllen = sizeof(msg->control),
+                };
+        }
+
+        /* Services sending frequent keep-alives and status updates would otherwise cost us one wakeup per
+         * datagram. Take as many as are queued, up to a batch, and process them together. */
+        n = recvmmsg(m->notify_fd, mmsghdr, NOTIFY_BATCH_MAX, MSG_DONTWAIT|MSG_CMSG_CLOEXEC|MSG_TRUNC, NULL);
+        if (n < 0) {
+                if (IN_SET(errno, EAGAIN, EINTR))
+                        return 0; /* Spurious wakeup, try again */
+
+                /* If this is any other, real error, then let's stop processing this socket. This of course means we
+                 * won't take notification messages anymore, but that's still better than busy looping around this:
+                 * being woken up over and over again but being unable to actually read the message off the socket. */
+                return log_error_errno(errno, "Failed to receive notification message: %m");
+        }
+
+        for (i = 0; i < (unsigned) n; i++)
+                (void) notify_message_parse(m->notify_messages + i, &mmsghdr[i].msg_hdr, mmsghdr[i].msg_len);
+
+        for (i = 0; i < (unsigned) n; i++) {
+                NotifyMessage *msg = m->notify_messages + i;
+
+                if (msg->valid && !notify_message_superseded(m->notify_messages, n, i))
+                        manager_dispatch_notify_message(m, msg);
+
+                if (fdset_size(msg->fds) > 0)
+                        log_warning("Got extra auxiliary fds with notification message, closing them.");
+
+                msg->fds = fdset_free(msg->fds);
+        }
 
         return 0;
 }
 
 static void invoke_sigchld_event(Manager *m, Unit *u, const siginfo_t *si) {
-        uint64_t iteration;
-
         assert(m);
         assert(u);
         assert(si);
 
-        sd_event_get_iteration(m->event, &iteration);
-
         log_unit_debug(u, "Child "PID_FMT" belongs to %s", si->si_pid, u->id);
 
-        unit_unwatch_pid(u, si->si_pid);
+        if (UNIT_VTABLE(u)->sigchld_event)
+                UNIT_VTABLE(u)->sigchld_event(u, si->si_pid, si->si_code, si->si_status);
+}
 
-        if (UNIT_VTABLE(u)->sigchld_event) {
-                if (set_size(u->pids) <= 1 ||
-                    iteration != u->sigchldgen ||
-                    unit_main_pid(u) == si->si_pid ||
-                    unit_control_pid(u) == si->si_pid) {
-                        UNIT_VTABLE(u)->sigchld_event(u, si->si_pid, si->si_code, si->si_status);
-                        u->sigchldgen = iteration;
-                } else
-                        log_debug("%s already issued a sigchld this iteration %" PRIu64 ", skipping. Pids still being watched %d", u->id, iteration, set_size(u->pids));
-         }
+typedef struct ChildExit {
+        Unit *unit;
+        siginfo_t si;
+} ChildExit;
+
+static void flush_child_exits(Manager *m, ChildExit *exits, size_t *n) {
+        size_t i;
+
+        for (i = 0; i < *n; i++)
+                invoke_sigchld_event(m, exits[i].unit, &exits[i].si);
+
+        *n = 0;
+}
+
+static void defer_child_exit(Manager *m, Unit *u, const siginfo_t *si, ChildExit *exits, size_t *n) {
+        size_t i;
+
+        /* One callback per unit is enough for the processes which are neither its main nor its control process,
+         * all it does about them is rescanning which processes are left. */
+        for (i = 0; i < *n; i++)
+                if (exits[i].unit == u) {
+                        exits[i].si = *si;
+                        return;
+                }
+
+        if (*n >= SIGCHLD_BATCH_MAX)
+                flush_child_exits(m, exits, n);
+
+        exits[(*n)++] = (ChildExit) {
+                .unit = u,
+                .si = *si,
+        };
 }
 
 static int manager_dispatch_sigchld(Manager *m) {
+        ChildExit deferred[SIGCHLD_BATCH_MAX];
+        size_t n_deferred = 0;
+        int r = 0;
+
         assert(m);
 
         for (;;) {
@@ -1876,49 +2190,71 @@ static int manager_dispatch_sigchld(Manager *m) {
                         if (errno == EINTR)
                                 continue;
 
-                        return -errno;
+                        r = -errno;
+                        break;
                 }
 
                 if (si.si_pid <= 0)
                         break;
 
                 if (si.si_code == CLD_EXITED || si.si_code == CLD_KILLED || si.si_code == CLD_DUMPED) {
-                        _cleanup_free_ char *name = NULL;
-                        Unit *u1, *u2, *u3;
+                        Unit *units[3];
+                        size_t k;
 
-                        get_process_comm(si.si_pid, &name);
+                        if (_unlikely_(log_get_max_level() >= LOG_DEBUG)) {
+                                _cleanup_free_ char *name = NULL;
 
-                        log_debug("Child "PID_FMT" (%s) died (code=%s, status=%i/%s)",
-                                  si.si_pid, strna(name),
-                                  sigchld_code_to_string(si.si_code),
-                                  si.si_status,
-                                  strna(si.si_code == CLD_EXITED
-                                        ? exit_status_to_string(si.si_status, EXIT_STATUS_FULL)
-                                        : signal_to_string(si.si_status)));
+                                get_process_comm(si.si_pid, &name);
+
+                                log_debug("Child "PID_FMT" (%s) died (code=%s, status=%i/%s)",
+                                          si.si_pid, strna(name),
+                                          sigchld_code_to_string(si.si_code),
+                                          si.si_status,
+                                          strna(si.si_code == CLD_EXITED
+                                                ? exit_status_to_string(si.si_status, EXIT_STATUS_FULL)
+                                                : signal_to_string(si.si_status)));
+                        }
 
                         /* And now figure out the unit this belongs
                          * to, it might be multiple... */
-                        u1 = manager_get_unit_by_pid_cgroup(m, si.si_pid);
-                        if (u1)
-                                invoke_sigchld_event(m, u1, &si);
-                        u2 = hashmap_get(m->watch_pids1, PID_TO_PTR(si.si_pid));
-                        if (u2 && u2 != u1)
-                                invoke_sigchld_event(m, u2, &si);
-                        u3 = hashmap_get(m->watch_pids2, PID_TO_PTR(si.si_pid));
-                        if (u3 && u3 != u2 && u3 != u1)
-                                invoke_sigchld_event(m, u3, &si);
+                        units[0] = manager_get_unit_by_pid_cgroup(m, si.si_pid);
+                        units[1] = hashmap_get(m->watch_pids1, PID_TO_PTR(si.si_pid));
+                        units[2] = hashmap_get(m->watch_pids2, PID_TO_PTR(si.si_pid));
+
+                        for (k = 0; k < ELEMENTSOF(units); k++) {
+                                Unit *u = units[k];
+
+                                if (!u || (k > 0 && u == units[0]) || (k > 1 && u == units[1]))
+                                        continue;
+
+                                unit_unwatch_pid(u, si.si_pid);
+
+                                /* The main and control processes are dispatched while they are still zombies,
+                                 * so that their PIDs cannot have been reused yet. The others are dispatched
+                                 * together once all children that exited so far are reaped. */
+                                if (unit_main_pid(u) == si.si_pid || unit_control_pid(u) == si.si_pid)
+                                        invoke_sigchld_event(m, u, &si);
+                                else
+                                        defer_child_exit(m, u, &si, deferred, &n_deferred);
+                        }
                 }
 
-                /* And now, we actually reap the zombie. */
-                if (waitid(P_PID, si.si_pid, &si, WEXITED) < 0) {
+                /* And now, we actually reap the zombie. Retry right here on EINTR, as otherwise we'd see and
+                 * dispatch the same child again. */
+                while (waitid(P_PID, si.si_pid, &si, WEXITED) < 0) {
                         if (errno == EINTR)
                                 continue;
 
-                        return -errno;
+                        r = -errno;
+                        break;
                 }
+                if (r < 0)
+                        break;
         }
 
-        return 0;
+        flush_child_exits(m, deferred, &n_deferred);
+
+        return r;
 }
 
 static int manager_start_target(Manager *m, const char *name, JobMode mode) {
@@ -2230,8 +2566,10 @@ int manager_loop(Manager *m) {
         assert(m);
         m->exit_code = MANAGER_OK;
 
-        /* Release the path cache */
-        m->unit_path_cache = set_free_free(m->unit_path_cache);
+        /* Release the path cache. The directory listings it was
+         * built from are kept, so that the next reload only needs to
+         * read the directories that changed in the meantime. */
+        m->unit_path_cache = set_free(m->unit_path_cache);
 
         manager_check_finished(m);
 
@@ -2265,8 +2603,16 @@ int manager_loop(Manager *m) {
                 if (manager_dispatch_cleanup_queue(m) > 0)
                         continue;
 
-                if (manager_dispatch_cgroup_queue(m) > 0)
+                if (manager_dispatch_cgroup_queue(m) > 0) {
+                        /* The cgroup queue is worked off in batches, don't let a long one stall event processing */
+                        if (m->cgroup_queue) {
+                                r = sd_event_run(m->event, 0);
+                                if (r < 0)
+                                        return log_error_errno(r, "Failed to run event loop: %m");
+                        }
+
                         continue;
+                }
 
                 if (manager_dispatch_dbus_queue(m) > 0)
                         continue;
@@ -2464,23 +2810,310 @@ int manager_open_serialization(Manager *m, FILE **_f) {
         return 0;
 }
 
-int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root) {
-        Iterator i;
-        Unit *u;
-        const char *t;
-        char **e;
+/* The binary serialization format starts with a fixed header, followed by the manager's own state in the key=value
+ * text form, terminated by an empty line. After that one section per unit type follows, each consisting of one
+ * record per unit. Sections and records carry their size, so that they may be processed independently of each other,
+ * and state of units that cannot be loaded anymore is skipped instead of failing the whole deserialization. The
+ * per-unit records contain the generic unit state as a binary blob followed by the type-specific key=value items.
+ *
+ * All integers are in host byte order: the format is only used for reloading and reexecution, i.e. the data is
+ * always read back on the same machine. When switching root we might pass the data on to a different systemd
+ * version, hence the text format is used there. */
+
+#define SERIALIZATION_VERSION 1U
+
+static const char serialization_magic[8] = { 'S', 'D', 'S', 'T', 'A', 'T', 'E', 0 };
+
+typedef struct SerializationHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t header_size;
+} SerializationHeader;
+
+typedef struct SerializationSection {
+        uint32_t type;     /* UnitType, or UINT32_MAX for the end marker */
+        uint32_t n_units;
+        uint64_t size;     /* Size of the records following */
+} SerializationSection;
+
+typedef struct SerializationRecord {
+        uint32_t name_size;
+        uint32_t reserved;
+        uint64_t size;     /* Size of the unit state following the name */
+} SerializationRecord;
+
+static int serialization_patch(FILE *mf, char **buf, off_t offset, const void *p, size_t n) {
+
+        /* Fills in a header we wrote earlier into the memstream, once its sizes are known. After flushing, the
+         * buffer reflects everything written so far, and later writes only go past it. */
+
+        if (fflush(mf) != 0)
+                return -ENOMEM;
+
+        memcpy(*buf + offset, p, n);
+        return 0;
+}
+
+static int manager_serialize_units_binary(Manager *m, FILE *f, FDSet *fds) {
+        SerializationSection end = { .type = UINT32_MAX };
+        _cleanup_free_ char *buf = NULL;
+        _cleanup_fclose_ FILE *mf = NULL;
+        size_t size = 0;
+        UnitType t;
         int r;
 
         assert(m);
         assert(f);
         assert(fds);
 
-        m->n_reloading++;
+        /* Collect everything in memory first, so that we can fill in the sizes cheaply, and then write it out in one
+         * go. */
+        mf = open_memstream(&buf, &size);
+        if (!mf)
+                return -ENOMEM;
 
-        fprintf(f, "current-job-id=%"PRIu32"\n", m->current_job_id);
-        fprintf(f, "taint-usr=%s\n", yes_no(m->taint_usr));
-        fprintf(f, "n-installed-jobs=%u\n", m->n_installed_jobs);
-        fprintf(f, "n-failed-jobs=%u\n", m->n_failed_jobs);
+        for (t = 0; t < _UNIT_TYPE_MAX; t++) {
+                SerializationSection section = { .type = t };
+                off_t section_offset;
+                Unit *u;
+
+                if (!m->units_by_type[t])
+                        continue;
+
+                section_offset = ftello(mf);
+                if (section_offset < 0)
+                        return -errno;
+
+                if (fwrite(&section, sizeof(section), 1, mf) != 1)
+                        return -ENOMEM;
+
+                LIST_FOREACH(units_by_type, u, m->units_by_type[t]) {
+                        SerializationRecord record = {};
+                        off_t record_offset, record_end;
+
+                        /* Units merged into another one stay in the list until they are collected, but have no
+                         * name anymore, their state is serialized with the unit they were merged into */
+                        if (u->load_state == UNIT_MERGED || !u->id)
+                                continue;
+
+                        record.name_size = strlen(u->id);
+
+                        record_offset = ftello(mf);
+                        if (record_offset < 0)
+                                return -errno;
+
+                        if (fwrite(&record, sizeof(record), 1, mf) != 1 ||
+                            fwrite(u->id, record.name_size, 1, mf) != 1)
+                                return -ENOMEM;
+
+                        r = unit_serialize_binary(u, mf, fds, true);
+                        if (r < 0)
+                                return r;
+
+                        record_end = ftello(mf);
+                        if (record_end < 0)
+                                return -errno;
+
+                        record.size = record_end - record_offset - sizeof(record) - record.name_size;
+                        r = serialization_patch(mf, &buf, record_offset, &record, sizeof(record));
+                        if (r < 0)
+                                return r;
+
+                        section.n_units++;
+                        section.size += record_end - record_offset;
+                }
+
+                r = serialization_patch(mf, &buf, section_offset, &section, sizeof(section));
+                if (r < 0)
+                        return r;
+        }
+
+        if (fwrite(&end, sizeof(end), 1, mf) != 1)
+                return -ENOMEM;
+
+        if (fflush(mf) != 0)
+                return -ENOMEM;
+
+        if (fwrite(buf, 1, size, f) != size)
+                return -EIO;
+
+        return 0;
+}
+
+static int manager_serialize_units_text(Manager *m, FILE *f, FDSet *fds) {
+        Iterator i;
+        Unit *u;
+        const char *t;
+        int r;
+
+        assert(m);
+        assert(f);
+        assert(fds);
+
+        HASHMAP_FOREACH_KEY(u, t, m->units, i) {
+                if (u->id != t)
+                        continue;
+
+                /* Start marker */
+                fputs(u->id, f);
+                fputc('\n', f);
+
+                /* Jobs are not carried over when switching root */
+                r = unit_serialize(u, f, fds, false);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int manager_deserialize_units_binary(Manager *m, FILE *f, FDSet *fds, uint32_t version) {
+        int r;
+
+        assert(m);
+        assert(f);
+        assert(fds);
+        assert(version > 0 && version <= SERIALIZATION_VERSION);
+
+        for (;;) {
+                SerializationSection section;
+                off_t section_end;
+                uint32_t k;
+
+                if (fread(&section, sizeof(section), 1, f) != 1)
+                        return ferror(f) ? -EIO : -EBADMSG;
+
+                if (section.type == UINT32_MAX)
+                        return 0;
+
+                section_end = ftello(f);
+                if (section_end < 0)
+                        return -errno;
+                section_end += section.size;
+
+                if (section.type >= _UNIT_TYPE_MAX) {
+                        log_debug("Skipping serialized state of %" PRIu32 " units of unknown type %" PRIu32 ".", section.n_units, section.type);
+
+                        if (fseeko(f, section_end, SEEK_SET) < 0)
+                                return -errno;
+                        continue;
+                }
+
+                for (k = 0; k < section.n_units; k++) {
+                        SerializationRecord record;
+                        char name[UNIT_NAME_MAX+1];
+                        off_t record_end;
+                        Unit *u;
+
+                        if (fread(&record, sizeof(record), 1, f) != 1)
+                                return ferror(f) ? -EIO : -EBADMSG;
+
+                        if (record.name_size == 0 || record.name_size > UNIT_NAME_MAX)
+                                return -EBADMSG;
+
+                        if (fread(name, record.name_size, 1, f) != 1)
+                                return ferror(f) ? -EIO : -EBADMSG;
+                        name[record.name_size] = 0;
+
+                        record_end = ftello(f);
+                        if (record_end < 0)
+                                return -errno;
+                        record_end += record.size;
+
+                        r = manager_load_unit(m, name, NULL, NULL, &u);
+                        if (r < 0)
+                                log_debug_errno(r, "Failed to load unit %s, skipping its serialized state: %m", name);
+                        else if ((uint32_t) u->type != section.type)
+                                log_unit_debug(u, "Serialized state is for a different unit type, skipping.");
+                        else {
+                                r = unit_deserialize_binary(u, f, fds, version);
+                                if (r < 0)
+                                        return r;
+                        }
+
+                        /* Only seek if the unit did not consume exactly its own record, since seeking drops the read
+                         * buffer. */
+                        if (ftello(f) != record_end &&
+                            fseeko(f, record_end, SEEK_SET) < 0)
+                                return -errno;
+                }
+
+                if (ftello(f) != section_end)
+                        return -EBADMSG;
+        }
+}
+
+static int manager_read_serialization_header(FILE *f, uint32_t *ret_version) {
+        SerializationHeader h;
+        off_t start;
+        size_t n;
+
+        assert(f);
+        assert(ret_version);
+
+        /* Older versions only knew the text format, which has no header. If the header is missing (or we cannot
+         * seek, which we never do for serialization files we created ourselves) fall back to it, and return 0 as
+         * the version. */
+
+        start = ftello(f);
+        if (start < 0) {
+                *ret_version = 0;
+                return 0;
+        }
+
+        n = fread(&h, 1, sizeof(h), f);
+        if (n < sizeof(serialization_magic) || memcmp(h.magic, serialization_magic, sizeof(serialization_magic)) != 0) {
+                clearerr(f);
+                if (fseeko(f, start, SEEK_SET) < 0)
+                        return -errno;
+
+                *ret_version = 0;
+                return 0;
+        }
+
+        if (n != sizeof(h) || h.header_size < sizeof(h))
+                return -EBADMSG;
+
+        /* On daemon-reexec during an upgrade we read what the previous version wrote, hence older versions of the
+         * format are read too. Only a downgrade gives us one we don't know. */
+        if (h.version == 0 || h.version > SERIALIZATION_VERSION)
+                return log_error_errno(EPROTONOSUPPORT, "Unsupported serialization format version %" PRIu32 ".", h.version);
+
+        if (h.header_size > sizeof(h) &&
+            fseeko(f, h.header_size - sizeof(h), SEEK_CUR) < 0)
+                return -errno;
+
+        *ret_version = h.version;
+        return 0;
+}
+
+int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root) {
+        char **e;
+        int r;
+
+        assert(m);
+        assert(f);
+        assert(fds);
+
+        m->n_reloading++;
+
+        if (!switching_root) {
+                SerializationHeader h = {
+                        .version = SERIALIZATION_VERSION,
+                        .header_size = sizeof(h),
+                };
+
+                memcpy(h.magic, serialization_magic, sizeof(h.magic));
+                if (fwrite(&h, sizeof(h), 1, f) != 1) {
+                        m->n_reloading--;
+                        return -EIO;
+                }
+        }
+
+        fprintf(f, "current-job-id=%"PRIu32"\n", m->current_job_id);
+        fprintf(f, "taint-usr=%s\n", yes_no(m->taint_usr));
+        fprintf(f, "n-installed-jobs=%u\n", m->n_installed_jobs);
+        fprintf(f, "n-failed-jobs=%u\n", m->n_failed_jobs);
 
         dual_timestamp_serialize(f, "firmware-timestamp", &m->firmware_timestamp);
         dual_timestamp_serialize(f, "loader-timestamp", &m->loader_timestamp);
@@ -2556,19 +3189,13 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root) {
 
         fputc('\n', f);
 
-        HASHMAP_FOREACH_KEY(u, t, m->units, i) {
-                if (u->id != t)
-                        continue;
-
-                /* Start marker */
-                fputs(u->id, f);
-                fputc('\n', f);
-
-                r = unit_serialize(u, f, fds, !switching_root);
-                if (r < 0) {
-                        m->n_reloading--;
-                        return r;
-                }
+        if (switching_root)
+                r = manager_serialize_units_text(m, f, fds);
+        else
+                r = manager_serialize_units_binary(m, f, fds);
+        if (r < 0) {
+                m->n_reloading--;
+                return r;
         }
 
         assert(m->n_reloading > 0);
@@ -2585,12 +3212,20 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root) {
 }
 
 int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
+        uint32_t version;
         int r = 0;
 
         assert(m);
         assert(f);
 
-        log_debug("Deserializing state...");
+        r = manager_read_serialization_header(f, &version);
+        if (r < 0)
+                return r;
+
+        if (version > 0)
+                log_debug("Deserializing state (binary format version %" PRIu32 ")...", version);
+        else
+                log_debug("Deserializing state (text format)...");
 
         m->n_reloading++;
 
@@ -2748,6 +3383,11 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                         log_debug("Unknown serialization item '%s'", l);
         }
 
+        if (version > 0) {
+                r = manager_deserialize_units_binary(m, f, fds, version);
+                goto finish;
+        }
+
         for (;;) {
                 Unit *u;
                 char name[UNIT_NAME_MAX+2];
@@ -2858,6 +3498,10 @@ int manager_reload(Manager *m) {
         if (q < 0 && r >= 0)
                 r = q;
 
+        q = manager_setup_resource_sampler(m);
+        if (q < 0 && r >= 0)
+                r = q;
+
         /* Third, fire things up! */
         manager_coldplug(m);
 
@@ -2880,6 +3524,346 @@ int manager_reload(Manager *m) {
         return r;
 }
 
+typedef struct KeptDependency {
+        Unit *unit;
+        UnitDependency dependency;
+        bool loaded;
+} KeptDependency;
+
+typedef struct InPlaceReload {
+        char *id;
+        FILE *f;
+} InPlaceReload;
+
+static void in_place_reload_free_many(InPlaceReload *reloads, size_t n) {
+        size_t k;
+
+        for (k = 0; k < n; k++) {
+                free(reloads[k].id);
+                safe_fclose(reloads[k].f);
+        }
+
+        free(reloads);
+}
+
+/* Serializes the runtime state of the unit, without changing anything yet */
+static int manager_prepare_reload_in_place(Manager *m, Unit *u, FDSet *fds, InPlaceReload *ret) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *id = NULL;
+        int r;
+
+        assert(m);
+        assert(u);
+        assert(fds);
+        assert(ret);
+
+        id = strdup(u->id);
+        if (!id)
+                return -ENOMEM;
+
+        r = manager_open_serialization(m, &f);
+        if (r < 0)
+                return r;
+
+        r = unit_serialize(u, f, fds, false);
+        if (r < 0)
+                return r;
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                return r;
+
+        if (fseeko(f, 0, SEEK_SET) < 0)
+                return -errno;
+
+        ret->id = id;
+        ret->f = f;
+        id = NULL;
+        f = NULL;
+
+        return 0;
+}
+
+static int manager_reload_unit_in_place(Manager *m, Unit *u, FILE *f, FDSet *fds) {
+        _cleanup_free_ KeptDependency *kept = NULL;
+        size_t n_kept = 0, n_allocated = 0, k;
+        _cleanup_free_ char *id = NULL;
+        bool sent_dbus_new_signal;
+        UnitRef *refs;
+        Unit *n;
+        int r;
+
+        assert(m);
+        assert(u);
+        assert(f);
+        assert(MANAGER_IS_RELOADING(m));
+
+        /* Everything that can fail is done before the unit is freed, so that a failure leaves it untouched */
+
+        id = strdup(u->id);
+        if (!id)
+                return -ENOMEM;
+
+        /* Remember all dependencies other units have on us, except for those we added ourselves while being loaded:
+         * the latter are added again (or not) when the unit file is loaded again. */
+        for (k = 0; k < u->dependencies.n_entries; k++) {
+                UnitDependencyEntry *ours, *theirs;
+                UnitDependency e;
+
+                ours = u->dependencies.entries + k;
+                theirs = unit_dependency_find(ours->other, u);
+                assert(theirs);
+
+                for (e = 0; e < _UNIT_DEPENDENCY_MAX; e++) {
+                        UnitDependency inverse;
+
+                        if (!(theirs->mask & (1U << e)))
+                                continue;
+
+                        inverse = unit_dependency_inverse(e);
+                        if (!(theirs->origin & (1U << e)) &&
+                            inverse != _UNIT_DEPENDENCY_INVALID &&
+                            (ours->origin & (1U << inverse)))
+                                continue;
+
+                        if (!GREEDY_REALLOC(kept, n_allocated, n_kept + 1))
+                                return -ENOMEM;
+
+                        kept[n_kept++] = (KeptDependency) {
+                                .unit = ours->other,
+                                .dependency = e,
+                                .loaded = theirs->origin & (1U << e),
+                        };
+                }
+        }
+
+        /* Take over the references to the unit, they are redirected to the new unit object below */
+        refs = u->refs;
+        u->refs = NULL;
+
+        /* The unit stays around for bus clients, it is not removed and added again */
+        sent_dbus_new_signal = u->sent_dbus_new_signal;
+        u->reloading_in_place = true;
+
+        log_unit_debug(u, "Reloading unit in place.");
+
+        unit_free(u);
+        u = NULL;
+
+        r = manager_load_unit(m, id, NULL, NULL, &n);
+        if (r < 0) {
+                /* Nothing is pointing to us anymore, but let's not leave dangling pointers around */
+                while (refs) {
+                        UnitRef *ref = refs;
+
+                        LIST_REMOVE(refs, refs, ref);
+                        ref->unit = NULL;
+                }
+
+                return log_error_errno(r, "Failed to load unit %s again: %m", id);
+        }
+
+        n->sent_dbus_new_signal = sent_dbus_new_signal;
+
+        while (refs) {
+                UnitRef *ref = refs;
+
+                LIST_REMOVE(refs, refs, ref);
+                ref->unit = NULL;
+                unit_ref_set(ref, n);
+        }
+
+        for (k = 0; k < n_kept; k++) {
+                r = unit_add_dependency(kept[k].unit, kept[k].dependency, n, false);
+                if (r < 0) {
+                        log_unit_warning_errno(n, r, "Failed to restore %s dependency of %s, ignoring: %m",
+                                               unit_dependency_to_string(kept[k].dependency), kept[k].unit->id);
+                        continue;
+                }
+
+                if (kept[k].loaded)
+                        (void) unit_remember_loaded_dependency(unit_follow_merge(kept[k].unit), kept[k].dependency, n);
+        }
+
+        r = unit_deserialize(n, f, fds);
+        if (r < 0)
+                log_unit_warning_errno(n, r, "Failed to deserialize unit state, ignoring: %m");
+
+        r = unit_coldplug(n);
+        if (r < 0)
+                log_unit_warning_errno(n, r, "Failed to coldplug unit, ignoring: %m");
+
+        unit_add_to_dbus_queue(n);
+        unit_add_to_gc_queue(n);
+
+        return 0;
+}
+
+static int add_reload_in_place(Set *s, Unit ***units, size_t *n_units, size_t *n_allocated, Unit *u) {
+        int r;
+
+        r = set_put(s, u);
+        if (r <= 0)
+                return r;
+
+        if (!GREEDY_REALLOC(*units, *n_allocated, *n_units + 1))
+                return -ENOMEM;
+
+        (*units)[(*n_units)++] = u;
+        return 1;
+}
+
+int manager_reload_incremental(Manager *m) {
+        _cleanup_free_ Unit **units = NULL;
+        _cleanup_set_free_ Set *seen = NULL;
+        _cleanup_fdset_free_ FDSet *fds = NULL;
+        InPlaceReload *reloads = NULL;
+        size_t n_units = 0, n_allocated = 0, n_changed, k, j;
+        unsigned n_reloaded = 0;
+        Iterator i;
+        const char *id;
+        Unit *u;
+        int r = 0;
+
+        assert(m);
+
+        /* Instead of serializing everything, flushing all units and loading everything from scratch, this only
+         * loads those units again whose unit files, drop-ins or .wants/.requires directories changed since they
+         * were loaded, plus the units whose unit files declare dependencies on them. Their runtime state is
+         * serialized and deserialized individually, and all references and dependencies other units have on them
+         * are redirected to the new unit objects. Returns -EBUSY if one of these units cannot be reloaded that
+         * way, in which case the caller should do a full reload. This is decided before any unit is touched.
+         *
+         * Note that generators are not run again, and the unit search path is left as it is. */
+
+        manager_build_unit_path_cache(m);
+
+        seen = set_new(NULL);
+        if (!seen) {
+                r = -ENOMEM;
+                goto finish;
+        }
+
+        HASHMAP_FOREACH_KEY(u, id, m->units, i) {
+                if (u->id != id)
+                        continue;
+
+                if (!unit_need_reload_in_place(u))
+                        continue;
+
+                if (!unit_can_reload_in_place(u)) {
+                        /* Unloadable units of other types have no state we'd lose, skip them */
+                        if (IN_SET(u->load_state, UNIT_NOT_FOUND, UNIT_ERROR) &&
+                            !unit_need_daemon_reload(u))
+                                continue;
+
+                        log_unit_debug(u, "Unit changed on disk, but cannot be reloaded in place.");
+                        r = -EBUSY;
+                        goto finish;
+                }
+
+                r = add_reload_in_place(seen, &units, &n_units, &n_allocated, u);
+                if (r < 0)
+                        goto finish;
+        }
+
+        /* Dependencies that other units declared on a changed unit are read again from their unit files too */
+        n_changed = n_units;
+        for (k = 0; k < n_changed; k++) {
+                u = units[k];
+
+                for (j = 0; j < u->dependencies.n_entries; j++) {
+                        UnitDependencyEntry *theirs;
+                        Unit *other = u->dependencies.entries[j].other;
+
+                        theirs = unit_dependency_find(other, u);
+                        if (!theirs || theirs->origin == 0)
+                                continue;
+
+                        if (other->load_state == UNIT_MERGED || set_contains(seen, other))
+                                continue;
+
+                        if (!unit_can_reload_in_place(other)) {
+                                log_unit_debug(other, "Unit depends on %s, which changed on disk, but cannot be reloaded in place.", u->id);
+                                r = -EBUSY;
+                                goto finish;
+                        }
+
+                        r = add_reload_in_place(seen, &units, &n_units, &n_allocated, other);
+                        if (r < 0)
+                                goto finish;
+                }
+        }
+
+        fds = fdset_new();
+        if (!fds) {
+                r = -ENOMEM;
+                goto finish;
+        }
+
+        reloads = new0(InPlaceReload, n_units);
+        if (n_units > 0 && !reloads) {
+                r = -ENOMEM;
+                goto finish;
+        }
+
+        /* Serialize all of them first, so that nothing is changed if that fails */
+        for (k = 0; k < n_units; k++) {
+                r = manager_prepare_reload_in_place(m, units[k], fds, reloads + k);
+                if (r < 0)
+                        goto finish;
+        }
+
+        /* The unit objects are freed from here on, only their names remain valid */
+        units = mfree(units);
+
+        m->n_reloading++;
+        bus_manager_send_reloading(m, true);
+
+        for (k = 0; k < n_units; k++) {
+                /* Loading one unit might have merged another one we were about to reload into it */
+                u = manager_get_unit(m, reloads[k].id);
+                if (!u || u->load_state == UNIT_MERGED || !streq(u->id, reloads[k].id))
+                        continue;
+
+                /* The unit is left as it is if this fails, unless it failed to load again */
+                r = manager_reload_unit_in_place(m, u, reloads[k].f, fds);
+                if (r < 0) {
+                        log_warning_errno(r, "Failed to reload unit %s in place: %m", reloads[k].id);
+                        continue;
+                }
+
+                n_reloaded++;
+        }
+
+        manager_forget_cgroup_attributes(m);
+
+        /* Release any dynamic users no longer referenced */
+        dynamic_user_vacuum(m, true);
+
+        /* Release any references to UIDs/GIDs no longer referenced, and destroy any IPC owned by them */
+        manager_vacuum_uid_refs(m);
+        manager_vacuum_gid_refs(m);
+
+        /* Sync current state of bus names with our set of listening units */
+        if (m->api_bus)
+                manager_sync_bus_names(m, m->api_bus);
+
+        assert(m->n_reloading > 0);
+        m->n_reloading--;
+
+        m->send_reloading_done = true;
+
+        log_info("Reloaded %u units in place.", n_reloaded);
+        r = 0;
+
+finish:
+        in_place_reload_free_many(reloads, reloads ? n_units : 0);
+        m->unit_path_cache = set_free(m->unit_path_cache);
+
+        return r < 0 ? r : (int) n_reloaded;
+}
+
 void manager_reset_failed(Manager *m) {
         Unit *u;
         Iterator i;
@@ -3017,8 +4001,72 @@ void manager_check_finished(Manager *m) {
         manager_invalidate_startup_units(m);
 }
 
+static void manager_free_generator_timings(Manager *m) {
+        unsigned i;
+
+        assert(m);
+
+        for (i = 0; i < m->n_generator_timings; i++)
+                free(m->generator_timings[i].path);
+
+        m->generator_timings = mfree(m->generator_timings);
+        m->n_generator_timings = 0;
+}
+
+static int manager_read_generator_timings(Manager *m, int fd) {
+        _cleanup_fclose_ FILE *f = NULL;
+        char line[LINE_MAX];
+        size_t allocated = 0;
+
+        assert(m);
+        assert(fd >= 0);
+
+        /* Takes possession of fd. The executor appended one "<start> <finish> <path>" line per generator
+         * that finished. */
+
+        if (lseek(fd, 0, SEEK_SET) < 0) {
+                safe_close(fd);
+                return -errno;
+        }
+
+        f = fdopen(fd, "re");
+        if (!f) {
+                safe_close(fd);
+                return -errno;
+        }
+
+        FOREACH_LINE(line, f, return -errno) {
+                GeneratorTiming *t;
+                uint64_t start, finish;
+                int k = 0;
+
+                if (sscanf(line, "%" SCNu64 " %" SCNu64 " %n", &start, &finish, &k) != 2 || k <= 0) {
+                        log_debug("Failed to parse generator timing line, ignoring: %s", line);
+                        continue;
+                }
+
+                if (isempty(truncate_nl(line + k)))
+                        continue;
+
+                if (!GREEDY_REALLOC(m->generator_timings, allocated, m->n_generator_timings + 1))
+                        return -ENOMEM;
+
+                t = m->generator_timings + m->n_generator_timings;
+                t->path = strdup(line + k);
+                if (!t->path)
+                        return -ENOMEM;
+
+                t->start = start;
+                t->finish = finish;
+                m->n_generator_timings++;
+        }
+
+        return 0;
+}
+
 static int manager_run_generators(Manager *m) {
         _cleanup_strv_free_ char **paths = NULL;
+        _cleanup_close_ int timings_fd = -1;
         const char *argv[5];
         char **path;
         int r;
@@ -3054,8 +4102,26 @@ static int manager_run_generators(Manager *m) {
         argv[3] = m->lookup_paths.generator_late;
         argv[4] = NULL;
 
+        manager_free_generator_timings(m);
+
+        /* The generators run in a forked off executor, have it tell us how long each one took through a temporary
+         * file. If we can't get one, run them anyway and simply go without timings. */
+        timings_fd = open_tmpfile_unlinkable(MANAGER_IS_SYSTEM(m) ? "/run/systemd" : "/tmp", O_RDWR|O_CLOEXEC);
+        if (timings_fd < 0)
+                log_debug_errno(timings_fd, "Failed to create generator timing file, ignoring: %m");
+
         RUN_WITH_UMASK(0022)
-                execute_directories((const char* const*) paths, DEFAULT_TIMEOUT_USEC, (char**) argv);
+                execute_directories_full((const char* const*) paths, DEFAULT_TIMEOUT_USEC, (char**) argv,
+                                         m->max_parallel_generators, timings_fd);
+
+        if (timings_fd >= 0) {
+                int q;
+
+                q = manager_read_generator_timings(m, timings_fd);
+                timings_fd = -1;
+                if (q < 0)
+                        log_debug_errno(q, "Failed to read generator timings, ignoring: %m");
+        }
 
 finish:
         lookup_paths_trim_generator(&m->lookup_paths);
@@ -36,6 +36,8 @@
 #define MANAGER_MAX_NAMES 131072 /* 128K */
 
 typedef struct Manager Manager;
+typedef struct NotifyMessage NotifyMessage;
+typedef struct GeneratorTiming GeneratorTiming;
 
 typedef enum ManagerState {
         MANAGER_INITIALIZING,
@@ -62,6 +64,13 @@ typedef enum ManagerExitCode {
         _MANAGER_EXIT_CODE_INVALID = -1
 } ManagerExitCode;
 
+/* Wall clock time spent by each generator during the last run, in CLOCK_MONOTONIC */
+struct GeneratorTiming {
+        char *path;
+        usec_t start;
+        usec_t finish;
+};
+
 typedef enum StatusType {
         STATUS_TYPE_EPHEMERAL,
         STATUS_TYPE_NORMAL,
@@ -91,6 +100,9 @@ struct Manager {
         /* Units that need to be loaded */
         LIST_HEAD(Unit, load_queue); /* this is actually more a stack than a queue, but uh. */
 
+        /* The unit unit_load() is currently working on */
+        Unit *loading_unit;
+
         /* Jobs that need to be run */
         LIST_HEAD(Job, run_queue);   /* more a stack than a queue, too */
 
@@ -111,6 +123,9 @@ struct Manager {
         /* Units that should be realized */
         LIST_HEAD(Unit, cgroup_queue);
 
+        /* Units whose cgroup might have become empty */
+        LIST_HEAD(Unit, cgroup_empty_queue);
+
         sd_event *event;
 
         /* We use two hash tables here, since the same PID might be
@@ -133,6 +148,7 @@ struct Manager {
         char *notify_socket;
         int notify_fd;
         sd_event_source *notify_event_source;
+        NotifyMessage *notify_messages;
 
         int cgroups_agent_fd;
         sd_event_source *cgroups_agent_event_source;
@@ -152,6 +168,14 @@ struct Manager {
         LookupPaths lookup_paths;
         Set *unit_path_cache;
 
+        /* The directory listings the unit path cache is built from,
+         * indexed by directory path. These are kept across reloads
+         * and reused as long as the directory's inode and mtime
+         * didn't change. */
+        Hashmap *unit_path_cache_dirs;
+        uint64_t unit_path_cache_hits;
+        uint64_t unit_path_cache_misses;
+
         char **environment;
 
         usec_t runtime_watchdog;
@@ -168,6 +192,10 @@ struct Manager {
         dual_timestamp security_finish_timestamp;
         dual_timestamp generators_start_timestamp;
         dual_timestamp generators_finish_timestamp;
+
+        GeneratorTiming *generator_timings;
+        unsigned n_generator_timings;
+        unsigned max_parallel_generators;
         dual_timestamp units_load_start_timestamp;
         dual_timestamp units_load_finish_timestamp;
 
@@ -225,6 +253,11 @@ struct Manager {
         sd_event_source *cgroup_inotify_event_source;
         Hashmap *cgroup_inotify_wd_unit;
 
+        /* Units we couldn't get an inotify watch for, because the
+         * watch limit was hit, and which are polled instead. */
+        Set *cgroup_poll_units;
+        sd_event_source *cgroup_poll_event_source;
+
         /* Make sure the user cannot accidentally unmount our cgroup
          * file system */
         int pin_cgroupfs_fd;
@@ -265,6 +298,11 @@ struct Manager {
         uint64_t default_tasks_max;
         usec_t default_timer_accuracy_usec;
 
+        /* Periodic sampling of the units' resource usage */
+        usec_t resource_sample_interval_usec;
+        unsigned resource_sample_count;
+        sd_event_source *resource_sample_event_source;
+
         struct rlimit *rlimit[_RLIMIT_MAX];
 
         /* non-zero if we are reloading or reexecuting, */
@@ -305,6 +343,10 @@ struct Manager {
         Hashmap *uid_refs;
         Hashmap *gid_refs;
 
+        /* Compiled seccomp filters, shared by all execution contexts with the same seccomp settings, e.g. the
+         * instances of a template. Indexed by a description of these settings. */
+        Hashmap *seccomp_filters;
+
         /* When the user hits C-A-D more than 7 times per 2s, do something immediately... */
         RateLimit ctrl_alt_del_ratelimit;
         EmergencyAction cad_burst_action;
@@ -360,6 +402,7 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root);
 int manager_deserialize(Manager *m, FILE *f, FDSet *fds);
 
 int manager_reload(Manager *m);
+int manager_reload_incremental(Manager *m);
 
 void manager_reset_failed(Manager *m);
 
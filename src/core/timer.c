@@ -179,7 +179,7 @@ static int timer_load(Unit *u) {
 
         if (u->load_state == UNIT_LOADED) {
 
-                if (set_isempty(u->dependencies[UNIT_TRIGGERS])) {
+                if (unit_dependency_count(u, UNIT_TRIGGERS) == 0) {
                         Unit *x;
 
                         r = unit_load_related_unit(u, ".service", &x);
@@ -61,29 +61,48 @@ void transaction_abort(Transaction *tr) {
         assert(hashmap_isempty(tr->jobs));
 }
 
-static void transaction_find_jobs_that_matter_to_anchor(Job *j, unsigned generation) {
-        JobDependency *l;
+static int transaction_find_jobs_that_matter_to_anchor(Job *anchor, unsigned generation) {
+        _cleanup_free_ Job **queue = NULL;
+        size_t allocated = 0, n = 0;
 
-        /* A recursive sweep through the graph that marks all units
-         * that matter to the anchor job, i.e. are directly or
-         * indirectly a dependency of the anchor job via paths that
-         * are fully marked as mattering. */
+        /* A sweep through the graph that marks all units that matter
+         * to the anchor job, i.e. are directly or indirectly a
+         * dependency of the anchor job via paths that are fully marked
+         * as mattering. */
 
-        j->matters_to_anchor = true;
-        j->generation = generation;
+        anchor->matters_to_anchor = true;
+        anchor->generation = generation;
 
-        LIST_FOREACH(subject, l, j->subject_list) {
+        if (!GREEDY_REALLOC(queue, allocated, 1))
+                return -ENOMEM;
+        queue[n++] = anchor;
 
-                /* This link does not matter */
-                if (!l->matters)
-                        continue;
+        while (n > 0) {
+                JobDependency *l;
+                Job *j;
 
-                /* This unit has already been marked */
-                if (l->object->generation == generation)
-                        continue;
+                j = queue[--n];
+
+                LIST_FOREACH(subject, l, j->subject_list) {
+
+                        /* This link does not matter */
+                        if (!l->matters)
+                                continue;
+
+                        /* This unit has already been marked */
+                        if (l->object->generation == generation)
+                                continue;
+
+                        l->object->matters_to_anchor = true;
+                        l->object->generation = generation;
 
-                transaction_find_jobs_that_matter_to_anchor(l->object, generation);
+                        if (!GREEDY_REALLOC(queue, allocated, n + 1))
+                                return -ENOMEM;
+                        queue[n++] = l->object;
+                }
         }
+
+        return 0;
 }
 
 static void transaction_merge_and_delete_job(Transaction *tr, Job *j, Job *other, JobType t) {
@@ -305,7 +324,6 @@ static void transaction_drop_redundant(Transaction *tr) {
 
         assert(tr);
 
-rescan:
         HASHMAP_FOREACH(j, tr->jobs, i) {
                 Job *k;
 
@@ -317,9 +335,16 @@ rescan:
                                 goto next_unit;
                 }
 
-                /* log_debug("Found redundant job %s/%s, dropping.", j->unit->id, job_type_to_string(j->type)); */
-                transaction_delete_job(tr, j, false);
-                goto rescan;
+                /* Deleting without dependencies only touches the
+                 * entry of this unit, hence there's no need to start
+                 * the iteration from the beginning again. */
+                while (j) {
+                        k = j->transaction_next;
+
+                        /* log_debug("Found redundant job %s/%s, dropping.", j->unit->id, job_type_to_string(j->type)); */
+                        transaction_delete_job(tr, j, false);
+                        j = k;
+                }
         next_unit:;
         }
 }
@@ -338,122 +363,162 @@ _pure_ static bool unit_matters_to_anchor(Unit *u, Job *j) {
         return false;
 }
 
-static int transaction_verify_order_one(Transaction *tr, Job *j, Job *from, unsigned generation, sd_bus_error *e) {
+typedef struct VerifyOrderFrame {
+        Job *job;
         Iterator i;
-        Unit *u;
-        int r;
-
-        assert(tr);
-        assert(j);
-        assert(!j->transaction_prev);
+} VerifyOrderFrame;
 
-        /* Does a recursive sweep through the ordering graph, looking
-         * for a cycle. If we find a cycle we try to break it. */
+static int transaction_break_order_cycle(Transaction *tr, Job *j, Job *from, unsigned generation, sd_bus_error *e) {
+        Job *k, *delete;
 
-        /* Have we seen this before? */
-        if (j->generation == generation) {
-                Job *k, *delete;
+        /* We reached j again while it is still on our path. We have a
+         * cycle. Let's try to break it. We go backwards in our path
+         * and try to find a suitable job to remove. We use the marker
+         * to find our way back, since smart how we are we stored our
+         * way back in there. */
+        log_unit_warning(j->unit,
+                         "Found ordering cycle on %s/%s",
+                         j->unit->id, job_type_to_string(j->type));
 
-                /* If the marker is NULL we have been here already and
-                 * decided the job was loop-free from here. Hence
-                 * shortcut things and return right-away. */
-                if (!j->marker)
-                        return 0;
+        delete = NULL;
+        for (k = from; k; k = ((k->generation == generation && k->marker != k) ? k->marker : NULL)) {
 
-                /* So, the marker is not NULL and we already have been
-                 * here. We have a cycle. Let's try to break it. We go
-                 * backwards in our path and try to find a suitable
-                 * job to remove. We use the marker to find our way
-                 * back, since smart how we are we stored our way back
-                 * in there. */
+                /* logging for j not k here to provide consistent narrative */
                 log_unit_warning(j->unit,
-                                 "Found ordering cycle on %s/%s",
-                                 j->unit->id, job_type_to_string(j->type));
+                                 "Found dependency on %s/%s",
+                                 k->unit->id, job_type_to_string(k->type));
 
-                delete = NULL;
-                for (k = from; k; k = ((k->generation == generation && k->marker != k) ? k->marker : NULL)) {
+                if (!delete && hashmap_get(tr->jobs, k->unit) && !unit_matters_to_anchor(k->unit, k))
+                        /* Ok, we can drop this one, so let's
+                         * do so. */
+                        delete = k;
 
-                        /* logging for j not k here to provide consistent narrative */
-                        log_unit_warning(j->unit,
-                                         "Found dependency on %s/%s",
-                                         k->unit->id, job_type_to_string(k->type));
+                /* Check if this in fact was the beginning of
+                 * the cycle */
+                if (k == j)
+                        break;
+        }
 
-                        if (!delete && hashmap_get(tr->jobs, k->unit) && !unit_matters_to_anchor(k->unit, k))
-                                /* Ok, we can drop this one, so let's
-                                 * do so. */
-                                delete = k;
 
-                        /* Check if this in fact was the beginning of
-                         * the cycle */
-                        if (k == j)
-                                break;
-                }
+        if (delete) {
+                const char *status;
+                /* logging for j not k here to provide consistent narrative */
+                log_unit_warning(j->unit,
+                                 "Breaking ordering cycle by deleting job %s/%s",
+                                 delete->unit->id, job_type_to_string(delete->type));
+                log_unit_error(delete->unit,
+                               "Job %s/%s deleted to break ordering cycle starting with %s/%s",
+                               delete->unit->id, job_type_to_string(delete->type),
+                               j->unit->id, job_type_to_string(j->type));
+
+                if (log_get_show_color())
+                        status = ANSI_HIGHLIGHT_RED " SKIP " ANSI_NORMAL;
+                else
+                        status = " SKIP ";
+
+                unit_status_printf(delete->unit, status,
+                                   "Ordering cycle found, skipping %s");
+                transaction_delete_unit(tr, delete->unit);
+                return -EAGAIN;
+        }
 
+        log_error("Unable to break cycle");
 
-                if (delete) {
-                        const char *status;
-                        /* logging for j not k here to provide consistent narrative */
-                        log_unit_warning(j->unit,
-                                         "Breaking ordering cycle by deleting job %s/%s",
-                                         delete->unit->id, job_type_to_string(delete->type));
-                        log_unit_error(delete->unit,
-                                       "Job %s/%s deleted to break ordering cycle starting with %s/%s",
-                                       delete->unit->id, job_type_to_string(delete->type),
-                                       j->unit->id, job_type_to_string(j->type));
+        return sd_bus_error_setf(e, BUS_ERROR_TRANSACTION_ORDER_IS_CYCLIC,
+                                 "Transaction order is cyclic. See system logs for details.");
+}
 
-                        if (log_get_show_color())
-                                status = ANSI_HIGHLIGHT_RED " SKIP " ANSI_NORMAL;
-                        else
-                                status = " SKIP ";
+static int transaction_verify_order_one(
+                Transaction *tr,
+                Job *j,
+                unsigned generation,
+                VerifyOrderFrame **stack,
+                size_t *allocated,
+                sd_bus_error *e) {
 
-                        unit_status_printf(delete->unit, status,
-                                           "Ordering cycle found, skipping %s");
-                        transaction_delete_unit(tr, delete->unit);
-                        return -EAGAIN;
-                }
+        Job *from = NULL;
+        size_t n = 0;
 
-                log_error("Unable to break cycle");
+        assert(tr);
+        assert(j);
+        assert(!j->transaction_prev);
+        assert(stack);
+        assert(allocated);
 
-                return sd_bus_error_setf(e, BUS_ERROR_TRANSACTION_ORDER_IS_CYCLIC,
-                                         "Transaction order is cyclic. See system logs for details.");
-        }
+        /* Does a depth-first sweep through the ordering graph, looking
+         * for a cycle. If we find a cycle we try to break it. The path
+         * we are on is kept on an explicit stack, so that long
+         * dependency chains don't exhaust our own stack. */
 
-        /* Make the marker point to where we come from, so that we can
-         * find our way backwards if we want to break a cycle. We use
-         * a special marker for the beginning: we point to
-         * ourselves. */
-        j->marker = from ? from : j;
-        j->generation = generation;
-
-        /* We assume that the dependencies are bidirectional, and
-         * hence can ignore UNIT_AFTER */
-        SET_FOREACH(u, j->unit->dependencies[UNIT_BEFORE], i) {
-                Job *o;
-
-                /* Is there a job for this unit? */
-                o = hashmap_get(tr->jobs, u);
-                if (!o) {
-                        /* Ok, there is no job for this in the
-                         * transaction, but maybe there is already one
-                         * running? */
-                        o = u->job;
-                        if (!o)
-                                continue;
+        for (;;) {
+                /* Have we seen this before? */
+                if (j->generation == generation) {
+
+                        /* If the marker is not NULL we are still on
+                         * the path that led us here. */
+                        if (j->marker)
+                                return transaction_break_order_cycle(tr, j, from, generation, e);
+
+                        /* Otherwise we have been here already and
+                         * decided the job was loop-free from here. */
+                } else {
+                        /* Make the marker point to where we come from,
+                         * so that we can find our way backwards if we
+                         * want to break a cycle. We use a special
+                         * marker for the beginning: we point to
+                         * ourselves. */
+                        j->marker = from ?: j;
+                        j->generation = generation;
+
+                        if (!GREEDY_REALLOC(*stack, *allocated, n + 1))
+                                return -ENOMEM;
+
+                        (*stack)[n++] = (VerifyOrderFrame) {
+                                .job = j,
+                                .i = ITERATOR_FIRST,
+                        };
                 }
 
-                r = transaction_verify_order_one(tr, o, j, generation, e);
-                if (r < 0)
-                        return r;
-        }
+                /* Find the next edge to follow, backtracking from all
+                 * jobs whose edges we have followed completely. */
+                j = NULL;
+                while (n > 0) {
+                        VerifyOrderFrame *f = *stack + n - 1;
+                        Unit *u;
+
+                        /* We assume that the dependencies are
+                         * bidirectional, and hence can ignore
+                         * UNIT_AFTER */
+                        if (unit_dependency_iterate(f->job->unit, UNIT_BEFORE, &f->i, &u)) {
+
+                                /* Is there a job for this unit? */
+                                j = hashmap_get(tr->jobs, u);
+                                if (!j)
+                                        /* Ok, there is no job for this in
+                                         * the transaction, but maybe there
+                                         * is already one running? */
+                                        j = u->job;
+                                if (!j)
+                                        continue;
 
-        /* Ok, let's backtrack, and remember that this entry is not on
-         * our path anymore. */
-        j->marker = NULL;
+                                from = f->job;
+                                break;
+                        }
 
-        return 0;
+                        /* Ok, let's backtrack, and remember that this
+                         * entry is not on our path anymore. */
+                        f->job->marker = NULL;
+                        n--;
+                }
+
+                if (!j)
+                        return 0;
+        }
 }
 
 static int transaction_verify_order(Transaction *tr, unsigned *generation, sd_bus_error *e) {
+        _cleanup_free_ VerifyOrderFrame *stack = NULL;
+        size_t allocated = 0;
         Job *j;
         int r;
         Iterator i;
@@ -468,7 +533,7 @@ static int transaction_verify_order(Transaction *tr, unsigned *generation, sd_bu
         g = (*generation)++;
 
         HASHMAP_FOREACH(j, tr->jobs, i) {
-                r = transaction_verify_order_one(tr, j, NULL, g, e);
+                r = transaction_verify_order_one(tr, j, g, &stack, &allocated, e);
                 if (r < 0)
                         return r;
         }
@@ -479,25 +544,36 @@ static int transaction_verify_order(Transaction *tr, unsigned *generation, sd_bu
 static void transaction_collect_garbage(Transaction *tr) {
         Iterator i;
         Job *j;
+        bool again;
 
         assert(tr);
 
         /* Drop jobs that are not required by any other job */
 
-rescan:
-        HASHMAP_FOREACH(j, tr->jobs, i) {
-                if (tr->anchor_job == j || j->object_list) {
-                        /* log_debug("Keeping job %s/%s because of %s/%s", */
-                        /*           j->unit->id, job_type_to_string(j->type), */
-                        /*           j->object_list->subject ? j->object_list->subject->unit->id : "root", */
-                        /*           j->object_list->subject ? job_type_to_string(j->object_list->subject->type) : "root"); */
-                        continue;
-                }
+        do {
+                again = false;
 
-                /* log_debug("Garbage collecting job %s/%s", j->unit->id, job_type_to_string(j->type)); */
-                transaction_delete_job(tr, j, true);
-                goto rescan;
-        }
+                HASHMAP_FOREACH(j, tr->jobs, i) {
+                        if (tr->anchor_job == j || j->object_list) {
+                                /* log_debug("Keeping job %s/%s because of %s/%s", */
+                                /*           j->unit->id, job_type_to_string(j->type), */
+                                /*           j->object_list->subject ? j->object_list->subject->unit->id : "root", */
+                                /*           j->object_list->subject ? job_type_to_string(j->object_list->subject->type) : "root"); */
+                                continue;
+                        }
+
+                        /* Nothing requires this job, hence deleting it
+                         * only touches the entry of this unit and we
+                         * can continue iterating. The jobs it required
+                         * might have become garbage now, and we might
+                         * have passed them already, hence go for
+                         * another round. */
+
+                        /* log_debug("Garbage collecting job %s/%s", j->unit->id, job_type_to_string(j->type)); */
+                        transaction_delete_job(tr, j, true);
+                        again = true;
+                }
+        } while (again);
 }
 
 static int transaction_is_destructive(Transaction *tr, JobMode mode, sd_bus_error *e) {
@@ -524,18 +600,31 @@ static int transaction_is_destructive(Transaction *tr, JobMode mode, sd_bus_erro
         return 0;
 }
 
-static void transaction_minimize_impact(Transaction *tr) {
-        Job *j;
+static int transaction_minimize_impact(Transaction *tr) {
+        _cleanup_free_ Unit **units = NULL;
+        unsigned n = 0, k;
         Iterator i;
+        Job *j;
 
         assert(tr);
 
         /* Drops all unnecessary jobs that reverse already active jobs
          * or that stop a running service. */
 
-rescan:
-        HASHMAP_FOREACH(j, tr->jobs, i) {
-                LIST_FOREACH(transaction, j, j) {
+        /* Deleting a job also deletes the jobs that depend on it,
+         * hence take a snapshot of the units first and look up their
+         * jobs again, instead of starting from the beginning after
+         * each deletion. */
+        units = new(Unit*, hashmap_size(tr->jobs));
+        if (!units)
+                return -ENOMEM;
+
+        HASHMAP_FOREACH(j, tr->jobs, i)
+                units[n++] = j->unit;
+
+        for (k = 0; k < n; k++) {
+        rescan:
+                LIST_FOREACH(transaction, j, (Job*) hashmap_get(tr->jobs, units[k])) {
                         bool stops_running_service, changes_existing_job;
 
                         /* If it matters, we shouldn't drop it */
@@ -575,6 +664,8 @@ rescan:
                         goto rescan;
                 }
         }
+
+        return 0;
 }
 
 static int transaction_apply(Transaction *tr, Manager *m, JobMode mode) {
@@ -664,13 +755,18 @@ int transaction_activate(Transaction *tr, Manager *m, JobMode mode, sd_bus_error
                 j->generation = 0;
 
         /* First step: figure out which jobs matter */
-        transaction_find_jobs_that_matter_to_anchor(tr->anchor_job, generation++);
+        r = transaction_find_jobs_that_matter_to_anchor(tr->anchor_job, generation++);
+        if (r < 0)
+                return r;
 
         /* Second step: Try not to stop any running services if
          * we don't have to. Don't try to reverse running
          * jobs if we don't have to. */
-        if (mode == JOB_FAIL)
-                transaction_minimize_impact(tr);
+        if (mode == JOB_FAIL) {
+                r = transaction_minimize_impact(tr);
+                if (r < 0)
+                        return r;
+        }
 
         /* Third step: Drop redundant jobs */
         transaction_drop_redundant(tr);
@@ -917,7 +1013,7 @@ int transaction_add_job_and_dependencies(
 
                 /* Finally, recursively add in all dependencies. */
                 if (type == JOB_START || type == JOB_RESTART) {
-                        SET_FOREACH(dep, ret->unit->dependencies[UNIT_REQUIRES], i) {
+                        UNIT_FOREACH_DEPENDENCY(dep, ret->unit, UNIT_REQUIRES, i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_START, dep, ret, true, false, false, ignore_order, e);
                                 if (r < 0) {
                                         if (r != -EBADR) /* job type not applicable */
@@ -927,7 +1023,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        SET_FOREACH(dep, ret->unit->dependencies[UNIT_BINDS_TO], i) {
+                        UNIT_FOREACH_DEPENDENCY(dep, ret->unit, UNIT_BINDS_TO, i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_START, dep, ret, true, false, false, ignore_order, e);
                                 if (r < 0) {
                                         if (r != -EBADR) /* job type not applicable */
@@ -937,7 +1033,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        SET_FOREACH(dep, ret->unit->dependencies[UNIT_WANTS], i) {
+                        UNIT_FOREACH_DEPENDENCY(dep, ret->unit, UNIT_WANTS, i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_START, dep, ret, false, false, false, ignore_order, e);
                                 if (r < 0) {
                                         /* unit masked, job type not applicable and unit not found are not considered as errors. */
@@ -949,7 +1045,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        SET_FOREACH(dep, ret->unit->dependencies[UNIT_REQUISITE], i) {
+                        UNIT_FOREACH_DEPENDENCY(dep, ret->unit, UNIT_REQUISITE, i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_VERIFY_ACTIVE, dep, ret, true, false, false, ignore_order, e);
                                 if (r < 0) {
                                         if (r != -EBADR) /* job type not applicable */
@@ -959,7 +1055,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        SET_FOREACH(dep, ret->unit->dependencies[UNIT_CONFLICTS], i) {
+                        UNIT_FOREACH_DEPENDENCY(dep, ret->unit, UNIT_CONFLICTS, i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_STOP, dep, ret, true, true, false, ignore_order, e);
                                 if (r < 0) {
                                         if (r != -EBADR) /* job type not applicable */
@@ -969,7 +1065,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        SET_FOREACH(dep, ret->unit->dependencies[UNIT_CONFLICTED_BY], i) {
+                        UNIT_FOREACH_DEPENDENCY(dep, ret->unit, UNIT_CONFLICTED_BY, i) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_STOP, dep, ret, false, false, false, ignore_order, e);
                                 if (r < 0) {
                                         log_unit_warning(dep,
@@ -998,7 +1094,7 @@ int transaction_add_job_and_dependencies(
                         ptype = type == JOB_RESTART ? JOB_TRY_RESTART : type;
 
                         for (j = 0; j < ELEMENTSOF(propagate_deps); j++)
-                                SET_FOREACH(dep, ret->unit->dependencies[propagate_deps[j]], i) {
+                                UNIT_FOREACH_DEPENDENCY(dep, ret->unit, propagate_deps[j], i) {
                                         JobType nt;
 
                                         nt = job_type_collapse(ptype, dep);
@@ -1017,7 +1113,7 @@ int transaction_add_job_and_dependencies(
 
                 if (type == JOB_RELOAD) {
 
-                        SET_FOREACH(dep, ret->unit->dependencies[UNIT_PROPAGATES_RELOAD_TO], i) {
+                        UNIT_FOREACH_DEPENDENCY(dep, ret->unit, UNIT_PROPAGATES_RELOAD_TO, i) {
                                 JobType nt;
 
                                 nt = job_type_collapse(JOB_TRY_RELOAD, dep);
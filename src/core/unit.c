@@ -102,6 +102,8 @@ Unit *unit_new(Manager *m, size_t size) {
         u->ref_uid = UID_INVALID;
         u->ref_gid = GID_INVALID;
         u->cpu_usage_last = NSEC_INFINITY;
+        u->dependencies.entries = u->dependencies.inline_entries;
+        u->dependencies.n_allocated = ELEMENTSOF(u->dependencies.inline_entries);
 
         RATELIMIT_INIT(u->start_limit, m->default_start_limit_interval, m->default_start_limit_burst);
         RATELIMIT_INIT(u->auto_stop_ratelimit, 10 * USEC_PER_SEC, 16);
@@ -411,25 +413,180 @@ void unit_add_to_dbus_queue(Unit *u) {
         u->in_dbus_queue = true;
 }
 
-static void bidi_set_free(Unit *u, Set *s) {
-        Iterator i;
-        Unit *other;
+static UnitDependencyEntry *dependency_table_find(UnitDependencyTable *t, Unit *other) {
+        unsigned k;
 
-        assert(u);
+        assert(t);
+        assert(other);
 
-        /* Frees the set and makes sure we are dropped from the
-         * inverse pointers */
+        if (t->index) {
+                k = PTR_TO_UINT(hashmap_get(t->index, other));
+                return k > 0 ? t->entries + k - 1 : NULL;
+        }
 
-        SET_FOREACH(other, s, i) {
-                UnitDependency d;
+        for (k = 0; k < t->n_entries; k++)
+                if (t->entries[k].other == other)
+                        return t->entries + k;
+
+        return NULL;
+}
+
+static void dependency_table_index(UnitDependencyTable *t) {
+        unsigned k;
+
+        assert(t);
+
+        /* Builds the index once the table got large enough. The index is only an accelerator: if we cannot
+         * allocate it we simply keep searching linearly. */
+
+        if (t->index || t->n_entries < UNIT_DEPENDENCY_INDEX_MIN)
+                return;
+
+        t->index = hashmap_new(NULL);
+        if (!t->index)
+                return;
+
+        for (k = 0; k < t->n_entries; k++)
+                if (hashmap_put(t->index, t->entries[k].other, UINT_TO_PTR(k + 1)) < 0) {
+                        t->index = hashmap_free(t->index);
+                        return;
+                }
+}
+
+static int dependency_table_reserve(UnitDependencyTable *t, unsigned n) {
+        UnitDependencyEntry *e;
+        unsigned a;
+
+        assert(t);
+
+        if (n <= t->n_allocated)
+                return 0;
+
+        a = MAX(n, t->n_allocated * 2);
+
+        if (t->entries == t->inline_entries) {
+                e = new(UnitDependencyEntry, a);
+                if (!e)
+                        return -ENOMEM;
+
+                memcpy(e, t->inline_entries, t->n_entries * sizeof(UnitDependencyEntry));
+        } else {
+                e = realloc_multiply(t->entries, sizeof(UnitDependencyEntry), a);
+                if (!e)
+                        return -ENOMEM;
+        }
+
+        t->entries = e;
+        t->n_allocated = a;
+
+        return 0;
+}
 
-                for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
-                        set_remove(other->dependencies[d], u);
+static int dependency_table_add(UnitDependencyTable *t, Unit *other, UnitDependencyEntry **ret) {
+        UnitDependencyEntry *e;
+        int r;
+
+        assert(t);
+        assert(other);
+        assert(ret);
+
+        /* Returns the entry for the other unit, creating an empty one if there is none yet */
+
+        e = dependency_table_find(t, other);
+        if (e) {
+                *ret = e;
+                return 0;
+        }
+
+        r = dependency_table_reserve(t, t->n_entries + 1);
+        if (r < 0)
+                return r;
+
+        e = t->entries + t->n_entries++;
+        *e = (UnitDependencyEntry) {
+                .other = other,
+        };
+
+        if (t->index && hashmap_put(t->index, other, UINT_TO_PTR(t->n_entries)) < 0)
+                t->index = hashmap_free(t->index);
+        else
+                dependency_table_index(t);
+
+        *ret = e;
+        return 1;
+}
+
+static void dependency_table_rename(UnitDependencyTable *t, UnitDependencyEntry *e, Unit *other) {
+        assert(t);
+        assert(e);
+        assert(other);
+
+        /* Makes the entry point to a different unit, which must not have an entry of its own */
+
+        if (t->index) {
+                hashmap_remove(t->index, e->other);
+                if (hashmap_put(t->index, other, UINT_TO_PTR(e - t->entries + 1)) < 0)
+                        t->index = hashmap_free(t->index);
+        }
+
+        e->other = other;
+}
+
+static void dependency_table_remove(UnitDependencyTable *t, Unit *other) {
+        UnitDependencyEntry *e, *last;
+
+        assert(t);
+        assert(other);
+
+        e = dependency_table_find(t, other);
+        if (!e)
+                return;
+
+        if (t->index)
+                hashmap_remove(t->index, other);
+
+        /* Fill the hole with the last entry. We do not bother updating the mask, it is fine if it is a superset. */
+        last = t->entries + t->n_entries - 1;
+        if (e != last) {
+                *e = *last;
+
+                if (t->index)
+                        (void) hashmap_update(t->index, e->other, UINT_TO_PTR(e - t->entries + 1));
+        }
+
+        t->n_entries--;
+}
 
+static void dependency_table_done(UnitDependencyTable *t) {
+        assert(t);
+
+        if (t->entries != t->inline_entries)
+                free(t->entries);
+
+        hashmap_free(t->index);
+
+        *t = (UnitDependencyTable) {
+                .n_allocated = ELEMENTSOF(t->inline_entries),
+        };
+        t->entries = t->inline_entries;
+}
+
+static void unit_drop_dependencies(Unit *u) {
+        unsigned k;
+
+        assert(u);
+
+        /* Frees the table and makes sure we are dropped from the
+         * inverse entries */
+
+        for (k = 0; k < u->dependencies.n_entries; k++) {
+                Unit *other = u->dependencies.entries[k].other;
+
+                dependency_table_remove(&other->dependencies, u);
                 unit_add_to_gc_queue(other);
         }
 
-        set_free(s);
+        dependency_table_done(&u->dependencies);
 }
 
 static void unit_remove_transient(Unit *u) {
@@ -512,7 +669,6 @@ static void unit_done(Unit *u) {
 }
 
 void unit_free(Unit *u) {
-        UnitDependency d;
         Iterator i;
         char *t;
 
@@ -524,7 +680,8 @@ void unit_free(Unit *u) {
         if (!MANAGER_IS_RELOADING(u->manager))
                 unit_remove_transient(u);
 
-        bus_unit_send_removed_signal(u);
+        if (!u->reloading_in_place)
+                bus_unit_send_removed_signal(u);
 
         unit_done(u);
 
@@ -553,8 +710,7 @@ void unit_free(Unit *u) {
                 job_free(j);
         }
 
-        for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
-                bidi_set_free(u, u->dependencies[d]);
+        unit_drop_dependencies(u);
 
         if (u->type != _UNIT_TYPE_INVALID)
                 LIST_REMOVE(units_by_type, u->manager->units_by_type[u->type], u);
@@ -574,7 +730,11 @@ void unit_free(Unit *u) {
         if (u->in_cgroup_queue)
                 LIST_REMOVE(cgroup_queue, u->manager->cgroup_queue, u);
 
+        if (u->in_cgroup_empty_queue)
+                LIST_REMOVE(cgroup_empty_queue, u->manager->cgroup_empty_queue, u);
+
         unit_release_cgroup(u);
+        u->resource_samples = mfree(u->resource_samples);
 
         unit_unref_uid_gid(u, false);
 
@@ -586,6 +746,7 @@ void unit_free(Unit *u) {
         free(u->fragment_path);
         free(u->source_path);
         strv_free(u->dropin_paths);
+        strv_free(u->dependency_dirs);
         free(u->instance);
 
         free(u->job_timeout_reboot_arg);
@@ -669,68 +830,52 @@ static int merge_names(Unit *u, Unit *other) {
         return 0;
 }
 
-static int reserve_dependencies(Unit *u, Unit *other, UnitDependency d) {
-        unsigned n_reserve;
+static void merge_dependencies(Unit *u, Unit *other, const char *other_id) {
+        unsigned k;
 
         assert(u);
         assert(other);
-        assert(d < _UNIT_DEPENDENCY_MAX);
 
-        /*
-         * If u does not have this dependency set allocated, there is no need
-         * to reserve anything. In that case other's set will be transferred
-         * as a whole to u by complete_move().
-         */
-        if (!u->dependencies[d])
-                return 0;
+        /* The caller must have reserved room for all of other's entries in u's table, so that this cannot fail */
 
-        /* merge_dependencies() will skip a u-on-u dependency */
-        n_reserve = set_size(other->dependencies[d]) - !!set_get(other->dependencies[d], u);
+        for (k = 0; k < other->dependencies.n_entries; k++) {
+                UnitDependencyEntry *e = other->dependencies.entries + k, *b, *n;
+                Unit *back = e->other;
+                UnitDependency d;
 
-        return set_reserve(u->dependencies[d], n_reserve);
-}
+                b = dependency_table_find(&back->dependencies, other);
+                assert(b);
 
-static void merge_dependencies(Unit *u, Unit *other, const char *other_id, UnitDependency d) {
-        Iterator i;
-        Unit *back;
-        int r;
+                /* Do not add dependencies between u and itself */
+                if (back == u) {
+                        for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
+                                if ((b->mask | e->mask) & (1U << d))
+                                        maybe_warn_about_dependency(u, other_id, d);
 
-        assert(u);
-        assert(other);
-        assert(d < _UNIT_DEPENDENCY_MAX);
-
-        /* Fix backwards pointers */
-        SET_FOREACH(back, other->dependencies[d], i) {
-                UnitDependency k;
-
-                for (k = 0; k < _UNIT_DEPENDENCY_MAX; k++) {
-                        /* Do not add dependencies between u and itself */
-                        if (back == u) {
-                                if (set_remove(back->dependencies[k], other))
-                                        maybe_warn_about_dependency(u, other_id, k);
-                        } else {
-                                r = set_remove_and_put(back->dependencies[k], other, u);
-                                if (r == -EEXIST)
-                                        set_remove(back->dependencies[k], other);
-                                else
-                                        assert(r >= 0 || r == -ENOENT);
-                        }
+                        dependency_table_remove(&u->dependencies, other);
+                        continue;
                 }
-        }
 
-        /* Also do not move dependencies on u to itself */
-        back = set_remove(other->dependencies[d], u);
-        if (back)
-                maybe_warn_about_dependency(u, other_id, d);
+                /* Fix backwards pointers, and make sure that whatever back added to other while loading is now
+                 * attributed to u */
+                n = dependency_table_find(&back->dependencies, u);
+                if (n) {
+                        n->mask |= b->mask;
+                        n->origin |= b->origin;
+                        dependency_table_remove(&back->dependencies, other);
+                } else
+                        dependency_table_rename(&back->dependencies, b, u);
 
-        /* The move cannot fail. The caller must have performed a reservation. */
-        assert_se(complete_move(&u->dependencies[d], &other->dependencies[d]) == 0);
+                assert_se(dependency_table_add(&u->dependencies, back, &n) >= 0);
+                n->mask |= e->mask;
+                n->origin |= e->origin;
+                u->dependencies.mask |= e->mask;
+        }
 
-        other->dependencies[d] = set_free(other->dependencies[d]);
+        dependency_table_done(&other->dependencies);
 }
 
 int unit_merge(Unit *u, Unit *other) {
-        UnitDependency d;
         const char *other_id = NULL;
         int r;
 
@@ -769,16 +914,10 @@ int unit_merge(Unit *u, Unit *other) {
         if (other->id)
                 other_id = strdupa(other->id);
 
-        /* Make reservations to ensure merge_dependencies() won't fail */
-        for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++) {
-                r = reserve_dependencies(u, other, d);
-                /*
-                 * We don't rollback reservations if we fail. We don't have
-                 * a way to undo reservations. A reservation is not a leak.
-                 */
-                if (r < 0)
-                        return r;
-        }
+        /* Make a reservation to ensure merge_dependencies() won't fail */
+        r = dependency_table_reserve(&u->dependencies, u->dependencies.n_entries + other->dependencies.n_entries);
+        if (r < 0)
+                return r;
 
         /* Merge names */
         r = merge_names(u, other);
@@ -790,8 +929,7 @@ int unit_merge(Unit *u, Unit *other) {
                 unit_ref_set(other->refs, u);
 
         /* Merge dependencies */
-        for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
-                merge_dependencies(u, other, other_id, d);
+        merge_dependencies(u, other, other_id);
 
         other->load_state = UNIT_MERGED;
         other->merged_into = u;
@@ -1023,10 +1161,28 @@ void unit_dump(Unit *u, FILE *f, const char *prefix) {
                         prefix, strna(format_timestamp(timestamp1, sizeof(timestamp1), u->assert_timestamp.realtime)),
                         prefix, yes_no(u->assert_result));
 
+        fprintf(f,
+                "%s\tMemory: %zu bytes\n"
+                "%s\tDependency Table: %u entries, %zu bytes%s\n",
+                prefix, UNIT_VTABLE(u)->object_size + unit_dependency_memory(u) - sizeof(UnitDependencyTable),
+                prefix, u->dependencies.n_entries, unit_dependency_memory(u), u->dependencies.index ? ", indexed" : "");
+
+        if (u->n_spawned > 0) {
+                char last[FORMAT_TIMESPAN_MAX], avg[FORMAT_TIMESPAN_MAX], max[FORMAT_TIMESPAN_MAX];
+
+                fprintf(f,
+                        "%s\tSpawn Latency: last %s, average %s, max %s (%u processes)\n",
+                        prefix,
+                        format_timespan(last, sizeof(last), u->spawn_latency_last, 1),
+                        format_timespan(avg, sizeof(avg), u->spawn_latency_total / u->n_spawned, 1),
+                        format_timespan(max, sizeof(max), u->spawn_latency_max, 1),
+                        u->n_spawned);
+        }
+
         for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++) {
                 Unit *other;
 
-                SET_FOREACH(other, u->dependencies[d], i)
+                UNIT_FOREACH_DEPENDENCY(other, u, d, i)
                         fprintf(f, "%s\t%s: %s\n", prefix, unit_dependency_to_string(d), other->id);
         }
 
@@ -1143,7 +1299,7 @@ int unit_add_default_target_dependency(Unit *u, Unit *target) {
                 return 0;
 
         /* Don't create loops */
-        if (set_get(target->dependencies[UNIT_BEFORE], u))
+        if (unit_has_dependency(target, UNIT_BEFORE, u))
                 return 0;
 
         return unit_add_dependency(target, UNIT_AFTER, u, true);
@@ -1166,7 +1322,7 @@ static int unit_add_target_dependencies(Unit *u) {
         assert(u);
 
         for (k = 0; k < ELEMENTSOF(deps); k++)
-                SET_FOREACH(target, u->dependencies[deps[k]], i) {
+                UNIT_FOREACH_DEPENDENCY(target, u, deps[k], i) {
                         r = unit_add_default_target_dependency(u, target);
                         if (r < 0)
                                 return r;
@@ -1285,6 +1441,9 @@ int unit_load(Unit *u) {
                 u->fragment_mtime = now(CLOCK_REALTIME);
         }
 
+        /* Dependencies added from here on are attributed to this unit, see unit_track_loaded_dependency() */
+        u->manager->loading_unit = u;
+
         if (UNIT_VTABLE(u)->load) {
                 r = UNIT_VTABLE(u)->load(u);
                 if (r < 0)
@@ -1314,7 +1473,7 @@ int unit_load(Unit *u) {
                 if (r < 0)
                         goto fail;
 
-                if (u->on_failure_job_mode == JOB_ISOLATE && set_size(u->dependencies[UNIT_ON_FAILURE]) > 1) {
+                if (u->on_failure_job_mode == JOB_ISOLATE && unit_dependency_count(u, UNIT_ON_FAILURE) > 1) {
                         log_unit_error(u, "More than one OnFailure= dependencies specified but OnFailureJobMode=isolate set. Refusing.");
                         r = -EINVAL;
                         goto fail;
@@ -1325,12 +1484,15 @@ int unit_load(Unit *u) {
 
         assert((u->load_state != UNIT_MERGED) == !u->merged_into);
 
+        u->manager->loading_unit = NULL;
+
         unit_add_to_dbus_queue(unit_follow_merge(u));
         unit_add_to_gc_queue(u);
 
         return 0;
 
 fail:
+        u->manager->loading_unit = NULL;
         u->load_state = u->load_state == UNIT_STUB ? UNIT_NOT_FOUND : UNIT_ERROR;
         u->load_error = r;
         unit_add_to_dbus_queue(u);
@@ -1734,7 +1896,7 @@ static void unit_check_unneeded(Unit *u) {
                 return;
 
         for (j = 0; j < ELEMENTSOF(needed_dependencies); j++)
-                SET_FOREACH(other, u->dependencies[needed_dependencies[j]], i)
+                UNIT_FOREACH_DEPENDENCY(other, u, needed_dependencies[j], i)
                         if (unit_active_or_pending(other))
                                 return;
 
@@ -1769,7 +1931,7 @@ static void unit_check_binds_to(Unit *u) {
         if (unit_active_state(u) != UNIT_ACTIVE)
                 return;
 
-        SET_FOREACH(other, u->dependencies[UNIT_BINDS_TO], i) {
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_BINDS_TO, i) {
                 if (other->job)
                         continue;
 
@@ -1807,26 +1969,26 @@ static void retroactively_start_dependencies(Unit *u) {
         assert(u);
         assert(UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(u)));
 
-        SET_FOREACH(other, u->dependencies[UNIT_REQUIRES], i)
-                if (!set_get(u->dependencies[UNIT_AFTER], other) &&
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_REQUIRES, i)
+                if (!unit_has_dependency(u, UNIT_AFTER, other) &&
                     !UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_START, other, JOB_REPLACE, NULL, NULL);
 
-        SET_FOREACH(other, u->dependencies[UNIT_BINDS_TO], i)
-                if (!set_get(u->dependencies[UNIT_AFTER], other) &&
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_BINDS_TO, i)
+                if (!unit_has_dependency(u, UNIT_AFTER, other) &&
                     !UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_START, other, JOB_REPLACE, NULL, NULL);
 
-        SET_FOREACH(other, u->dependencies[UNIT_WANTS], i)
-                if (!set_get(u->dependencies[UNIT_AFTER], other) &&
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_WANTS, i)
+                if (!unit_has_dependency(u, UNIT_AFTER, other) &&
                     !UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_START, other, JOB_FAIL, NULL, NULL);
 
-        SET_FOREACH(other, u->dependencies[UNIT_CONFLICTS], i)
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_CONFLICTS, i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_STOP, other, JOB_REPLACE, NULL, NULL);
 
-        SET_FOREACH(other, u->dependencies[UNIT_CONFLICTED_BY], i)
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_CONFLICTED_BY, i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_STOP, other, JOB_REPLACE, NULL, NULL);
 }
@@ -1839,7 +2001,7 @@ static void retroactively_stop_dependencies(Unit *u) {
         assert(UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(u)));
 
         /* Pull down units which are bound to us recursively if enabled */
-        SET_FOREACH(other, u->dependencies[UNIT_BOUND_BY], i)
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_BOUND_BY, i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_STOP, other, JOB_REPLACE, NULL, NULL);
 }
@@ -1852,16 +2014,16 @@ static void check_unneeded_dependencies(Unit *u) {
         assert(UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(u)));
 
         /* Garbage collect services that might not be needed anymore, if enabled */
-        SET_FOREACH(other, u->dependencies[UNIT_REQUIRES], i)
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_REQUIRES, i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         unit_check_unneeded(other);
-        SET_FOREACH(other, u->dependencies[UNIT_WANTS], i)
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_WANTS, i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         unit_check_unneeded(other);
-        SET_FOREACH(other, u->dependencies[UNIT_REQUISITE], i)
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_REQUISITE, i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         unit_check_unneeded(other);
-        SET_FOREACH(other, u->dependencies[UNIT_BINDS_TO], i)
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_BINDS_TO, i)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         unit_check_unneeded(other);
 }
@@ -1872,12 +2034,12 @@ void unit_start_on_failure(Unit *u) {
 
         assert(u);
 
-        if (set_size(u->dependencies[UNIT_ON_FAILURE]) <= 0)
+        if (unit_dependency_count(u, UNIT_ON_FAILURE) <= 0)
                 return;
 
         log_unit_info(u, "Triggering OnFailure= dependencies.");
 
-        SET_FOREACH(other, u->dependencies[UNIT_ON_FAILURE], i) {
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_ON_FAILURE, i) {
                 int r;
 
                 r = manager_add_job(u->manager, JOB_START, other, u->on_failure_job_mode, NULL, NULL);
@@ -1892,7 +2054,7 @@ void unit_trigger_notify(Unit *u) {
 
         assert(u);
 
-        SET_FOREACH(other, u->dependencies[UNIT_TRIGGERED_BY], i)
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_TRIGGERED_BY, i)
                 if (UNIT_VTABLE(other)->trigger_notify)
                         UNIT_VTABLE(other)->trigger_notify(other, u);
 }
@@ -2231,39 +2393,154 @@ static void maybe_warn_about_dependency(Unit *u, const char *other, UnitDependen
                 log_unit_warning(u, "Dependency %s=%s dropped, merged into %s", unit_dependency_to_string(dependency), strna(other), u->id);
 }
 
-int unit_add_dependency(Unit *u, UnitDependency d, Unit *other, bool add_reference) {
+static const UnitDependency inverse_table[_UNIT_DEPENDENCY_MAX] = {
+        [UNIT_REQUIRES] = UNIT_REQUIRED_BY,
+        [UNIT_WANTS] = UNIT_WANTED_BY,
+        [UNIT_REQUISITE] = UNIT_REQUISITE_OF,
+        [UNIT_BINDS_TO] = UNIT_BOUND_BY,
+        [UNIT_PART_OF] = UNIT_CONSISTS_OF,
+        [UNIT_REQUIRED_BY] = UNIT_REQUIRES,
+        [UNIT_REQUISITE_OF] = UNIT_REQUISITE,
+        [UNIT_WANTED_BY] = UNIT_WANTS,
+        [UNIT_BOUND_BY] = UNIT_BINDS_TO,
+        [UNIT_CONSISTS_OF] = UNIT_PART_OF,
+        [UNIT_CONFLICTS] = UNIT_CONFLICTED_BY,
+        [UNIT_CONFLICTED_BY] = UNIT_CONFLICTS,
+        [UNIT_BEFORE] = UNIT_AFTER,
+        [UNIT_AFTER] = UNIT_BEFORE,
+        [UNIT_ON_FAILURE] = _UNIT_DEPENDENCY_INVALID,
+        [UNIT_REFERENCES] = UNIT_REFERENCED_BY,
+        [UNIT_REFERENCED_BY] = UNIT_REFERENCES,
+        [UNIT_TRIGGERS] = UNIT_TRIGGERED_BY,
+        [UNIT_TRIGGERED_BY] = UNIT_TRIGGERS,
+        [UNIT_PROPAGATES_RELOAD_TO] = UNIT_RELOAD_PROPAGATED_FROM,
+        [UNIT_RELOAD_PROPAGATED_FROM] = UNIT_PROPAGATES_RELOAD_TO,
+        [UNIT_JOINS_NAMESPACE_OF] = UNIT_JOINS_NAMESPACE_OF,
+};
 
-        static const UnitDependency inverse_table[_UNIT_DEPENDENCY_MAX] = {
-                [UNIT_REQUIRES] = UNIT_REQUIRED_BY,
-                [UNIT_WANTS] = UNIT_WANTED_BY,
-                [UNIT_REQUISITE] = UNIT_REQUISITE_OF,
-                [UNIT_BINDS_TO] = UNIT_BOUND_BY,
-                [UNIT_PART_OF] = UNIT_CONSISTS_OF,
-                [UNIT_REQUIRED_BY] = UNIT_REQUIRES,
-                [UNIT_REQUISITE_OF] = UNIT_REQUISITE,
-                [UNIT_WANTED_BY] = UNIT_WANTS,
-                [UNIT_BOUND_BY] = UNIT_BINDS_TO,
-                [UNIT_CONSISTS_OF] = UNIT_PART_OF,
-                [UNIT_CONFLICTS] = UNIT_CONFLICTED_BY,
-                [UNIT_CONFLICTED_BY] = UNIT_CONFLICTS,
-                [UNIT_BEFORE] = UNIT_AFTER,
-                [UNIT_AFTER] = UNIT_BEFORE,
-                [UNIT_ON_FAILURE] = _UNIT_DEPENDENCY_INVALID,
-                [UNIT_REFERENCES] = UNIT_REFERENCED_BY,
-                [UNIT_REFERENCED_BY] = UNIT_REFERENCES,
-                [UNIT_TRIGGERS] = UNIT_TRIGGERED_BY,
-                [UNIT_TRIGGERED_BY] = UNIT_TRIGGERS,
-                [UNIT_PROPAGATES_RELOAD_TO] = UNIT_RELOAD_PROPAGATED_FROM,
-                [UNIT_RELOAD_PROPAGATED_FROM] = UNIT_PROPAGATES_RELOAD_TO,
-                [UNIT_JOINS_NAMESPACE_OF] = UNIT_JOINS_NAMESPACE_OF,
-        };
-        int r, q = 0, v = 0, w = 0;
-        Unit *orig_u = u, *orig_other = other;
+UnitDependency unit_dependency_inverse(UnitDependency d) {
+        assert(d >= 0 && d < _UNIT_DEPENDENCY_MAX);
+
+        return inverse_table[d];
+}
+
+int unit_remember_loaded_dependency(Unit *u, UnitDependency d, Unit *other) {
+        UnitDependencyEntry *e;
 
         assert(u);
         assert(d >= 0 && d < _UNIT_DEPENDENCY_MAX);
         assert(other);
 
+        e = dependency_table_find(&u->dependencies, other);
+        if (!e)
+                return -ENOENT;
+
+        e->origin |= 1U << d;
+        return 0;
+}
+
+UnitDependencyEntry *unit_dependency_find(Unit *u, Unit *other) {
+        assert(u);
+        assert(other);
+
+        return dependency_table_find(&u->dependencies, other);
+}
+
+bool unit_has_dependency(Unit *u, UnitDependency d, Unit *other) {
+        UnitDependencyEntry *e;
+
+        assert(u);
+        assert(d >= 0 && d < _UNIT_DEPENDENCY_MAX);
+
+        if (!other || !(u->dependencies.mask & (1U << d)))
+                return false;
+
+        e = dependency_table_find(&u->dependencies, other);
+        return e && (e->mask & (1U << d));
+}
+
+unsigned unit_dependency_count(Unit *u, UnitDependency d) {
+        unsigned k, n = 0;
+
+        assert(u);
+        assert(d >= 0 && d < _UNIT_DEPENDENCY_MAX);
+
+        if (!(u->dependencies.mask & (1U << d)))
+                return 0;
+
+        for (k = 0; k < u->dependencies.n_entries; k++)
+                if (u->dependencies.entries[k].mask & (1U << d))
+                        n++;
+
+        return n;
+}
+
+Unit *unit_dependency_first(Unit *u, UnitDependency d) {
+        unsigned k;
+
+        assert(u);
+        assert(d >= 0 && d < _UNIT_DEPENDENCY_MAX);
+
+        if (u->dependencies.mask & (1U << d))
+                for (k = 0; k < u->dependencies.n_entries; k++)
+                        if (u->dependencies.entries[k].mask & (1U << d))
+                                return u->dependencies.entries[k].other;
+
+        return NULL;
+}
+
+bool unit_dependency_iterate(Unit *u, UnitDependency d, Iterator *i, Unit **ret) {
+        unsigned k;
+
+        assert(u);
+        assert(d >= 0 && d < _UNIT_DEPENDENCY_MAX);
+        assert(i);
+        assert(ret);
+
+        /* The iterator's index is simply the position in the entry array here. Entries added while iterating
+         * are visited too. No entries may be removed while iterating, not even the current one: removal moves
+         * the last entry into the hole, which would then be skipped. */
+
+        k = i->idx == _IDX_ITERATOR_FIRST ? 0 : i->idx;
+
+        if (u->dependencies.mask & (1U << d))
+                for (; k < u->dependencies.n_entries; k++)
+                        if (u->dependencies.entries[k].mask & (1U << d)) {
+                                *ret = u->dependencies.entries[k].other;
+                                i->idx = k + 1;
+                                return true;
+                        }
+
+        *ret = NULL;
+        i->idx = u->dependencies.n_entries;
+        return false;
+}
+
+size_t unit_dependency_memory(Unit *u) {
+        size_t n = sizeof(UnitDependencyTable);
+
+        assert(u);
+
+        /* Only counts the entry array, not the index */
+
+        if (u->dependencies.entries != u->dependencies.inline_entries)
+                n += u->dependencies.n_allocated * sizeof(UnitDependencyEntry);
+
+        return n;
+}
+
+int unit_add_dependency(Unit *u, UnitDependency d, Unit *other, bool add_reference) {
+        UnitDependencyEntry *a, *b;
+        uint32_t mask, inverse_mask = 0;
+        Unit *orig_u = u, *orig_other = other, *loading;
+        int r;
+
+        assert(u);
+        assert(d >= 0 && d < _UNIT_DEPENDENCY_MAX);
+        assert(other);
+
+        assert_cc(_UNIT_DEPENDENCY_MAX <= sizeof(uint32_t) * 8);
+
         u = unit_follow_merge(u);
         other = unit_follow_merge(other);
 
@@ -2279,64 +2556,46 @@ int unit_add_dependency(Unit *u, UnitDependency d, Unit *other, bool add_referen
                 return 0;
         }
 
-        r = set_ensure_allocated(&u->dependencies[d], NULL);
-        if (r < 0)
-                return r;
+        mask = 1U << d;
+        if (inverse_table[d] != _UNIT_DEPENDENCY_INVALID && inverse_table[d] != d)
+                inverse_mask = 1U << inverse_table[d];
 
-        if (inverse_table[d] != _UNIT_DEPENDENCY_INVALID) {
-                r = set_ensure_allocated(&other->dependencies[inverse_table[d]], NULL);
-                if (r < 0)
-                        return r;
+        if (add_reference) {
+                mask |= 1U << UNIT_REFERENCES;
+                inverse_mask |= 1U << UNIT_REFERENCED_BY;
         }
 
-        if (add_reference) {
-                r = set_ensure_allocated(&u->dependencies[UNIT_REFERENCES], NULL);
-                if (r < 0)
-                        return r;
+        /* Entries are symmetric, hence make sure both exist before changing anything */
+        r = dependency_table_add(&u->dependencies, other, &a);
+        if (r < 0)
+                return r;
 
-                r = set_ensure_allocated(&other->dependencies[UNIT_REFERENCED_BY], NULL);
-                if (r < 0)
-                        return r;
+        if (dependency_table_add(&other->dependencies, u, &b) < 0) {
+                if (r > 0)
+                        dependency_table_remove(&u->dependencies, other);
+
+                return -ENOMEM;
         }
 
-        q = set_put(u->dependencies[d], other);
-        if (q < 0)
-                return q;
+        a->mask |= mask;
+        u->dependencies.mask |= mask;
 
-        if (inverse_table[d] != _UNIT_DEPENDENCY_INVALID && inverse_table[d] != d) {
-                v = set_put(other->dependencies[inverse_table[d]], u);
-                if (v < 0) {
-                        r = v;
-                        goto fail;
-                }
-        }
+        b->mask |= inverse_mask;
+        other->dependencies.mask |= inverse_mask;
 
-        if (add_reference) {
-                w = set_put(u->dependencies[UNIT_REFERENCES], other);
-                if (w < 0) {
-                        r = w;
-                        goto fail;
-                }
+        /* If either side of the new dependency is the unit that is currently being loaded, remember that it was
+         * this unit which added the dependency, so that it is dropped again when the unit is reloaded in place */
+        if (u->manager->loading_unit) {
+                loading = unit_follow_merge(u->manager->loading_unit);
 
-                r = set_put(other->dependencies[UNIT_REFERENCED_BY], u);
-                if (r < 0)
-                        goto fail;
+                if (loading == u)
+                        a->origin |= mask;
+                else if (loading == other)
+                        b->origin |= inverse_mask;
         }
 
         unit_add_to_dbus_queue(u);
         return 0;
-
-fail:
-        if (q > 0)
-                set_remove(u->dependencies[d], other);
-
-        if (v > 0)
-                set_remove(other->dependencies[inverse_table[d]], u);
-
-        if (w > 0)
-                set_remove(u->dependencies[UNIT_REFERENCES], other);
-
-        return r;
 }
 
 int unit_add_two_dependencies(Unit *u, UnitDependency d, UnitDependency e, Unit *other, bool add_reference) {
@@ -2645,7 +2904,28 @@ bool unit_can_serialize(Unit *u) {
         return UNIT_VTABLE(u)->serialize && UNIT_VTABLE(u)->deserialize_item;
 }
 
-int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs) {
+/* Generic unit state as stored in the binary serialization format, see manager_serialize(). It is followed by the
+ * type-specific state in the usual key=value form. Host byte order, as it is only read back on the same machine. */
+typedef struct UnitSerializedState {
+        dual_timestamp state_change_timestamp;
+        dual_timestamp inactive_exit_timestamp;
+        dual_timestamp active_enter_timestamp;
+        dual_timestamp active_exit_timestamp;
+        dual_timestamp inactive_enter_timestamp;
+        dual_timestamp condition_timestamp;
+        dual_timestamp assert_timestamp;
+        nsec_t cpu_usage_base;
+        nsec_t cpu_usage_last;
+        sd_id128_t invocation_id;
+        uint32_t ref_uid;
+        uint32_t ref_gid;
+        uint8_t condition_result;
+        uint8_t assert_result;
+        uint8_t transient;
+        uint8_t cgroup_realized;
+} UnitSerializedState;
+
+static int unit_serialize_internal(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs, bool generic_state) {
         int r;
 
         assert(u);
@@ -2667,6 +2947,9 @@ int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs) {
                 }
         }
 
+        if (!generic_state)
+                goto refs;
+
         dual_timestamp_serialize(f, "state-change-timestamp", &u->state_change_timestamp);
 
         dual_timestamp_serialize(f, "inactive-exit-timestamp", &u->inactive_exit_timestamp);
@@ -2689,8 +2972,6 @@ int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs) {
         if (u->cpu_usage_last != NSEC_INFINITY)
                 unit_serialize_item_format(u, f, "cpu-usage-last", "%" PRIu64, u->cpu_usage_last);
 
-        if (u->cgroup_path)
-                unit_serialize_item(u, f, "cgroup", u->cgroup_path);
         unit_serialize_item(u, f, "cgroup-realized", yes_no(u->cgroup_realized));
 
         if (uid_is_valid(u->ref_uid))
@@ -2701,6 +2982,10 @@ int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs) {
         if (!sd_id128_is_null(u->invocation_id))
                 unit_serialize_item_format(u, f, "invocation-id", SD_ID128_FORMAT_STR, SD_ID128_FORMAT_VAL(u->invocation_id));
 
+refs:
+        if (u->cgroup_path)
+                unit_serialize_item(u, f, "cgroup", u->cgroup_path);
+
         bus_track_serialize(u->bus_track, f, "ref");
 
         if (serialize_jobs) {
@@ -2720,6 +3005,39 @@ int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs) {
         return 0;
 }
 
+int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs) {
+        return unit_serialize_internal(u, f, fds, serialize_jobs, true);
+}
+
+int unit_serialize_binary(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs) {
+        UnitSerializedState s = {
+                .state_change_timestamp = u->state_change_timestamp,
+                .inactive_exit_timestamp = u->inactive_exit_timestamp,
+                .active_enter_timestamp = u->active_enter_timestamp,
+                .active_exit_timestamp = u->active_exit_timestamp,
+                .inactive_enter_timestamp = u->inactive_enter_timestamp,
+                .condition_timestamp = u->condition_timestamp,
+                .assert_timestamp = u->assert_timestamp,
+                .cpu_usage_base = u->cpu_usage_base,
+                .cpu_usage_last = u->cpu_usage_last,
+                .invocation_id = u->invocation_id,
+                .ref_uid = u->ref_uid,
+                .ref_gid = u->ref_gid,
+                .condition_result = u->condition_result,
+                .assert_result = u->assert_result,
+                .transient = u->transient,
+                .cgroup_realized = u->cgroup_realized,
+        };
+
+        assert(u);
+        assert(f);
+
+        if (fwrite(&s, sizeof(s), 1, f) != 1)
+                return -EIO;
+
+        return unit_serialize_internal(u, f, fds, serialize_jobs, false);
+}
+
 int unit_serialize_item(Unit *u, FILE *f, const char *key, const char *value) {
         assert(u);
         assert(f);
@@ -3020,6 +3338,52 @@ int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
         return 0;
 }
 
+int unit_deserialize_binary(Unit *u, FILE *f, FDSet *fds, uint32_t version) {
+        UnitSerializedState s;
+        int r;
+
+        assert(u);
+        assert(f);
+
+        /* Every version of the serialization format that changes UnitSerializedState gets its own case here,
+         * converting the older layouts to the current one. */
+        switch (version) {
+
+        case 1:
+                if (fread(&s, sizeof(s), 1, f) != 1)
+                        return ferror(f) ? -EIO : -EBADMSG;
+                break;
+
+        default:
+                return -EPROTONOSUPPORT;
+        }
+
+        u->state_change_timestamp = s.state_change_timestamp;
+        u->inactive_exit_timestamp = s.inactive_exit_timestamp;
+        u->active_enter_timestamp = s.active_enter_timestamp;
+        u->active_exit_timestamp = s.active_exit_timestamp;
+        u->inactive_enter_timestamp = s.inactive_enter_timestamp;
+        u->condition_timestamp = s.condition_timestamp;
+        u->assert_timestamp = s.assert_timestamp;
+        u->cpu_usage_base = s.cpu_usage_base;
+        u->cpu_usage_last = s.cpu_usage_last;
+        u->condition_result = s.condition_result;
+        u->assert_result = s.assert_result;
+        u->transient = s.transient;
+        u->cgroup_realized = s.cgroup_realized;
+
+        if (uid_is_valid(s.ref_uid) || gid_is_valid(s.ref_gid))
+                (void) unit_ref_uid_gid(u, s.ref_uid, s.ref_gid);
+
+        if (!sd_id128_is_null(s.invocation_id)) {
+                r = unit_set_invocation_id(u, s.invocation_id);
+                if (r < 0)
+                        log_unit_warning_errno(u, r, "Failed to set invocation ID for unit: %m");
+        }
+
+        return unit_deserialize(u, f, fds);
+}
+
 int unit_add_node_link(Unit *u, const char *what, bool wants, UnitDependency dep) {
         Unit *device;
         _cleanup_free_ char *e = NULL;
@@ -3144,6 +3508,65 @@ bool unit_need_daemon_reload(Unit *u) {
         return false;
 }
 
+static bool unit_dependency_dirs_changed(Unit *u) {
+        _cleanup_strv_free_ char **t = NULL;
+        char **path;
+
+        assert(u);
+
+        /* Checks whether symlinks were added to or removed from any of our .wants/ or .requires/ directories, for
+         * example by "systemctl enable". */
+
+        (void) unit_find_dependency_dirs(u, &t);
+        if (!strv_equal(u->dependency_dirs, t))
+                return true;
+
+        STRV_FOREACH(path, u->dependency_dirs)
+                if (fragment_mtime_newer(*path, u->dropin_mtime, false))
+                        return true;
+
+        return false;
+}
+
+bool unit_need_reload_in_place(Unit *u) {
+        assert(u);
+
+        /* Returns true if an incremental reload needs to load this unit again */
+
+        if (u->load_state == UNIT_MERGED)
+                return false;
+
+        /* Units that failed to load are cheap to load again, and their unit files might have shown up in the
+         * meantime. */
+        if (IN_SET(u->load_state, UNIT_NOT_FOUND, UNIT_ERROR))
+                return true;
+
+        return unit_need_daemon_reload(u) || unit_dependency_dirs_changed(u);
+}
+
+bool unit_can_reload_in_place(Unit *u) {
+        assert(u);
+
+        /* Units whose state is not fully described by their unit files plus their serialized state (for example
+         * mount, swap and device units, which pick up their state from the kernel), and units that are busy with
+         * a job, can only be reloaded by a full reload. */
+
+        if (!IN_SET(u->type, UNIT_SERVICE, UNIT_SOCKET, UNIT_TARGET, UNIT_TIMER, UNIT_PATH, UNIT_SLICE))
+                return false;
+
+        if (u->job || u->nop_job)
+                return false;
+
+        if (u->transient || u->perpetual)
+                return false;
+
+        /* Aliases would need to be taken apart and merged again */
+        if (set_size(u->names) > 1)
+                return false;
+
+        return true;
+}
+
 void unit_reset_failed(Unit *u) {
         assert(u);
 
@@ -3693,6 +4116,7 @@ int unit_make_transient(Unit *u) {
 
         u->source_path = mfree(u->source_path);
         u->dropin_paths = strv_free(u->dropin_paths);
+        u->dependency_dirs = strv_free(u->dependency_dirs);
         u->fragment_mtime = u->source_mtime = u->dropin_mtime = 0;
 
         u->load_state = UNIT_STUB;
@@ -3960,7 +4384,7 @@ int unit_setup_exec_runtime(Unit *u) {
                 return 0;
 
         /* Try to get it from somebody else */
-        SET_FOREACH(other, u->dependencies[UNIT_JOINS_NAMESPACE_OF], i) {
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_JOINS_NAMESPACE_OF, i) {
 
                 *rt = unit_get_exec_runtime(other);
                 if (*rt) {
@@ -70,6 +70,31 @@ struct UnitRef {
         LIST_FIELDS(UnitRef, refs);
 };
 
+/* All dependencies of a unit are kept in a single table, with one entry per unit depended on, covering all dependency
+ * types at once. Entries are symmetric: if a unit has an entry for another unit, the other unit has one for it, too,
+ * even if it carries no dependency types (e.g. for OnFailure=, which has no inverse). */
+typedef struct UnitDependencyEntry {
+        Unit *other;
+        uint32_t mask;          /* The UnitDependency types on the other unit, one bit each */
+        uint32_t origin;        /* The subset of those this unit added itself while it was loaded, i.e. those from
+                                 * its unit file, drop-ins and implicit/default dependencies. This is used to figure
+                                 * out which dependencies to drop when a unit is reloaded in place. */
+} UnitDependencyEntry;
+
+/* Most units only have a handful of dependencies, those are stored inline. Tables with UNIT_DEPENDENCY_INDEX_MIN or
+ * more entries get a hashmap index for lookups by unit. */
+#define UNIT_DEPENDENCY_INLINE 4
+#define UNIT_DEPENDENCY_INDEX_MIN 16
+
+typedef struct UnitDependencyTable {
+        UnitDependencyEntry *entries;   /* Points to inline_entries until the table outgrows it */
+        unsigned n_entries;
+        unsigned n_allocated;
+        uint32_t mask;                  /* All types of all entries; might be a superset after removals */
+        Hashmap *index;                 /* Unit → position in entries + 1 */
+        UnitDependencyEntry inline_entries[UNIT_DEPENDENCY_INLINE];
+} UnitDependencyTable;
+
 struct Unit {
         Manager *manager;
 
@@ -81,7 +106,7 @@ struct Unit {
         char *instance;
 
         Set *names;
-        Set *dependencies[_UNIT_DEPENDENCY_MAX];
+        UnitDependencyTable dependencies;
 
         char **requires_mounts_for;
 
@@ -91,6 +116,7 @@ struct Unit {
         char *fragment_path; /* if loaded from a config file this is the primary path to it */
         char *source_path; /* if converted, the source file */
         char **dropin_paths;
+        char **dependency_dirs; /* .wants/ and .requires/ directories we found when loading */
 
         usec_t fragment_mtime;
         usec_t source_mtime;
@@ -159,6 +185,9 @@ struct Unit {
         /* CGroup realize members queue */
         LIST_FIELDS(Unit, cgroup_queue);
 
+        /* CGroup empty check queue */
+        LIST_FIELDS(Unit, cgroup_empty_queue);
+
         /* Units with the same CGroup netclass */
         LIST_FIELDS(Unit, cgroup_netclass);
 
@@ -167,9 +196,6 @@ struct Unit {
          * process SIGCHLD for */
         Set *pids;
 
-        /* Used in sigchld event invocation to avoid repeat events being invoked */
-        uint64_t sigchldgen;
-
         /* Used during GC sweeps */
         unsigned gc_marker;
 
@@ -196,6 +222,12 @@ struct Unit {
         nsec_t cpu_usage_base;
         nsec_t cpu_usage_last; /* the most recently read value */
 
+        /* How long exec_spawn() took for the processes forked off for this unit */
+        usec_t spawn_latency_last;
+        usec_t spawn_latency_max;
+        usec_t spawn_latency_total;
+        unsigned n_spawned;
+
         /* Counterparts in the cgroup filesystem */
         char *cgroup_path;
         CGroupMask cgroup_realized_mask;
@@ -204,6 +236,12 @@ struct Unit {
         CGroupMask cgroup_members_mask;
         int cgroup_inotify_wd;
 
+        /* The values we last wrote to the cgroup's attribute files */
+        Hashmap *cgroup_attributes;
+
+        /* Recent resource usage, if the manager's sampler is enabled */
+        struct CGroupResourceSamples *resource_samples;
+
         /* How to start OnFailure units */
         JobMode on_failure_job_mode;
 
@@ -244,9 +282,13 @@ struct Unit {
         bool in_cleanup_queue:1;
         bool in_gc_queue:1;
         bool in_cgroup_queue:1;
+        bool in_cgroup_empty_queue:1;
 
         bool sent_dbus_new_signal:1;
 
+        /* Freed by an incremental reload, which creates the unit again right away */
+        bool reloading_in_place:1;
+
         bool in_audit:1;
 
         bool cgroup_realized:1;
@@ -388,6 +430,9 @@ struct UnitVTable {
         /* Called whenever a process of this unit sends us a message */
         void (*notify_message)(Unit *u, pid_t pid, char **tags, FDSet *fds);
 
+        /* Called instead of notify_message() for messages consisting of WATCHDOG=1 only */
+        void (*notify_watchdog)(Unit *u, pid_t pid);
+
         /* Called whenever a name this Unit registered for comes or goes away. */
         void (*bus_name_owner_change)(Unit *u, const char *name, const char *old_owner, const char *new_owner);
 
@@ -466,7 +511,7 @@ extern const UnitVTable * const unit_vtable[_UNIT_TYPE_MAX];
 #define UNIT_HAS_CGROUP_CONTEXT(u) (UNIT_VTABLE(u)->cgroup_context_offset > 0)
 #define UNIT_HAS_KILL_CONTEXT(u) (UNIT_VTABLE(u)->kill_context_offset > 0)
 
-#define UNIT_TRIGGER(u) ((Unit*) set_first((u)->dependencies[UNIT_TRIGGERS]))
+#define UNIT_TRIGGER(u) unit_dependency_first((u), UNIT_TRIGGERS)
 
 DEFINE_CAST(SERVICE, Service);
 DEFINE_CAST(SOCKET, Socket);
@@ -488,6 +533,19 @@ int unit_new_for_name(Manager *m, size_t size, const char *name, Unit **ret);
 int unit_add_name(Unit *u, const char *name);
 
 int unit_add_dependency(Unit *u, UnitDependency d, Unit *other, bool add_reference);
+int unit_remember_loaded_dependency(Unit *u, UnitDependency d, Unit *other);
+UnitDependency unit_dependency_inverse(UnitDependency d) _const_;
+
+UnitDependencyEntry *unit_dependency_find(Unit *u, Unit *other);
+bool unit_has_dependency(Unit *u, UnitDependency d, Unit *other);
+unsigned unit_dependency_count(Unit *u, UnitDependency d);
+Unit *unit_dependency_first(Unit *u, UnitDependency d);
+bool unit_dependency_iterate(Unit *u, UnitDependency d, Iterator *i, Unit **ret);
+size_t unit_dependency_memory(Unit *u);
+
+/* Must not remove dependencies of u while iterating, see unit_dependency_iterate() */
+#define UNIT_FOREACH_DEPENDENCY(other, u, d, i)                         \
+        for ((i) = ITERATOR_FIRST; unit_dependency_iterate((u), (d), &(i), &(other)); )
 int unit_add_two_dependencies(Unit *u, UnitDependency d, UnitDependency e, Unit *other, bool add_reference);
 
 int unit_add_dependency_by_name(Unit *u, UnitDependency d, const char *name, const char *filename, bool add_reference);
@@ -564,6 +622,8 @@ bool unit_can_serialize(Unit *u) _pure_;
 
 int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs);
 int unit_deserialize(Unit *u, FILE *f, FDSet *fds);
+int unit_serialize_binary(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs);
+int unit_deserialize_binary(Unit *u, FILE *f, FDSet *fds, uint32_t version);
 
 int unit_serialize_item(Unit *u, FILE *f, const char *key, const char *value);
 int unit_serialize_item_escaped(Unit *u, FILE *f, const char *key, const char *value);
@@ -578,6 +638,8 @@ void unit_status_printf(Unit *u, const char *status, const char *unit_status_msg
 void unit_status_emit_starting_stopping_reloading(Unit *u, JobType t);
 
 bool unit_need_daemon_reload(Unit *u);
+bool unit_need_reload_in_place(Unit *u);
+bool unit_can_reload_in_place(Unit *u);
 
 void unit_reset_failed(Unit *u);
 
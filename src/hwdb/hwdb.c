@@ -35,6 +35,7 @@
 #include "strbuf.h"
 #include "string-util.h"
 #include "strv.h"
+#include "time-util.h"
 #include "util.h"
 #include "verbs.h"
 
@@ -60,6 +61,9 @@ struct trie {
         size_t nodes_count;
         size_t children_count;
         size_t values_count;
+
+        /* time spent inserting into the trie, while the files are parsed */
+        usec_t build_usec;
 };
 
 struct trie_node {
@@ -328,11 +332,20 @@ static void trie_store_nodes_size(struct trie_f *trie, struct trie_node *node) {
                 trie->strings_off += sizeof(struct trie_value_entry2_f);
 }
 
+/* lets lookups skip searching for glob children, which most nodes do not have */
+static uint8_t trie_node_flags(const struct trie_node *node) {
+        if (node_lookup(node, '*') || node_lookup(node, '?') || node_lookup(node, '['))
+                return TRIE_NODE_GLOB_CHILD;
+
+        return 0;
+}
+
 static int64_t trie_store_nodes(struct trie_f *trie, struct trie_node *node) {
         uint64_t i;
         struct trie_node_f n = {
                 .prefix_off = htole64(trie->strings_off + node->prefix_off),
                 .children_count = node->children_count,
+                .flags = trie_node_flags(node),
                 .values_count = htole64(node->values_count),
         };
         struct trie_child_entry_f *children = NULL;
@@ -385,7 +398,7 @@ static int64_t trie_store_nodes(struct trie_f *trie, struct trie_node *node) {
         return node_off;
 }
 
-static int trie_store(struct trie *trie, const char *filename) {
+static int trie_store(struct trie *trie, const char *filename, uint64_t sources_hash) {
         struct trie_f t = {
                 .trie = trie,
         };
@@ -400,6 +413,8 @@ static int trie_store(struct trie *trie, const char *filename) {
                 .node_size = htole64(sizeof(struct trie_node_f)),
                 .child_entry_size = htole64(sizeof(struct trie_child_entry_f)),
                 .value_entry_size = htole64(sizeof(struct trie_value_entry2_f)),
+                .flags = htole64(HWDB_NODE_FLAGS),
+                .sources_hash = htole64(sources_hash),
         };
         int err;
 
@@ -465,6 +480,7 @@ static int trie_store(struct trie *trie, const char *filename) {
 static int insert_data(struct trie *trie, char **match_list, char *line,
                        const char *filename, size_t line_number) {
         char *value, **entry;
+        usec_t start;
 
         value = strchr(line, '=');
         if (!value) {
@@ -484,8 +500,10 @@ static int insert_data(struct trie *trie, char **match_list, char *line,
                 return -EINVAL;
         }
 
+        start = now(CLOCK_MONOTONIC);
         STRV_FOREACH(entry, match_list)
                 trie_insert(trie, trie->root, *entry, line, value, filename, line_number);
+        trie->build_usec += now(CLOCK_MONOTONIC) - start;
 
         return 0;
 }
@@ -624,9 +642,17 @@ static int hwdb_query(int argc, char *argv[], void *userdata) {
 static int hwdb_update(int argc, char *argv[], void *userdata) {
         _cleanup_free_ char *hwdb_bin = NULL;
         _cleanup_(trie_freep) struct trie *trie = NULL;
-        char **files, **f;
+        _cleanup_strv_free_ char **files = NULL;
+        char ts1[FORMAT_TIMESPAN_MAX], ts2[FORMAT_TIMESPAN_MAX], ts3[FORMAT_TIMESPAN_MAX];
+        usec_t start, parse_usec, build_usec;
+        uint64_t sources_hash;
+        char **f;
         int r;
 
+        hwdb_bin = strjoin(arg_root, "/", arg_hwdb_bin_dir, "/hwdb.bin");
+        if (!hwdb_bin)
+                return -ENOMEM;
+
         trie = new0(struct trie, 1);
         if (!trie)
                 return -ENOMEM;
@@ -647,14 +673,27 @@ static int hwdb_update(int argc, char *argv[], void *userdata) {
         if (r < 0)
                 return log_error_errno(r, "failed to enumerate hwdb files: %m");
 
+        /* compiling the same files again would write the same database */
+        r = hwdb_sources_hash(files, sizeof(struct trie_value_entry2_f), &sources_hash);
+        if (r < 0)
+                return log_error_errno(r, "Failed to read hwdb files: %m");
+        if (hwdb_bin_up_to_date(hwdb_bin, sources_hash)) {
+                log_info("%s is up to date.", hwdb_bin);
+                return 0;
+        }
+
+        start = now(CLOCK_MONOTONIC);
+
         STRV_FOREACH(f, files) {
                 log_debug("reading file '%s'", *f);
                 import_file(trie, *f);
         }
-        strv_free(files);
 
         strbuf_complete(trie->strings);
 
+        build_usec = trie->build_usec;
+        parse_usec = now(CLOCK_MONOTONIC) - start - build_usec;
+
         log_debug("=== trie in-memory ===");
         log_debug("nodes:            %8zu bytes (%8zu)",
                   trie->nodes_count * sizeof(struct trie_node), trie->nodes_count);
@@ -669,15 +708,19 @@ static int hwdb_update(int argc, char *argv[], void *userdata) {
         log_debug("strings dedup'ed: %8zu bytes (%8zu)",
                   trie->strings->dedup_len, trie->strings->dedup_count);
 
-        hwdb_bin = strjoin(arg_root, "/", arg_hwdb_bin_dir, "/hwdb.bin");
-        if (!hwdb_bin)
-                return -ENOMEM;
+        start = now(CLOCK_MONOTONIC);
 
         mkdir_parents_label(hwdb_bin, 0755);
-        r = trie_store(trie, hwdb_bin);
+        r = trie_store(trie, hwdb_bin, sources_hash);
         if (r < 0)
                 return log_error_errno(r, "Failure writing database %s: %m", hwdb_bin);
 
+        log_info("Compiled %u files into %s: parsing took %s, building %s, writing %s.",
+                 strv_length(files), hwdb_bin,
+                 format_timespan(ts1, sizeof(ts1), parse_usec, USEC_PER_MSEC),
+                 format_timespan(ts2, sizeof(ts2), build_usec, USEC_PER_MSEC),
+                 format_timespan(ts3, sizeof(ts3), now(CLOCK_MONOTONIC) - start, USEC_PER_MSEC));
+
         return label_fix(hwdb_bin, false, false);
 }
 
@@ -446,7 +446,6 @@ static int invoke_property_get(
         int r;
 
         assert(bus);
-        assert(slot);
         assert(v);
         assert(path);
         assert(interface);
@@ -771,6 +770,77 @@ static int vtable_append_all_properties(
         return 1;
 }
 
+int bus_vtable_append_properties(
+                sd_bus *bus,
+                sd_bus_message *reply,
+                const char *path,
+                const char *interface,
+                const sd_bus_vtable *vtable,
+                void *userdata,
+                char **properties,
+                sd_bus_error *error) {
+
+        const sd_bus_vtable *v;
+        void *current_userdata;
+        sd_bus_slot *slot;
+        int r;
+
+        assert(bus);
+        assert(reply);
+        assert(path);
+        assert(interface);
+        assert(vtable);
+
+        /* Appends the properties of a vtable as {sv} dict entries to an already opened array, like GetAll()
+         * would, but without going through an object lookup. If a list of properties is passed only those
+         * are appended, including hidden and explicit ones. */
+
+        if (strv_isempty(properties) && (vtable[0].flags & SD_BUS_VTABLE_HIDDEN))
+                return 0;
+
+        for (v = vtable+1; v->type != _SD_BUS_VTABLE_END; v++) {
+                if (v->type != _SD_BUS_VTABLE_PROPERTY && v->type != _SD_BUS_VTABLE_WRITABLE_PROPERTY)
+                        continue;
+
+                if (strv_isempty(properties)) {
+                        if (v->flags & (SD_BUS_VTABLE_HIDDEN|SD_BUS_VTABLE_PROPERTY_EXPLICIT))
+                                continue;
+                } else if (!strv_contains(properties, v->x.property.member))
+                        continue;
+
+                r = sd_bus_message_open_container(reply, 'e', "sv");
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_append(reply, "s", v->x.property.member);
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_open_container(reply, 'v', v->x.property.signature);
+                if (r < 0)
+                        return r;
+
+                /* We are usually called from a method handler, hence keep its slot current */
+                slot = bus->current_slot;
+                current_userdata = bus->current_userdata;
+                r = invoke_property_get(bus, NULL, v, path, interface, v->x.property.member, reply, vtable_property_convert_userdata(v, userdata), error);
+                bus->current_slot = slot;
+                bus->current_userdata = current_userdata;
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_close_container(reply);
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_close_container(reply);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
 static int property_get_all_callbacks_run(
                 sd_bus *bus,
                 sd_bus_message *m,
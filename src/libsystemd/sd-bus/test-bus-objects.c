@@ -26,6 +26,7 @@
 #include "bus-dump.h"
 #include "bus-internal.h"
 #include "bus-message.h"
+#include "bus-objects.h"
 #include "bus-util.h"
 #include "log.h"
 #include "macro.h"
@@ -237,6 +238,27 @@ static int enumerator2_callback(sd_bus *bus, const char *path, void *userdata, c
         return 1;
 }
 
+static void test_append_properties(sd_bus *bus, struct context *c) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        const char *s;
+        uint32_t u;
+
+        assert_se(sd_bus_message_new_signal(bus, &m, "/foo", "org.freedesktop.systemd.test", "Properties") >= 0);
+        assert_se(sd_bus_message_open_container(m, 'a', "{sv}") >= 0);
+        assert_se(bus_vtable_append_properties(bus, m, "/foo", "org.freedesktop.systemd.test", vtable, c,
+                                               STRV_MAKE("AutomaticIntegerProperty", "AutomaticStringProperty"), NULL) >= 0);
+        assert_se(sd_bus_message_close_container(m) >= 0);
+        assert_se(bus_message_seal(m, 1, 0) >= 0);
+
+        /* Only what we asked for, in vtable order */
+        assert_se(sd_bus_message_read(m, "a{sv}", 2,
+                                      "AutomaticStringProperty", "s", &s,
+                                      "AutomaticIntegerProperty", "u", &u) >= 0);
+        assert_se(streq(s, "dudeldu"));
+        assert_se(u == 4711);
+        assert_se(sd_bus_message_at_end(m, true) > 0);
+}
+
 static void *server(void *p) {
         struct context *c = p;
         sd_bus *bus = NULL;
@@ -261,6 +283,8 @@ static void *server(void *p) {
 
         assert_se(sd_bus_start(bus) >= 0);
 
+        test_append_properties(bus, c);
+
         log_error("Entering event loop on server");
 
         while (!c->quit) {
@@ -0,0 +1,612 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "device-database.h"
+#include "dirent-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "string-util.h"
+#include "time-util.h"
+#include "util.h"
+
+/*
+ * A snapshot of the udev database in /run/udev/data and /run/udev/tags, in a single file which
+ * can be mapped, instead of one file per device and tag. udevd writes it when its queue is empty,
+ * and every change to the database removes it, so if it exists, it is current.
+ *
+ * The records are sorted by device id, the tags by name, and the device ids of every tag are
+ * sorted too. All offsets are relative to the start of the file, which is only read on the
+ * machine which wrote it, so everything is in native byte order.
+ */
+
+#define DEVICE_DATABASE_SIG { 'U', 'D', 'E', 'V', 'D', 'B', '\0', '\1' }
+
+struct device_database_header {
+        uint8_t signature[8];
+        uint64_t header_size;
+        uint64_t file_size;
+
+        uint64_t records_off;
+        uint64_t n_records;
+        uint64_t tags_off;
+        uint64_t n_tags;
+};
+
+struct device_database_record {
+        /* the device id, and the contents of its file in /run/udev/data */
+        uint64_t id_off;
+        uint64_t data_off;
+        uint64_t data_size;
+};
+
+struct device_database_tag {
+        uint64_t name_off;
+        /* array of the offsets of the ids of the tagged devices */
+        uint64_t ids_off;
+        uint64_t n_ids;
+};
+
+struct DeviceDatabase {
+        unsigned n_ref;
+        struct stat st;
+        union {
+                const struct device_database_header *header;
+                const char *map;
+        };
+};
+
+/* the snapshot the last lookup of this thread used, checked against the file system every time */
+static thread_local DeviceDatabase *current = NULL;
+
+DeviceDatabase *device_database_ref(DeviceDatabase *db) {
+        if (!db)
+                return NULL;
+
+        assert(db->n_ref > 0);
+        db->n_ref++;
+
+        return db;
+}
+
+DeviceDatabase *device_database_unref(DeviceDatabase *db) {
+        if (!db)
+                return NULL;
+
+        assert(db->n_ref > 0);
+        db->n_ref--;
+        if (db->n_ref > 0)
+                return NULL;
+
+        if (db->map)
+                (void) munmap((void *) db->map, db->st.st_size);
+
+        return mfree(db);
+}
+
+static bool range_valid(DeviceDatabase *db, uint64_t offset, uint64_t n, size_t size) {
+        return offset <= (uint64_t) db->st.st_size &&
+               n <= ((uint64_t) db->st.st_size - offset) / size;
+}
+
+int device_database_open(const char *path, DeviceDatabase **ret) {
+        _cleanup_(device_database_unrefp) DeviceDatabase *db = NULL;
+        _cleanup_close_ int fd = -1;
+        const uint8_t sig[] = DEVICE_DATABASE_SIG;
+        const struct device_database_header *h;
+        void *map;
+
+        assert(path);
+        assert(ret);
+
+        fd = open(path, O_RDONLY|O_CLOEXEC);
+        if (fd < 0)
+                return -errno;
+
+        db = new0(DeviceDatabase, 1);
+        if (!db)
+                return -ENOMEM;
+
+        db->n_ref = 1;
+
+        if (fstat(fd, &db->st) < 0)
+                return -errno;
+
+        if ((size_t) db->st.st_size < sizeof(struct device_database_header))
+                return -EBADMSG;
+
+        map = mmap(NULL, db->st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED)
+                return -errno;
+        db->map = map;
+
+        h = db->header;
+        if (memcmp(h->signature, sig, sizeof(h->signature)) != 0 ||
+            h->header_size < sizeof(struct device_database_header) ||
+            h->file_size != (uint64_t) db->st.st_size ||
+            !range_valid(db, h->records_off, h->n_records, sizeof(struct device_database_record)) ||
+            !range_valid(db, h->tags_off, h->n_tags, sizeof(struct device_database_tag)))
+                return -EBADMSG;
+
+        *ret = db;
+        db = NULL;
+
+        return 0;
+}
+
+const char *device_database_string(DeviceDatabase *db, uint64_t offset) {
+        assert(db);
+
+        return db->map + offset;
+}
+
+static const struct device_database_record *record_get(DeviceDatabase *db, size_t i) {
+        return (const struct device_database_record *) (db->map + db->header->records_off) + i;
+}
+
+static const struct device_database_tag *tag_get(DeviceDatabase *db, size_t i) {
+        return (const struct device_database_tag *) (db->map + db->header->tags_off) + i;
+}
+
+int device_database_get(DeviceDatabase *db, const char *id, const char **ret_data, size_t *ret_size) {
+        size_t lower = 0, upper;
+
+        assert(db);
+        assert(id);
+        assert(ret_data);
+        assert(ret_size);
+
+        upper = db->header->n_records;
+        while (lower < upper) {
+                const struct device_database_record *r;
+                size_t i = (lower + upper) / 2;
+                int c;
+
+                r = record_get(db, i);
+                c = strcmp(id, device_database_string(db, r->id_off));
+                if (c < 0)
+                        upper = i;
+                else if (c > 0)
+                        lower = i + 1;
+                else {
+                        if (!range_valid(db, r->data_off, r->data_size, 1))
+                                return -EBADMSG;
+
+                        *ret_data = db->map + r->data_off;
+                        *ret_size = r->data_size;
+                        return 0;
+                }
+        }
+
+        return -ENOENT;
+}
+
+int device_database_get_tag(DeviceDatabase *db, const char *tag, const uint64_t **ret_ids, size_t *ret_n_ids) {
+        size_t lower = 0, upper;
+
+        assert(db);
+        assert(tag);
+        assert(ret_ids);
+        assert(ret_n_ids);
+
+        upper = db->header->n_tags;
+        while (lower < upper) {
+                const struct device_database_tag *t;
+                size_t i = (lower + upper) / 2;
+                int c;
+
+                t = tag_get(db, i);
+                c = strcmp(tag, device_database_string(db, t->name_off));
+                if (c < 0)
+                        upper = i;
+                else if (c > 0)
+                        lower = i + 1;
+                else {
+                        if (!range_valid(db, t->ids_off, t->n_ids, sizeof(uint64_t)))
+                                return -EBADMSG;
+
+                        *ret_ids = (const uint64_t *) (db->map + t->ids_off);
+                        *ret_n_ids = t->n_ids;
+                        return 0;
+                }
+        }
+
+        return -ENOENT;
+}
+
+/* Returns a reference to the snapshot, if there is a current one. The thread keeps its own reference
+ * only until the snapshot is replaced, which the next lookup, possibly further down the stack of the
+ * caller, might do. */
+int device_database_get_current(DeviceDatabase **ret) {
+        struct stat st;
+        int r;
+
+        assert(ret);
+
+        if (stat(DEVICE_DATABASE_PATH, &st) < 0) {
+                current = device_database_unref(current);
+                return -errno;
+        }
+
+        /* a new snapshot is always a new file */
+        if (!current ||
+            current->st.st_dev != st.st_dev ||
+            current->st.st_ino != st.st_ino ||
+            timespec_load(&current->st.st_mtim) != timespec_load(&st.st_mtim)) {
+                current = device_database_unref(current);
+
+                r = device_database_open(DEVICE_DATABASE_PATH, &current);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = device_database_ref(current);
+        return 0;
+}
+
+/* drops this thread's snapshot, threads call this before they exit */
+void device_database_release_current(void) {
+        current = device_database_unref(current);
+}
+
+/* called before every change to the database */
+void device_database_invalidate(void) {
+        (void) unlink(DEVICE_DATABASE_PATH);
+}
+
+struct record {
+        char *id;
+        char *data;
+        size_t size;
+};
+
+struct tag {
+        char *name;
+        char **ids;
+        size_t n_ids;
+};
+
+static int record_compare(const void *a, const void *b) {
+        const struct record *x = a, *y = b;
+
+        return strcmp(x->id, y->id);
+}
+
+static int tag_compare(const void *a, const void *b) {
+        const struct tag *x = a, *y = b;
+
+        return strcmp(x->name, y->name);
+}
+
+static int string_compare(const void *a, const void *b) {
+        return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+static int read_records(const char *data_dir, struct record **ret, size_t *ret_n) {
+        _cleanup_closedir_ DIR *dir = NULL;
+        struct record *records = NULL;
+        size_t n = 0, allocated = 0, i;
+        struct dirent *de;
+        int r;
+
+        dir = opendir(data_dir);
+        if (!dir) {
+                if (errno != ENOENT)
+                        return -errno;
+
+                *ret = NULL;
+                *ret_n = 0;
+                return 0;
+        }
+
+        FOREACH_DIRENT_ALL(de, dir, r = -errno; goto fail) {
+                struct record *rec;
+                char *path;
+
+                /* hidden files are the temporary files of an update */
+                if (de->d_name[0] == '.')
+                        continue;
+
+                if (!GREEDY_REALLOC(records, allocated, n + 1)) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                rec = &records[n];
+                *rec = (struct record) {};
+
+                path = strjoina(data_dir, "/", de->d_name);
+                r = read_full_file(path, &rec->data, &rec->size);
+                if (r == -ENOENT)
+                        continue;
+                if (r < 0)
+                        goto fail;
+
+                rec->id = strdup(de->d_name);
+                if (!rec->id) {
+                        free(rec->data);
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                n++;
+        }
+
+        qsort_safe(records, n, sizeof(struct record), record_compare);
+
+        *ret = records;
+        *ret_n = n;
+        return 0;
+
+fail:
+        for (i = 0; i < n; i++) {
+                free(records[i].id);
+                free(records[i].data);
+        }
+        free(records);
+        return r;
+}
+
+static int read_tags(const char *tags_dir, struct tag **ret, size_t *ret_n) {
+        _cleanup_closedir_ DIR *dir = NULL;
+        struct tag *tags = NULL;
+        size_t n = 0, allocated = 0, i;
+        struct dirent *de;
+        int r;
+
+        dir = opendir(tags_dir);
+        if (!dir) {
+                if (errno != ENOENT)
+                        return -errno;
+
+                *ret = NULL;
+                *ret_n = 0;
+                return 0;
+        }
+
+        FOREACH_DIRENT_ALL(de, dir, r = -errno; goto fail) {
+                _cleanup_closedir_ DIR *tag_dir = NULL;
+                size_t allocated_ids = 0;
+                struct dirent *de_id;
+                struct tag *t;
+                char *path;
+
+                if (de->d_name[0] == '.')
+                        continue;
+
+                path = strjoina(tags_dir, "/", de->d_name);
+                tag_dir = opendir(path);
+                if (!tag_dir) {
+                        if (IN_SET(errno, ENOENT, ENOTDIR))
+                                continue;
+
+                        r = -errno;
+                        goto fail;
+                }
+
+                if (!GREEDY_REALLOC(tags, allocated, n + 1)) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                t = &tags[n++];
+                *t = (struct tag) {};
+
+                t->name = strdup(de->d_name);
+                if (!t->name) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                FOREACH_DIRENT_ALL(de_id, tag_dir, r = -errno; goto fail) {
+                        if (de_id->d_name[0] == '.')
+                                continue;
+
+                        if (!GREEDY_REALLOC(t->ids, allocated_ids, t->n_ids + 1)) {
+                                r = -ENOMEM;
+                                goto fail;
+                        }
+
+                        t->ids[t->n_ids] = strdup(de_id->d_name);
+                        if (!t->ids[t->n_ids]) {
+                                r = -ENOMEM;
+                                goto fail;
+                        }
+
+                        t->n_ids++;
+                }
+
+                qsort_safe(t->ids, t->n_ids, sizeof(char *), string_compare);
+        }
+
+        qsort_safe(tags, n, sizeof(struct tag), tag_compare);
+
+        *ret = tags;
+        *ret_n = n;
+        return 0;
+
+fail:
+        for (i = 0; i < n; i++) {
+                size_t k;
+
+                for (k = 0; k < tags[i].n_ids; k++)
+                        free(tags[i].ids[k]);
+                free(tags[i].ids);
+                free(tags[i].name);
+        }
+        free(tags);
+        return r;
+}
+
+struct blob {
+        char *buf;
+        size_t size;
+        size_t allocated;
+};
+
+/* appends to the string and data section, returns the offset in it */
+static int blob_add(struct blob *b, const void *data, size_t size, bool terminate, uint64_t *ret) {
+        if (!GREEDY_REALLOC(b->buf, b->allocated, b->size + size + terminate))
+                return -ENOMEM;
+
+        memcpy_safe(b->buf + b->size, data, size);
+        if (terminate)
+                b->buf[b->size + size] = '\0';
+
+        *ret = b->size;
+        b->size += size + terminate;
+
+        return 0;
+}
+
+int device_database_write(const char *path, const char *data_dir, const char *tags_dir) {
+        _cleanup_free_ struct device_database_record *file_records = NULL;
+        _cleanup_free_ struct device_database_tag *file_tags = NULL;
+        _cleanup_free_ uint64_t *file_ids = NULL;
+        _cleanup_free_ char *path_tmp = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        struct record *records = NULL;
+        struct tag *tags = NULL;
+        size_t n_records = 0, n_tags = 0, n_ids = 0, i, k, id;
+        struct blob blob = {};
+        struct device_database_header h = {
+                .signature = DEVICE_DATABASE_SIG,
+                .header_size = sizeof(struct device_database_header),
+        };
+        uint64_t ids_off, blob_off;
+        int r;
+
+        assert(path);
+        assert(data_dir);
+        assert(tags_dir);
+
+        r = read_records(data_dir, &records, &n_records);
+        if (r < 0)
+                return r;
+
+        r = read_tags(tags_dir, &tags, &n_tags);
+        if (r < 0)
+                goto finish;
+
+        for (i = 0; i < n_tags; i++)
+                n_ids += tags[i].n_ids;
+
+        file_records = new0(struct device_database_record, n_records);
+        file_tags = new0(struct device_database_tag, n_tags);
+        file_ids = new0(uint64_t, n_ids);
+        if ((n_records > 0 && !file_records) || (n_tags > 0 && !file_tags) || (n_ids > 0 && !file_ids)) {
+                r = -ENOMEM;
+                goto finish;
+        }
+
+        /* header, records, tags, the id arrays of the tags, then strings and data */
+        h.records_off = sizeof(struct device_database_header);
+        h.n_records = n_records;
+        h.tags_off = h.records_off + n_records * sizeof(struct device_database_record);
+        h.n_tags = n_tags;
+        ids_off = h.tags_off + n_tags * sizeof(struct device_database_tag);
+        blob_off = ids_off + n_ids * sizeof(uint64_t);
+
+        for (i = 0; i < n_records; i++) {
+                r = blob_add(&blob, records[i].id, strlen(records[i].id), true, &file_records[i].id_off);
+                if (r < 0)
+                        goto finish;
+                file_records[i].id_off += blob_off;
+
+                r = blob_add(&blob, records[i].data, records[i].size, false, &file_records[i].data_off);
+                if (r < 0)
+                        goto finish;
+                file_records[i].data_off += blob_off;
+                file_records[i].data_size = records[i].size;
+        }
+
+        for (i = 0, id = 0; i < n_tags; i++) {
+                r = blob_add(&blob, tags[i].name, strlen(tags[i].name), true, &file_tags[i].name_off);
+                if (r < 0)
+                        goto finish;
+                file_tags[i].name_off += blob_off;
+
+                file_tags[i].ids_off = ids_off + id * sizeof(uint64_t);
+                file_tags[i].n_ids = tags[i].n_ids;
+
+                for (k = 0; k < tags[i].n_ids; k++, id++) {
+                        r = blob_add(&blob, tags[i].ids[k], strlen(tags[i].ids[k]), true, &file_ids[id]);
+                        if (r < 0)
+                                goto finish;
+                        file_ids[id] += blob_off;
+                }
+        }
+
+        h.file_size = blob_off + blob.size;
+
+        r = fopen_temporary(path, &f, &path_tmp);
+        if (r < 0)
+                goto finish;
+
+        (void) fchmod(fileno(f), 0644);
+
+        fwrite(&h, sizeof(h), 1, f);
+        fwrite(file_records, sizeof(struct device_database_record), n_records, f);
+        fwrite(file_tags, sizeof(struct device_database_tag), n_tags, f);
+        fwrite(file_ids, sizeof(uint64_t), n_ids, f);
+        fwrite(blob.buf, 1, blob.size, f);
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                goto fail;
+
+        if (rename(path_tmp, path) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        r = 0;
+        goto finish;
+
+fail:
+        (void) unlink(path_tmp);
+
+finish:
+        for (i = 0; i < n_records; i++) {
+                free(records[i].id);
+                free(records[i].data);
+        }
+        free(records);
+
+        for (i = 0; i < n_tags; i++) {
+                for (k = 0; k < tags[i].n_ids; k++)
+                        free(tags[i].ids[k]);
+                free(tags[i].ids);
+                free(tags[i].name);
+        }
+        free(tags);
+
+        free(blob.buf);
+
+        return r;
+}
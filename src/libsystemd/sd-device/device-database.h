@@ -0,0 +1,44 @@
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "macro.h"
+
+#define DEVICE_DATABASE_PATH "/run/udev/data.db"
+#define DEVICE_DATABASE_DATA_DIR "/run/udev/data"
+#define DEVICE_DATABASE_TAGS_DIR "/run/udev/tags"
+
+typedef struct DeviceDatabase DeviceDatabase;
+
+int device_database_open(const char *path, DeviceDatabase **ret);
+DeviceDatabase *device_database_ref(DeviceDatabase *db);
+DeviceDatabase *device_database_unref(DeviceDatabase *db);
+DEFINE_TRIVIAL_CLEANUP_FUNC(DeviceDatabase*, device_database_unref);
+
+int device_database_get(DeviceDatabase *db, const char *id, const char **ret_data, size_t *ret_size);
+int device_database_get_tag(DeviceDatabase *db, const char *tag, const uint64_t **ret_ids, size_t *ret_n_ids);
+const char *device_database_string(DeviceDatabase *db, uint64_t offset);
+
+int device_database_get_current(DeviceDatabase **ret);
+void device_database_release_current(void);
+void device_database_invalidate(void);
+
+int device_database_write(const char *path, const char *data_dir, const char *tags_dir);
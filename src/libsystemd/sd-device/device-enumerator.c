@@ -18,9 +18,13 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include <pthread.h>
+#include <signal.h>
+
 #include "sd-device.h"
 
 #include "alloc-util.h"
+#include "device-database.h"
 #include "device-enumerator-private.h"
 #include "device-util.h"
 #include "dirent-util.h"
@@ -32,6 +36,7 @@
 #include "util.h"
 
 #define DEVICE_ENUMERATE_MAX_DEPTH 256
+#define DEVICE_ENUMERATE_MAX_THREADS 16U
 
 typedef enum DeviceEnumerationType {
         DEVICE_ENUMERATION_TYPE_DEVICES,
@@ -56,8 +61,18 @@ struct sd_device_enumerator {
         Set *match_tag;
         sd_device *match_parent;
         bool match_allow_uninitialized;
+
+        /* threads scanning the subsystem directories, 0 or 1 scans in the calling thread */
+        unsigned n_threads;
 };
 
+/* the devices one thread found, they are added to the enumerator once all threads are done */
+typedef struct DeviceScan {
+        sd_device **devices;
+        size_t n_devices;
+        size_t n_allocated;
+} DeviceScan;
+
 _public_ int sd_device_enumerator_new(sd_device_enumerator **ret) {
         _cleanup_(sd_device_enumerator_unrefp) sd_device_enumerator *enumerator = NULL;
 
@@ -275,6 +290,22 @@ int device_enumerator_add_match_is_initialized(sd_device_enumerator *enumerator)
         return 0;
 }
 
+/* scan the subsystems with the given number of threads, 0 means one per CPU */
+int device_enumerator_set_threads(sd_device_enumerator *enumerator, unsigned n_threads) {
+        assert_return(enumerator, -EINVAL);
+
+        if (n_threads == 0) {
+                long n;
+
+                n = sysconf(_SC_NPROCESSORS_ONLN);
+                n_threads = n > 0 ? (unsigned) n : 1;
+        }
+
+        enumerator->n_threads = MIN(n_threads, DEVICE_ENUMERATE_MAX_THREADS);
+
+        return 0;
+}
+
 static int device_compare(const void *_a, const void *_b) {
         sd_device *a = (sd_device *)_a, *b = (sd_device *)_b;
         const char *devpath_a, *devpath_b, *sound_a;
@@ -465,22 +496,125 @@ static bool match_sysname(sd_device_enumerator *enumerator, const char *sysname)
         return false;
 }
 
-static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator, const char *basedir, const char *subdir1, const char *subdir2) {
-        _cleanup_closedir_ DIR *dir = NULL;
-        char *path;
-        struct dirent *dent;
-        int r = 0;
+static void device_scan_done(DeviceScan *scan) {
+        size_t i;
+
+        assert(scan);
+
+        for (i = 0; i < scan->n_devices; i++)
+                sd_device_unref(scan->devices[i]);
+
+        scan->devices = mfree(scan->devices);
+        scan->n_devices = scan->n_allocated = 0;
+}
+
+static int device_scan_add(DeviceScan *scan, sd_device *device) {
+        assert(scan);
+        assert(device);
+
+        if (!GREEDY_REALLOC(scan->devices, scan->n_allocated, scan->n_devices + 1))
+                return -ENOMEM;
+
+        scan->devices[scan->n_devices++] = sd_device_ref(device);
+
+        return 0;
+}
+
+static int enumerator_add_scan(sd_device_enumerator *enumerator, DeviceScan *scan) {
+        size_t i;
+        int r = 0, k;
 
         assert(enumerator);
-        assert(basedir);
+        assert(scan);
 
-        path = strjoina("/sys/", basedir, "/");
+        for (i = 0; i < scan->n_devices; i++) {
+                k = device_enumerator_add_device(enumerator, scan->devices[i]);
+                if (k < 0)
+                        r = k;
+        }
 
-        if (subdir1)
-                path = strjoina(path, subdir1, "/");
+        device_scan_done(scan);
 
-        if (subdir2)
-                path = strjoina(path, subdir2, "/");
+        return r;
+}
+
+/* Checks a device found in sysfs against the matches. Only reads what the matches need, and can
+ * be called from any thread. */
+static int enumerator_check_device(sd_device_enumerator *enumerator, const char *syspath, sd_device **ret) {
+        _cleanup_(sd_device_unrefp) sd_device *device = NULL;
+        int r;
+
+        assert(enumerator);
+        assert(syspath);
+        assert(ret);
+
+        r = sd_device_new_from_syspath(&device, syspath);
+        if (r == -ENODEV)
+                /* this is necessarily racey, so ignore missing devices */
+                return 0;
+        if (r < 0)
+                return r;
+
+        if (!match_parent(enumerator, device))
+                return 0;
+
+        /*
+         * All devices with a device node or network interfaces
+         * possibly need udev to adjust the device node permission
+         * or context, or rename the interface before it can be
+         * reliably used from other processes.
+         *
+         * For now, we can only check these types of devices, we
+         * might not store a database, and have no way to find out
+         * for all other types of devices.
+         *
+         * This needs the uevent file and the database, which are
+         * not read at all if uninitialized devices are fine.
+         */
+        if (!enumerator->match_allow_uninitialized) {
+                dev_t devnum;
+                int ifindex, initialized;
+
+                r = sd_device_get_devnum(device, &devnum);
+                if (r < 0)
+                        return r;
+
+                r = sd_device_get_ifindex(device, &ifindex);
+                if (r < 0)
+                        return r;
+
+                r = sd_device_get_is_initialized(device, &initialized);
+                if (r < 0)
+                        return r;
+
+                if (!initialized && (major(devnum) > 0 || ifindex > 0))
+                        return 0;
+        }
+
+        if (!match_tag(enumerator, device))
+                return 0;
+
+        if (!match_property(enumerator, device))
+                return 0;
+
+        if (!match_sysattr(enumerator, device))
+                return 0;
+
+        *ret = device;
+        device = NULL;
+
+        return 1;
+}
+
+/* collects the matching devices in the directory, the path ends in a slash */
+static int enumerator_scan_dir_and_collect(sd_device_enumerator *enumerator, const char *path, DeviceScan *scan) {
+        _cleanup_closedir_ DIR *dir = NULL;
+        struct dirent *dent;
+        int r = 0;
+
+        assert(enumerator);
+        assert(path);
+        assert(scan);
 
         dir = opendir(path);
         if (!dir)
@@ -488,9 +622,8 @@ static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator,
 
         FOREACH_DIRENT_ALL(dent, dir, return -errno) {
                 _cleanup_(sd_device_unrefp) sd_device *device = NULL;
-                char syspath[strlen(path) + 1 + strlen(dent->d_name) + 1];
-                dev_t devnum;
-                int ifindex, initialized, k;
+                char syspath[strlen(path) + strlen(dent->d_name) + 1];
+                int k;
 
                 if (dent->d_name[0] == '.')
                         continue;
@@ -500,61 +633,138 @@ static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator,
 
                 (void)sprintf(syspath, "%s%s", path, dent->d_name);
 
-                k = sd_device_new_from_syspath(&device, syspath);
-                if (k < 0) {
-                        if (k != -ENODEV)
-                                /* this is necessarily racey, so ignore missing devices */
-                                r = k;
-
-                        continue;
-                }
-
-                k = sd_device_get_devnum(device, &devnum);
-                if (k < 0) {
+                k = enumerator_check_device(enumerator, syspath, &device);
+                if (k < 0)
                         r = k;
+                if (k <= 0)
                         continue;
-                }
 
-                k = sd_device_get_ifindex(device, &ifindex);
-                if (k < 0) {
+                k = device_scan_add(scan, device);
+                if (k < 0)
                         r = k;
-                        continue;
-                }
+        }
 
-                k = sd_device_get_is_initialized(device, &initialized);
-                if (k < 0) {
-                        r = k;
-                        continue;
+        return r;
+}
+
+static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator, const char *basedir, const char *subdir1, const char *subdir2) {
+        DeviceScan scan = {};
+        char *path;
+        int r, k;
+
+        assert(enumerator);
+        assert(basedir);
+
+        path = strjoina("/sys/", basedir, "/");
+
+        if (subdir1)
+                path = strjoina(path, subdir1, "/");
+
+        if (subdir2)
+                path = strjoina(path, subdir2, "/");
+
+        r = enumerator_scan_dir_and_collect(enumerator, path, &scan);
+
+        k = enumerator_add_scan(enumerator, &scan);
+        if (k < 0)
+                r = k;
+
+        return r;
+}
+
+typedef struct ScanThread {
+        sd_device_enumerator *enumerator;
+        char **dirs;
+        unsigned n_dirs;
+        /* the next directory to scan, shared by all threads */
+        unsigned *next;
+
+        pthread_t id;
+        bool started;
+        DeviceScan scan;
+        int r;
+} ScanThread;
+
+static void *scan_thread(void *userdata) {
+        ScanThread *t = userdata;
+
+        for (;;) {
+                unsigned i;
+                int k;
+
+                i = __sync_fetch_and_add(t->next, 1);
+                if (i >= t->n_dirs)
+                        break;
+
+                k = enumerator_scan_dir_and_collect(t->enumerator, t->dirs[i], &t->scan);
+                if (k < 0 && k != -ENOENT)
+                        t->r = k;
+        }
+
+        return NULL;
+}
+
+static void *scan_thread_start(void *userdata) {
+        scan_thread(userdata);
+
+        /* reading the database mapped the snapshot once more for this thread, don't leak it */
+        device_database_release_current();
+
+        return NULL;
+}
+
+/* Scans the directories with the enumerator's threads. The directories are independent of each
+ * other, every thread takes the next one which is left until all are done. */
+static int enumerator_scan_dirs(sd_device_enumerator *enumerator, char **dirs) {
+        _cleanup_free_ ScanThread *threads = NULL;
+        sigset_t fullset, saved;
+        unsigned n_dirs, n_threads, next = 0, i;
+        int r = 0, k;
+
+        assert(enumerator);
+
+        n_dirs = strv_length(dirs);
+        n_threads = MAX(MIN(enumerator->n_threads, n_dirs), 1U);
+
+        threads = new0(ScanThread, n_threads);
+        if (!threads)
+                return -ENOMEM;
+
+        for (i = 0; i < n_threads; i++) {
+                threads[i].enumerator = enumerator;
+                threads[i].dirs = dirs;
+                threads[i].n_dirs = n_dirs;
+                threads[i].next = &next;
+        }
+
+        /* No signals in the threads please, they inherit the mask */
+        assert_se(sigfillset(&fullset) == 0);
+        assert_se(pthread_sigmask(SIG_BLOCK, &fullset, &saved) == 0);
+
+        /* the calling thread scans too, so the scan completes even if no thread can be started */
+        for (i = 1; i < n_threads; i++) {
+                k = pthread_create(&threads[i].id, NULL, scan_thread_start, &threads[i]);
+                if (k != 0) {
+                        log_debug_errno(k, "device-enumerator: failed to start scanning thread, continuing with %u: %m", i);
+                        break;
                 }
 
-                /*
-                 * All devices with a device node or network interfaces
-                 * possibly need udev to adjust the device node permission
-                 * or context, or rename the interface before it can be
-                 * reliably used from other processes.
-                 *
-                 * For now, we can only check these types of devices, we
-                 * might not store a database, and have no way to find out
-                 * for all other types of devices.
-                 */
-                if (!enumerator->match_allow_uninitialized &&
-                    !initialized &&
-                    (major(devnum) > 0 || ifindex > 0))
-                        continue;
+                threads[i].started = true;
+        }
 
-                if (!match_parent(enumerator, device))
-                        continue;
+        assert_se(pthread_sigmask(SIG_SETMASK, &saved, NULL) == 0);
 
-                if (!match_tag(enumerator, device))
-                        continue;
+        scan_thread(&threads[0]);
 
-                if (!match_property(enumerator, device))
-                        continue;
+        for (i = 1; i < n_threads; i++)
+                if (threads[i].started)
+                        assert_se(pthread_join(threads[i].id, NULL) == 0);
 
-                if (!match_sysattr(enumerator, device))
-                        continue;
+        for (i = 0; i < n_threads; i++) {
+                if (threads[i].r < 0)
+                        r = threads[i].r;
 
-                k = device_enumerator_add_device(enumerator, device);
+                k = enumerator_add_scan(enumerator, &threads[i].scan);
                 if (k < 0)
                         r = k;
         }
@@ -587,9 +797,9 @@ static bool match_subsystem(sd_device_enumerator *enumerator, const char *subsys
 
 static int enumerator_scan_dir(sd_device_enumerator *enumerator, const char *basedir, const char *subdir, const char *subsystem) {
         _cleanup_closedir_ DIR *dir = NULL;
+        _cleanup_strv_free_ char **dirs = NULL;
         char *path;
         struct dirent *dent;
-        int r = 0;
 
         path = strjoina("/sys/", basedir);
 
@@ -599,8 +809,9 @@ static int enumerator_scan_dir(sd_device_enumerator *enumerator, const char *bas
 
         log_debug("  device-enumerator: scanning %s", path);
 
+        /* filter the subsystems before looking at any of their devices */
         FOREACH_DIRENT_ALL(dent, dir, return -errno) {
-                int k;
+                char *d;
 
                 if (dent->d_name[0] == '.')
                         continue;
@@ -608,23 +819,90 @@ static int enumerator_scan_dir(sd_device_enumerator *enumerator, const char *bas
                 if (!match_subsystem(enumerator, subsystem ? : dent->d_name))
                         continue;
 
-                k = enumerator_scan_dir_and_add_devices(enumerator, basedir, dent->d_name, subdir);
-                if (k < 0)
-                        r = k;
+                d = strjoin(path, "/", dent->d_name, "/", subdir ? : "", subdir ? "/" : "");
+                if (!d)
+                        return -ENOMEM;
+
+                if (strv_consume(&dirs, d) < 0)
+                        return -ENOMEM;
         }
 
-        return r;
+        return enumerator_scan_dirs(enumerator, dirs);
+}
+
+static int enumerator_add_tagged_device(sd_device_enumerator *enumerator, const char *id) {
+        _cleanup_(sd_device_unrefp) sd_device *device = NULL;
+        const char *subsystem, *sysname;
+        int r;
+
+        r = sd_device_new_from_device_id(&device, id);
+        if (r == -ENODEV)
+                /* this is necessarily racy, so ignore missing devices */
+                return 0;
+        if (r < 0)
+                return r;
+
+        r = sd_device_get_subsystem(device, &subsystem);
+        if (r < 0)
+                return r;
+
+        if (!match_subsystem(enumerator, subsystem))
+                return 0;
+
+        r = sd_device_get_sysname(device, &sysname);
+        if (r < 0)
+                return r;
+
+        if (!match_sysname(enumerator, sysname))
+                return 0;
+
+        if (!match_parent(enumerator, device))
+                return 0;
+
+        if (!match_property(enumerator, device))
+                return 0;
+
+        if (!match_sysattr(enumerator, device))
+                return 0;
+
+        r = device_enumerator_add_device(enumerator, device);
+        if (r < 0)
+                return r;
+
+        return 1;
 }
 
 static int enumerator_scan_devices_tag(sd_device_enumerator *enumerator, const char *tag) {
+        _cleanup_(device_database_unrefp) DeviceDatabase *snapshot = NULL;
         _cleanup_closedir_ DIR *dir = NULL;
         char *path;
         struct dirent *dent;
-        int r = 0;
+        int r = 0, k;
 
         assert(enumerator);
         assert(tag);
 
+        /* The snapshot of the database has the tagged devices in one place. Adding them looks at their
+         * database entries, which might replace the current snapshot, our reference keeps the ids
+         * valid. */
+        if (device_database_get_current(&snapshot) >= 0) {
+                const uint64_t *ids;
+                size_t n_ids, i;
+
+                k = device_database_get_tag(snapshot, tag, &ids, &n_ids);
+                if (k == -ENOENT)
+                        return 0;
+                if (k >= 0) {
+                        for (i = 0; i < n_ids; i++) {
+                                k = enumerator_add_tagged_device(enumerator, device_database_string(snapshot, ids[i]));
+                                if (k < 0)
+                                        r = k;
+                        }
+
+                        return r;
+                }
+        }
+
         path = strjoina("/run/udev/tags/", tag);
 
         dir = opendir(path);
@@ -640,54 +918,12 @@ static int enumerator_scan_devices_tag(sd_device_enumerator *enumerator, const c
         /* TODO: filter away subsystems? */
 
         FOREACH_DIRENT_ALL(dent, dir, return -errno) {
-                _cleanup_(sd_device_unrefp) sd_device *device = NULL;
-                const char *subsystem, *sysname;
-                int k;
-
                 if (dent->d_name[0] == '.')
                         continue;
 
-                k = sd_device_new_from_device_id(&device, dent->d_name);
-                if (k < 0) {
-                        if (k != -ENODEV)
-                                /* this is necessarily racy, so ignore missing devices */
-                                r = k;
-
-                        continue;
-                }
-
-                k = sd_device_get_subsystem(device, &subsystem);
-                if (k < 0) {
-                        r = k;
-                        continue;
-                }
-
-                if (!match_subsystem(enumerator, subsystem))
-                        continue;
-
-                k = sd_device_get_sysname(device, &sysname);
-                if (k < 0) {
-                        r = k;
-                        continue;
-                }
-
-                if (!match_sysname(enumerator, sysname))
-                        continue;
-
-                if (!match_parent(enumerator, device))
-                        continue;
-
-                if (!match_property(enumerator, device))
-                        continue;
-
-                if (!match_sysattr(enumerator, device))
-                        continue;
-
-                k = device_enumerator_add_device(enumerator, device);
-                if (k < 0) {
+                k = enumerator_add_tagged_device(enumerator, dent->d_name);
+                if (k < 0)
                         r = k;
-                        continue;
-                }
         }
 
         return r;
@@ -25,6 +25,7 @@
 #include "sd-device.h"
 
 #include "alloc-util.h"
+#include "device-database.h"
 #include "device-internal.h"
 #include "device-private.h"
 #include "device-util.h"
@@ -925,6 +926,8 @@ static int device_tag(sd_device *device, const char *tag, bool add) {
 
         path = strjoina("/run/udev/tags/", tag, "/", id);
 
+        device_database_invalidate();
+
         if (add) {
                 r = touch_file(path, true, USEC_INFINITY, UID_INVALID, GID_INVALID, 0444);
                 if (r < 0)
@@ -1007,6 +1010,9 @@ int device_update_db(sd_device *device) {
 
         path = strjoina("/run/udev/data/", id);
 
+        /* the snapshot of the database is outdated now, udevd writes a new one */
+        device_database_invalidate();
+
         /* do not store anything for otherwise empty devices */
         if (!has_info && major(device->devnum) == 0 && device->ifindex == 0) {
                 r = unlink(path);
@@ -1105,6 +1111,8 @@ int device_delete_db(sd_device *device) {
 
         path = strjoina("/run/udev/data/", id);
 
+        device_database_invalidate();
+
         r = unlink(path);
         if (r < 0 && errno != ENOENT)
                 return -errno;
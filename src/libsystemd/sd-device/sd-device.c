@@ -25,6 +25,7 @@
 #include "sd-device.h"
 
 #include "alloc-util.h"
+#include "device-database.h"
 #include "device-internal.h"
 #include "device-private.h"
 #include "device-util.h"
@@ -1304,6 +1305,7 @@ int device_get_id_filename(sd_device *device, const char **ret) {
 
 int device_read_db_aux(sd_device *device, bool force) {
         _cleanup_free_ char *db = NULL;
+        _cleanup_(device_database_unrefp) DeviceDatabase *snapshot = NULL;
         char *path;
         const char *id, *value;
         char key;
@@ -1328,14 +1330,33 @@ int device_read_db_aux(sd_device *device, bool force) {
         if (r < 0)
                 return r;
 
-        path = strjoina("/run/udev/data/", id);
+        /* if udevd wrote a snapshot of the database, it is current and has all entries */
+        if (device_database_get_current(&snapshot) >= 0) {
+                const char *data;
 
-        r = read_full_file(path, &db, &db_len);
-        if (r < 0) {
+                r = device_database_get(snapshot, id, &data, &db_len);
                 if (r == -ENOENT)
                         return 0;
-                else
-                        return log_debug_errno(r, "sd-device: failed to read db '%s': %m", path);
+                if (r < 0)
+                        return log_debug_errno(r, "sd-device: failed to read db entry '%s' from '%s': %m", id, DEVICE_DATABASE_PATH);
+
+                /* the entry is parsed in place */
+                db = new(char, db_len + 1);
+                if (!db)
+                        return -ENOMEM;
+
+                memcpy_safe(db, data, db_len);
+                db[db_len] = '\0';
+        } else {
+                path = strjoina("/run/udev/data/", id);
+
+                r = read_full_file(path, &db, &db_len);
+                if (r < 0) {
+                        if (r == -ENOENT)
+                                return 0;
+                        else
+                                return log_debug_errno(r, "sd-device: failed to read db '%s': %m", path);
+                }
         }
 
         /* devices with a database entry are initialized */
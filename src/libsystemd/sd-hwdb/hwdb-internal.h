@@ -24,6 +24,10 @@
 
 #define HWDB_SIG { 'K', 'S', 'L', 'P', 'H', 'H', 'R', 'H' }
 
+/* bump when the compiled database changes in a way the header does not tell, it is part of the
+ * sources hash, so that databases written before are compiled again */
+#define HWDB_FORMAT_VERSION 1
+
 /* on-disk trie objects */
 struct trie_header_f {
         uint8_t signature[8];
@@ -44,18 +48,32 @@ struct trie_header_f {
         /* size of the nodes and string section */
         le64_t nodes_len;
         le64_t strings_len;
+
+        /* HWDB_* flags, only present if header_size covers them */
+        le64_t flags;
+
+        /* hash of the source files and the format, see hwdb_sources_hash() */
+        le64_t sources_hash;
 } _packed_;
 
+/* the flags of the trie nodes are set */
+#define HWDB_NODE_FLAGS (UINT64_C(1) << 0)
+
 struct trie_node_f {
         /* prefix of lookup string, shared by all children  */
         le64_t prefix_off;
         /* size of children entry array appended to the node */
         uint8_t children_count;
-        uint8_t padding[7];
+        /* TRIE_NODE_* flags, if the header has HWDB_NODE_FLAGS */
+        uint8_t flags;
+        uint8_t padding[6];
         /* size of value entry array appended to the node */
         le64_t values_count;
 } _packed_;
 
+/* one of the children is a '*', '?' or '[', and needs to be matched with fnmatch() */
+#define TRIE_NODE_GLOB_CHILD (1 << 0)
+
 /* array of child entries, follows directly the node record */
 struct trie_child_entry_f {
         /* index of the child node */
@@ -24,3 +24,5 @@
 #include "util.h"
 
 bool hwdb_validate(sd_hwdb *hwdb);
+int hwdb_sources_hash(char **files, uint64_t value_entry_size, uint64_t *ret);
+bool hwdb_bin_up_to_date(const char *path, uint64_t sources_hash);
@@ -31,11 +31,24 @@
 
 #include "alloc-util.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "hashmap.h"
 #include "hwdb-internal.h"
 #include "hwdb-util.h"
 #include "refcnt.h"
+#include "siphash24.h"
 #include "string-util.h"
+#include "strv.h"
+
+/* number of modaliases whose lookup results are remembered, the cache starts over when it is full */
+#define HWDB_CACHE_MAX 1024U
+
+/* the properties a modalias matched, in the order of the lookup */
+struct hwdb_cache_entry {
+        char *modalias;
+        size_t n_entries;
+        const struct trie_value_entry_f *entries[];
+};
 
 struct sd_hwdb {
         RefCount n_ref;
@@ -47,9 +60,13 @@ struct sd_hwdb {
                 struct trie_header_f *head;
                 const char *map;
         };
+        bool node_flags;
 
         char *modalias;
 
+        /* modalias → struct hwdb_cache_entry */
+        Hashmap *cache;
+
         OrderedHashmap *properties;
         Iterator properties_iterator;
         bool properties_modified;
@@ -217,6 +234,29 @@ static int trie_fnmatch_f(sd_hwdb *hwdb, const struct trie_node_f *node, size_t
         return 0;
 }
 
+static int trie_search_glob_children_f(sd_hwdb *hwdb, const struct trie_node_f *node,
+                                       struct linebuf *buf, const char *search) {
+        static const char globs[] = { '*', '?', '[' };
+        size_t i;
+        int err;
+
+        for (i = 0; i < ELEMENTSOF(globs); i++) {
+                const struct trie_node_f *child;
+
+                child = node_lookup_f(hwdb, node, globs[i]);
+                if (!child)
+                        continue;
+
+                linebuf_add_char(buf, globs[i]);
+                err = trie_fnmatch_f(hwdb, child, 0, buf, search);
+                if (err < 0)
+                        return err;
+                linebuf_rem_char(buf);
+        }
+
+        return 0;
+}
+
 static int trie_search_f(sd_hwdb *hwdb, const char *search) {
         struct linebuf buf;
         const struct trie_node_f *node;
@@ -242,31 +282,11 @@ static int trie_search_f(sd_hwdb *hwdb, const char *search) {
                         i += p;
                 }
 
-                child = node_lookup_f(hwdb, node, '*');
-                if (child) {
-                        linebuf_add_char(&buf, '*');
-                        err = trie_fnmatch_f(hwdb, child, 0, &buf, search + i);
+                /* the file tells which nodes have glob children, older files need to be searched */
+                if (!hwdb->node_flags || (node->flags & TRIE_NODE_GLOB_CHILD)) {
+                        err = trie_search_glob_children_f(hwdb, node, &buf, search + i);
                         if (err < 0)
                                 return err;
-                        linebuf_rem_char(&buf);
-                }
-
-                child = node_lookup_f(hwdb, node, '?');
-                if (child) {
-                        linebuf_add_char(&buf, '?');
-                        err = trie_fnmatch_f(hwdb, child, 0, &buf, search + i);
-                        if (err < 0)
-                                return err;
-                        linebuf_rem_char(&buf);
-                }
-
-                child = node_lookup_f(hwdb, node, '[');
-                if (child) {
-                        linebuf_add_char(&buf, '[');
-                        err = trie_fnmatch_f(hwdb, child, 0, &buf, search + i);
-                        if (err < 0)
-                                return err;
-                        linebuf_rem_char(&buf);
                 }
 
                 if (search[i] == '\0') {
@@ -339,6 +359,9 @@ _public_ int sd_hwdb_new(sd_hwdb **ret) {
                 return -EINVAL;
         }
 
+        hwdb->node_flags = le64toh(hwdb->head->header_size) >= offsetof(struct trie_header_f, flags) + sizeof(le64_t) &&
+                           (le64toh(hwdb->head->flags) & HWDB_NODE_FLAGS);
+
         log_debug("=== trie on-disk ===");
         log_debug("tool version:          %"PRIu64, le64toh(hwdb->head->tool_version));
         log_debug("file size:        %8"PRIi64" bytes", hwdb->st.st_size);
@@ -366,6 +389,7 @@ _public_ sd_hwdb *sd_hwdb_unref(sd_hwdb *hwdb) {
                         munmap((void *)hwdb->map, hwdb->st.st_size);
                 safe_fclose(hwdb->f);
                 free(hwdb->modalias);
+                hashmap_free_free(hwdb->cache);
                 ordered_hashmap_free(hwdb->properties);
                 free(hwdb);
         }
@@ -398,6 +422,124 @@ bool hwdb_validate(sd_hwdb *hwdb) {
         return false;
 }
 
+/* remembers the properties the last lookup found for its modalias */
+static int cache_add(sd_hwdb *hwdb, const char *modalias) {
+        struct hwdb_cache_entry *e;
+        const struct trie_value_entry_f *entry;
+        Iterator i;
+        size_t n;
+        int r;
+
+        if (hashmap_size(hwdb->cache) >= HWDB_CACHE_MAX)
+                hashmap_clear_free(hwdb->cache);
+
+        r = hashmap_ensure_allocated(&hwdb->cache, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        n = ordered_hashmap_size(hwdb->properties);
+
+        /* the modalias is stored right after the entries */
+        e = malloc(offsetof(struct hwdb_cache_entry, entries) + n * sizeof(e->entries[0]) + strlen(modalias) + 1);
+        if (!e)
+                return -ENOMEM;
+
+        e->modalias = (char *) (e->entries + n);
+        strcpy(e->modalias, modalias);
+
+        e->n_entries = 0;
+        ORDERED_HASHMAP_FOREACH(entry, hwdb->properties, i)
+                e->entries[e->n_entries++] = entry;
+
+        r = hashmap_put(hwdb->cache, e->modalias, e);
+        if (r < 0) {
+                free(e);
+                return r;
+        }
+
+        return 0;
+}
+
+static int cache_lookup(sd_hwdb *hwdb, const char *modalias) {
+        struct hwdb_cache_entry *e;
+        size_t i;
+        int r;
+
+        e = hashmap_get(hwdb->cache, modalias);
+        if (!e)
+                return 0;
+
+        r = ordered_hashmap_ensure_allocated(&hwdb->properties, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        for (i = 0; i < e->n_entries; i++) {
+                r = ordered_hashmap_replace(hwdb->properties, trie_string(hwdb, e->entries[i]->key_off) + 1, (void *) e->entries[i]);
+                if (r < 0)
+                        return r;
+        }
+
+        return 1;
+}
+
+/* identifies the input of a compiled database: the names and contents of the source files, in
+ * the order they are read, and the format it is written in, which differs between systemd-hwdb
+ * and udevadm hwdb in the size of the value entries */
+int hwdb_sources_hash(char **files, uint64_t value_entry_size, uint64_t *ret) {
+        static const uint8_t hash_key[16] = {
+                0x91, 0x4c, 0x2e, 0x07, 0xb5, 0x68, 0xda, 0x13,
+                0x7f, 0xc0, 0x39, 0x84, 0x5e, 0xa2, 0x16, 0xeb,
+        };
+        const uint64_t format[] = { HWDB_FORMAT_VERSION, value_entry_size };
+        struct siphash state;
+        char **f;
+        int r;
+
+        assert(ret);
+
+        siphash24_init(&state, hash_key);
+        siphash24_compress(format, sizeof(format), &state);
+
+        STRV_FOREACH(f, files) {
+                _cleanup_free_ char *contents = NULL;
+                size_t size;
+
+                r = read_full_file(*f, &contents, &size);
+                if (r < 0)
+                        return r;
+
+                siphash24_compress(*f, strlen(*f) + 1, &state);
+                siphash24_compress(&size, sizeof(size), &state);
+                siphash24_compress(contents, size, &state);
+        }
+
+        *ret = siphash24_finalize(&state);
+        return 0;
+}
+
+/* whether the database at path was compiled from the same input */
+bool hwdb_bin_up_to_date(const char *path, uint64_t sources_hash) {
+        _cleanup_fclose_ FILE *f = NULL;
+        struct trie_header_f h = {};
+        const char sig[] = HWDB_SIG;
+        struct stat st;
+
+        f = fopen(path, "re");
+        if (!f)
+                return false;
+
+        if (fstat(fileno(f), &st) < 0)
+                return false;
+
+        if (fread(&h, sizeof(h), 1, f) != 1)
+                return false;
+
+        return memcmp(h.signature, sig, sizeof(h.signature)) == 0 &&
+               le64toh(h.header_size) >= offsetof(struct trie_header_f, sources_hash) + sizeof(le64_t) &&
+               le64toh(h.file_size) == (uint64_t) st.st_size &&
+               le64toh(h.sources_hash) == sources_hash;
+}
+
 static int properties_prepare(sd_hwdb *hwdb, const char *modalias) {
         _cleanup_free_ char *mod = NULL;
         int r;
@@ -416,9 +558,19 @@ static int properties_prepare(sd_hwdb *hwdb, const char *modalias) {
 
         hwdb->properties_modified = true;
 
-        r = trie_search_f(hwdb, modalias);
+        /* devices of the same model all ask for the same modalias */
+        r = cache_lookup(hwdb, modalias);
         if (r < 0)
                 return r;
+        if (r == 0) {
+                r = trie_search_f(hwdb, modalias);
+                if (r < 0)
+                        return r;
+
+                r = cache_add(hwdb, modalias);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to cache hwdb lookup of '%s', ignoring: %m", modalias);
+        }
 
         free(hwdb->modalias);
         hwdb->modalias = mod;
@@ -0,0 +1,119 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdlib.h>
+
+#include "sd-hwdb.h"
+
+#include "alloc-util.h"
+#include "log.h"
+#include "macro.h"
+#include "strv.h"
+#include "time-util.h"
+
+#define N_DEVICES 20000U
+
+static const char * const models[] = {
+        "usb:v1D6Bp0002d0415dc09dsc00dp01ic09isc00ip00in00",
+        "usb:v1D6Bp0003d0415dc09dsc00dp03ic09isc00ip00in00",
+        "usb:v046DpC52Bd1211dc00dsc00dp00ic03isc01ip01in00",
+        "usb:v046DpC077d7200dc00dsc00dp00ic03isc01ip02in00",
+        "usb:v8087p0024d0000dc09dsc00dp01ic09isc00ip00in00",
+        "usb:v0781p5581d0100dc00dsc00dp00ic08isc06ip50in00",
+        "pci:v00008086d00001237sv00000000sd00000000bc06sc00i00",
+        "pci:v00008086d00007010sv00000000sd00000000bc01sc01i80",
+        "pci:v000010ECd00008168sv00001043sd00008432bc02sc00i00",
+        "pci:v000015ADd00000405sv000015ADsd00000405bc03sc00i00",
+        "pci:v00001AF4d00001001sv00001AF4sd00000002bc01sc00i00",
+        "acpi:PNP0A03:",
+        "acpi:PNP0C0C:",
+        "input:b0003v046DpC52Be0111-e0,1,2,4,k110,111,112,113,114,r0,1,6,8,am4,lsfw",
+        "evdev:input:b0003v046DpC52Be0111-e0,1,2,4,k110,111,112,113,114,r0,1,6,8,am4,lsfw",
+        "evdev:atkbd:dmi:bvnSeaBIOS:bvr1.10.2:bd04/01/2014:svnQEMU:pnStandardPC(i440FX+PIIX,1996):pvrpc-i440fx-2.8:cvnQEMU:ct1:cvrpc-i440fx-2.8:",
+        "mouse:usb:v046DpC077:name:Logitech USB Optical Mouse:",
+        "OUI:001A11",
+        "net:naming:drvirtio_net",
+        "sdio:c00v02D0d4330",
+};
+
+static char **lookup(sd_hwdb *hwdb, const char *modalias) {
+        const char *key, *value;
+        char **l = NULL;
+
+        SD_HWDB_FOREACH_PROPERTY(hwdb, modalias, key, value)
+                assert_se(strv_extendf(&l, "%s=%s", key, value) >= 0);
+
+        return l;
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(sd_hwdb_unrefp) sd_hwdb *hwdb = NULL;
+        char **results[ELEMENTSOF(models)] = {};
+        char ts1[FORMAT_TIMESPAN_MAX], ts2[FORMAT_TIMESPAN_MAX];
+        usec_t start, uncached, cached;
+        unsigned i, n_found = 0;
+        int r;
+
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        r = sd_hwdb_new(&hwdb);
+        if (r < 0) {
+                log_notice_errno(r, "Skipping test: cannot open hwdb.bin: %m");
+                return EXIT_TEST_SKIP;
+        }
+
+        /* the first lookup of every model walks the trie */
+        start = now(CLOCK_MONOTONIC);
+        for (i = 0; i < ELEMENTSOF(models); i++)
+                results[i] = lookup(hwdb, models[i]);
+        uncached = now(CLOCK_MONOTONIC) - start;
+
+        /* coldplug asks for the same few models over and over, interleaved */
+        start = now(CLOCK_MONOTONIC);
+        for (i = 0; i < N_DEVICES; i++) {
+                _cleanup_strv_free_ char **l = NULL;
+
+                l = lookup(hwdb, models[i % ELEMENTSOF(models)]);
+                assert_se(strv_equal(l, results[i % ELEMENTSOF(models)]));
+        }
+        cached = now(CLOCK_MONOTONIC) - start;
+
+        log_info("Looked up %zu modaliases: %s per uncached lookup, %s per cached lookup.",
+                 ELEMENTSOF(models),
+                 format_timespan(ts1, sizeof(ts1), uncached / ELEMENTSOF(models), 1),
+                 format_timespan(ts2, sizeof(ts2), cached / N_DEVICES, 1));
+
+        /* a fresh handle, which has nothing cached, finds the same */
+        for (i = 0; i < ELEMENTSOF(models); i++) {
+                _cleanup_(sd_hwdb_unrefp) sd_hwdb *fresh = NULL;
+                _cleanup_strv_free_ char **l = NULL;
+
+                assert_se(sd_hwdb_new(&fresh) >= 0);
+                l = lookup(fresh, models[i]);
+                assert_se(strv_equal(l, results[i]));
+
+                if (!strv_isempty(l))
+                        n_found++;
+                strv_free(results[i]);
+        }
+
+        log_info("%u of %zu modaliases have properties.", n_found, ELEMENTSOF(models));
+
+        return 0;
+}
@@ -35,6 +35,7 @@
 #include "device-enumerator-private.h"
 #include "device-util.h"
 #include "libudev-device-internal.h"
+#include "libudev-private.h"
 
 /**
  * SECTION:libudev-enumerate
@@ -417,3 +418,10 @@ _public_ int udev_enumerate_scan_subsystems(struct udev_enumerate *udev_enumerat
 
         return device_enumerator_scan_subsystems(udev_enumerate->enumerator);
 }
+
+/* scan the subsystems in parallel, 0 uses one thread per CPU */
+int udev_enumerate_set_threads(struct udev_enumerate *udev_enumerate, unsigned n_threads) {
+        assert_return(udev_enumerate, -EINVAL);
+
+        return device_enumerator_set_threads(udev_enumerate->enumerator, n_threads);
+}
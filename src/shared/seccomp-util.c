@@ -21,10 +21,14 @@
 #include <seccomp.h>
 #include <stddef.h>
 #include <sys/prctl.h>
+#include <linux/filter.h>
 #include <linux/seccomp.h>
 
 #include "alloc-util.h"
+#include "fd-util.h"
+#include "io-util.h"
 #include "macro.h"
+#include "memfd-util.h"
 #include "nsflags.h"
 #include "seccomp-util.h"
 #include "string-util.h"
@@ -557,34 +561,53 @@ int seccomp_add_syscall_filter_set(scmp_filter_ctx seccomp, const SyscallFilterS
         return 0;
 }
 
-int seccomp_load_filter_set(uint32_t default_action, const SyscallFilterSet *set, uint32_t action) {
+int seccomp_build_filter_set(uint32_t default_action, const SyscallFilterSet *set, uint32_t action, scmp_filter_ctx *ret) {
         scmp_filter_ctx seccomp;
         int r;
 
         assert(set);
-
-        /* The one-stop solution: allocate a seccomp object, add a filter to it, and apply it */
+        assert(ret);
 
         r = seccomp_init_conservative(&seccomp, default_action);
         if (r < 0)
                 return r;
 
         r = seccomp_add_syscall_filter_set(seccomp, set, action);
+        if (r < 0) {
+                seccomp_release(seccomp);
+                return r;
+        }
+
+        *ret = seccomp;
+        return 0;
+}
+
+int seccomp_load_filter_set(uint32_t default_action, const SyscallFilterSet *set, uint32_t action) {
+        scmp_filter_ctx seccomp;
+        int r;
+
+        assert(set);
+
+        /* The one-stop solution: allocate a seccomp object, add a filter to it, and apply it */
+
+        r = seccomp_build_filter_set(default_action, set, action, &seccomp);
         if (r < 0)
-                goto finish;
+                return r;
 
         r = seccomp_load(seccomp);
-
-finish:
         seccomp_release(seccomp);
         return r;
 }
 
-int seccomp_restrict_namespaces(unsigned long retain) {
+int seccomp_build_restrict_namespaces(unsigned long retain, scmp_filter_ctx *ret) {
         scmp_filter_ctx seccomp;
         unsigned i;
         int r;
 
+        assert(ret);
+
+        /* Returns 0 if nothing is to be restricted, 1 and the filter otherwise */
+
         if (log_get_max_level() >= LOG_DEBUG) {
                 _cleanup_free_ char *s = NULL;
 
@@ -593,8 +616,10 @@ int seccomp_restrict_namespaces(unsigned long retain) {
         }
 
         /* NOOP? */
-        if ((retain & NAMESPACE_FLAGS_ALL) == NAMESPACE_FLAGS_ALL)
+        if ((retain & NAMESPACE_FLAGS_ALL) == NAMESPACE_FLAGS_ALL) {
+                *ret = NULL;
                 return 0;
+        }
 
         r = seccomp_init_conservative(&seccomp, SCMP_ACT_ALLOW);
         if (r < 0)
@@ -661,9 +686,88 @@ int seccomp_restrict_namespaces(unsigned long retain) {
                 }
         }
 
-        r = seccomp_load(seccomp);
+        *ret = seccomp;
+        return 1;
 
 finish:
         seccomp_release(seccomp);
         return r;
 }
+
+int seccomp_restrict_namespaces(unsigned long retain) {
+        scmp_filter_ctx seccomp;
+        int r;
+
+        r = seccomp_build_restrict_namespaces(retain, &seccomp);
+        if (r <= 0)
+                return r;
+
+        r = seccomp_load(seccomp);
+        seccomp_release(seccomp);
+        return r;
+}
+
+int seccomp_program_compile(scmp_filter_ctx seccomp, struct sock_fprog *ret) {
+        _cleanup_free_ struct sock_filter *filter = NULL;
+        _cleanup_close_ int fd = -1;
+        uint64_t sz;
+        int r;
+
+        assert(seccomp);
+        assert(ret);
+
+        /* Turns a libseccomp filter into the BPF program the kernel wants, so that it may be generated once and
+         * loaded many times, see seccomp_program_load(). libseccomp can only export to an fd, hence go through a
+         * memfd. */
+
+        fd = memfd_new("seccomp");
+        if (fd < 0)
+                return fd;
+
+        r = seccomp_export_bpf(seccomp, fd);
+        if (r < 0)
+                return r;
+
+        r = memfd_get_size(fd, &sz);
+        if (r < 0)
+                return r;
+
+        if (sz == 0 || sz % sizeof(struct sock_filter) != 0 || sz / sizeof(struct sock_filter) > BPF_MAXINSNS)
+                return -EBADMSG;
+
+        filter = malloc(sz);
+        if (!filter)
+                return -ENOMEM;
+
+        if (lseek(fd, 0, SEEK_SET) < 0)
+                return -errno;
+
+        r = loop_read_exact(fd, filter, sz, false);
+        if (r < 0)
+                return r;
+
+        *ret = (struct sock_fprog) {
+                .len = sz / sizeof(struct sock_filter),
+                .filter = filter,
+        };
+        filter = NULL;
+
+        return 0;
+}
+
+int seccomp_program_load(const struct sock_fprog *prog) {
+        assert(prog);
+
+        /* Same as what seccomp_load() does for filters with NNP and TSYNC turned off */
+        if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, prog) < 0)
+                return -errno;
+
+        return 0;
+}
+
+void seccomp_program_done(struct sock_fprog *prog) {
+        assert(prog);
+
+        prog->filter = mfree(prog->filter);
+        prog->len = 0;
+}
@@ -19,6 +19,7 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include <linux/filter.h>
 #include <seccomp.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -65,6 +66,12 @@ const SyscallFilterSet *syscall_filter_set_find(const char *name);
 
 int seccomp_add_syscall_filter_set(scmp_filter_ctx seccomp, const SyscallFilterSet *set, uint32_t action);
 
+int seccomp_build_filter_set(uint32_t default_action, const SyscallFilterSet *set, uint32_t action, scmp_filter_ctx *ret);
 int seccomp_load_filter_set(uint32_t default_action, const SyscallFilterSet *set, uint32_t action);
 
+int seccomp_build_restrict_namespaces(unsigned long retain, scmp_filter_ctx *ret);
 int seccomp_restrict_namespaces(unsigned long retain);
+
+int seccomp_program_compile(scmp_filter_ctx seccomp, struct sock_fprog *ret);
+int seccomp_program_load(const struct sock_fprog *prog);
+void seccomp_program_done(struct sock_fprog *prog);
@@ -173,6 +173,7 @@ static OutputMode arg_output = OUTPUT_SHORT;
 static bool arg_plain = false;
 static bool arg_firmware_setup = false;
 static bool arg_now = false;
+static bool arg_incremental = false;
 static bool arg_jobs_before = false;
 static bool arg_jobs_after = false;
 
@@ -4888,10 +4889,10 @@ static int print_property(const char *name, sd_bus_message *m, const char *conte
         return 0;
 }
 
-static int show_one(
+static int show_one_properties(
                 const char *verb,
                 sd_bus *bus,
-                const char *path,
+                sd_bus_message *reply,
                 const char *unit,
                 bool show_properties,
                 bool *new_line,
@@ -4903,7 +4904,6 @@ static int show_one(
                 {}
         };
 
-        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         _cleanup_set_free_ Set *found_properties = NULL;
         _cleanup_(unit_status_info_free) UnitStatusInfo info = {
@@ -4916,24 +4916,14 @@ static int show_one(
                 .tasks_current = (uint64_t) -1,
                 .tasks_max = (uint64_t) -1,
         };
+        char type;
         int r;
 
-        assert(path);
+        assert(reply);
         assert(new_line);
 
-        log_debug("Showing one %s", path);
-
-        r = sd_bus_call_method(
-                        bus,
-                        "org.freedesktop.systemd1",
-                        path,
-                        "org.freedesktop.DBus.Properties",
-                        "GetAll",
-                        &error,
-                        &reply,
-                        "s", "");
-        if (r < 0)
-                return log_error_errno(r, "Failed to get properties: %s", bus_error_message(&error, r));
+        /* Shows the a{sv} array the message is positioned at, which is either a GetAll() reply or an entry
+         * of a ListUnitsWithProperties() reply, with the unit name already read. */
 
         if (unit) {
                 r = bus_message_map_all_properties(reply, property_map, &info);
@@ -4951,9 +4941,19 @@ static int show_one(
                                 return -ENOENT;
                 }
 
-                r = sd_bus_message_rewind(reply, true);
+                r = sd_bus_message_rewind(reply, false);
                 if (r < 0)
                         return log_error_errno(r, "Failed to rewind: %s", bus_error_message(&error, r));
+
+                /* In a ListUnitsWithProperties() entry we are back at the unit name now */
+                r = sd_bus_message_peek_type(reply, &type, NULL);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+                if (type == SD_BUS_TYPE_STRING) {
+                        r = sd_bus_message_skip(reply, "s");
+                        if (r < 0)
+                                return bus_log_parse_error(r);
+                }
         }
 
         r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "{sv}");
@@ -5035,6 +5035,202 @@ static int show_one(
         return r;
 }
 
+static int show_one(
+                const char *verb,
+                sd_bus *bus,
+                const char *path,
+                const char *unit,
+                bool show_properties,
+                bool *new_line,
+                bool *ellipsized) {
+
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        int r;
+
+        assert(path);
+
+        log_debug("Showing one %s", path);
+
+        r = sd_bus_call_method(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        path,
+                        "org.freedesktop.DBus.Properties",
+                        "GetAll",
+                        &error,
+                        &reply,
+                        "s", "");
+        if (r < 0)
+                return log_error_errno(r, "Failed to get properties: %s", bus_error_message(&error, r));
+
+        return show_one_properties(verb, bus, reply, unit, show_properties, new_line, ellipsized);
+}
+
+/* How many units to ask for in one ListUnitsWithProperties() call */
+#define SHOW_CHUNK_UNITS 256U
+
+static int show_one_by_one(
+                const char *verb,
+                sd_bus *bus,
+                char **names,
+                bool show_properties,
+                bool *new_line,
+                bool *ellipsized) {
+
+        char **name;
+        int r, ret = 0;
+
+        STRV_FOREACH(name, names) {
+                _cleanup_free_ char *path = NULL;
+
+                path = unit_dbus_path_from_name(*name);
+                if (!path)
+                        return log_oom();
+
+                r = show_one(verb, bus, path, *name, show_properties, new_line, ellipsized);
+                if (r < 0)
+                        return r;
+                if (r > 0 && ret == 0)
+                        ret = r;
+        }
+
+        return ret;
+}
+
+static int show_chunk(
+                const char *verb,
+                sd_bus *bus,
+                char **names,
+                char **properties,
+                bool show_properties,
+                bool *new_line,
+                bool *ellipsized) {
+
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        int r, ret = 0;
+
+        r = sd_bus_message_new_method_call(
+                        bus,
+                        &m,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "ListUnitsWithProperties");
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_message_append_strv(m, NULL);
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_message_append_strv(m, names);
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_message_append_strv(m, NULL);
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_message_append_strv(m, properties);
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_call(bus, m, 0, &error, &reply);
+        if (r < 0) {
+                /* Older managers, SELinux policies only permitting access to some units, and replies that would
+                 * grow too large all make us ask for each unit separately */
+                if (sd_bus_error_has_name(&error, SD_BUS_ERROR_UNKNOWN_METHOD) ||
+                    sd_bus_error_has_name(&error, SD_BUS_ERROR_ACCESS_DENIED) ||
+                    sd_bus_error_has_name(&error, SD_BUS_ERROR_LIMITS_EXCEEDED)) {
+                        log_debug_errno(r, "Failed to list units with properties: %s Falling back to querying units one by one.", bus_error_message(&error, r));
+                        return show_one_by_one(verb, bus, names, show_properties, new_line, ellipsized);
+                }
+
+                return log_error_errno(r, "Failed to list units with properties: %s", bus_error_message(&error, r));
+        }
+
+        r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "(sa{sv})");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        while ((r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_STRUCT, "sa{sv}")) > 0) {
+                const char *unit;
+
+                r = sd_bus_message_read(reply, "s", &unit);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+
+                r = show_one_properties(verb, bus, reply, unit, show_properties, new_line, ellipsized);
+                if (r < 0)
+                        return r;
+                if (r > 0 && ret == 0)
+                        ret = r;
+
+                r = sd_bus_message_exit_container(reply);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+        }
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        r = sd_bus_message_exit_container(reply);
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        return ret;
+}
+
+static int show_many(
+                const char *verb,
+                sd_bus *bus,
+                char **names,
+                bool show_properties,
+                bool *new_line,
+                bool *ellipsized) {
+
+        _cleanup_strv_free_ char **properties = NULL;
+        char **chunk;
+        size_t n, i;
+        int r, ret = 0;
+
+        /* Fetches the properties of many units at once, instead of one GetAll() call per unit. Units are asked
+         * for in chunks, so that the replies stay well below the bus message size limit. */
+
+        n = strv_length(names);
+        if (n <= 1)
+                return show_one_by_one(verb, bus, names, show_properties, new_line, ellipsized);
+
+        if (show_properties && !strv_isempty(arg_properties)) {
+                /* We need the states to detect units that don't exist, they are not shown unless asked for */
+                properties = strv_copy(arg_properties);
+                if (!properties)
+                        return log_oom();
+
+                r = strv_extend_strv(&properties, STRV_MAKE("LoadState", "ActiveState"), true);
+                if (r < 0)
+                        return log_oom();
+        }
+
+        chunk = newa(char*, SHOW_CHUNK_UNITS + 1);
+
+        for (i = 0; i < n; i += SHOW_CHUNK_UNITS) {
+                size_t k = MIN(n - i, SHOW_CHUNK_UNITS);
+
+                memcpy(chunk, names + i, k * sizeof(char*));
+                chunk[k] = NULL;
+
+                r = show_chunk(verb, bus, chunk, properties, show_properties, new_line, ellipsized);
+                if (r < 0)
+                        return r;
+                if (r > 0 && ret == 0)
+                        ret = r;
+        }
+
+        return ret;
+}
+
 static int get_unit_dbus_path_by_pid(
                 sd_bus *bus,
                 uint32_t pid,
@@ -5078,9 +5274,10 @@ static int show_all(
 
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         _cleanup_free_ UnitInfo *unit_infos = NULL;
+        _cleanup_free_ char **names = NULL;
         const UnitInfo *u;
         unsigned c;
-        int r, ret = 0;
+        int r;
 
         r = get_unit_list(bus, NULL, NULL, &unit_infos, 0, &reply);
         if (r < 0)
@@ -5092,21 +5289,14 @@ static int show_all(
 
         qsort_safe(unit_infos, c, sizeof(UnitInfo), compare_unit_info);
 
-        for (u = unit_infos; u < unit_infos + c; u++) {
-                _cleanup_free_ char *p = NULL;
-
-                p = unit_dbus_path_from_name(u->id);
-                if (!p)
-                        return log_oom();
+        names = new0(char*, c + 1);
+        if (!names)
+                return log_oom();
 
-                r = show_one(verb, bus, p, u->id, show_properties, new_line, ellipsized);
-                if (r < 0)
-                        return r;
-                else if (r > 0 && ret == 0)
-                        ret = r;
-        }
+        for (u = unit_infos; u < unit_infos + c; u++)
+                names[u - unit_infos] = (char*) u->id;
 
-        return ret;
+        return show_many(verb, bus, names, show_properties, new_line, ellipsized);
 }
 
 static int show_system_status(sd_bus *bus) {
@@ -5249,19 +5439,11 @@ static int show(int argc, char *argv[], void *userdata) {
                         if (r < 0)
                                 return log_error_errno(r, "Failed to expand names: %m");
 
-                        STRV_FOREACH(name, names) {
-                                _cleanup_free_ char *path;
-
-                                path = unit_dbus_path_from_name(*name);
-                                if (!path)
-                                        return log_oom();
-
-                                r = show_one(argv[0], bus, path, *name, show_properties, &new_line, &ellipsized);
-                                if (r < 0)
-                                        return r;
-                                if (r > 0 && ret == 0)
-                                        ret = r;
-                        }
+                        r = show_many(argv[0], bus, names, show_properties, &new_line, &ellipsized);
+                        if (r < 0)
+                                return r;
+                        if (r > 0 && ret == 0)
+                                ret = r;
                 }
         }
 
@@ -5436,6 +5618,7 @@ static int daemon_reload(int argc, char *argv[], void *userdata) {
 
         case ACTION_SYSTEMCTL:
                 method = streq(argv[0], "daemon-reexec") ? "Reexecute" :
+                         arg_incremental ? "ReloadIncremental" :
                                      /* "daemon-reload" */ "Reload";
                 break;
 
@@ -6922,6 +7105,7 @@ static void systemctl_help(void) {
                "     --no-block       Do not wait until operation finished\n"
                "     --no-wall        Don't send wall message before halt/power-off/reboot\n"
                "     --no-reload      Don't reload daemon after en-/dis-abling unit files\n"
+               "     --incremental    When reloading, only reload units changed on disk\n"
                "     --no-legend      Do not print a legend (column headers and hints)\n"
                "     --no-pager       Do not pipe output into a pager\n"
                "     --no-ask-password\n"
@@ -7190,6 +7374,7 @@ static int systemctl_parse_argv(int argc, char *argv[]) {
                 ARG_PRESET_MODE,
                 ARG_FIRMWARE_SETUP,
                 ARG_NOW,
+                ARG_INCREMENTAL,
                 ARG_MESSAGE,
                 ARG_WAIT,
         };
@@ -7238,6 +7423,7 @@ static int systemctl_parse_argv(int argc, char *argv[]) {
                 { "preset-mode",         required_argument, NULL, ARG_PRESET_MODE         },
                 { "firmware-setup",      no_argument,       NULL, ARG_FIRMWARE_SETUP      },
                 { "now",                 no_argument,       NULL, ARG_NOW                 },
+                { "incremental",         no_argument,       NULL, ARG_INCREMENTAL         },
                 { "message",             required_argument, NULL, ARG_MESSAGE             },
                 {}
         };
@@ -7553,6 +7739,10 @@ static int systemctl_parse_argv(int argc, char *argv[]) {
                         arg_now = true;
                         break;
 
+                case ARG_INCREMENTAL:
+                        arg_incremental = true;
+                        break;
+
                 case ARG_MESSAGE:
                         if (strv_extend(&arg_wall, optarg) < 0)
                                 return log_oom();
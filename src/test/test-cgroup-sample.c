@@ -0,0 +1,60 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include "alloc-util.h"
+#include "cgroup.h"
+#include "macro.h"
+
+static void test_resource_samples(unsigned size, unsigned n_push) {
+        _cleanup_free_ CGroupResourceSamples *s = NULL;
+        CGroupResourceSample sample = {};
+        unsigned i, expected;
+
+        assert_se(s = cgroup_resource_samples_new(size));
+        assert_se(!cgroup_resource_samples_get(s, 0));
+
+        for (i = 0; i < n_push; i++) {
+                sample.timestamp = i;
+                sample.memory = i * 4096;
+                cgroup_resource_samples_push(s, &sample);
+        }
+
+        expected = MIN(size, n_push);
+        assert_se(s->n == expected);
+
+        /* Samples come out oldest first, and only the newest ones survive */
+        for (i = 0; i < expected; i++) {
+                const CGroupResourceSample *p;
+
+                assert_se(p = cgroup_resource_samples_get(s, i));
+                assert_se(p->timestamp == n_push - expected + i);
+                assert_se(p->memory == (n_push - expected + i) * 4096);
+        }
+
+        assert_se(!cgroup_resource_samples_get(s, expected));
+}
+
+int main(int argc, char *argv[]) {
+        test_resource_samples(1, 0);
+        test_resource_samples(1, 5);
+        test_resource_samples(60, 10);
+        test_resource_samples(60, 60);
+        test_resource_samples(60, 61);
+        test_resource_samples(60, 1000);
+
+        return 0;
+}
@@ -0,0 +1,278 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "device-database.h"
+#include "dirent-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "log.h"
+#include "macro.h"
+#include "rm-rf.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "time-util.h"
+
+#define N_DEVICES 50000U
+
+static void device_id(char *buf, size_t size, unsigned i) {
+        /* block devices, and every fourth one a network interface */
+        if (i % 4 == 3)
+                snprintf(buf, size, "n%u", i);
+        else
+                snprintf(buf, size, "b%u:%u", 8 + i / 256, i % 256);
+}
+
+static void populate(const char *data_dir, const char *tags_dir) {
+        const char *systemd_dir, *seat_dir;
+        unsigned i;
+
+        systemd_dir = strjoina(tags_dir, "/systemd");
+        seat_dir = strjoina(tags_dir, "/seat");
+
+        assert_se(mkdir(data_dir, 0755) >= 0);
+        assert_se(mkdir(tags_dir, 0755) >= 0);
+        assert_se(mkdir(systemd_dir, 0755) >= 0);
+        assert_se(mkdir(seat_dir, 0755) >= 0);
+
+        for (i = 0; i < N_DEVICES; i++) {
+                char id[32], data[256], path[PATH_MAX];
+
+                device_id(id, sizeof(id), i);
+
+                xsprintf(path, "%s/%s", data_dir, id);
+                xsprintf(data, "S:disk/by-id/test-%u\nI:%u\nE:ID_SERIAL=test-%u\nE:ID_BUS=ata\nG:systemd\n", i, i, i);
+                assert_se(write_string_file(path, data, WRITE_STRING_FILE_CREATE) >= 0);
+
+                xsprintf(path, "%s/%s", systemd_dir, id);
+                assert_se(touch(path) >= 0);
+
+                if (i % 100 == 0) {
+                        xsprintf(path, "%s/%s", seat_dir, id);
+                        assert_se(touch(path) >= 0);
+                }
+        }
+
+        /* the temporary file of an update in progress */
+        assert_se(write_string_file(strjoina(data_dir, "/.#b8:0XXXXXX"), "garbage", WRITE_STRING_FILE_CREATE) >= 0);
+}
+
+static unsigned count_dir(const char *path) {
+        _cleanup_closedir_ DIR *dir = NULL;
+        struct dirent *de;
+        unsigned n = 0;
+
+        assert_se(dir = opendir(path));
+
+        FOREACH_DIRENT(de, dir, assert_se(false))
+                n++;
+
+        return n;
+}
+
+static void test_lookup(const char *db_path, const char *data_dir) {
+        _cleanup_(device_database_unrefp) DeviceDatabase *db = NULL;
+        char ts1[FORMAT_TIMESPAN_MAX], ts2[FORMAT_TIMESPAN_MAX];
+        usec_t start, files, snapshot;
+        const char *data;
+        size_t size;
+        unsigned i;
+
+        assert_se(device_database_open(db_path, &db) >= 0);
+
+        start = now(CLOCK_MONOTONIC);
+        for (i = 0; i < N_DEVICES; i++) {
+                _cleanup_free_ char *contents = NULL;
+                char id[32], path[PATH_MAX];
+                size_t len;
+
+                device_id(id, sizeof(id), i);
+                xsprintf(path, "%s/%s", data_dir, id);
+                assert_se(read_full_file(path, &contents, &len) >= 0);
+        }
+        files = now(CLOCK_MONOTONIC) - start;
+
+        start = now(CLOCK_MONOTONIC);
+        for (i = 0; i < N_DEVICES; i++) {
+                char id[32];
+
+                device_id(id, sizeof(id), i);
+                assert_se(device_database_get(db, id, &data, &size) >= 0);
+        }
+        snapshot = now(CLOCK_MONOTONIC) - start;
+
+        log_info("Read %u database entries: %s from files, %s from the snapshot.",
+                 N_DEVICES,
+                 format_timespan(ts1, sizeof(ts1), files, 1),
+                 format_timespan(ts2, sizeof(ts2), snapshot, 1));
+
+        /* the snapshot has the same contents as the files */
+        for (i = 0; i < N_DEVICES; i += 997) {
+                _cleanup_free_ char *contents = NULL;
+                char id[32], path[PATH_MAX];
+                size_t len;
+
+                device_id(id, sizeof(id), i);
+                xsprintf(path, "%s/%s", data_dir, id);
+                assert_se(read_full_file(path, &contents, &len) >= 0);
+
+                assert_se(device_database_get(db, id, &data, &size) >= 0);
+                assert_se(size == len);
+                assert_se(memcmp(data, contents, len) == 0);
+        }
+
+        assert_se(device_database_get(db, "b1:1", &data, &size) == -ENOENT);
+        assert_se(device_database_get(db, "n", &data, &size) == -ENOENT);
+        assert_se(device_database_get(db, ".#b8:0XXXXXX", &data, &size) == -ENOENT);
+}
+
+static void test_tags(const char *db_path, const char *tags_dir) {
+        _cleanup_(device_database_unrefp) DeviceDatabase *db = NULL;
+        char ts1[FORMAT_TIMESPAN_MAX], ts2[FORMAT_TIMESPAN_MAX];
+        const char *systemd_dir;
+        const uint64_t *ids;
+        usec_t start, files, snapshot;
+        size_t n_ids, i;
+        unsigned n;
+
+        assert_se(device_database_open(db_path, &db) >= 0);
+
+        systemd_dir = strjoina(tags_dir, "/systemd");
+
+        start = now(CLOCK_MONOTONIC);
+        n = count_dir(systemd_dir);
+        files = now(CLOCK_MONOTONIC) - start;
+
+        start = now(CLOCK_MONOTONIC);
+        assert_se(device_database_get_tag(db, "systemd", &ids, &n_ids) >= 0);
+        snapshot = now(CLOCK_MONOTONIC) - start;
+
+        log_info("Listed %u tagged devices: %s from the directory, %s from the snapshot.",
+                 n,
+                 format_timespan(ts1, sizeof(ts1), files, 1),
+                 format_timespan(ts2, sizeof(ts2), snapshot, 1));
+
+        assert_se(n == N_DEVICES);
+        assert_se(n_ids == N_DEVICES);
+
+        /* sorted, and every tagged device has an entry */
+        for (i = 0; i < n_ids; i++) {
+                const char *data;
+                size_t size;
+
+                if (i > 0)
+                        assert_se(strcmp(device_database_string(db, ids[i - 1]), device_database_string(db, ids[i])) < 0);
+
+                assert_se(device_database_get(db, device_database_string(db, ids[i]), &data, &size) >= 0);
+        }
+
+        assert_se(device_database_get_tag(db, "seat", &ids, &n_ids) >= 0);
+        assert_se(n_ids == count_dir(strjoina(tags_dir, "/seat")));
+
+        assert_se(device_database_get_tag(db, "uaccess", &ids, &n_ids) == -ENOENT);
+}
+
+static void test_ref(const char *db_path) {
+        DeviceDatabase *db, *ref;
+        const char *data;
+        size_t size;
+
+        assert_se(device_database_open(db_path, &db) >= 0);
+        assert_se(device_database_get(db, "b8:0", &data, &size) >= 0);
+
+        /* the last reference keeps the snapshot mapped */
+        ref = device_database_ref(db);
+        assert_se(!device_database_unref(db));
+        assert_se(memcmp(data, "S:disk/by-id/test-0\n", 20) == 0);
+
+        assert_se(!device_database_unref(ref));
+}
+
+static void test_invalid(const char *db_path, const char *dir) {
+        _cleanup_(device_database_unrefp) DeviceDatabase *db = NULL;
+        const char *path;
+        struct stat st;
+
+        path = strjoina(dir, "/truncated.db");
+
+        assert_se(stat(db_path, &st) >= 0);
+        assert_se(write_string_file(path, "UDEVDB", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(device_database_open(path, &db) == -EBADMSG);
+
+        /* a header which claims more than there is */
+        assert_se(truncate(db_path, st.st_size / 2) >= 0);
+        assert_se(device_database_open(db_path, &db) == -EBADMSG);
+
+        assert_se(device_database_open(strjoina(dir, "/missing.db"), &db) == -ENOENT);
+}
+
+static void test_empty(const char *db_path, const char *dir) {
+        _cleanup_(device_database_unrefp) DeviceDatabase *db = NULL;
+        const uint64_t *ids;
+        const char *data;
+        size_t size;
+
+        /* no database at all, e.g. before udevd ran */
+        assert_se(device_database_write(db_path, strjoina(dir, "/none"), strjoina(dir, "/none")) >= 0);
+        assert_se(device_database_open(db_path, &db) >= 0);
+
+        assert_se(device_database_get(db, "b8:0", &data, &size) == -ENOENT);
+        assert_se(device_database_get_tag(db, "systemd", &ids, &size) == -ENOENT);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *dir = NULL;
+        char template[] = "/tmp/test-device-database.XXXXXX";
+        char ts[FORMAT_TIMESPAN_MAX];
+        const char *data_dir, *tags_dir, *db_path;
+        usec_t start;
+
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        assert_se(mkdtemp(template));
+        assert_se(dir = strdup(template));
+
+        data_dir = strjoina(dir, "/data");
+        tags_dir = strjoina(dir, "/tags");
+        db_path = strjoina(dir, "/data.db");
+
+        populate(data_dir, tags_dir);
+
+        start = now(CLOCK_MONOTONIC);
+        assert_se(device_database_write(db_path, data_dir, tags_dir) >= 0);
+        log_info("Wrote the snapshot of %u devices in %s.",
+                 N_DEVICES, format_timespan(ts, sizeof(ts), now(CLOCK_MONOTONIC) - start, 1));
+
+        test_lookup(db_path, data_dir);
+        test_tags(db_path, tags_dir);
+        test_ref(db_path);
+        test_invalid(db_path, dir);
+
+        test_empty(db_path, dir);
+
+        return 0;
+}
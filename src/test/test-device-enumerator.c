@@ -0,0 +1,93 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "sd-device.h"
+
+#include "alloc-util.h"
+#include "device-enumerator-private.h"
+#include "device-util.h"
+#include "log.h"
+#include "macro.h"
+#include "strv.h"
+#include "time-util.h"
+
+static char **enumerate(unsigned n_threads, bool allow_uninitialized, const char *subsystem, usec_t *ret_usec) {
+        _cleanup_(sd_device_enumerator_unrefp) sd_device_enumerator *e = NULL;
+        char **l = NULL;
+        sd_device *d;
+        usec_t start;
+
+        assert_se(sd_device_enumerator_new(&e) >= 0);
+        assert_se(device_enumerator_set_threads(e, n_threads) >= 0);
+
+        if (allow_uninitialized)
+                assert_se(sd_device_enumerator_allow_uninitialized(e) >= 0);
+
+        if (subsystem)
+                assert_se(sd_device_enumerator_add_match_subsystem(e, subsystem, true) >= 0);
+
+        start = now(CLOCK_MONOTONIC);
+        FOREACH_DEVICE(e, d) {
+                const char *syspath;
+
+                assert_se(sd_device_get_syspath(d, &syspath) >= 0);
+                assert_se(strv_extend(&l, syspath) >= 0);
+        }
+        *ret_usec = now(CLOCK_MONOTONIC) - start;
+
+        return l;
+}
+
+static void test_enumerate(bool allow_uninitialized, const char *subsystem) {
+        _cleanup_strv_free_ char **serial = NULL, **parallel = NULL;
+        char ts1[FORMAT_TIMESPAN_MAX], ts2[FORMAT_TIMESPAN_MAX];
+        usec_t usec_serial, usec_parallel;
+
+        serial = enumerate(1, allow_uninitialized, subsystem, &usec_serial);
+        parallel = enumerate(0, allow_uninitialized, subsystem, &usec_parallel);
+
+        log_info("Enumerated %u %s%sdevices%s: %s in one thread, %s in parallel.",
+                 strv_length(serial),
+                 subsystem ?: "", subsystem ? " " : "",
+                 allow_uninitialized ? "" : " (initialized only)",
+                 format_timespan(ts1, sizeof(ts1), usec_serial, 1),
+                 format_timespan(ts2, sizeof(ts2), usec_parallel, 1));
+
+        /* the devices are sorted, no matter which thread found them */
+        assert_se(strv_equal(serial, parallel));
+}
+
+int main(int argc, char *argv[]) {
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        if (access("/sys/class", F_OK) < 0) {
+                log_notice("Skipping test: no sysfs.");
+                return EXIT_TEST_SKIP;
+        }
+
+        test_enumerate(true, NULL);
+        test_enumerate(false, NULL);
+        test_enumerate(true, "block");
+        test_enumerate(true, "net");
+
+        return 0;
+}
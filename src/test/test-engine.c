@@ -27,6 +27,13 @@
 #include "test-helper.h"
 #include "tests.h"
 
+static bool dependency_loaded(Unit *u, Unit *other, UnitDependency d) {
+        UnitDependencyEntry *e;
+
+        e = unit_dependency_find(u, other);
+        return e && (e->origin & (1U << d));
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error err = SD_BUS_ERROR_NULL;
@@ -55,6 +62,13 @@ int main(int argc, char *argv[]) {
         assert_se(manager_load_unit(m, "c.service", NULL, NULL, &c) >= 0);
         manager_dump_units(m, stdout, "\t");
 
+        printf("Test0: (Dependencies remembered as added while loading)\n");
+        assert_se(dependency_loaded(a, b, UNIT_REQUIRES));
+        assert_se(dependency_loaded(a, b, UNIT_BEFORE));
+        assert_se(!dependency_loaded(b, a, UNIT_REQUIRED_BY));
+        assert_se(dependency_loaded(c, a, UNIT_REQUIRES));
+        assert_se(!dependency_loaded(a, c, UNIT_REQUIRED_BY));
+
         printf("Test1: (Trivial)\n");
         r = manager_add_job(m, JOB_START, c, JOB_REPLACE, &err, &j);
         if (sd_bus_error_is_set(&err))
@@ -110,6 +124,13 @@ int main(int argc, char *argv[]) {
         assert_se(manager_add_job(m, JOB_START, h, JOB_FAIL, NULL, &j) == 0);
         manager_dump_jobs(m, stdout, "\t");
 
+        printf("Test11: (Incremental reload, nothing changed)\n");
+        manager_clear_jobs(m);
+        assert_se(manager_reload_incremental(m) >= 0);
+        assert_se(manager_get_unit(m, "a.service") == a);
+        assert_se(unit_has_dependency(a, UNIT_REQUIRES, b));
+        assert_se(unit_has_dependency(c, UNIT_REQUIRES, a));
+
         manager_free(m);
 
         return 0;
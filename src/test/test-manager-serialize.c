@@ -0,0 +1,148 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+
+#include "fd-util.h"
+#include "fdset.h"
+#include "macro.h"
+#include "manager.h"
+#include "parse-util.h"
+#include "rm-rf.h"
+#include "stdio-util.h"
+#include "test-helper.h"
+#include "tests.h"
+
+/* Pass a larger number of units, e.g. 10000, to see how long (de)serialization takes */
+#define N_UNITS 100U
+
+static void test_serialize(unsigned n_units, bool text) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_fdset_free_ FDSet *fds = NULL;
+        char name[sizeof("serialize-.service") + DECIMAL_STR_MAX(unsigned)];
+        char ts[FORMAT_TIMESPAN_MAX];
+        dual_timestamp active;
+        Manager *m = NULL;
+        Unit *u = NULL;
+        unsigned i;
+        usec_t start;
+
+        assert_se(n_units > 0);
+
+        assert_se(manager_new(UNIT_FILE_USER, true, &m) >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        for (i = 0; i < n_units; i++) {
+                xsprintf(name, "serialize-%u.service", i);
+                assert_se(manager_load_unit(m, name, NULL, NULL, &u) >= 0);
+        }
+
+        /* Put some recognizable state on the last unit */
+        dual_timestamp_get(&u->active_enter_timestamp);
+        active = u->active_enter_timestamp;
+        u->cpu_usage_base = 4711;
+
+        assert_se(manager_open_serialization(m, &f) >= 0);
+        assert_se(fds = fdset_new());
+
+        /* The text format is what we use when switching root */
+        start = now(CLOCK_MONOTONIC);
+        assert_se(manager_serialize(m, f, fds, text) >= 0);
+        log_info("%s: serialized %u units in %s, %llu bytes.",
+                 text ? "text" : "binary", n_units,
+                 format_timespan(ts, sizeof(ts), now(CLOCK_MONOTONIC) - start, 1),
+                 (unsigned long long) ftello(f));
+
+        manager_free(m);
+
+        assert_se(fseeko(f, 0, SEEK_SET) == 0);
+
+        assert_se(manager_new(UNIT_FILE_USER, true, &m) >= 0);
+
+        start = now(CLOCK_MONOTONIC);
+        assert_se(manager_startup(m, f, fds) >= 0);
+        log_info("%s: deserialized %u units in %s.",
+                 text ? "text" : "binary", n_units,
+                 format_timespan(ts, sizeof(ts), now(CLOCK_MONOTONIC) - start, 1));
+
+        for (i = 0; i < n_units; i++) {
+                xsprintf(name, "serialize-%u.service", i);
+                assert_se(u = manager_get_unit(m, name));
+        }
+
+        assert_se(u->cpu_usage_base == 4711);
+        assert_se(u->active_enter_timestamp.realtime == active.realtime);
+        assert_se(u->active_enter_timestamp.monotonic == active.monotonic);
+
+        manager_free(m);
+}
+
+static void test_newer_version(void) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_fdset_free_ FDSet *fds = NULL;
+        Manager *m = NULL;
+        struct {
+                char magic[8];
+                uint32_t version;
+                uint32_t header_size;
+        } h = {
+                .magic = { 'S', 'D', 'S', 'T', 'A', 'T', 'E', 0 },
+                .version = UINT32_MAX,
+                .header_size = sizeof(h),
+        };
+
+        /* What a later version wrote is refused, rather than misread */
+        assert_se(f = tmpfile());
+        assert_se(fwrite(&h, sizeof(h), 1, f) == 1);
+        assert_se(fseeko(f, 0, SEEK_SET) == 0);
+        assert_se(fds = fdset_new());
+
+        assert_se(manager_new(UNIT_FILE_USER, true, &m) >= 0);
+        assert_se(manager_startup(m, f, fds) == -EPROTONOSUPPORT);
+        manager_free(m);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
+        unsigned n_units = N_UNITS;
+        Manager *m = NULL;
+        int r;
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &n_units) >= 0);
+
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+        assert_se(set_unit_path(TEST_DIR) >= 0);
+
+        r = manager_new(UNIT_FILE_USER, true, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+        manager_free(m);
+
+        test_serialize(n_units, false);
+        test_serialize(n_units, true);
+        test_newer_version();
+
+        return 0;
+}
@@ -31,6 +31,7 @@
 #include "raw-clone.h"
 #include "seccomp-util.h"
 #include "string-util.h"
+#include "time-util.h"
 #include "util.h"
 
 static void test_seccomp_arch_to_string(void) {
@@ -216,6 +217,124 @@ static void test_restrict_namespace(void) {
         assert_se(wait_for_terminate_and_warn("nsseccomp", pid, true) == EXIT_SUCCESS);
 }
 
+static void test_program_compile(void) {
+        _cleanup_(seccomp_program_done) struct sock_fprog prog = {};
+        scmp_filter_ctx seccomp;
+        pid_t pid;
+
+        if (!is_seccomp_available())
+                return;
+
+        if (geteuid() != 0)
+                return;
+
+        assert_se(seccomp_build_filter_set(SCMP_ACT_ALLOW, syscall_filter_sets + SYSCALL_FILTER_SET_IO_EVENT, SCMP_ACT_ERRNO(EPERM), &seccomp) >= 0);
+        assert_se(seccomp_program_compile(seccomp, &prog) >= 0);
+        seccomp_release(seccomp);
+
+        assert_se(prog.len > 0);
+        assert_se(prog.filter);
+
+        pid = fork();
+        assert_se(pid >= 0);
+
+        if (pid == 0) {
+                assert_se(seccomp_program_load(&prog) >= 0);
+
+                assert_se(eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC) < 0);
+                assert_se(errno == EPERM);
+
+                _exit(EXIT_SUCCESS);
+        }
+
+        assert_se(wait_for_terminate_and_warn("seccompprogram", pid, true) == EXIT_SUCCESS);
+}
+
+static usec_t benchmark_one(const struct sock_fprog *prog) {
+        _cleanup_close_pair_ int pipe_fds[2] = { -1, -1 };
+        usec_t t = 0;
+        pid_t pid;
+
+        assert_se(pipe2(pipe_fds, O_CLOEXEC) >= 0);
+
+        pid = fork();
+        assert_se(pid >= 0);
+
+        if (pid == 0) {
+                usec_t start;
+                unsigned i;
+
+                /* What exec_child() does for a unit with a couple of protections turned on, either from scratch or
+                 * from the programs the manager compiled */
+
+                start = now(CLOCK_MONOTONIC);
+
+                for (i = 0; i < 3; i++)
+                        if (prog)
+                                assert_se(seccomp_program_load(prog + i) >= 0);
+                        else if (i < 2)
+                                assert_se(seccomp_load_filter_set(SCMP_ACT_ALLOW,
+                                                                  syscall_filter_sets + (i == 0 ? SYSCALL_FILTER_SET_MODULE : SYSCALL_FILTER_SET_RAW_IO),
+                                                                  SCMP_ACT_ERRNO(EPERM)) >= 0);
+                        else
+                                assert_se(seccomp_restrict_namespaces(0) >= 0);
+
+                t = now(CLOCK_MONOTONIC) - start;
+                assert_se(write(pipe_fds[1], &t, sizeof(t)) == sizeof(t));
+
+                _exit(EXIT_SUCCESS);
+        }
+
+        assert_se(wait_for_terminate_and_warn("seccompbench", pid, true) == EXIT_SUCCESS);
+        assert_se(read(pipe_fds[0], &t, sizeof(t)) == sizeof(t));
+
+        return t;
+}
+
+static void test_program_benchmark(unsigned iterations) {
+        struct sock_fprog prog[3] = {};
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX];
+        usec_t built = 0, compiled = 0;
+        scmp_filter_ctx seccomp;
+        unsigned i;
+
+        if (!is_seccomp_available())
+                return;
+
+        if (geteuid() != 0)
+                return;
+
+        /* Keep the debug output of building the filters out of the numbers */
+        log_set_max_level(LOG_INFO);
+
+        assert_se(seccomp_build_filter_set(SCMP_ACT_ALLOW, syscall_filter_sets + SYSCALL_FILTER_SET_MODULE, SCMP_ACT_ERRNO(EPERM), &seccomp) >= 0);
+        assert_se(seccomp_program_compile(seccomp, prog + 0) >= 0);
+        seccomp_release(seccomp);
+
+        assert_se(seccomp_build_filter_set(SCMP_ACT_ALLOW, syscall_filter_sets + SYSCALL_FILTER_SET_RAW_IO, SCMP_ACT_ERRNO(EPERM), &seccomp) >= 0);
+        assert_se(seccomp_program_compile(seccomp, prog + 1) >= 0);
+        seccomp_release(seccomp);
+
+        assert_se(seccomp_build_restrict_namespaces(0, &seccomp) > 0);
+        assert_se(seccomp_program_compile(seccomp, prog + 2) >= 0);
+        seccomp_release(seccomp);
+
+        for (i = 0; i < iterations; i++) {
+                built += benchmark_one(NULL);
+                compiled += benchmark_one(prog);
+        }
+
+        log_info("Seccomp setup in the child over %u runs: %s on average when built there, %s when precompiled.",
+                 iterations,
+                 format_timespan(a, sizeof(a), built / iterations, 1),
+                 format_timespan(b, sizeof(b), compiled / iterations, 1));
+
+        for (i = 0; i < ELEMENTSOF(prog); i++)
+                seccomp_program_done(prog + i);
+
+        log_set_max_level(LOG_DEBUG);
+}
+
 int main(int argc, char *argv[]) {
 
         log_set_max_level(LOG_DEBUG);
@@ -225,6 +344,8 @@ int main(int argc, char *argv[]) {
         test_syscall_filter_set_find();
         test_filter_sets();
         test_restrict_namespace();
+        test_program_compile();
+        test_program_benchmark(100);
 
         return 0;
 }
@@ -0,0 +1,155 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fileio.h"
+#include "log.h"
+#include "macro.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "udev-util.h"
+#include "udev.h"
+
+#define SYSPATH "/sys/class/net/lo"
+
+static struct udev_device *new_device(struct udev *udev, const char *action) {
+        struct udev_device *dev;
+
+        assert_se(dev = udev_device_new_from_synthetic_event(udev, SYSPATH, action));
+        return dev;
+}
+
+/* runs path_id on the device, and returns the ID_TEST property it ends up with */
+static int run(struct udev *udev, const char *action, bool test, bool *cached, char **id_test) {
+        _cleanup_udev_device_unref_ struct udev_device *dev = NULL;
+        int r;
+
+        dev = new_device(udev, action);
+        r = udev_builtin_run_cached(dev, UDEV_BUILTIN_PATH_ID, "path_id", test, cached);
+        assert_se(r >= 0);
+
+        if (id_test)
+                assert_se(free_and_strdup(id_test, udev_device_get_property_value(dev, "ID_TEST")) >= 0);
+
+        return r;
+}
+
+static void test_cache(struct udev *udev, const char *path) {
+        _cleanup_free_ char *contents = NULL, *id_test = NULL;
+        bool cached;
+        int r;
+
+        /* the first run fills the cache, the second one reuses it */
+        r = run(udev, "change", false, &cached, NULL);
+        assert_se(!cached);
+        assert_se(access(path, F_OK) >= 0);
+        assert_se(run(udev, "change", false, &cached, NULL) == r);
+        assert_se(cached);
+
+        /* the recorded return value and properties are replayed, records of other commands are kept */
+        assert_se(write_string_file(path,
+                                    "C:usb_id\nK:\nR:1\n"
+                                    "C:path_id\nK:\nR:0\nE:ID_TEST=cached\n",
+                                    WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(run(udev, "change", false, &cached, &id_test) == 0);
+        assert_se(cached);
+        assert_se(streq_ptr(id_test, "cached"));
+
+        /* a record with a different key is not used, and replaced by the new result */
+        assert_se(write_string_file(path,
+                                    "C:usb_id\nK:\nR:1\n"
+                                    "C:path_id\nK:stale\nR:0\nE:ID_TEST=cached\n",
+                                    WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(run(udev, "change", false, &cached, &id_test) == r);
+        assert_se(!cached);
+        assert_se(!id_test);
+        assert_se(read_full_file(path, &contents, NULL) >= 0);
+        assert_se(startswith(contents, "C:usb_id\nK:\nR:1\n"));
+        assert_se(!strstr(contents, "stale"));
+        assert_se(run(udev, "change", false, &cached, NULL) == r);
+        assert_se(cached);
+
+        /* "remove" neither uses nor stores results */
+        assert_se(write_string_file(path, "C:path_id\nK:\nR:0\nE:ID_TEST=cached\n", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(run(udev, "remove", false, &cached, &id_test) == r);
+        assert_se(!cached);
+        assert_se(!id_test);
+
+        /* a simulation does not store anything */
+        assert_se(unlink(path) >= 0);
+        assert_se(run(udev, "change", true, &cached, NULL) == r);
+        assert_se(!cached);
+        assert_se(access(path, F_OK) < 0 && errno == ENOENT);
+}
+
+static void test_handle_event(struct udev *udev, const char *path) {
+        const char *actions[] = { "add", "remove" };
+        unsigned i;
+        bool cached;
+
+        for (i = 0; i < ELEMENTSOF(actions); i++) {
+                _cleanup_udev_device_unref_ struct udev_device *change = NULL, *dev = NULL;
+
+                (void) run(udev, "change", false, &cached, NULL);
+                assert_se(access(path, F_OK) >= 0);
+
+                change = new_device(udev, "change");
+                udev_builtin_cache_handle_event(change);
+                assert_se(access(path, F_OK) >= 0);
+
+                dev = new_device(udev, actions[i]);
+                udev_builtin_cache_handle_event(dev);
+                assert_se(access(path, F_OK) < 0 && errno == ENOENT);
+        }
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *dir = NULL;
+        _cleanup_udev_device_unref_ struct udev_device *dev = NULL;
+        _cleanup_udev_unref_ struct udev *udev = NULL;
+        char template[] = "/tmp/test-udev-builtin-cache.XXXXXX";
+        const char *path;
+
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        if (access(SYSPATH, F_OK) < 0) {
+                log_notice("Skipping test: no %s.", SYSPATH);
+                return EXIT_TEST_SKIP;
+        }
+
+        assert_se(mkdtemp(template));
+        assert_se(dir = strdup(template));
+
+        assert_se(udev = udev_new());
+        udev_builtin_set_cache_dir(dir);
+
+        dev = new_device(udev, "change");
+        path = strjoina(dir, "/", udev_device_get_id_filename(dev));
+
+        test_cache(udev, path);
+        test_handle_event(udev, path);
+
+        udev_builtin_set_cache_dir(NULL);
+
+        return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "io-util.h"
+#include "log.h"
+#include "macro.h"
+#include "memfd-util.h"
+#include "time-util.h"
+#include "udev.h"
+#include "util.h"
+
+#define MIB (UINT64_C(1024) * 1024)
+
+/* Regular files and memfds stand in for block devices here, the prefetching only needs the size of
+ * the device and its read-ahead window, which the caller gets from the device. */
+
+static bool resident(int fd, uint64_t offset, uint64_t size) {
+        _cleanup_free_ unsigned char *vec = NULL;
+        size_t n, i;
+        void *p;
+
+        n = DIV_ROUND_UP(size, page_size());
+        assert_se(vec = new(unsigned char, n));
+
+        p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, offset);
+        assert_se(p != MAP_FAILED);
+        assert_se(mincore(p, size, vec) >= 0);
+        assert_se(munmap(p, size) >= 0);
+
+        for (i = 0; i < n; i++)
+                if (!(vec[i] & 1))
+                        return false;
+
+        return true;
+}
+
+static void fill(int fd, uint64_t offset, uint64_t size) {
+        _cleanup_free_ char *buf = NULL;
+
+        assert_se(buf = malloc(size));
+        memset(buf, 'x', size);
+        assert_se(pwrite(fd, buf, size, offset) == (ssize_t) size);
+}
+
+static void test_cached(void) {
+        _cleanup_close_ int fd = -1;
+
+        /* a device which answers at once */
+        assert_se((fd = memfd_new("test-udev-prefetch")) >= 0);
+        fill(fd, 0, 4 * MIB);
+
+        assert_se(udev_prefetch_probe_regions(fd, 0, 4 * MIB, 128 * 1024, USEC_PER_SEC) == 0);
+}
+
+static void test_timeout(void) {
+        _cleanup_close_ int fd = -1;
+        usec_t start;
+
+        /* a device which never answers: read-ahead does nothing on the holes of a memfd */
+        assert_se((fd = memfd_new("test-udev-prefetch")) >= 0);
+        assert_se(ftruncate(fd, 4 * MIB) >= 0);
+
+        start = now(CLOCK_MONOTONIC);
+        assert_se(udev_prefetch_probe_regions(fd, 0, 4 * MIB, 128 * 1024, 100 * USEC_PER_MSEC) == -ETIMEDOUT);
+        assert_se(now(CLOCK_MONOTONIC) - start >= 100 * USEC_PER_MSEC);
+}
+
+static void test_regions(void) {
+        _cleanup_close_ int fd = -1;
+
+        /* only the first MiB and the last two are waited for, with data only there */
+        assert_se((fd = memfd_new("test-udev-prefetch")) >= 0);
+        assert_se(ftruncate(fd, 16 * MIB) >= 0);
+        fill(fd, 0, 1 * MIB);
+        fill(fd, 14 * MIB, 2 * MIB);
+
+        assert_se(udev_prefetch_probe_regions(fd, 0, 16 * MIB, 128 * 1024, USEC_PER_SEC) == 0);
+
+        /* the head starts at the offset, here it overlaps with the tail */
+        assert_se(udev_prefetch_probe_regions(fd, 14 * MIB, 16 * MIB, 128 * 1024, USEC_PER_SEC) == 0);
+        assert_se(udev_prefetch_probe_regions(fd, 512 * 1024, 16 * MIB, 128 * 1024, 10 * USEC_PER_MSEC) == -ETIMEDOUT);
+
+        /* nothing to read */
+        assert_se(udev_prefetch_probe_regions(fd, 16 * MIB, 16 * MIB, 128 * 1024, 10 * USEC_PER_MSEC) == 0);
+}
+
+static void test_readahead(void) {
+        char path[] = "/var/tmp/test-udev-prefetch.XXXXXX";
+        _cleanup_close_ int fd = -1;
+
+        /* a device which has to be read, with a read-ahead window much smaller than the regions */
+        assert_se((fd = mkostemp_safe(path)) >= 0);
+        (void) unlink(path);
+
+        fill(fd, 0, 8 * MIB);
+        assert_se(fsync(fd) >= 0);
+        assert_se(posix_fadvise(fd, 0, 8 * MIB, POSIX_FADV_DONTNEED) == 0);
+
+        if (resident(fd, 0, page_size())) {
+                log_info("Cannot drop pages from the page cache, skipping read-ahead test.");
+                return;
+        }
+
+        assert_se(udev_prefetch_probe_regions(fd, 0, 8 * MIB, 16 * 1024, 10 * USEC_PER_SEC) == 0);
+        assert_se(resident(fd, 0, 1 * MIB));
+        assert_se(resident(fd, 6 * MIB, 2 * MIB));
+}
+
+int main(int argc, char *argv[]) {
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        test_cached();
+        test_timeout();
+        test_regions();
+        test_readahead();
+
+        return 0;
+}
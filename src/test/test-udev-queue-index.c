@@ -0,0 +1,265 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sysmacros.h>
+
+#include "alloc-util.h"
+#include "log.h"
+#include "macro.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "time-util.h"
+#include "udev.h"
+
+#define N_CONTROLLERS 250U
+#define N_COMPARE 20U
+
+struct test_event {
+        struct queue_entry entry;
+        char *devpath;
+        bool queued;
+};
+
+/* The check udevd used to do, against every event queued before this one */
+static bool naive_conflict(const struct queue_entry *loop, const struct queue_entry *e) {
+        size_t common, loop_len = strlen(loop->devpath), len = strlen(e->devpath);
+
+        if (major(e->devnum) != 0 && e->devnum == loop->devnum && e->is_block == loop->is_block)
+                return true;
+        if (e->ifindex != 0 && e->ifindex == loop->ifindex)
+                return true;
+        if (e->devpath_old && streq(loop->devpath, e->devpath_old))
+                return true;
+
+        common = MIN(loop_len, len);
+        if (memcmp(loop->devpath, e->devpath, common) != 0)
+                return false;
+
+        if (loop_len == len) {
+                if (major(e->devnum) != 0 && (e->devnum != loop->devnum || e->is_block != loop->is_block))
+                        return false;
+                if (e->ifindex != 0 && e->ifindex != loop->ifindex)
+                        return false;
+                return true;
+        }
+
+        return e->devpath[common] == '/' || loop->devpath[common] == '/';
+}
+
+static struct queue_entry *naive_find_blocker(struct test_event *events, unsigned n, struct test_event *e) {
+        unsigned i;
+
+        for (i = 0; i < n && &events[i] != e; i++)
+                if (events[i].queued && naive_conflict(&events[i].entry, &e->entry))
+                        return &events[i].entry;
+
+        return NULL;
+}
+
+static void add_event(struct test_event *events, unsigned *n, const char *devpath, dev_t devnum, bool is_block, int ifindex) {
+        struct test_event *e = &events[*n];
+
+        assert_se(e->devpath = strdup(devpath));
+        e->entry.seqnum = ++(*n);
+        e->entry.devpath = e->devpath;
+        e->entry.devnum = devnum;
+        e->entry.is_block = is_block;
+        e->entry.ifindex = ifindex;
+}
+
+/* What a coldplug of a large machine looks like: controllers with disks, partitions, block devices
+ * and network interfaces below them, all triggered in one go. */
+static unsigned generate_coldplug(struct test_event *events, unsigned n_controllers) {
+        char path[256];
+        unsigned c, d, p, n = 0;
+
+        for (c = 0; c < n_controllers; c++) {
+                xsprintf(path, "/devices/pci0000:00/0000:00:%02x.0", c);
+                add_event(events, &n, path, 0, false, 0);
+
+                xsprintf(path, "/devices/pci0000:00/0000:00:%02x.0/net/eth%u", c, c);
+                add_event(events, &n, path, 0, false, c + 2);
+
+                for (d = 0; d < 10; d++) {
+                        xsprintf(path, "/devices/pci0000:00/0000:00:%02x.0/host%u/target%u:0:%u/%u:0:%u:0",
+                                 c, c, c, d, c, d);
+                        add_event(events, &n, path, 0, false, 0);
+
+                        for (p = 0; p < 4; p++) {
+                                unsigned minor = (c * 10 + d) * 16 + p;
+
+                                xsprintf(path, "/devices/pci0000:00/0000:00:%02x.0/host%u/target%u:0:%u/%u:0:%u:0/block/sd%u/sd%u%u",
+                                         c, c, c, d, c, d, c * 10 + d, c * 10 + d, p);
+                                add_event(events, &n, path, makedev(8, minor), true, 0);
+
+                                /* the same minor as char device must not be confused with the block one */
+                                xsprintf(path, "/devices/virtual/misc/char%u", minor);
+                                add_event(events, &n, path, makedev(8, minor), false, 0);
+                        }
+                }
+        }
+
+        return n;
+}
+
+static void free_events(struct test_event *events, unsigned n) {
+        unsigned i;
+
+        for (i = 0; i < n; i++)
+                free(events[i].devpath);
+        free(events);
+}
+
+/* Runs the queue like udevd does: start every event nothing blocks, up to 'parallel' at a time,
+ * then finish the oldest running one. Returns the number of blocker lookups done. */
+static unsigned run_queue(struct queue_index *idx, struct test_event *events, unsigned n, unsigned parallel, bool compare) {
+        unsigned i, first = 0, lookups = 0, n_running = 0, n_queued = n;
+        unsigned *running;
+
+        assert_se(running = new(unsigned, parallel));
+
+        while (n_queued > 0) {
+                for (i = first; i < n && n_running < parallel; i++) {
+                        struct queue_entry *blocker;
+                        unsigned k;
+                        bool is_running = false;
+
+                        if (!events[i].queued)
+                                continue;
+                        for (k = 0; k < n_running; k++)
+                                if (running[k] == i)
+                                        is_running = true;
+                        if (is_running)
+                                continue;
+
+                        blocker = queue_index_find_blocker(idx, &events[i].entry);
+                        lookups++;
+
+                        if (compare) {
+                                struct queue_entry *naive = naive_find_blocker(events, n, &events[i]);
+
+                                /* the index reports the earliest blocker, which is what the linear scan finds first */
+                                assert_se(blocker == naive);
+                        }
+
+                        if (!blocker)
+                                running[n_running++] = i;
+                }
+
+                /* nothing can be blocked if nothing is running, the oldest event never has a blocker */
+                assert_se(n_running > 0);
+
+                i = running[0];
+                memmove(running, running + 1, (n_running - 1) * sizeof(unsigned));
+                n_running--;
+
+                queue_index_remove(idx, &events[i].entry);
+                events[i].queued = false;
+                n_queued--;
+
+                while (first < n && !events[first].queued)
+                        first++;
+        }
+
+        free(running);
+        return lookups;
+}
+
+static void test_coldplug(unsigned n_controllers, unsigned parallel, bool compare) {
+        struct queue_index *idx;
+        struct test_event *events;
+        char ts[FORMAT_TIMESPAN_MAX];
+        unsigned i, n, lookups;
+        usec_t start;
+
+        assert_se(events = new0(struct test_event, n_controllers * (2 + 10 * (1 + 4 * 2))));
+        n = generate_coldplug(events, n_controllers);
+
+        assert_se(idx = queue_index_new());
+
+        start = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++) {
+                assert_se(queue_index_add(idx, &events[i].entry) >= 0);
+                events[i].queued = true;
+        }
+
+        lookups = run_queue(idx, events, n, parallel, compare);
+        log_info("Processed %u events with %u workers, %u lookups in %s.",
+                 n, parallel, lookups, format_timespan(ts, sizeof(ts), now(CLOCK_MONOTONIC) - start, 1));
+
+        assert_se(!queue_index_free(idx));
+        free_events(events, n);
+}
+
+static void test_rename(void) {
+        struct queue_index *idx;
+        struct test_event *events;
+        unsigned n = 0;
+
+        assert_se(events = new0(struct test_event, 4));
+        assert_se(idx = queue_index_new());
+
+        add_event(events, &n, "/devices/virtual/net/eth0", 0, false, 2);
+        add_event(events, &n, "/devices/virtual/net/eth1", 0, false, 3);
+        /* eth0 and eth1 swapped their names, the new event is not blocked by the identical devpath */
+        add_event(events, &n, "/devices/virtual/net/eth0", 0, false, 3);
+        /* a rename waits for events on the old name */
+        add_event(events, &n, "/devices/virtual/net/wan0", 0, false, 4);
+        events[3].entry.devpath_old = "/devices/virtual/net/eth1";
+
+        assert_se(queue_index_add(idx, &events[0].entry) >= 0);
+        assert_se(queue_index_add(idx, &events[1].entry) >= 0);
+        assert_se(queue_index_add(idx, &events[2].entry) >= 0);
+        assert_se(queue_index_add(idx, &events[3].entry) >= 0);
+
+        assert_se(!queue_index_find_blocker(idx, &events[0].entry));
+        assert_se(!queue_index_find_blocker(idx, &events[1].entry));
+        assert_se(queue_index_find_blocker(idx, &events[2].entry) == &events[1].entry);
+        assert_se(queue_index_find_blocker(idx, &events[3].entry) == &events[1].entry);
+
+        queue_index_remove(idx, &events[1].entry);
+        assert_se(!queue_index_find_blocker(idx, &events[2].entry));
+        assert_se(!queue_index_find_blocker(idx, &events[3].entry));
+
+        queue_index_remove(idx, &events[0].entry);
+        queue_index_remove(idx, &events[2].entry);
+        queue_index_remove(idx, &events[3].entry);
+
+        assert_se(!queue_index_free(idx));
+        free_events(events, n);
+}
+
+int main(int argc, char *argv[]) {
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        test_rename();
+
+        /* check that the index agrees with the linear scan */
+        test_coldplug(N_COMPARE, 1, true);
+        test_coldplug(N_COMPARE, 8, true);
+
+        /* and show what it does for a large machine */
+        test_coldplug(N_CONTROLLERS, 8, false);
+        test_coldplug(N_CONTROLLERS, 64, false);
+
+        return 0;
+}
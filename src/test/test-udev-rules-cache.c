@@ -0,0 +1,140 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "log.h"
+#include "macro.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "strv.h"
+#include "udev-util.h"
+#include "udev.h"
+
+static const char rules_a[] =
+        "ACTION==\"remove\", GOTO=\"test_end\"\n"
+        "SUBSYSTEM==\"block\", KERNEL==\"sd*|vd*\", ENV{DEVTYPE}==\"disk\", IMPORT{builtin-cached}=\"path_id\"\n"
+        "ATTRS{idVendor}==\"1234\", ATTR{queue/scheduler}=\"none\", SYMLINK+=\"test/%k\", OWNER=\"root\", MODE=\"0600\"\n"
+        "ENV{ID_PATH}==\"?*\", PROGRAM=\"/bin/true %k\", RESULT==\"x*\", RUN+=\"/bin/echo $env{ID_PATH}\"\n"
+        "LABEL=\"test_end\"\n";
+
+static const char rules_b[] =
+        "SUBSYSTEM==\"net\", ACTION==\"add\", IMPORT{builtin}=\"net_id\", ENV{ID_NET_NAME}=\"test\"\n"
+        "KERNEL==\"tty[0-9]*\", GROUP=\"tty\", MODE=\"0620\", OPTIONS+=\"static_node=tty0\"\n";
+
+static char *dump(struct udev_rules *rules) {
+        char *buf = NULL;
+        size_t size;
+        FILE *f;
+
+        assert_se(f = open_memstream(&buf, &size));
+        udev_rules_dump(rules, f);
+        assert_se(fclose(f) == 0);
+
+        return buf;
+}
+
+static uint64_t read_u64(int fd, off_t offset) {
+        uint64_t v;
+
+        assert_se(pread(fd, &v, sizeof(v), offset) == sizeof(v));
+        return v;
+}
+
+static void test_cache(struct udev *udev, const char *dir) {
+        _cleanup_free_ char *fresh_dump = NULL, *cached_dump = NULL, *reparsed_dump = NULL;
+        struct udev_rules *fresh, *cached, *reparsed;
+        const char *rules_dir, *cache_path;
+        _cleanup_close_ int fd = -1;
+        uint32_t garbage = UINT32_MAX;
+        uint64_t tokens_off;
+        char **dirs;
+
+        rules_dir = strjoina(dir, "/rules.d");
+        cache_path = strjoina(dir, "/rules.bin");
+        dirs = STRV_MAKE((char*) rules_dir);
+
+        assert_se(mkdir(rules_dir, 0755) >= 0);
+        assert_se(write_string_file(strjoina(rules_dir, "/10-a.rules"), rules_a, WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(write_string_file(strjoina(rules_dir, "/20-b.rules"), rules_b, WRITE_STRING_FILE_CREATE) >= 0);
+
+        /* the first run parses the rules and writes the cache */
+        assert_se(fresh = udev_rules_new_full(udev, 0, dirs, cache_path));
+        assert_se(!udev_rules_is_cached(fresh));
+        assert_se(access(cache_path, F_OK) >= 0);
+
+        /* the second one maps it, with the same result */
+        assert_se(cached = udev_rules_new_full(udev, 0, dirs, cache_path));
+        assert_se(udev_rules_is_cached(cached));
+
+        fresh_dump = dump(fresh);
+        cached_dump = dump(cached);
+        assert_se(streq(fresh_dump, cached_dump));
+
+        udev_rules_unref(cached);
+
+        /* A string offset pointing beyond the file is refused, and the rules are parsed again. The
+         * header has the offset of the tokens after signature, version, three sizes and the key, and
+         * the first token is a rule, with the offset of its label at byte 4. */
+        assert_se(chmod(cache_path, 0644) >= 0);
+        assert_se((fd = open(cache_path, O_RDWR|O_CLOEXEC)) >= 0);
+        tokens_off = read_u64(fd, 48);
+        assert_se(pwrite(fd, &garbage, sizeof(garbage), tokens_off + 4) == sizeof(garbage));
+        fd = safe_close(fd);
+
+        assert_se(reparsed = udev_rules_new_full(udev, 0, dirs, cache_path));
+        assert_se(!udev_rules_is_cached(reparsed));
+
+        reparsed_dump = dump(reparsed);
+        assert_se(streq(fresh_dump, reparsed_dump));
+
+        udev_rules_unref(reparsed);
+
+        /* a change to the rules invalidates the cache */
+        assert_se(write_string_file(strjoina(rules_dir, "/20-b.rules"), rules_a, WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(reparsed = udev_rules_new_full(udev, 0, dirs, cache_path));
+        assert_se(!udev_rules_is_cached(reparsed));
+
+        udev_rules_unref(reparsed);
+        udev_rules_unref(fresh);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *dir = NULL;
+        _cleanup_udev_unref_ struct udev *udev = NULL;
+        char template[] = "/tmp/test-udev-rules-cache.XXXXXX";
+
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        assert_se(mkdtemp(template));
+        assert_se(dir = strdup(template));
+
+        assert_se(udev = udev_new());
+
+        test_cache(udev, dir);
+
+        return 0;
+}
@@ -24,6 +24,7 @@
 #include <unistd.h>
 
 #include "def.h"
+#include "fd-util.h"
 #include "fileio.h"
 #include "fs-util.h"
 #include "parse-util.h"
@@ -239,6 +240,52 @@ static void test_execute_directory(void) {
         (void) rm_rf(template_hi, REMOVE_ROOT|REMOVE_PHYSICAL);
 }
 
+static void test_execute_directories_full(void) {
+        char template[] = "/tmp/test-execute-directories-full.XXXXXXX";
+        const char * dirs[] = {template, NULL};
+        _cleanup_fclose_ FILE *f = NULL;
+        char line[LINE_MAX];
+        uint64_t last_finish = 0;
+        unsigned n = 0;
+        const char *name;
+        int fd;
+
+        assert_se(mkdtemp(template));
+
+        name = strjoina(template, "/first");
+        assert_se(write_string_file(name, "#!/bin/sh\nsleep 0.1", WRITE_STRING_FILE_CREATE) == 0);
+        assert_se(chmod(name, 0755) == 0);
+        name = strjoina(template, "/second");
+        assert_se(write_string_file(name, "#!/bin/sh\nsleep 0.1", WRITE_STRING_FILE_CREATE) == 0);
+        assert_se(chmod(name, 0755) == 0);
+
+        fd = open_tmpfile_unlinkable(NULL, O_RDWR|O_CLOEXEC);
+        assert_se(fd >= 0);
+        assert_se(f = fdopen(fd, "r"));
+
+        /* With a limit of one the two scripts must not overlap */
+        execute_directories_full(dirs, DEFAULT_TIMEOUT_USEC, NULL, 1, fd);
+
+        rewind(f);
+        FOREACH_LINE(line, f, assert_not_reached("Failed to read timings")) {
+                uint64_t start, finish;
+                int k = 0;
+
+                assert_se(sscanf(line, "%" SCNu64 " %" SCNu64 " %n", &start, &finish, &k) == 2);
+                assert_se(startswith(line + k, template));
+                assert_se(start > 0);
+                assert_se(finish >= start + 100 * USEC_PER_MSEC);
+                assert_se(start >= last_finish);
+
+                last_finish = finish;
+                n++;
+        }
+
+        assert_se(n == 2);
+
+        (void) rm_rf(template, REMOVE_ROOT|REMOVE_PHYSICAL);
+}
+
 static void test_raw_clone(void) {
         pid_t parent, pid, pid2;
 
@@ -360,6 +407,7 @@ int main(int argc, char *argv[]) {
         test_in_set();
         test_log2i();
         test_execute_directory();
+        test_execute_directories_full();
         test_raw_clone();
         test_physical_memory();
         test_physical_memory_scale();
@@ -25,16 +25,29 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <linux/fs.h>
 
 #include "sd-id128.h"
 
 #include "alloc-util.h"
 #include "efivars.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "gpt.h"
 #include "string-util.h"
+#include "time-util.h"
 #include "udev.h"
+#include "util.h"
+
+/*
+ * libblkid reads the device synchronously, a device which does not answer, like a failed path of
+ * a SAN LUN, keeps the worker waiting. The regions the probing will look at are read ahead
+ * asynchronously first. If they do not arrive in time, the device is probed nevertheless, but
+ * that is logged, to point at the device holding up the event.
+ */
+#define PROBE_TIMEOUT_USEC (10 * USEC_PER_SEC)
 
 static void print_property(struct udev_device *dev, bool test, const char *name, const char *value) {
         char s[256];
@@ -224,6 +237,7 @@ static int builtin_blkid(struct udev_device *dev, int argc, char *argv[], bool t
         const char *root_partition;
         int64_t offset = 0;
         bool noraid = false;
+        usec_t timeout = PROBE_TIMEOUT_USEC;
         _cleanup_close_ int fd = -1;
         blkid_probe pr;
         const char *data;
@@ -237,13 +251,14 @@ static int builtin_blkid(struct udev_device *dev, int argc, char *argv[], bool t
         static const struct option options[] = {
                 { "offset", optional_argument, NULL, 'o' },
                 { "noraid", no_argument, NULL, 'R' },
+                { "timeout", required_argument, NULL, 't' },
                 {}
         };
 
         for (;;) {
                 int option;
 
-                option = getopt_long(argc, argv, "oR", options, NULL);
+                option = getopt_long(argc, argv, "oRt:", options, NULL);
                 if (option == -1)
                         break;
 
@@ -254,6 +269,12 @@ static int builtin_blkid(struct udev_device *dev, int argc, char *argv[], bool t
                 case 'R':
                         noraid = true;
                         break;
+                case 't':
+                        if (parse_sec(optarg, &timeout) < 0)
+                                log_error("invalid timeout '%s', ignoring", optarg);
+                        else if (timeout == 0)
+                                timeout = USEC_INFINITY;
+                        break;
                 }
         }
 
@@ -276,6 +297,33 @@ static int builtin_blkid(struct udev_device *dev, int argc, char *argv[], bool t
                 goto out;
         }
 
+        if (timeout != USEC_INFINITY) {
+                char ts[FORMAT_TIMESPAN_MAX];
+                uint64_t size;
+                long ra;
+
+                /* without a read-ahead window, asking for read-ahead reads nothing */
+                if (ioctl(fd, BLKGETSIZE64, &size) < 0)
+                        err = -errno;
+                else if (ioctl(fd, BLKRAGET, &ra) < 0)
+                        err = -errno;
+                else if (ra <= 0)
+                        err = -EOPNOTSUPP;
+                else
+                        err = udev_prefetch_probe_regions(fd, offset, size, (uint64_t) ra * 512, timeout);
+
+                /* a hung device would pin the worker in the synchronous probe */
+                if (err == -ETIMEDOUT) {
+                        log_warning("%s did not answer within %s, not probing it",
+                                    udev_device_get_devnode(dev), format_timespan(ts, sizeof(ts), timeout, 0));
+                        goto out;
+                }
+                /* not a block device, one which cannot be mapped, or without a read-ahead window, just probe it */
+                if (err < 0)
+                        log_debug_errno(err, "Failed to read ahead %s, ignoring: %m", udev_device_get_devnode(dev));
+                err = 0;
+        }
+
         err = blkid_probe_set_device(pr, fd, offset, 0);
         if (err < 0)
                 goto out;
@@ -321,17 +369,93 @@ static int builtin_blkid(struct udev_device *dev, int argc, char *argv[], bool t
         if (is_gpt)
                 find_gpt_root(dev, pr, test);
 
-        blkid_free_probe(pr);
 out:
+        blkid_free_probe(pr);
         if (err < 0)
                 return EXIT_FAILURE;
 
         return EXIT_SUCCESS;
 }
 
+/*
+ * What is on the device only changes with writes to it, which are counted in its statistics, or
+ * with a new medium. The content of device-mapper and md devices can also change with their
+ * configuration, which cannot be told from the outside, they are always probed.
+ */
+static int read_write_counters(struct udev_device *dev, unsigned long *writes, unsigned long *sectors) {
+        _cleanup_free_ char *path = NULL, *line = NULL;
+        int r;
+
+        path = strjoin(udev_device_get_syspath(dev), "/stat");
+        if (!path)
+                return -ENOMEM;
+
+        r = read_one_line_file(path, &line);
+        if (r < 0)
+                return r;
+
+        /* the fifth and the seventh field are the completed writes and the sectors written */
+        if (sscanf(line, "%*u %*u %*u %*u %lu %*u %lu", writes, sectors) != 2)
+                return -EINVAL;
+
+        return 0;
+}
+
+/*
+ * The result is reused as long as nothing was written through this device, the disk it is a
+ * partition of, or, for loop devices, to the backing file. Writes which bypass the block layer of
+ * this host, like another host writing to shared storage, are not noticed, rules should not cache
+ * the result for such devices.
+ */
+static int builtin_blkid_cache_key(struct udev_device *dev, char *key, size_t size) {
+        unsigned long writes, sectors, disk_writes = 0, disk_sectors = 0;
+        const char *sysname, *backing_file;
+        struct stat st = {};
+        int r;
+
+        sysname = udev_device_get_sysname(dev);
+        if (!sysname || startswith(sysname, "dm-") || startswith(sysname, "md"))
+                return -EOPNOTSUPP;
+
+        r = read_write_counters(dev, &writes, &sectors);
+        if (r < 0)
+                return r;
+
+        if (streq_ptr(udev_device_get_devtype(dev), "partition")) {
+                struct udev_device *disk;
+
+                disk = udev_device_get_parent_with_subsystem_devtype(dev, "block", "disk");
+                if (!disk)
+                        return -EOPNOTSUPP;
+
+                r = read_write_counters(disk, &disk_writes, &disk_sectors);
+                if (r < 0)
+                        return r;
+        }
+
+        /* the backing file can be written to without going through the loop device */
+        backing_file = udev_device_get_sysattr_value(dev, "loop/backing_file");
+        if (backing_file && stat(backing_file, &st) < 0)
+                return -EOPNOTSUPP;
+
+        snprintf(key, size, "%s %lu %lu %lu %lu %s %s %lu %lu %"PRIu64" "NSEC_FMT,
+                 strempty(udev_device_get_sysattr_value(dev, "size")), writes, sectors, disk_writes, disk_sectors,
+                 strempty(backing_file),
+                 strempty(udev_device_get_sysattr_value(dev, "loop/offset")),
+                 (unsigned long) st.st_dev, (unsigned long) st.st_ino, (uint64_t) st.st_size,
+                 timespec_load_nsec(&st.st_mtim));
+
+        /* the kernel saw a new medium, which might be the same size, and has not been written to */
+        if (streq_ptr(udev_device_get_property_value(dev, "DISK_MEDIA_CHANGE"), "1"))
+                return 1;
+
+        return 0;
+}
+
 const struct udev_builtin udev_builtin_blkid = {
         .name = "blkid",
         .cmd = builtin_blkid,
         .help = "Filesystem and partition probing",
+        .cache_key = builtin_blkid_cache_key,
         .run_once = true,
 };
@@ -337,4 +337,5 @@ const struct udev_builtin udev_builtin_input_id = {
         .name = "input_id",
         .cmd = builtin_input_id,
         .help = "Input device properties",
+        .cache_key = udev_builtin_cache_key_device,
 };
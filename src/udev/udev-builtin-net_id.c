@@ -631,8 +631,17 @@ out:
         return EXIT_SUCCESS;
 }
 
+/* the MAC address of an interface can be changed at any time */
+static int builtin_net_id_cache_key(struct udev_device *dev, char *key, size_t size) {
+        strscpyl(key, size,
+                 strempty(udev_device_get_sysattr_value(dev, "addr_assign_type")), " ",
+                 strempty(udev_device_get_sysattr_value(dev, "address")), NULL);
+        return 0;
+}
+
 const struct udev_builtin udev_builtin_net_id = {
         .name = "net_id",
         .cmd = builtin_net_id,
         .help = "Network device properties",
+        .cache_key = builtin_net_id_cache_key,
 };
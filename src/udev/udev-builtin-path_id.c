@@ -766,5 +766,6 @@ const struct udev_builtin udev_builtin_path_id = {
         .name = "path_id",
         .cmd = builtin_path_id,
         .help = "Compose persistent device path",
+        .cache_key = udev_builtin_cache_key_device,
         .run_once = true,
 };
@@ -469,5 +469,6 @@ const struct udev_builtin udev_builtin_usb_id = {
         .name = "usb_id",
         .cmd = builtin_usb_id,
         .help = "USB device properties",
+        .cache_key = udev_builtin_cache_key_device,
         .run_once = true,
 };
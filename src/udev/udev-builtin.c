@@ -17,14 +17,45 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include <errno.h>
 #include <getopt.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "mkdir.h"
+#include "parse-util.h"
 #include "string-util.h"
+#include "strv.h"
 #include "udev.h"
 
+/*
+ * Results of builtins which support it are kept per device in /run/udev/builtin/, so that later
+ * events for the same device, which usually only signal a change of some state, can reuse them
+ * instead of walking sysfs or probing the device again. Rules opt in with IMPORT{builtin-cached}.
+ * The file of a device is removed with its "add" and "remove" events. For every command it holds
+ * a record, which is only reused if the key the builtin calculates for the current state of the
+ * device still matches:
+ *
+ *   C:<command>
+ *   K:<key>
+ *   R:<return value>
+ *   E:<property>=<value>
+ *   ...
+ */
+#define BUILTIN_CACHE_DIR "/run/udev/builtin"
+
 static bool initialized;
+static const char *cache_dir = BUILTIN_CACHE_DIR;
+
+/* while a builtin runs whose result is to be cached, the properties it sets are recorded here */
+static bool recording;
+static bool recording_failed;
+static char **recorded_properties;
 
 static const struct udev_builtin *builtins[] = {
 #ifdef HAVE_BLKID
@@ -133,9 +164,218 @@ int udev_builtin_run(struct udev_device *dev, enum udev_builtin_cmd cmd, const c
         return builtins[cmd]->cmd(dev, argc, argv, test);
 }
 
+bool udev_builtin_cacheable(enum udev_builtin_cmd cmd) {
+        if (!builtins[cmd])
+                return false;
+
+        return builtins[cmd]->cache_key;
+}
+
+/* for builtins whose result only depends on the device, which does not change until it is removed */
+/* for tests */
+void udev_builtin_set_cache_dir(const char *dir) {
+        cache_dir = dir ?: BUILTIN_CACHE_DIR;
+}
+
+int udev_builtin_cache_key_device(struct udev_device *dev, char *key, size_t size) {
+        key[0] = '\0';
+        return 0;
+}
+
+static int builtin_cache_path(struct udev_device *dev, char **ret) {
+        const char *id;
+        char *path;
+
+        id = udev_device_get_id_filename(dev);
+        if (!id)
+                return -ENODEV;
+
+        path = strjoin(cache_dir, "/", id);
+        if (!path)
+                return -ENOMEM;
+
+        *ret = path;
+        return 0;
+}
+
+/* applies the recorded result for the command, and returns the recorded return value of the builtin */
+static int builtin_cache_lookup(struct udev_device *dev, const char *path, const char *command, const char *key) {
+        _cleanup_free_ char *contents = NULL;
+        bool matching = false, key_matching = false;
+        char *line, *next;
+        int r, ret = -ENOENT;
+
+        r = read_full_file(path, &contents, NULL);
+        if (r < 0)
+                return r;
+
+        for (line = contents; line && *line; line = next) {
+                next = strchr(line, '\n');
+                if (next)
+                        *next++ = '\0';
+
+                if (startswith(line, "C:")) {
+                        if (key_matching)
+                                break;
+                        matching = streq(line + 2, command);
+                } else if (!matching)
+                        continue;
+                else if (startswith(line, "K:"))
+                        key_matching = streq(line + 2, key);
+                else if (!key_matching)
+                        continue;
+                else if (startswith(line, "R:")) {
+                        r = safe_atoi(line + 2, &ret);
+                        if (r < 0)
+                                return r;
+                } else if (startswith(line, "E:")) {
+                        char *value;
+
+                        value = strchr(line + 2, '=');
+                        if (!value)
+                                continue;
+                        *value++ = '\0';
+
+                        udev_device_add_property(dev, line + 2, value);
+                }
+        }
+
+        return key_matching ? ret : -ENOENT;
+}
+
+static int builtin_cache_store(const char *path, const char *command, const char *key, int ret, char **properties) {
+        _cleanup_free_ char *contents = NULL, *path_tmp = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        bool skip = false;
+        char *line, *next;
+        char **p;
+        int r;
+
+        /* the records are line based */
+        STRV_FOREACH(p, properties)
+                if (strchr(*p, '\n'))
+                        return -EINVAL;
+        if (strchr(command, '\n') || strchr(key, '\n'))
+                return -EINVAL;
+
+        r = read_full_file(path, &contents, NULL);
+        if (r < 0 && r != -ENOENT)
+                return r;
+
+        r = mkdir_parents(path, 0755);
+        if (r < 0)
+                return r;
+
+        r = fopen_temporary(path, &f, &path_tmp);
+        if (r < 0)
+                return r;
+        (void) fchmod(fileno(f), 0644);
+
+        /* keep the records of the other commands */
+        for (line = contents; line && *line; line = next) {
+                next = strchr(line, '\n');
+                if (next)
+                        *next++ = '\0';
+
+                if (startswith(line, "C:"))
+                        skip = streq(line + 2, command);
+                if (!skip)
+                        fprintf(f, "%s\n", line);
+        }
+
+        fprintf(f, "C:%s\nK:%s\nR:%i\n", command, key, ret);
+        STRV_FOREACH(p, properties)
+                fprintf(f, "E:%s\n", *p);
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                goto fail;
+
+        if (rename(path_tmp, path) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        return 0;
+
+fail:
+        unlink_noerrno(path_tmp);
+        return r;
+}
+
+int udev_builtin_run_cached(struct udev_device *dev, enum udev_builtin_cmd cmd, const char *command, bool test, bool *ret_cached) {
+        _cleanup_free_ char *path = NULL;
+        _cleanup_strv_free_ char **properties = NULL;
+        char key[UTIL_PATH_SIZE];
+        bool failed;
+        int r, ret;
+
+        assert(ret_cached);
+
+        *ret_cached = false;
+
+        if (!udev_builtin_cacheable(cmd))
+                return udev_builtin_run(dev, cmd, command, false);
+
+        /* a device which goes away, or changes its name, starts over with its next event */
+        if (STR_IN_SET(strempty(udev_device_get_action(dev)), "remove", "move"))
+                return udev_builtin_run(dev, cmd, command, false);
+
+        r = builtins[cmd]->cache_key(dev, key, sizeof(key));
+        if (r < 0)
+                return udev_builtin_run(dev, cmd, command, false);
+
+        if (builtin_cache_path(dev, &path) < 0)
+                return udev_builtin_run(dev, cmd, command, false);
+
+        /* the builtin may ask for a new result, even if nothing in its key changed */
+        if (r == 0) {
+                ret = builtin_cache_lookup(dev, path, command, key);
+                if (ret >= 0) {
+                        log_debug("using cached result of '%s'", command);
+                        *ret_cached = true;
+                        return ret;
+                }
+        }
+
+        recording = true;
+        ret = udev_builtin_run(dev, cmd, command, false);
+        properties = recorded_properties;
+        failed = recording_failed;
+        recorded_properties = NULL;
+        recording_failed = false;
+        recording = false;
+
+        /* errors might be transient, they are not remembered, and neither is what a simulation saw */
+        if (ret < 0 || failed || test)
+                return ret;
+
+        r = builtin_cache_store(path, command, key, ret, properties);
+        if (r < 0)
+                log_debug_errno(r, "failed to cache result of '%s', ignoring: %m", command);
+
+        return ret;
+}
+
+/* results of builtins are stale after "remove", and of no use to a new device with the same name after "add" */
+void udev_builtin_cache_handle_event(struct udev_device *dev) {
+        _cleanup_free_ char *path = NULL;
+
+        if (!STR_IN_SET(strempty(udev_device_get_action(dev)), "add", "remove"))
+                return;
+
+        if (builtin_cache_path(dev, &path) < 0)
+                return;
+
+        (void) unlink(path);
+}
+
 int udev_builtin_add_property(struct udev_device *dev, bool test, const char *key, const char *val) {
         udev_device_add_property(dev, key, val);
 
+        if (recording && strv_extendf(&recorded_properties, "%s=%s", key, strempty(val)) < 0)
+                recording_failed = true;
+
         if (test)
                 printf("%s=%s\n", key, val);
         return 0;
@@ -828,6 +828,9 @@ void udev_event_execute_rules(struct udev_event *event,
         if (udev_device_get_subsystem(dev) == NULL)
                 return;
 
+        if (!event->test)
+                udev_builtin_cache_handle_event(dev);
+
         if (streq(udev_device_get_action(dev), "remove")) {
                 udev_device_read_db(dev);
                 udev_device_tag_index(dev, NULL, false);
@@ -0,0 +1,156 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "macro.h"
+#include "time-util.h"
+#include "udev.h"
+#include "util.h"
+
+/*
+ * Superblocks and partition tables live in the first MiB of a device; RAID metadata, ZFS labels
+ * and the backup GPT header are found in its last two MiB. These are the regions probing looks
+ * at, merged into one for small devices.
+ */
+#define PREFETCH_HEAD_SIZE (UINT64_C(1) * 1024 * 1024)
+#define PREFETCH_TAIL_SIZE (UINT64_C(2) * 1024 * 1024)
+#define PREFETCH_POLL_MAX_USEC (100 * USEC_PER_MSEC)
+
+struct prefetch_region {
+        uint64_t offset;
+        uint64_t size;
+};
+
+static unsigned prefetch_plan(uint64_t offset, uint64_t size, struct prefetch_region plan[static 2]) {
+        uint64_t head_end, tail_start;
+
+        if (offset >= size)
+                return 0;
+
+        head_end = MIN(size, offset + PREFETCH_HEAD_SIZE);
+        tail_start = MAX(size > PREFETCH_TAIL_SIZE ? size - PREFETCH_TAIL_SIZE : 0, offset);
+
+        if (tail_start <= head_end) {
+                plan[0] = (struct prefetch_region) { offset, size - offset };
+                return 1;
+        }
+
+        plan[0] = (struct prefetch_region) { offset, head_end - offset };
+        plan[1] = (struct prefetch_region) { tail_start, size - tail_start };
+        return 2;
+}
+
+/* The kernel reads at most one read-ahead window per request, larger ones are cut short */
+static int prefetch_region_advise(int fd, const struct prefetch_region *region, uint64_t window) {
+        uint64_t o, end = region->offset + region->size;
+        int r;
+
+        for (o = region->offset; o < end; o += window) {
+                r = posix_fadvise(fd, o, MIN(window, end - o), POSIX_FADV_WILLNEED);
+                if (r != 0)
+                        return -r;
+        }
+
+        return 0;
+}
+
+/* returns > 0 if the whole region is in the page cache, without touching the device */
+static int prefetch_region_cached(int fd, const struct prefetch_region *region) {
+        _cleanup_free_ unsigned char *vec = NULL;
+        uint64_t start;
+        size_t len, n, i;
+        void *p;
+        int r = 1;
+
+        start = region->offset & ~((uint64_t) page_size() - 1);
+        len = region->offset + region->size - start;
+        n = DIV_ROUND_UP(len, page_size());
+
+        vec = new(unsigned char, n);
+        if (!vec)
+                return -ENOMEM;
+
+        p = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, start);
+        if (p == MAP_FAILED)
+                return -errno;
+
+        if (mincore(p, len, vec) < 0)
+                r = -errno;
+        else
+                for (i = 0; i < n; i++)
+                        if (!(vec[i] & 1)) {
+                                r = 0;
+                                break;
+                        }
+
+        (void) munmap(p, len);
+        return r;
+}
+
+/*
+ * Reads the regions of a device of the specified size probing looks at into the page cache
+ * asynchronously, in requests of at most window bytes, and waits for them to arrive. Returns
+ * -ETIMEDOUT if they did not in time, which includes pages which failed to read.
+ */
+int udev_prefetch_probe_regions(int fd, uint64_t offset, uint64_t size, uint64_t window, usec_t timeout) {
+        struct prefetch_region plan[2];
+        usec_t deadline, delay = USEC_PER_MSEC;
+        unsigned n, i;
+        int r;
+
+        assert(fd >= 0);
+
+        window = MAX(window & ~((uint64_t) page_size() - 1), (uint64_t) page_size());
+
+        n = prefetch_plan(offset, size, plan);
+
+        /* queue all reads at once, the kernel does them in the background */
+        for (i = 0; i < n; i++) {
+                r = prefetch_region_advise(fd, &plan[i], window);
+                if (r < 0)
+                        return r;
+        }
+
+        deadline = usec_add(now(CLOCK_MONOTONIC), timeout);
+
+        for (;;) {
+                usec_t n_usec;
+                bool done = true;
+
+                for (i = 0; i < n && done; i++) {
+                        r = prefetch_region_cached(fd, &plan[i]);
+                        if (r < 0)
+                                return r;
+                        if (r == 0)
+                                done = false;
+                }
+
+                if (done)
+                        return 0;
+
+                n_usec = now(CLOCK_MONOTONIC);
+                if (n_usec >= deadline)
+                        return -ETIMEDOUT;
+
+                (void) usleep(MIN(delay, deadline - n_usec));
+                delay = MIN(delay * 2, PREFETCH_POLL_MAX_USEC);
+        }
+}
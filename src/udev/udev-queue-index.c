@@ -0,0 +1,418 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc-util.h"
+#include "hashmap.h"
+#include "udev.h"
+
+/*
+ * Index of the queued and running events, answering whether an event has to wait for an
+ * earlier one which is still in the queue:
+ *
+ *   - events for the same devpath, a parent or a child devpath, or the old name of a renamed device
+ *   - events for the same device node number (block or char)
+ *   - events for the same network interface index
+ *
+ * Devpaths are kept in a trie of path components. Each node lists the entries for exactly its
+ * devpath, and links to all entries anywhere below it. All lists are appended to in order of
+ * insertion, i.e. in seqnum order, so the earliest entry is always at the head and a lookup only
+ * needs to look at the heads of the lists along the devpath.
+ */
+
+struct devpath_node {
+        struct devpath_node *parent;
+        char *name;
+        Hashmap *children;
+
+        /* entries for exactly this devpath */
+        struct udev_list_node entries;
+        /* struct queue_link of all entries below this devpath */
+        struct udev_list_node descendants;
+
+        /* number of entries at or below this node, the node is freed when it drops to zero */
+        unsigned n_ref;
+};
+
+struct queue_link {
+        struct udev_list_node node;
+        struct queue_entry *entry;
+};
+
+struct queue_bucket {
+        uint64_t key;
+        struct udev_list_node entries;
+};
+
+struct queue_index {
+        struct devpath_node root;
+        Hashmap *by_devnum;
+        Hashmap *by_ifindex;
+};
+
+#define FIRST_ENTRY(list, member)                                               \
+        (udev_list_node_is_empty(list) ? NULL : container_of((list)->next, struct queue_entry, member))
+
+struct queue_index *queue_index_new(void) {
+        struct queue_index *idx;
+
+        idx = new0(struct queue_index, 1);
+        if (!idx)
+                return NULL;
+
+        udev_list_node_init(&idx->root.entries);
+        udev_list_node_init(&idx->root.descendants);
+
+        return idx;
+}
+
+struct queue_index *queue_index_free(struct queue_index *idx) {
+        if (!idx)
+                return NULL;
+
+        /* all entries must have been removed already, which frees all nodes and buckets */
+        assert(hashmap_isempty(idx->root.children));
+        assert(hashmap_isempty(idx->by_devnum));
+        assert(hashmap_isempty(idx->by_ifindex));
+
+        hashmap_free(idx->root.children);
+        hashmap_free(idx->by_devnum);
+        hashmap_free(idx->by_ifindex);
+
+        return mfree(idx);
+}
+
+static struct devpath_node *devpath_node_lookup(struct queue_index *idx, const char *devpath) {
+        struct devpath_node *node = &idx->root;
+        const char *p = devpath;
+
+        while (node) {
+                char name[strlen(p) + 1];
+                size_t n;
+
+                p += strspn(p, "/");
+                if (*p == '\0')
+                        return node == &idx->root ? NULL : node;
+
+                n = strcspn(p, "/");
+                memcpy(name, p, n);
+                name[n] = '\0';
+                p += n;
+
+                node = hashmap_get(node->children, name);
+        }
+
+        return NULL;
+}
+
+static void devpath_node_unref(struct devpath_node *node) {
+        while (node && node->parent) {
+                struct devpath_node *parent = node->parent;
+
+                assert(node->n_ref > 0);
+
+                node->n_ref--;
+                if (node->n_ref == 0) {
+                        assert(udev_list_node_is_empty(&node->entries));
+                        assert(udev_list_node_is_empty(&node->descendants));
+
+                        hashmap_remove(parent->children, node->name);
+                        hashmap_free(node->children);
+                        free(node->name);
+                        free(node);
+                }
+
+                node = parent;
+        }
+}
+
+/* finds or creates the node for the devpath, taking a reference on it and all of its parents */
+static int devpath_node_get(struct queue_index *idx, const char *devpath, struct devpath_node **ret, unsigned *ret_depth) {
+        struct devpath_node *node = &idx->root;
+        const char *p = devpath;
+        unsigned depth = 0;
+        int r;
+
+        for (;;) {
+                struct devpath_node *child;
+                _cleanup_free_ char *name = NULL;
+                size_t n;
+
+                p += strspn(p, "/");
+                if (*p == '\0')
+                        break;
+
+                n = strcspn(p, "/");
+                name = strndup(p, n);
+                if (!name) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+                p += n;
+
+                child = hashmap_get(node->children, name);
+                if (!child) {
+                        r = hashmap_ensure_allocated(&node->children, &string_hash_ops);
+                        if (r < 0)
+                                goto fail;
+
+                        child = new0(struct devpath_node, 1);
+                        if (!child) {
+                                r = -ENOMEM;
+                                goto fail;
+                        }
+
+                        child->parent = node;
+                        child->name = name;
+                        udev_list_node_init(&child->entries);
+                        udev_list_node_init(&child->descendants);
+
+                        r = hashmap_put(node->children, child->name, child);
+                        if (r < 0) {
+                                free(child);
+                                goto fail;
+                        }
+                        name = NULL;
+                }
+
+                child->n_ref++;
+                node = child;
+                depth++;
+        }
+
+        if (node == &idx->root)
+                return -EINVAL;
+
+        *ret = node;
+        *ret_depth = depth;
+        return 0;
+
+fail:
+        devpath_node_unref(node);
+        return r;
+}
+
+static int bucket_add(Hashmap **h, uint64_t key, struct udev_list_node *link) {
+        struct queue_bucket *bucket;
+        int r;
+
+        bucket = hashmap_get(*h, &key);
+        if (!bucket) {
+                r = hashmap_ensure_allocated(h, &uint64_hash_ops);
+                if (r < 0)
+                        return r;
+
+                bucket = new0(struct queue_bucket, 1);
+                if (!bucket)
+                        return -ENOMEM;
+
+                bucket->key = key;
+                udev_list_node_init(&bucket->entries);
+
+                r = hashmap_put(*h, &bucket->key, bucket);
+                if (r < 0) {
+                        free(bucket);
+                        return r;
+                }
+        }
+
+        udev_list_node_append(link, &bucket->entries);
+        return 0;
+}
+
+static void bucket_remove(Hashmap *h, uint64_t key, struct udev_list_node *link) {
+        struct queue_bucket *bucket;
+
+        if (!link->next)
+                return;
+
+        udev_list_node_remove(link);
+
+        bucket = hashmap_get(h, &key);
+        assert(bucket);
+
+        if (udev_list_node_is_empty(&bucket->entries)) {
+                hashmap_remove(h, &bucket->key);
+                free(bucket);
+        }
+}
+
+static struct udev_list_node *bucket_entries(Hashmap *h, uint64_t key) {
+        struct queue_bucket *bucket;
+
+        bucket = hashmap_get(h, &key);
+        return bucket ? &bucket->entries : NULL;
+}
+
+static inline uint64_t devnum_key(const struct queue_entry *entry) {
+        return ((uint64_t) entry->devnum << 1) | entry->is_block;
+}
+
+int queue_index_add(struct queue_index *idx, struct queue_entry *entry) {
+        struct devpath_node *node, *n;
+        unsigned depth, i;
+        int r;
+
+        assert(idx);
+        assert(entry);
+        assert(entry->devpath);
+        assert(!entry->devpath_node);
+
+        r = devpath_node_get(idx, entry->devpath, &node, &depth);
+        if (r < 0)
+                return r;
+
+        /* link the entry into all nodes above its own one, except the root */
+        entry->n_ancestor_links = depth - 1;
+        if (entry->n_ancestor_links > 0) {
+                entry->ancestor_links = new0(struct queue_link, entry->n_ancestor_links);
+                if (!entry->ancestor_links) {
+                        devpath_node_unref(node);
+                        return -ENOMEM;
+                }
+        }
+
+        if (major(entry->devnum) != 0) {
+                r = bucket_add(&idx->by_devnum, devnum_key(entry), &entry->devnum_link);
+                if (r < 0)
+                        goto fail;
+        }
+
+        if (entry->ifindex != 0) {
+                r = bucket_add(&idx->by_ifindex, (uint64_t) entry->ifindex, &entry->ifindex_link);
+                if (r < 0)
+                        goto fail;
+        }
+
+        entry->devpath_node = node;
+        udev_list_node_append(&entry->devpath_link, &node->entries);
+
+        for (n = node->parent, i = 0; n != &idx->root; n = n->parent, i++) {
+                entry->ancestor_links[i].entry = entry;
+                udev_list_node_append(&entry->ancestor_links[i].node, &n->descendants);
+        }
+
+        return 0;
+
+fail:
+        if (major(entry->devnum) != 0)
+                bucket_remove(idx->by_devnum, devnum_key(entry), &entry->devnum_link);
+        entry->ancestor_links = mfree(entry->ancestor_links);
+        entry->n_ancestor_links = 0;
+        devpath_node_unref(node);
+        return r;
+}
+
+void queue_index_remove(struct queue_index *idx, struct queue_entry *entry) {
+        unsigned i;
+
+        assert(idx);
+        assert(entry);
+
+        if (!entry->devpath_node)
+                return;
+
+        if (major(entry->devnum) != 0)
+                bucket_remove(idx->by_devnum, devnum_key(entry), &entry->devnum_link);
+
+        if (entry->ifindex != 0)
+                bucket_remove(idx->by_ifindex, (uint64_t) entry->ifindex, &entry->ifindex_link);
+
+        udev_list_node_remove(&entry->devpath_link);
+
+        for (i = 0; i < entry->n_ancestor_links; i++)
+                udev_list_node_remove(&entry->ancestor_links[i].node);
+
+        entry->ancestor_links = mfree(entry->ancestor_links);
+        entry->n_ancestor_links = 0;
+
+        devpath_node_unref(entry->devpath_node);
+        entry->devpath_node = NULL;
+}
+
+static inline bool is_earlier(const struct queue_entry *other, const struct queue_entry *entry) {
+        return other && other->seqnum < entry->seqnum;
+}
+
+/* returns the earliest entry queued before the given one, which it has to wait for */
+struct queue_entry *queue_index_find_blocker(struct queue_index *idx, struct queue_entry *entry) {
+        struct queue_entry *blocker = NULL, *other;
+        struct udev_list_node *list, *loop;
+        struct devpath_node *node;
+
+#define CANDIDATE(e)                                                    \
+        do {                                                            \
+                struct queue_entry *_e = (e);                           \
+                if (is_earlier(_e, entry) &&                            \
+                    (!blocker || _e->seqnum < blocker->seqnum))         \
+                        blocker = _e;                                   \
+        } while (false)
+
+        assert(idx);
+        assert(entry);
+        assert(entry->devpath_node);
+
+        /* check major/minor */
+        if (major(entry->devnum) != 0) {
+                list = bucket_entries(idx->by_devnum, devnum_key(entry));
+                if (list)
+                        CANDIDATE(FIRST_ENTRY(list, devnum_link));
+        }
+
+        /* check network device ifindex */
+        if (entry->ifindex != 0) {
+                list = bucket_entries(idx->by_ifindex, (uint64_t) entry->ifindex);
+                if (list)
+                        CANDIDATE(FIRST_ENTRY(list, ifindex_link));
+        }
+
+        /* check our old name */
+        if (entry->devpath_old) {
+                node = devpath_node_lookup(idx, entry->devpath_old);
+                if (node)
+                        CANDIDATE(FIRST_ENTRY(&node->entries, devpath_link));
+        }
+
+        /* identical device event found, unless device names have changed/swapped in the meantime */
+        udev_list_node_foreach(loop, &entry->devpath_node->entries) {
+                other = container_of(loop, struct queue_entry, devpath_link);
+
+                if (!is_earlier(other, entry))
+                        break;
+
+                if (major(entry->devnum) != 0 && (entry->devnum != other->devnum || entry->is_block != other->is_block))
+                        continue;
+                if (entry->ifindex != 0 && entry->ifindex != other->ifindex)
+                        continue;
+
+                CANDIDATE(other);
+                break;
+        }
+
+        /* parent device event found */
+        for (node = entry->devpath_node->parent; node && node->parent; node = node->parent)
+                CANDIDATE(FIRST_ENTRY(&node->entries, devpath_link));
+
+        /* child device event found */
+        if (!udev_list_node_is_empty(&entry->devpath_node->descendants))
+                CANDIDATE(container_of(entry->devpath_node->descendants.next, struct queue_link, node)->entry);
+
+#undef CANDIDATE
+
+        return blocker;
+}
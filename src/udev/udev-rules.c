@@ -26,6 +26,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -33,9 +35,12 @@
 #include "conf-files.h"
 #include "escape.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "fs-util.h"
 #include "glob-util.h"
+#include "hashmap.h"
 #include "path-util.h"
+#include "siphash24.h"
 #include "stat-util.h"
 #include "stdio-util.h"
 #include "strbuf.h"
@@ -48,6 +53,37 @@
 
 #define PREALLOC_TOKEN          2048
 
+/*
+ * The compiled rules, the token array, the parsed files and the string buffer, are stored in a
+ * cache file, keyed on the names and the contents of the rules files. As long as none of them
+ * changed, udevd and its workers map it instead of parsing the rules again.
+ */
+#define RULES_CACHE_PATH        "/run/udev/rules.bin"
+#define RULES_CACHE_SIG         { 'U', 'D', 'E', 'V', 'R', 'U', 'L', 'E' }
+
+/* bump when the meaning of the token types or of their fields changes */
+#define RULES_CACHE_FORMAT      1
+
+struct rules_cache_header {
+        uint8_t signature[8];
+
+        /* version of tool which created the file, and the size of structures, which change with it */
+        uint64_t tool_version;
+        uint64_t header_size;
+        uint64_t token_size;
+        uint64_t file_size;
+
+        /* hash of the names and contents of the rules files */
+        uint64_t key;
+
+        uint64_t tokens_off;
+        uint64_t tokens_count;
+        uint64_t files_off;
+        uint64_t files_count;
+        uint64_t strings_off;
+        uint64_t strings_len;
+};
+
 struct uid_gid {
         unsigned int name_off;
         union {
@@ -56,6 +92,56 @@ struct uid_gid {
         };
 };
 
+/*
+ * Rules are dispatched on literal prefixes of their ACTION, SUBSYSTEM and KERNEL match keys: a
+ * rule which can only match if one of these values starts with a certain string is only looked
+ * at for events where it does. All other rules are looked at for every event.
+ */
+enum dispatch_key {
+        DISPATCH_ACTION,
+        DISPATCH_SUBSYSTEM,
+        DISPATCH_KERNEL,
+        _DISPATCH_KEY_MAX,
+};
+
+/* token indices of the TK_RULE tokens of the rules, in ascending order */
+struct dispatch_list {
+        char *prefix;
+        unsigned int *rules;
+        unsigned int rules_cur;
+        size_t rules_max;
+};
+
+struct dispatch_cursor {
+        const unsigned int *rules;
+        const unsigned int *end;
+};
+
+struct rules_file {
+        unsigned int filename_off;
+        unsigned int first_token;
+        unsigned int n_rules;
+
+        /* collected while profiling */
+        unsigned int n_evaluated;
+        unsigned int n_matched;
+        usec_t usec;
+};
+
+/* collected while profiling, for IMPORT{builtin} */
+struct builtin_profile {
+        unsigned int n_runs;
+        unsigned int n_cached;
+        usec_t usec;
+};
+
+struct rules_profile {
+        struct rules_file *file;
+        unsigned int file_idx;
+        usec_t start;
+        bool matched;
+};
+
 static const char* const rules_dirs[] = {
         "/etc/udev/rules.d",
         "/run/udev/rules.d",
@@ -65,8 +151,10 @@ static const char* const rules_dirs[] = {
 
 struct udev_rules {
         struct udev *udev;
+        char **dirs;
         usec_t dirs_ts_usec;
         int resolve_names;
+        char *cache_path;
 
         /* every key in the rules file becomes a token */
         struct token *tokens;
@@ -76,6 +164,23 @@ struct udev_rules {
         /* all key strings are copied and de-duplicated in a single continuous string buffer */
         struct strbuf *strbuf;
 
+        /* or, when loaded from the cache, the tokens and strings are mapped from it */
+        void *map;
+        size_t map_size;
+        char *map_strings;
+
+        /* rules which can only match certain ACTION, SUBSYSTEM or KERNEL values, by prefix */
+        Hashmap *dispatch[_DISPATCH_KEY_MAX];
+        /* rules which need to be looked at for every event */
+        struct dispatch_list dispatch_always;
+
+        /* the parsed files, in the order of their tokens */
+        struct rules_file *files;
+        unsigned int files_cur;
+        size_t files_max;
+        bool profile;
+        struct builtin_profile builtins[UDEV_BUILTIN_MAX];
+
         /* during rule parsing, uid/gid lookup results are cached */
         struct uid_gid *uids;
         unsigned int uids_cur;
@@ -86,6 +191,8 @@ struct udev_rules {
 };
 
 static char *rules_str(struct udev_rules *rules, unsigned int off) {
+        if (rules->map)
+                return rules->map_strings + off;
         return rules->strbuf->buf + off;
 }
 
@@ -154,6 +261,7 @@ enum token_type {
         TK_M_IMPORT_FILE,               /* val */
         TK_M_IMPORT_PROG,               /* val */
         TK_M_IMPORT_BUILTIN,            /* val */
+        TK_M_IMPORT_BUILTIN_CACHED,     /* val */
         TK_M_IMPORT_DB,                 /* val */
         TK_M_IMPORT_CMDLINE,            /* val */
         TK_M_IMPORT_PARENT,             /* val */
@@ -290,6 +398,7 @@ static const char *token_str(enum token_type type) {
                 [TK_M_IMPORT_FILE] =            "M IMPORT_FILE",
                 [TK_M_IMPORT_PROG] =            "M IMPORT_PROG",
                 [TK_M_IMPORT_BUILTIN] =         "M IMPORT_BUILTIN",
+                [TK_M_IMPORT_BUILTIN_CACHED] =  "M IMPORT_BUILTIN_CACHED",
                 [TK_M_IMPORT_DB] =              "M IMPORT_DB",
                 [TK_M_IMPORT_CMDLINE] =         "M IMPORT_CMDLINE",
                 [TK_M_IMPORT_PARENT] =          "M IMPORT_PARENT",
@@ -375,6 +484,7 @@ static void dump_token(struct udev_rules *rules, struct token *token) {
                           token_str(type), operation_str(op), value, string_glob_str(glob));
                 break;
         case TK_M_IMPORT_BUILTIN:
+        case TK_M_IMPORT_BUILTIN_CACHED:
                 log_debug("%s %i '%s'", token_str(type), token->key.builtin_cmd, value);
                 break;
         case TK_M_ATTR:
@@ -864,6 +974,7 @@ static void rule_add_key(struct rule_tmp *rule_tmp, enum token_type type,
                 token->key.value_off = rules_add_string(rule_tmp->rules, value);
                 break;
         case TK_M_IMPORT_BUILTIN:
+        case TK_M_IMPORT_BUILTIN_CACHED:
                 token->key.value_off = rules_add_string(rule_tmp->rules, value);
                 token->key.builtin_cmd = *(enum udev_builtin_cmd *)data;
                 break;
@@ -1232,6 +1343,16 @@ static void add_rule(struct udev_rules *rules, char *line,
                                         LOG_RULE_WARNING("IMPORT{builtin} '%s' unknown", value);
                                 else
                                         rule_add_key(&rule_tmp, TK_M_IMPORT_BUILTIN, op, value, &cmd);
+                        } else if (streq(attr, "builtin-cached")) {
+                                const enum udev_builtin_cmd cmd = udev_builtin_lookup(value);
+
+                                if (cmd >= UDEV_BUILTIN_MAX)
+                                        LOG_RULE_WARNING("IMPORT{builtin-cached} '%s' unknown", value);
+                                else if (!udev_builtin_cacheable(cmd)) {
+                                        LOG_RULE_WARNING("IMPORT{builtin-cached} '%s' does not support caching, running it every time", value);
+                                        rule_add_key(&rule_tmp, TK_M_IMPORT_BUILTIN, op, value, &cmd);
+                                } else
+                                        rule_add_key(&rule_tmp, TK_M_IMPORT_BUILTIN_CACHED, op, value, &cmd);
                         } else if (streq(attr, "file"))
                                 rule_add_key(&rule_tmp, TK_M_IMPORT_FILE, op, value, NULL);
                         else if (streq(attr, "db"))
@@ -1505,40 +1626,437 @@ static int parse_file(struct udev_rules *rules, const char *filename) {
                                 log_error("GOTO '%s' has no matching label in: '%s'", label, filename);
                 }
         }
+
+        /* remember which tokens belong to this file, for profiling */
+        if (rules->token_cur > first_token) {
+                struct rules_file *file;
+
+                if (!GREEDY_REALLOC0(rules->files, rules->files_max, rules->files_cur + 1))
+                        return -ENOMEM;
+
+                file = &rules->files[rules->files_cur++];
+                file->filename_off = filename_off;
+                file->first_token = first_token;
+                for (i = first_token; i < rules->token_cur; i++)
+                        if (rules->tokens[i].type == TK_RULE)
+                                file->n_rules++;
+        }
+
         return 0;
 }
 
-struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names) {
-        struct udev_rules *rules;
-        struct udev_list file_list;
-        struct token end_token;
-        char **files, **f;
-        int r;
+static int dispatch_list_add(struct dispatch_list *list, unsigned int rule) {
+        /* alternatives of a key might share a prefix */
+        if (list->rules_cur > 0 && list->rules[list->rules_cur - 1] == rule)
+                return 0;
 
-        rules = new0(struct udev_rules, 1);
-        if (rules == NULL)
+        if (!GREEDY_REALLOC(list->rules, list->rules_max, list->rules_cur + 1))
+                return -ENOMEM;
+
+        list->rules[list->rules_cur++] = rule;
+        return 0;
+}
+
+static struct dispatch_list *dispatch_list_free(struct dispatch_list *list) {
+        if (!list)
                 return NULL;
-        rules->udev = udev;
-        rules->resolve_names = resolve_names;
-        udev_list_init(udev, &file_list, true);
+
+        free(list->prefix);
+        free(list->rules);
+        return mfree(list);
+}
+
+static size_t literal_prefix_len(const char *s) {
+        return strcspn(s, "|\\" GLOB_CHARS);
+}
+
+/* a match key can be dispatched on, if every alternative of it starts with a literal string */
+static bool token_has_literal_prefix(struct udev_rules *rules, struct token *token) {
+        const char *s;
+
+        if (token->key.op != OP_MATCH)
+                return false;
+
+        if (!IN_SET(token->key.glob, GL_PLAIN, GL_GLOB, GL_SPLIT, GL_SPLIT_GLOB))
+                return false;
+
+        s = rules_str(rules, token->key.value_off);
+        for (;;) {
+                if (literal_prefix_len(s) == 0)
+                        return false;
+
+                s = strchr(s, '|');
+                if (!s)
+                        return true;
+                s++;
+        }
+}
+
+static int dispatch_add(struct udev_rules *rules, enum dispatch_key key, const char *prefix, size_t len, unsigned int rule) {
+        _cleanup_free_ char *p = NULL;
+        struct dispatch_list *list;
+        int r;
+
+        p = strndup(prefix, len);
+        if (!p)
+                return -ENOMEM;
+
+        list = hashmap_get(rules->dispatch[key], p);
+        if (!list) {
+                r = hashmap_ensure_allocated(&rules->dispatch[key], &string_hash_ops);
+                if (r < 0)
+                        return r;
+
+                list = new0(struct dispatch_list, 1);
+                if (!list)
+                        return -ENOMEM;
+
+                r = hashmap_put(rules->dispatch[key], p, list);
+                if (r < 0) {
+                        free(list);
+                        return r;
+                }
+                list->prefix = p;
+                p = NULL;
+        }
+
+        return dispatch_list_add(list, rule);
+}
+
+static int dispatch_add_token(struct udev_rules *rules, enum dispatch_key key, struct token *token, unsigned int rule) {
+        const char *s;
+        int r;
+
+        s = rules_str(rules, token->key.value_off);
+        for (;;) {
+                r = dispatch_add(rules, key, s, literal_prefix_len(s), rule);
+                if (r < 0)
+                        return r;
+
+                s = strchr(s, '|');
+                if (!s)
+                        return 0;
+                s++;
+        }
+}
+
+static int build_dispatch(struct udev_rules *rules) {
+        /* the key which is most likely to rule out a rule comes first */
+        static const enum dispatch_key preference[] = {
+                DISPATCH_SUBSYSTEM,
+                DISPATCH_KERNEL,
+                DISPATCH_ACTION,
+        };
+        unsigned int i, n_rules = 0, n_dispatched = 0;
+        int r;
+
+        for (i = 0; i < rules->token_cur; i++) {
+                struct token *keys[_DISPATCH_KEY_MAX] = {};
+                struct token *rule = &rules->tokens[i];
+                struct token *cur;
+                unsigned int k;
+
+                if (rule->type != TK_RULE)
+                        continue;
+                n_rules++;
+
+                /* all of these are checked before anything else of the rule, so if one of them does not
+                 * match, the rule does nothing at all */
+                for (cur = rule + 1; cur < rule + rule->rule.token_count; cur++) {
+                        enum dispatch_key key;
+
+                        if (cur->type == TK_M_ACTION)
+                                key = DISPATCH_ACTION;
+                        else if (cur->type == TK_M_SUBSYSTEM)
+                                key = DISPATCH_SUBSYSTEM;
+                        else if (cur->type == TK_M_KERNEL)
+                                key = DISPATCH_KERNEL;
+                        else
+                                continue;
+
+                        if (!keys[key] && token_has_literal_prefix(rules, cur))
+                                keys[key] = cur;
+                }
+
+                for (k = 0; k < ELEMENTSOF(preference); k++)
+                        if (keys[preference[k]])
+                                break;
+
+                if (k < ELEMENTSOF(preference)) {
+                        r = dispatch_add_token(rules, preference[k], keys[preference[k]], i);
+                        n_dispatched++;
+                } else
+                        r = dispatch_list_add(&rules->dispatch_always, i);
+                if (r < 0)
+                        return r;
+        }
+
+        log_debug("%u rules, %u dispatched on ACTION, SUBSYSTEM or KERNEL", n_rules, n_dispatched);
+        return 0;
+}
+
+static int rules_cache_key(char **files, int resolve_names, uint64_t *ret) {
+        static const uint8_t hash_key[16] = {
+                0x5b, 0x1e, 0x3c, 0x9a, 0x27, 0xd0, 0x48, 0x61,
+                0xa4, 0x0f, 0x7e, 0x92, 0xc3, 0x15, 0x6d, 0xb8,
+        };
+        /* token types and builtin numbers are stored as they are, a cache written with a different set of
+         * them must not be used, even if the version did not change */
+        static const uint32_t layout[] = {
+                RULES_CACHE_FORMAT,
+                TK_END,
+                UDEV_BUILTIN_MAX,
+                sizeof(struct token),
+                sizeof(struct rules_file),
+        };
+        struct siphash state;
+        char **f;
+        int r;
+
+        siphash24_init(&state, hash_key);
+        siphash24_compress(layout, sizeof(layout), &state);
+        siphash24_compress(&resolve_names, sizeof(resolve_names), &state);
+
+        /* the contents, not the timestamps: a file rewritten within the timestamp granularity must
+         * not be missed */
+        STRV_FOREACH(f, files) {
+                _cleanup_free_ char *contents = NULL;
+                size_t size;
+
+                r = read_full_file(*f, &contents, &size);
+                if (r < 0)
+                        return r;
+
+                siphash24_compress(*f, strlen(*f) + 1, &state);
+                siphash24_compress(&size, sizeof(size), &state);
+                siphash24_compress(contents, size, &state);
+        }
+
+        /* user and group names are resolved while parsing */
+        if (resolve_names > 0) {
+                static const char* const name_files[] = { "/etc/passwd", "/etc/group" };
+                unsigned int i;
+
+                for (i = 0; i < ELEMENTSOF(name_files); i++) {
+                        struct stat st = {};
+
+                        if (stat(name_files[i], &st) < 0 && errno != ENOENT)
+                                return -errno;
+
+                        siphash24_compress(&st.st_ino, sizeof(st.st_ino), &state);
+                        siphash24_compress(&st.st_size, sizeof(st.st_size), &state);
+                        siphash24_compress(&st.st_mtim, sizeof(st.st_mtim), &state);
+                }
+        }
+
+        *ret = siphash24_finalize(&state);
+        return 0;
+}
+
+static bool token_has_attr(enum token_type type) {
+        return IN_SET(type,
+                      TK_M_ENV, TK_M_ATTR, TK_M_SYSCTL, TK_M_ATTRS,
+                      TK_A_SECLABEL, TK_A_ENV, TK_A_ATTR, TK_A_SYSCTL);
+}
+
+static bool token_has_builtin(enum token_type type) {
+        return IN_SET(type, TK_M_IMPORT_BUILTIN, TK_M_IMPORT_BUILTIN_CACHED, TK_A_RUN_BUILTIN);
+}
+
+/* The offsets in the mapped tokens are used without further checks when the rules are applied, make sure
+ * they stay within the file. The string buffer is known to be NUL-terminated. */
+static int rules_cache_verify(const struct rules_cache_header *h,
+                              const struct token *tokens, const struct rules_file *files) {
+        uint64_t i;
+
+        for (i = 0; i < h->tokens_count; i++) {
+                const struct token *t = &tokens[i];
+
+                if (t->type == TK_UNSET || t->type > TK_END)
+                        return -EBADMSG;
+
+                /* exactly one end token, at the end */
+                if ((t->type == TK_END) != (i == h->tokens_count - 1))
+                        return -EBADMSG;
+
+                if (t->type == TK_RULE) {
+                        if (t->rule.label_off >= h->strings_len ||
+                            t->rule.filename_off >= h->strings_len ||
+                            t->rule.token_count == 0 ||
+                            i + t->rule.token_count >= h->tokens_count)
+                                return -EBADMSG;
+                        continue;
+                }
+
+                if (t->key.value_off >= h->strings_len)
+                        return -EBADMSG;
+                if (token_has_attr(t->type) && t->key.attr_off >= h->strings_len)
+                        return -EBADMSG;
+                if (t->type == TK_A_GOTO && t->key.rule_goto >= h->tokens_count)
+                        return -EBADMSG;
+                if (token_has_builtin(t->type) && (unsigned) t->key.builtin_cmd >= UDEV_BUILTIN_MAX)
+                        return -EBADMSG;
+        }
+
+        for (i = 0; i < h->files_count; i++)
+                if (files[i].filename_off >= h->strings_len ||
+                    files[i].first_token >= h->tokens_count)
+                        return -EBADMSG;
+
+        return 0;
+}
+
+static int rules_cache_load(struct udev_rules *rules, uint64_t key) {
+        const char sig[] = RULES_CACHE_SIG;
+        const struct rules_cache_header *h;
+        _cleanup_close_ int fd = -1;
+        const struct token *tokens;
+        struct stat st;
+        void *map;
+        int r;
+
+        fd = open(rules->cache_path, O_RDONLY|O_CLOEXEC);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        if (st.st_size < (off_t) sizeof(struct rules_cache_header))
+                return -EBADMSG;
+
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED)
+                return -errno;
+        h = map;
+
+        if (memcmp(h->signature, sig, sizeof(h->signature)) != 0 ||
+            h->tool_version != (uint64_t) atoi(VERSION) ||
+            h->header_size != sizeof(struct rules_cache_header) ||
+            h->token_size != sizeof(struct token) ||
+            h->file_size != (uint64_t) st.st_size) {
+                r = -EBADMSG;
+                goto fail;
+        }
+
+        if (h->key != key) {
+                r = -ESTALE;
+                goto fail;
+        }
+
+        if (h->tokens_count == 0 || h->tokens_count > UINT_MAX || h->files_count > UINT_MAX ||
+            h->tokens_off % 8 != 0 || h->files_off % 8 != 0 ||
+            h->tokens_off < sizeof(struct rules_cache_header) ||
+            h->tokens_off + h->tokens_count * sizeof(struct token) > h->files_off ||
+            h->files_off + h->files_count * sizeof(struct rules_file) > h->strings_off ||
+            h->strings_len == 0 ||
+            h->strings_off + h->strings_len != h->file_size) {
+                r = -EBADMSG;
+                goto fail;
+        }
+
+        tokens = (const struct token *) ((const uint8_t *) map + h->tokens_off);
+        if (((const char *) map)[h->file_size - 1] != '\0') {
+                r = -EBADMSG;
+                goto fail;
+        }
+
+        r = rules_cache_verify(h, tokens, (const struct rules_file *) ((const uint8_t *) map + h->files_off));
+        if (r < 0)
+                goto fail;
+
+        /* the files are updated while profiling, they get a copy of their own */
+        if (h->files_count > 0) {
+                rules->files = newdup(struct rules_file, (const uint8_t *) map + h->files_off, h->files_count);
+                if (!rules->files) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+        }
+        rules->files_cur = rules->files_max = h->files_count;
+
+        rules->map = map;
+        rules->map_size = st.st_size;
+        rules->map_strings = (char *) map + h->strings_off;
+        rules->tokens = (struct token *) tokens;
+        rules->token_cur = rules->token_max = h->tokens_count;
+
+        log_debug("loaded compiled rules from %s, %u tokens, %"PRIu64" bytes strings",
+                  rules->cache_path, rules->token_cur, h->strings_len);
+        return 0;
+
+fail:
+        munmap(map, st.st_size);
+        return r;
+}
+
+static int rules_cache_write(struct udev_rules *rules, uint64_t key) {
+        _cleanup_free_ char *path_tmp = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        struct rules_cache_header h = {
+                .signature = RULES_CACHE_SIG,
+                .tool_version = atoi(VERSION),
+                .header_size = sizeof(struct rules_cache_header),
+                .token_size = sizeof(struct token),
+                .key = key,
+                .tokens_count = rules->token_cur,
+                .files_count = rules->files_cur,
+                .strings_len = rules->strbuf->len,
+        };
+        int r;
+
+        h.tokens_off = ALIGN8(sizeof(struct rules_cache_header));
+        h.files_off = ALIGN8(h.tokens_off + h.tokens_count * sizeof(struct token));
+        h.strings_off = ALIGN8(h.files_off + h.files_count * sizeof(struct rules_file));
+        h.file_size = h.strings_off + h.strings_len;
+
+        r = fopen_temporary(rules->cache_path, &f, &path_tmp);
+        if (r < 0)
+                return r;
+        (void) fchmod(fileno(f), 0444);
+
+        /* the gaps between the sections are left as holes */
+        if (fwrite(&h, sizeof(h), 1, f) != 1 ||
+            fseeko(f, h.tokens_off, SEEK_SET) < 0 ||
+            fwrite(rules->tokens, sizeof(struct token), h.tokens_count, f) != h.tokens_count ||
+            fseeko(f, h.files_off, SEEK_SET) < 0 ||
+            fwrite(rules->files, sizeof(struct rules_file), h.files_count, f) != h.files_count ||
+            fseeko(f, h.strings_off, SEEK_SET) < 0 ||
+            fwrite(rules->strbuf->buf, 1, h.strings_len, f) != h.strings_len) {
+                r = -errno ?: -EIO;
+                goto fail;
+        }
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                goto fail;
+
+        if (rename(path_tmp, rules->cache_path) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        log_debug("wrote compiled rules to %s, %"PRIu64" bytes", rules->cache_path, h.file_size);
+        return 0;
+
+fail:
+        unlink_noerrno(path_tmp);
+        return r;
+}
+
+static int rules_parse(struct udev_rules *rules, char **files) {
+        struct token end_token;
+        char **f;
 
         /* init token array and string buffer */
         rules->tokens = malloc(PREALLOC_TOKEN * sizeof(struct token));
         if (rules->tokens == NULL)
-                return udev_rules_unref(rules);
+                return -ENOMEM;
         rules->token_max = PREALLOC_TOKEN;
 
         rules->strbuf = strbuf_new();
         if (!rules->strbuf)
-                return udev_rules_unref(rules);
-
-        udev_rules_check_timestamp(rules);
-
-        r = conf_files_list_strv(&files, ".rules", NULL, rules_dirs);
-        if (r < 0) {
-                log_error_errno(r, "failed to enumerate rules files: %m");
-                return udev_rules_unref(rules);
-        }
+                return -ENOMEM;
 
         /*
          * The offset value in the rules strct is limited; add all
@@ -1550,11 +2068,10 @@ struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names) {
         STRV_FOREACH(f, files)
                 parse_file(rules, *f);
 
-        strv_free(files);
-
         memzero(&end_token, sizeof(struct token));
         end_token.type = TK_END;
         add_token(rules, &end_token);
+
         log_debug("rules contain %zu bytes tokens (%u * %zu bytes), %zu bytes strings",
                   rules->token_max * sizeof(struct token), rules->token_max, sizeof(struct token), rules->strbuf->len);
 
@@ -1572,25 +2089,200 @@ struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names) {
         rules->gids_cur = 0;
         rules->gids_max = 0;
 
+        return 0;
+}
+
+struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names) {
+        return udev_rules_new_full(udev, resolve_names, (char**) rules_dirs, RULES_CACHE_PATH);
+}
+
+/* Like udev_rules_new(), but with the rules from the specified directories, and the compiled rules
+ * cached at the specified path, if any. */
+struct udev_rules *udev_rules_new_full(struct udev *udev, int resolve_names, char **dirs, const char *cache_path) {
+        struct udev_rules *rules;
+        struct udev_list file_list;
+        _cleanup_strv_free_ char **files = NULL;
+        uint64_t key;
+        bool have_key = false;
+        int r;
+
+        rules = new0(struct udev_rules, 1);
+        if (rules == NULL)
+                return NULL;
+        rules->udev = udev;
+        rules->resolve_names = resolve_names;
+        udev_list_init(udev, &file_list, true);
+
+        rules->dirs = strv_copy(dirs);
+        if (!rules->dirs)
+                return udev_rules_unref(rules);
+
+        if (cache_path) {
+                rules->cache_path = strdup(cache_path);
+                if (!rules->cache_path)
+                        return udev_rules_unref(rules);
+        }
+
+        udev_rules_check_timestamp(rules);
+
+        r = conf_files_list_strv(&files, ".rules", NULL, (const char* const*) rules->dirs);
+        if (r < 0) {
+                log_error_errno(r, "failed to enumerate rules files: %m");
+                return udev_rules_unref(rules);
+        }
+
+        if (rules->cache_path) {
+                r = rules_cache_key(files, resolve_names, &key);
+                if (r < 0)
+                        log_debug_errno(r, "failed to read rules files for the cache, ignoring: %m");
+                have_key = r >= 0;
+        }
+
+        r = have_key ? rules_cache_load(rules, key) : -ENOENT;
+        if (r < 0) {
+                if (!IN_SET(r, -ENOENT, -ESTALE))
+                        log_debug_errno(r, "failed to load compiled rules from %s, ignoring: %m", rules->cache_path);
+
+                r = rules_parse(rules, files);
+                if (r < 0) {
+                        log_error_errno(r, "failed to parse rules: %m");
+                        return udev_rules_unref(rules);
+                }
+
+                if (have_key) {
+                        r = rules_cache_write(rules, key);
+                        if (r < 0)
+                                log_debug_errno(r, "failed to write compiled rules to %s, ignoring: %m", rules->cache_path);
+                }
+        }
+
+        r = build_dispatch(rules);
+        if (r < 0) {
+                log_error_errno(r, "failed to build rules dispatch index: %m");
+                return udev_rules_unref(rules);
+        }
+
         dump_rules(rules);
         return rules;
 }
 
 struct udev_rules *udev_rules_unref(struct udev_rules *rules) {
+        unsigned int k;
+
         if (rules == NULL)
                 return NULL;
-        free(rules->tokens);
+        if (rules->map)
+                munmap(rules->map, rules->map_size);
+        else
+                free(rules->tokens);
         strbuf_cleanup(rules->strbuf);
         free(rules->uids);
         free(rules->gids);
+        for (k = 0; k < _DISPATCH_KEY_MAX; k++) {
+                struct dispatch_list *list;
+
+                while ((list = hashmap_steal_first(rules->dispatch[k])))
+                        dispatch_list_free(list);
+                hashmap_free(rules->dispatch[k]);
+        }
+        free(rules->dispatch_always.rules);
+        free(rules->files);
+        strv_free(rules->dirs);
+        free(rules->cache_path);
         return mfree(rules);
 }
 
+void udev_rules_set_profile(struct udev_rules *rules, bool profile) {
+        unsigned int i;
+
+        rules->profile = profile;
+
+        for (i = 0; i < rules->files_cur; i++) {
+                rules->files[i].n_evaluated = 0;
+                rules->files[i].n_matched = 0;
+                rules->files[i].usec = 0;
+        }
+
+        memzero(rules->builtins, sizeof(rules->builtins));
+}
+
+void udev_rules_print_profile(struct udev_rules *rules) {
+        unsigned int i, n_rules = 0, n_evaluated = 0, n_matched = 0;
+        char ts[FORMAT_TIMESPAN_MAX];
+        usec_t usec = 0;
+
+        printf("%-60s %6s %9s %7s %10s\n", "FILE", "RULES", "EVALUATED", "MATCHED", "TIME");
+
+        for (i = 0; i < rules->files_cur; i++) {
+                struct rules_file *f = &rules->files[i];
+
+                printf("%-60s %6u %9u %7u %10s\n",
+                       rules_str(rules, f->filename_off), f->n_rules, f->n_evaluated, f->n_matched,
+                       format_timespan(ts, sizeof(ts), f->usec, 1));
+
+                n_rules += f->n_rules;
+                n_evaluated += f->n_evaluated;
+                n_matched += f->n_matched;
+                usec += f->usec;
+        }
+
+        printf("%-60s %6u %9u %7u %10s\n",
+               "total", n_rules, n_evaluated, n_matched, format_timespan(ts, sizeof(ts), usec, 1));
+
+        printf("\n%-60s %6s %9s %7s %10s\n", "BUILTIN", "", "RUNS", "CACHED", "TIME");
+
+        for (i = 0; i < UDEV_BUILTIN_MAX; i++) {
+                struct builtin_profile *b = &rules->builtins[i];
+
+                if (b->n_runs == 0)
+                        continue;
+
+                printf("%-60s %6s %9u %7u %10s\n",
+                       udev_builtin_name(i), "", b->n_runs, b->n_cached,
+                       format_timespan(ts, sizeof(ts), b->usec, 1));
+        }
+}
+
+bool udev_rules_is_cached(struct udev_rules *rules) {
+        return rules->map;
+}
+
+/* Writes the tokens and files with their strings resolved, for comparing compiled rules */
+void udev_rules_dump(struct udev_rules *rules, FILE *f) {
+        unsigned int i;
+
+        for (i = 0; i < rules->files_cur; i++)
+                fprintf(f, "file %s first=%u rules=%u\n",
+                        rules_str(rules, rules->files[i].filename_off),
+                        rules->files[i].first_token, rules->files[i].n_rules);
+
+        for (i = 0; i < rules->token_cur; i++) {
+                struct token *t = &rules->tokens[i];
+
+                if (t->type == TK_RULE) {
+                        fprintf(f, "%u rule %s:%u label='%s' tokens=%u name=%s static=%s\n", i,
+                                rules_str(rules, t->rule.filename_off), t->rule.filename_line,
+                                rules_str(rules, t->rule.label_off), t->rule.token_count,
+                                yes_no(t->rule.can_set_name), yes_no(t->rule.has_static_node));
+                        continue;
+                }
+
+                fprintf(f, "%u type=%u op=%u glob=%u subst=%u,%u value='%s'", i,
+                        t->type, t->key.op, t->key.glob, t->key.subst, t->key.attrsubst,
+                        rules_str(rules, t->key.value_off));
+
+                if (token_has_attr(t->type))
+                        fprintf(f, " attr='%s'\n", rules_str(rules, t->key.attr_off));
+                else
+                        fprintf(f, " arg=%u\n", t->key.attr_off);
+        }
+}
+
 bool udev_rules_check_timestamp(struct udev_rules *rules) {
         if (!rules)
                 return false;
 
-        return paths_check_timestamp(rules_dirs, &rules->dirs_ts_usec, true);
+        return paths_check_timestamp((const char* const*) rules->dirs, &rules->dirs_ts_usec, true);
 }
 
 static int match_key(struct udev_rules *rules, struct token *token, const char *val) {
@@ -1720,6 +2412,74 @@ enum escape_type {
         ESCAPE_REPLACE,
 };
 
+static unsigned int dispatch_add_cursors(struct udev_rules *rules, enum dispatch_key key, const char *value,
+                                         struct dispatch_cursor *cursors, unsigned int n) {
+        char *prefix;
+        size_t len;
+
+        if (!rules->dispatch[key] || !value)
+                return n;
+
+        /* look up every prefix of the value */
+        prefix = strdupa(value);
+        for (len = strlen(prefix); len > 0; len--) {
+                struct dispatch_list *list;
+
+                prefix[len] = '\0';
+                list = hashmap_get(rules->dispatch[key], prefix);
+                if (list)
+                        cursors[n++] = (struct dispatch_cursor) { list->rules, list->rules + list->rules_cur };
+        }
+
+        return n;
+}
+
+/* returns the token index of the next rule at or after the given token, which may match the event */
+static unsigned int dispatch_next(struct dispatch_cursor *cursors, unsigned int n, unsigned int from, unsigned int end) {
+        unsigned int i, next = end;
+
+        for (i = 0; i < n; i++) {
+                while (cursors[i].rules < cursors[i].end && *cursors[i].rules < from)
+                        cursors[i].rules++;
+
+                if (cursors[i].rules < cursors[i].end && *cursors[i].rules < next)
+                        next = *cursors[i].rules;
+        }
+
+        return next;
+}
+
+static void profile_rule(struct udev_rules *rules, struct rules_profile *profile, struct token *rule) {
+        unsigned int t;
+        usec_t n;
+
+        if (!rules->profile || rules->files_cur == 0)
+                return;
+
+        n = now(CLOCK_MONOTONIC);
+
+        /* account the previous rule */
+        if (profile->file) {
+                profile->file->usec += n - profile->start;
+                if (profile->matched)
+                        profile->file->n_matched++;
+                profile->file = NULL;
+        }
+
+        if (!rule)
+                return;
+
+        /* rules are only ever looked at in ascending order */
+        t = rule - rules->tokens;
+        while (profile->file_idx + 1 < rules->files_cur && rules->files[profile->file_idx + 1].first_token <= t)
+                profile->file_idx++;
+
+        profile->file = &rules->files[profile->file_idx];
+        profile->file->n_evaluated++;
+        profile->matched = true;
+        profile->start = n;
+}
+
 void udev_rules_apply_to_event(struct udev_rules *rules,
                                struct udev_event *event,
                                usec_t timeout_usec,
@@ -1729,30 +2489,58 @@ void udev_rules_apply_to_event(struct udev_rules *rules,
         struct token *rule;
         enum escape_type esc = ESCAPE_UNSET;
         bool can_set_name;
+        const char *action, *subsystem, *sysname;
+        struct dispatch_cursor *cursors;
+        unsigned int n_cursors = 0;
+        struct rules_profile profile = {};
 
         if (rules->tokens == NULL)
                 return;
 
-        can_set_name = ((!streq(udev_device_get_action(event->dev), "remove")) &&
+        action = udev_device_get_action(event->dev);
+        subsystem = udev_device_get_subsystem(event->dev);
+        sysname = udev_device_get_sysname(event->dev);
+
+        can_set_name = ((!streq(action, "remove")) &&
                         (major(udev_device_get_devnum(event->dev)) > 0 ||
                          udev_device_get_ifindex(event->dev) > 0));
 
+        /* one cursor for every prefix of the values, and one for the rules without any */
+        cursors = newa(struct dispatch_cursor,
+                       1 + (action ? strlen(action) : 0) + (subsystem ? strlen(subsystem) : 0) + (sysname ? strlen(sysname) : 0));
+        cursors[n_cursors++] = (struct dispatch_cursor) { rules->dispatch_always.rules,
+                                                          rules->dispatch_always.rules + rules->dispatch_always.rules_cur };
+        n_cursors = dispatch_add_cursors(rules, DISPATCH_ACTION, action, cursors, n_cursors);
+        n_cursors = dispatch_add_cursors(rules, DISPATCH_SUBSYSTEM, subsystem, cursors, n_cursors);
+        n_cursors = dispatch_add_cursors(rules, DISPATCH_KERNEL, sysname, cursors, n_cursors);
+
         /* loop through token list, match, run actions or forward to next rule */
         cur = &rules->tokens[0];
         rule = cur;
         for (;;) {
                 dump_token(rules, cur);
                 switch (cur->type) {
-                case TK_RULE:
+                case TK_RULE: {
+                        unsigned int next;
+
+                        /* skip all rules which cannot match this event */
+                        next = dispatch_next(cursors, n_cursors, cur - rules->tokens, rules->token_cur - 1);
+                        if (&rules->tokens[next] != cur) {
+                                cur = &rules->tokens[next];
+                                continue;
+                        }
+
                         /* current rule */
                         rule = cur;
+                        profile_rule(rules, &profile, rule);
                         /* possibly skip rules which want to set NAME, SYMLINK, OWNER, GROUP, MODE */
                         if (!can_set_name && rule->rule.can_set_name)
                                 goto nomatch;
                         esc = ESCAPE_UNSET;
                         break;
+                }
                 case TK_M_ACTION:
-                        if (match_key(rules, cur, udev_device_get_action(event->dev)) != 0)
+                        if (match_key(rules, cur, action) != 0)
                                 goto nomatch;
                         break;
                 case TK_M_DEVPATH:
@@ -1989,8 +2777,12 @@ void udev_rules_apply_to_event(struct udev_rules *rules,
                                         goto nomatch;
                         break;
                 }
-                case TK_M_IMPORT_BUILTIN: {
+                case TK_M_IMPORT_BUILTIN:
+                case TK_M_IMPORT_BUILTIN_CACHED: {
                         char command[UTIL_PATH_SIZE];
+                        bool cached = false;
+                        usec_t start = 0;
+                        int r;
 
                         if (udev_builtin_run_once(cur->key.builtin_cmd)) {
                                 /* check if we ran already */
@@ -2015,7 +2807,24 @@ void udev_rules_apply_to_event(struct udev_rules *rules,
                                   rules_str(rules, rule->rule.filename_off),
                                   rule->rule.filename_line);
 
-                        if (udev_builtin_run(event->dev, cur->key.builtin_cmd, command, false) != 0) {
+                        if (rules->profile)
+                                start = now(CLOCK_MONOTONIC);
+
+                        if (cur->type == TK_M_IMPORT_BUILTIN_CACHED)
+                                r = udev_builtin_run_cached(event->dev, cur->key.builtin_cmd, command, event->test, &cached);
+                        else
+                                r = udev_builtin_run(event->dev, cur->key.builtin_cmd, command, false);
+
+                        if (rules->profile) {
+                                struct builtin_profile *b = &rules->builtins[cur->key.builtin_cmd];
+
+                                b->n_runs++;
+                                if (cached)
+                                        b->n_cached++;
+                                b->usec += now(CLOCK_MONOTONIC) - start;
+                        }
+
+                        if (r != 0) {
                                 /* remember failure */
                                 log_debug("IMPORT builtin '%s' returned non-zero",
                                           udev_builtin_name(cur->key.builtin_cmd));
@@ -2422,6 +3231,7 @@ void udev_rules_apply_to_event(struct udev_rules *rules,
                         cur = &rules->tokens[cur->key.rule_goto];
                         continue;
                 case TK_END:
+                        profile_rule(rules, &profile, NULL);
                         return;
 
                 case TK_M_PARENTS_MIN:
@@ -2435,6 +3245,7 @@ void udev_rules_apply_to_event(struct udev_rules *rules,
                 cur++;
                 continue;
         nomatch:
+                profile.matched = false;
                 /* fast-forward to next rule */
                 cur = rule + rule->rule.token_count;
         }
@@ -59,6 +59,8 @@ struct udev_event {
         bool name_final;
         bool devlink_final;
         bool run_final;
+        /* a simulation by "udevadm test", which leaves no cached results behind */
+        bool test;
 };
 
 struct udev_watch {
@@ -70,8 +72,13 @@ struct udev_watch {
 /* udev-rules.c */
 struct udev_rules;
 struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names);
+struct udev_rules *udev_rules_new_full(struct udev *udev, int resolve_names, char **dirs, const char *cache_path);
 struct udev_rules *udev_rules_unref(struct udev_rules *rules);
 bool udev_rules_check_timestamp(struct udev_rules *rules);
+void udev_rules_set_profile(struct udev_rules *rules, bool profile);
+void udev_rules_print_profile(struct udev_rules *rules);
+bool udev_rules_is_cached(struct udev_rules *rules);
+void udev_rules_dump(struct udev_rules *rules, FILE *f);
 void udev_rules_apply_to_event(struct udev_rules *rules, struct udev_event *event,
                                usec_t timeout_usec, usec_t timeout_warn_usec,
                                struct udev_list *properties_list);
@@ -109,6 +116,33 @@ void udev_node_add(struct udev_device *dev, bool apply,
 void udev_node_remove(struct udev_device *dev);
 void udev_node_update_old_links(struct udev_device *dev, struct udev_device *dev_old);
 
+/* udev-prefetch.c */
+int udev_prefetch_probe_regions(int fd, uint64_t offset, uint64_t size, uint64_t window, usec_t timeout);
+
+/* udev-queue-index.c */
+struct queue_entry {
+        unsigned long long int seqnum;
+        const char *devpath;
+        const char *devpath_old;
+        dev_t devnum;
+        bool is_block;
+        int ifindex;
+
+        /* private to the index */
+        struct devpath_node *devpath_node;
+        struct udev_list_node devpath_link;
+        struct udev_list_node devnum_link;
+        struct udev_list_node ifindex_link;
+        struct queue_link *ancestor_links;
+        unsigned n_ancestor_links;
+};
+struct queue_index;
+struct queue_index *queue_index_new(void);
+struct queue_index *queue_index_free(struct queue_index *idx);
+int queue_index_add(struct queue_index *idx, struct queue_entry *entry);
+void queue_index_remove(struct queue_index *idx, struct queue_entry *entry);
+struct queue_entry *queue_index_find_blocker(struct queue_index *idx, struct queue_entry *entry);
+
 /* udev-ctrl.c */
 struct udev_ctrl;
 struct udev_ctrl *udev_ctrl_new(struct udev *udev);
@@ -170,6 +204,9 @@ struct udev_builtin {
         int (*init)(struct udev *udev);
         void (*exit)(struct udev *udev);
         bool (*validate)(struct udev *udev);
+        /* builtins whose results may be reused for later events of the same device write what
+         * their result depends on, besides the device itself, into key */
+        int (*cache_key)(struct udev_device *dev, char *key, size_t size);
         bool run_once;
 };
 #ifdef HAVE_BLKID
@@ -193,6 +230,11 @@ enum udev_builtin_cmd udev_builtin_lookup(const char *command);
 const char *udev_builtin_name(enum udev_builtin_cmd cmd);
 bool udev_builtin_run_once(enum udev_builtin_cmd cmd);
 int udev_builtin_run(struct udev_device *dev, enum udev_builtin_cmd cmd, const char *command, bool test);
+bool udev_builtin_cacheable(enum udev_builtin_cmd cmd);
+void udev_builtin_set_cache_dir(const char *dir);
+int udev_builtin_cache_key_device(struct udev_device *dev, char *key, size_t size);
+int udev_builtin_run_cached(struct udev_device *dev, enum udev_builtin_cmd cmd, const char *command, bool test, bool *ret_cached);
+void udev_builtin_cache_handle_event(struct udev_device *dev);
 void udev_builtin_list(struct udev *udev);
 bool udev_builtin_validate(struct udev *udev);
 int udev_builtin_add_property(struct udev_device *dev, bool test, const char *key, const char *val);
@@ -32,6 +32,8 @@
 #include "mkdir.h"
 #include "strbuf.h"
 #include "string-util.h"
+#include "strv.h"
+#include "time-util.h"
 #include "udev.h"
 #include "util.h"
 
@@ -54,6 +56,9 @@ struct trie {
         size_t nodes_count;
         size_t children_count;
         size_t values_count;
+
+        /* time spent inserting into the trie, while the files are parsed */
+        usec_t build_usec;
 };
 
 struct trie_node {
@@ -287,11 +292,20 @@ static void trie_store_nodes_size(struct trie_f *trie, struct trie_node *node) {
                 trie->strings_off += sizeof(struct trie_value_entry_f);
 }
 
+/* lets lookups skip searching for glob children, which most nodes do not have */
+static uint8_t trie_node_flags(const struct trie_node *node) {
+        if (node_lookup(node, '*') || node_lookup(node, '?') || node_lookup(node, '['))
+                return TRIE_NODE_GLOB_CHILD;
+
+        return 0;
+}
+
 static int64_t trie_store_nodes(struct trie_f *trie, struct trie_node *node) {
         uint64_t i;
         struct trie_node_f n = {
                 .prefix_off = htole64(trie->strings_off + node->prefix_off),
                 .children_count = node->children_count,
+                .flags = trie_node_flags(node),
                 .values_count = htole64(node->values_count),
         };
         struct trie_child_entry_f *children = NULL;
@@ -342,7 +356,7 @@ static int64_t trie_store_nodes(struct trie_f *trie, struct trie_node *node) {
         return node_off;
 }
 
-static int trie_store(struct trie *trie, const char *filename) {
+static int trie_store(struct trie *trie, const char *filename, uint64_t sources_hash) {
         struct trie_f t = {
                 .trie = trie,
         };
@@ -357,6 +371,8 @@ static int trie_store(struct trie *trie, const char *filename) {
                 .node_size = htole64(sizeof(struct trie_node_f)),
                 .child_entry_size = htole64(sizeof(struct trie_child_entry_f)),
                 .value_entry_size = htole64(sizeof(struct trie_value_entry_f)),
+                .flags = htole64(HWDB_NODE_FLAGS),
+                .sources_hash = htole64(sources_hash),
         };
         int err;
 
@@ -423,6 +439,7 @@ static int insert_data(struct trie *trie, struct udev_list *match_list,
                        char *line, const char *filename) {
         char *value;
         struct udev_list_entry *entry;
+        usec_t start;
 
         value = strchr(line, '=');
         if (!value) {
@@ -442,8 +459,10 @@ static int insert_data(struct trie *trie, struct udev_list *match_list,
                 return -EINVAL;
         }
 
+        start = now(CLOCK_MONOTONIC);
         udev_list_entry_foreach(entry, udev_list_get_entry(match_list))
                 trie_insert(trie, trie->root, udev_list_entry_get_name(entry), line, value);
+        trie->build_usec += now(CLOCK_MONOTONIC) - start;
 
         return 0;
 }
@@ -601,8 +620,18 @@ static int adm_hwdb(struct udev *udev, int argc, char *argv[]) {
         }
 
         if (update) {
-                char **files, **f;
+                _cleanup_strv_free_ char **files = NULL;
                 _cleanup_free_ char *hwdb_bin = NULL;
+                char ts1[FORMAT_TIMESPAN_MAX], ts2[FORMAT_TIMESPAN_MAX], ts3[FORMAT_TIMESPAN_MAX];
+                usec_t start, parse_usec, build_usec;
+                uint64_t sources_hash;
+                char **f;
+
+                hwdb_bin = strjoin(root, "/", hwdb_bin_dir, "/hwdb.bin");
+                if (!hwdb_bin) {
+                        rc = EXIT_FAILURE;
+                        goto out;
+                }
 
                 trie = new0(struct trie, 1);
                 if (!trie) {
@@ -631,14 +660,31 @@ static int adm_hwdb(struct udev *udev, int argc, char *argv[]) {
                         rc = EXIT_FAILURE;
                         goto out;
                 }
+
+                /* compiling the same files again would write the same database */
+                err = hwdb_sources_hash(files, sizeof(struct trie_value_entry_f), &sources_hash);
+                if (err < 0) {
+                        log_error_errno(err, "failed to read hwdb files: %m");
+                        rc = EXIT_FAILURE;
+                        goto out;
+                }
+                if (hwdb_bin_up_to_date(hwdb_bin, sources_hash)) {
+                        log_info("%s is up to date.", hwdb_bin);
+                        goto query;
+                }
+
+                start = now(CLOCK_MONOTONIC);
+
                 STRV_FOREACH(f, files) {
                         log_debug("reading file '%s'", *f);
                         import_file(udev, trie, *f);
                 }
-                strv_free(files);
 
                 strbuf_complete(trie->strings);
 
+                build_usec = trie->build_usec;
+                parse_usec = now(CLOCK_MONOTONIC) - start - build_usec;
+
                 log_debug("=== trie in-memory ===");
                 log_debug("nodes:            %8zu bytes (%8zu)",
                           trie->nodes_count * sizeof(struct trie_node), trie->nodes_count);
@@ -653,23 +699,25 @@ static int adm_hwdb(struct udev *udev, int argc, char *argv[]) {
                 log_debug("strings dedup'ed: %8zu bytes (%8zu)",
                           trie->strings->dedup_len, trie->strings->dedup_count);
 
-                hwdb_bin = strjoin(root, "/", hwdb_bin_dir, "/hwdb.bin");
-                if (!hwdb_bin) {
-                        rc = EXIT_FAILURE;
-                        goto out;
-                }
+                start = now(CLOCK_MONOTONIC);
 
                 mkdir_parents_label(hwdb_bin, 0755);
 
-                err = trie_store(trie, hwdb_bin);
+                err = trie_store(trie, hwdb_bin, sources_hash);
                 if (err < 0) {
                         log_error_errno(err, "Failure writing database %s: %m", hwdb_bin);
                         rc = EXIT_FAILURE;
-                }
+                } else
+                        log_info("Compiled %u files into %s: parsing took %s, building %s, writing %s.",
+                                 strv_length(files), hwdb_bin,
+                                 format_timespan(ts1, sizeof(ts1), parse_usec, USEC_PER_MSEC),
+                                 format_timespan(ts2, sizeof(ts2), build_usec, USEC_PER_MSEC),
+                                 format_timespan(ts3, sizeof(ts3), now(CLOCK_MONOTONIC) - start, USEC_PER_MSEC));
 
                 label_fix(hwdb_bin, false, false);
         }
 
+query:
         if (test) {
                 _cleanup_(sd_hwdb_unrefp) sd_hwdb *hwdb = NULL;
                 int r;
@@ -178,6 +178,7 @@ static int export_devices(struct udev *udev) {
         if (udev_enumerate == NULL)
                 return -ENOMEM;
 
+        (void) udev_enumerate_set_threads(udev_enumerate, 0);
         udev_enumerate_scan_devices(udev_enumerate);
         udev_list_entry_foreach(list_entry, udev_enumerate_get_list_entry(udev_enumerate)) {
                 _cleanup_udev_device_unref_ struct udev_device *device;
@@ -219,9 +220,10 @@ static void cleanup_dir(DIR *dir, mode_t mask, int depth) {
 }
 
 static void cleanup_db(struct udev *udev) {
-        _cleanup_closedir_ DIR *dir1 = NULL, *dir2 = NULL, *dir3 = NULL, *dir4 = NULL, *dir5 = NULL;
+        _cleanup_closedir_ DIR *dir1 = NULL, *dir2 = NULL, *dir3 = NULL, *dir4 = NULL, *dir5 = NULL, *dir6 = NULL;
 
         (void) unlink("/run/udev/queue.bin");
+        (void) unlink("/run/udev/data.db");
 
         dir1 = opendir("/run/udev/data");
         if (dir1 != NULL)
@@ -242,6 +244,10 @@ static void cleanup_db(struct udev *udev) {
         dir5 = opendir("/run/udev/watch");
         if (dir5 != NULL)
                 cleanup_dir(dir5, 0, 1);
+
+        dir6 = opendir("/run/udev/builtin");
+        if (dir6 != NULL)
+                cleanup_dir(dir6, 0, 1);
 }
 
 static void help(void) {
@@ -37,6 +37,7 @@ static void help(void) {
                "     --version                         Show package version\n"
                "  -a --action=ACTION                   Set action string\n"
                "  -N --resolve-names=early|late|never  When to resolve names\n"
+               "     --profile                         Show rule match counts and time per rules file\n"
                , program_invocation_short_name);
 }
 
@@ -50,11 +51,17 @@ static int adm_test(struct udev *udev, int argc, char *argv[]) {
         _cleanup_udev_device_unref_ struct udev_device *dev = NULL;
         _cleanup_udev_event_unref_ struct udev_event *event = NULL;
         sigset_t mask, sigmask_orig;
+        bool profile = false;
         int rc = 0, c;
 
+        enum {
+                ARG_PROFILE = 0x100,
+        };
+
         static const struct option options[] = {
                 { "action", required_argument, NULL, 'a' },
                 { "resolve-names", required_argument, NULL, 'N' },
+                { "profile", no_argument, NULL, ARG_PROFILE },
                 { "help", no_argument, NULL, 'h' },
                 {}
         };
@@ -79,6 +86,9 @@ static int adm_test(struct udev *udev, int argc, char *argv[]) {
                                 exit(EXIT_FAILURE);
                         }
                         break;
+                case ARG_PROFILE:
+                        profile = true;
+                        break;
                 case 'h':
                         help();
                         exit(EXIT_SUCCESS);
@@ -129,6 +139,9 @@ static int adm_test(struct udev *udev, int argc, char *argv[]) {
         udev_device_set_info_loaded(dev);
 
         event = udev_event_new(dev);
+        event->test = true;
+
+        udev_rules_set_profile(rules, profile);
 
         sigfillset(&mask);
         sigprocmask(SIG_SETMASK, &mask, &sigmask_orig);
@@ -147,6 +160,11 @@ static int adm_test(struct udev *udev, int argc, char *argv[]) {
                 udev_event_apply_format(event, udev_list_entry_get_name(entry), program, sizeof(program));
                 printf("run: '%s'\n", program);
         }
+
+        if (profile) {
+                printf("\n");
+                udev_rules_print_profile(rules);
+        }
 out:
         udev_builtin_exit(udev);
         return rc;
@@ -28,9 +28,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/file.h>
 #include <sys/inotify.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/mount.h>
 #include <sys/prctl.h>
 #include <sys/signalfd.h>
@@ -47,6 +49,7 @@
 #include "cgroup-util.h"
 #include "cpu-set-util.h"
 #include "dev-setup.h"
+#include "device-database.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "format-util.h"
@@ -57,6 +60,7 @@
 #include "parse-util.h"
 #include "proc-cmdline.h"
 #include "process-util.h"
+#include "ratelimit.h"
 #include "selinux-util.h"
 #include "signal-util.h"
 #include "socket-util.h"
@@ -70,15 +74,20 @@ static bool arg_debug = false;
 static int arg_daemonize = false;
 static int arg_resolve_names = 1;
 static unsigned arg_children_max;
+static unsigned arg_children_warm;
 static int arg_exec_delay;
+static bool arg_database_snapshot = true;
 static usec_t arg_event_timeout_usec = 180 * USEC_PER_SEC;
 static usec_t arg_event_timeout_warn_usec = 180 * USEC_PER_SEC / 3;
 
+#define DATABASE_SNAPSHOT_DELAY_USEC (3 * USEC_PER_SEC)
+
 typedef struct Manager {
         struct udev *udev;
         sd_event *event;
         Hashmap *workers;
         struct udev_list_node events;
+        struct queue_index *queue_index;
         const char *cgroup;
         pid_t pid; /* the process that originally allocated the manager object */
 
@@ -94,9 +103,26 @@ typedef struct Manager {
         sd_event_source *ctrl_event;
         sd_event_source *uevent_event;
         sd_event_source *inotify_event;
+        sd_event_source *database_event;
 
         usec_t last_usec;
 
+        /* bumped on every reload, workers reload their rules when they see a new one */
+        unsigned rules_generation;
+
+        /* since the queue was last empty: when it got its first event, how many events have been
+         * processed, and how many of them had to wait for an earlier one */
+        usec_t queue_start_usec;
+        unsigned n_events_processed;
+        unsigned n_events_delayed;
+        usec_t events_delayed_usec;
+
+        /* the database changed since the last snapshot of it was written */
+        bool database_dirty:1;
+
+        /* how often left-over processes are looked for while warm workers are around */
+        RateLimit cgroup_cleanup_ratelimit;
+
         bool stop_exec_queue:1;
         bool exit:1;
 } Manager;
@@ -115,14 +141,9 @@ struct event {
         struct udev_device *dev_kernel;
         struct worker *worker;
         enum event_state state;
+        struct queue_entry entry;
         unsigned long long int delaying_seqnum;
-        unsigned long long int seqnum;
-        const char *devpath;
-        size_t devpath_len;
-        const char *devpath_old;
-        dev_t devnum;
-        int ifindex;
-        bool is_block;
+        usec_t delayed_since_usec;
         sd_event_source *timeout_warning;
         sd_event_source *timeout;
 };
@@ -140,12 +161,21 @@ enum worker_state {
         WORKER_KILLED,
 };
 
+/* shared memory through which the main process hands the next event to an idle worker */
+struct worker_mailbox {
+        unsigned rules_generation;
+        int log_level;
+        size_t len;
+        char properties[8192];
+};
+
 struct worker {
         Manager *manager;
         struct udev_list_node node;
         int refcount;
         pid_t pid;
-        struct udev_monitor *monitor;
+        struct worker_mailbox *mailbox;
+        int fd_mailbox;
         enum worker_state state;
         struct event *event;
 };
@@ -161,6 +191,7 @@ static void event_free(struct event *event) {
                 return;
 
         udev_list_node_remove(&event->node);
+        queue_index_remove(event->manager->queue_index, &event->entry);
         udev_device_unref(event->dev);
         udev_device_unref(event->dev_kernel);
 
@@ -172,13 +203,38 @@ static void event_free(struct event *event) {
 
         assert(event->manager);
 
+        event->manager->database_dirty = true;
+
         if (udev_list_node_is_empty(&event->manager->events)) {
                 /* only clean up the queue from the process that created it */
                 if (event->manager->pid == getpid()) {
                         r = unlink("/run/udev/queue");
                         if (r < 0)
                                 log_warning_errno(errno, "could not unlink /run/udev/queue: %m");
+
+                        if (event->manager->n_events_processed > 0) {
+                                char ts[FORMAT_TIMESPAN_MAX];
+                                usec_t usec;
+
+                                usec = now(clock_boottime_or_monotonic()) - event->manager->queue_start_usec;
+                                log_debug("queue is empty, processed %u events in %s, %.1f events/s",
+                                          event->manager->n_events_processed,
+                                          format_timespan(ts, sizeof(ts), usec, USEC_PER_MSEC),
+                                          (double) event->manager->n_events_processed * USEC_PER_SEC / MAX(usec, 1U));
+                        }
+
+                        if (event->manager->n_events_delayed > 0) {
+                                char ts[FORMAT_TIMESPAN_MAX];
+
+                                log_debug("queue is empty, %u events had to wait for earlier events, %s in total",
+                                          event->manager->n_events_delayed,
+                                          format_timespan(ts, sizeof(ts), event->manager->events_delayed_usec, USEC_PER_MSEC));
+                        }
                 }
+
+                event->manager->n_events_processed = 0;
+                event->manager->n_events_delayed = 0;
+                event->manager->events_delayed_usec = 0;
         }
 
         free(event);
@@ -191,7 +247,9 @@ static void worker_free(struct worker *worker) {
         assert(worker->manager);
 
         hashmap_remove(worker->manager->workers, PID_TO_PTR(worker->pid));
-        udev_monitor_unref(worker->monitor);
+        if (worker->mailbox)
+                munmap(worker->mailbox, sizeof(struct worker_mailbox));
+        safe_close(worker->fd_mailbox);
         event_free(worker->event);
 
         free(worker);
@@ -209,13 +267,15 @@ static void manager_workers_free(Manager *manager) {
         manager->workers = hashmap_free(manager->workers);
 }
 
-static int worker_new(struct worker **ret, Manager *manager, struct udev_monitor *worker_monitor, pid_t pid) {
+/* takes possession of the mailbox and its fd on success */
+static int worker_new(struct worker **ret, Manager *manager, struct worker_mailbox *mailbox, int fd_mailbox, pid_t pid) {
         _cleanup_free_ struct worker *worker = NULL;
         int r;
 
         assert(ret);
         assert(manager);
-        assert(worker_monitor);
+        assert(mailbox);
+        assert(fd_mailbox >= 0);
         assert(pid > 1);
 
         worker = new0(struct worker, 1);
@@ -224,9 +284,6 @@ static int worker_new(struct worker **ret, Manager *manager, struct udev_monitor
 
         worker->refcount = 1;
         worker->manager = manager;
-        /* close monitor, but keep address around */
-        udev_monitor_disconnect(worker_monitor);
-        worker->monitor = udev_monitor_ref(worker_monitor);
         worker->pid = pid;
 
         r = hashmap_ensure_allocated(&manager->workers, NULL);
@@ -237,12 +294,63 @@ static int worker_new(struct worker **ret, Manager *manager, struct udev_monitor
         if (r < 0)
                 return r;
 
+        worker->mailbox = mailbox;
+        worker->fd_mailbox = fd_mailbox;
+
         *ret = worker;
         worker = NULL;
 
         return 0;
 }
 
+static int worker_send_event(struct worker *worker, struct event *event) {
+        const char *buf;
+        ssize_t len;
+
+        assert(worker);
+        assert(event);
+
+        len = udev_device_get_properties_monitor_buf(event->dev, &buf);
+        if (len < 0)
+                return len;
+        if ((size_t) len > sizeof(worker->mailbox->properties))
+                return -E2BIG;
+
+        /* the worker is idle, it does not look at the mailbox until we wake it up */
+        memcpy(worker->mailbox->properties, buf, len);
+        worker->mailbox->len = len;
+        worker->mailbox->rules_generation = worker->manager->rules_generation;
+        worker->mailbox->log_level = log_get_max_level();
+
+        if (eventfd_write(worker->fd_mailbox, 1) < 0)
+                return -errno;
+
+        return 0;
+}
+
+static struct udev_device *worker_receive_event(struct udev *udev, const struct worker_mailbox *mailbox, int fd_mailbox) {
+        char buf[sizeof(mailbox->properties)];
+        struct udev_device *dev;
+        eventfd_t value;
+
+        if (eventfd_read(fd_mailbox, &value) < 0)
+                return NULL;
+
+        if (mailbox->len == 0 || mailbox->len > sizeof(buf))
+                return NULL;
+
+        /* parsing modifies the buffer, and the mailbox belongs to the main process */
+        memcpy(buf, mailbox->properties, mailbox->len);
+        dev = udev_device_new_from_nulstr(udev, buf, mailbox->len);
+        if (!dev)
+                return NULL;
+
+        /* devices handed to us by the main process are always initialized */
+        udev_device_set_is_initialized(dev);
+
+        return dev;
+}
+
 static int on_event_timeout(sd_event_source *s, uint64_t usec, void *userdata) {
         struct event *event = userdata;
 
@@ -252,7 +360,7 @@ static int on_event_timeout(sd_event_source *s, uint64_t usec, void *userdata) {
         kill_and_sigcont(event->worker->pid, SIGKILL);
         event->worker->state = WORKER_KILLED;
 
-        log_error("seq %llu '%s' killed", udev_device_get_seqnum(event->dev), event->devpath);
+        log_error("seq %llu '%s' killed", udev_device_get_seqnum(event->dev), event->entry.devpath);
 
         return 1;
 }
@@ -262,7 +370,7 @@ static int on_event_timeout_warning(sd_event_source *s, uint64_t usec, void *use
 
         assert(event);
 
-        log_warning("seq %llu '%s' is taking a long time", udev_device_get_seqnum(event->dev), event->devpath);
+        log_warning("seq %llu '%s' is taking a long time", udev_device_get_seqnum(event->dev), event->entry.devpath);
 
         return 1;
 }
@@ -286,6 +394,18 @@ static void worker_attach_event(struct worker *worker, struct event *event) {
 
         assert_se(sd_event_now(e, clock_boottime_or_monotonic(), &usec) >= 0);
 
+        if (event->delaying_seqnum != 0) {
+                char ts[FORMAT_TIMESPAN_MAX];
+                usec_t delayed = usec - event->delayed_since_usec;
+
+                log_debug("seq %llu '%s' waited %s for earlier events, last for seq %llu",
+                          event->entry.seqnum, event->entry.devpath,
+                          format_timespan(ts, sizeof(ts), delayed, USEC_PER_MSEC), event->delaying_seqnum);
+
+                worker->manager->n_events_delayed++;
+                worker->manager->events_delayed_usec += delayed;
+        }
+
         (void) sd_event_add_time(e, &event->timeout_warning, clock_boottime_or_monotonic(),
                                  usec + arg_event_timeout_warn_usec, USEC_PER_SEC, on_event_timeout_warning, event);
 
@@ -302,11 +422,13 @@ static void manager_free(Manager *manager) {
         sd_event_source_unref(manager->ctrl_event);
         sd_event_source_unref(manager->uevent_event);
         sd_event_source_unref(manager->inotify_event);
+        sd_event_source_unref(manager->database_event);
 
         udev_unref(manager->udev);
         sd_event_unref(manager->event);
         manager_workers_free(manager);
         event_queue_cleanup(manager, EVENT_UNDEF);
+        queue_index_free(manager->queue_index);
 
         udev_monitor_unref(manager->monitor);
         udev_ctrl_unref(manager->ctrl);
@@ -323,42 +445,70 @@ static void manager_free(Manager *manager) {
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(Manager*, manager_free);
 
+static int manager_load_rules(Manager *manager) {
+        assert(manager);
+
+        udev_builtin_init(manager->udev);
+
+        if (!manager->rules) {
+                manager->rules = udev_rules_new(manager->udev, arg_resolve_names);
+                if (!manager->rules)
+                        return -ENOMEM;
+        }
+
+        return 0;
+}
+
 static int worker_send_message(int fd) {
         struct worker_message message = {};
 
         return loop_write(fd, &message, sizeof(message), false);
 }
 
-static void worker_spawn(Manager *manager, struct event *event) {
-        struct udev *udev = event->udev;
+/* spawns a worker, either handing it the event right away, or as an idle one when event is NULL */
+static int worker_spawn(Manager *manager, struct event *event) {
+        struct udev *udev = manager->udev;
         _cleanup_udev_monitor_unref_ struct udev_monitor *worker_monitor = NULL;
+        struct worker_mailbox *mailbox;
+        _cleanup_close_ int fd_mailbox = -1;
         pid_t pid;
         int r = 0;
 
-        /* listen for new events */
+        /* broadcast processed events to libudev listeners */
         worker_monitor = udev_monitor_new_from_netlink(udev, NULL);
         if (worker_monitor == NULL)
-                return;
-        /* allow the main daemon netlink address to send devices to the worker */
-        udev_monitor_allow_unicast_sender(worker_monitor, manager->monitor);
-        r = udev_monitor_enable_receiving(worker_monitor);
-        if (r < 0)
-                log_error_errno(r, "worker: could not enable receiving of device: %m");
+                return -ENOMEM;
+
+        /* the mailbox is shared with the worker, and outlives any number of events and reloads */
+        mailbox = mmap(NULL, sizeof(struct worker_mailbox), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+        if (mailbox == MAP_FAILED)
+                return log_error_errno(errno, "failed to allocate worker mailbox: %m");
+
+        mailbox->rules_generation = manager->rules_generation;
+        mailbox->log_level = log_get_max_level();
+
+        fd_mailbox = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+        if (fd_mailbox < 0) {
+                r = log_error_errno(errno, "failed to create worker eventfd: %m");
+                munmap(mailbox, sizeof(struct worker_mailbox));
+                return r;
+        }
 
         pid = fork();
         switch (pid) {
         case 0: {
                 struct udev_device *dev = NULL;
                 _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
-                int fd_monitor;
                 _cleanup_close_ int fd_signal = -1, fd_ep = -1;
                 struct epoll_event ep_signal = { .events = EPOLLIN };
-                struct epoll_event ep_monitor = { .events = EPOLLIN };
+                struct epoll_event ep_mailbox = { .events = EPOLLIN };
                 sigset_t mask;
 
                 /* take initial device from queue */
-                dev = event->dev;
-                event->dev = NULL;
+                if (event) {
+                        dev = event->dev;
+                        event->dev = NULL;
+                }
 
                 unsetenv("NOTIFY_SOCKET");
 
@@ -373,6 +523,7 @@ static void worker_spawn(Manager *manager, struct event *event) {
                 manager->ctrl_event = sd_event_source_unref(manager->ctrl_event);
                 manager->uevent_event = sd_event_source_unref(manager->uevent_event);
                 manager->inotify_event = sd_event_source_unref(manager->inotify_event);
+                manager->database_event = sd_event_source_unref(manager->database_event);
 
                 manager->event = sd_event_unref(manager->event);
 
@@ -384,8 +535,7 @@ static void worker_spawn(Manager *manager, struct event *event) {
                 }
                 ep_signal.data.fd = fd_signal;
 
-                fd_monitor = udev_monitor_get_fd(worker_monitor);
-                ep_monitor.data.fd = fd_monitor;
+                ep_mailbox.data.fd = fd_mailbox;
 
                 fd_ep = epoll_create1(EPOLL_CLOEXEC);
                 if (fd_ep < 0) {
@@ -394,7 +544,7 @@ static void worker_spawn(Manager *manager, struct event *event) {
                 }
 
                 if (epoll_ctl(fd_ep, EPOLL_CTL_ADD, fd_signal, &ep_signal) < 0 ||
-                    epoll_ctl(fd_ep, EPOLL_CTL_ADD, fd_monitor, &ep_monitor) < 0) {
+                    epoll_ctl(fd_ep, EPOLL_CTL_ADD, fd_mailbox, &ep_mailbox) < 0) {
                         r = log_error_errno(errno, "fail to add fds to epoll: %m");
                         goto out;
                 }
@@ -410,7 +560,55 @@ static void worker_spawn(Manager *manager, struct event *event) {
                         struct udev_event *udev_event;
                         int fd_lock = -1;
 
-                        assert(dev);
+                        /* wait for more device messages from main udevd, or term signal */
+                        while (dev == NULL) {
+                                struct epoll_event ev[4];
+                                int fdcount;
+                                int i;
+
+                                fdcount = epoll_wait(fd_ep, ev, ELEMENTSOF(ev), -1);
+                                if (fdcount < 0) {
+                                        if (errno == EINTR)
+                                                continue;
+                                        r = log_error_errno(errno, "failed to poll: %m");
+                                        goto out;
+                                }
+
+                                for (i = 0; i < fdcount; i++) {
+                                        if (ev[i].data.fd == fd_mailbox && ev[i].events & EPOLLIN) {
+                                                dev = worker_receive_event(udev, mailbox, fd_mailbox);
+                                                break;
+                                        } else if (ev[i].data.fd == fd_signal && ev[i].events & EPOLLIN) {
+                                                struct signalfd_siginfo fdsi;
+                                                ssize_t size;
+
+                                                size = read(fd_signal, &fdsi, sizeof(struct signalfd_siginfo));
+                                                if (size != sizeof(struct signalfd_siginfo))
+                                                        continue;
+                                                switch (fdsi.ssi_signo) {
+                                                case SIGTERM:
+                                                        goto out;
+                                                }
+                                        }
+                                }
+                        }
+
+                        /* pick up a new log level and configuration, instead of being replaced */
+                        log_set_max_level(mailbox->log_level);
+
+                        if (mailbox->rules_generation != manager->rules_generation) {
+                                log_debug("rules changed, reloading");
+
+                                manager->rules = udev_rules_unref(manager->rules);
+                                udev_builtin_exit(udev);
+                                manager->rules_generation = mailbox->rules_generation;
+                        }
+
+                        r = manager_load_rules(manager);
+                        if (r < 0) {
+                                log_error_errno(r, "failed to load rules: %m");
+                                goto out;
+                        }
 
                         log_debug("seq %llu running", udev_device_get_seqnum(dev));
                         udev_event = udev_event_new(dev);
@@ -489,39 +687,6 @@ skip:
                         dev = NULL;
 
                         udev_event_unref(udev_event);
-
-                        /* wait for more device messages from main udevd, or term signal */
-                        while (dev == NULL) {
-                                struct epoll_event ev[4];
-                                int fdcount;
-                                int i;
-
-                                fdcount = epoll_wait(fd_ep, ev, ELEMENTSOF(ev), -1);
-                                if (fdcount < 0) {
-                                        if (errno == EINTR)
-                                                continue;
-                                        r = log_error_errno(errno, "failed to poll: %m");
-                                        goto out;
-                                }
-
-                                for (i = 0; i < fdcount; i++) {
-                                        if (ev[i].data.fd == fd_monitor && ev[i].events & EPOLLIN) {
-                                                dev = udev_monitor_receive_device(worker_monitor);
-                                                break;
-                                        } else if (ev[i].data.fd == fd_signal && ev[i].events & EPOLLIN) {
-                                                struct signalfd_siginfo fdsi;
-                                                ssize_t size;
-
-                                                size = read(fd_signal, &fdsi, sizeof(struct signalfd_siginfo));
-                                                if (size != sizeof(struct signalfd_siginfo))
-                                                        continue;
-                                                switch (fdsi.ssi_signo) {
-                                                case SIGTERM:
-                                                        goto out;
-                                                }
-                                        }
-                                }
-                        }
                 }
 out:
                 udev_device_unref(dev);
@@ -530,21 +695,29 @@ out:
                 _exit(r < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
         }
         case -1:
-                event->state = EVENT_QUEUED;
-                log_error_errno(errno, "fork of child failed: %m");
-                break;
+                r = log_error_errno(errno, "fork of child failed: %m");
+                munmap(mailbox, sizeof(struct worker_mailbox));
+                return r;
         default:
         {
                 struct worker *worker;
 
-                r = worker_new(&worker, manager, worker_monitor, pid);
-                if (r < 0)
-                        return;
+                r = worker_new(&worker, manager, mailbox, fd_mailbox, pid);
+                if (r < 0) {
+                        munmap(mailbox, sizeof(struct worker_mailbox));
+                        return r;
+                }
+                fd_mailbox = -1;
 
-                worker_attach_event(worker, event);
+                if (event) {
+                        worker_attach_event(worker, event);
+                        log_debug("seq %llu forked new worker ["PID_FMT"]", udev_device_get_seqnum(event->dev), pid);
+                } else {
+                        worker->state = WORKER_IDLE;
+                        log_debug("forked new idle worker ["PID_FMT"]", pid);
+                }
 
-                log_debug("seq %llu forked new worker ["PID_FMT"]", udev_device_get_seqnum(event->dev), pid);
-                break;
+                return 0;
         }
         }
 }
@@ -552,20 +725,23 @@ out:
 static void event_run(Manager *manager, struct event *event) {
         struct worker *worker;
         Iterator i;
+        int r;
 
         assert(manager);
         assert(event);
 
         HASHMAP_FOREACH(worker, manager->workers, i) {
-                ssize_t count;
-
                 if (worker->state != WORKER_IDLE)
                         continue;
 
-                count = udev_monitor_send_device(manager->monitor, worker->monitor, event->dev);
-                if (count < 0) {
-                        log_error_errno(errno, "worker ["PID_FMT"] did not accept message %zi (%m), kill it",
-                                        worker->pid, count);
+                r = worker_send_event(worker, event);
+                if (r == -E2BIG) {
+                        log_error_errno(r, "seq %llu is too large to be passed to a worker, skipping", udev_device_get_seqnum(event->dev));
+                        event_free(event);
+                        return;
+                }
+                if (r < 0) {
+                        log_error_errno(r, "worker ["PID_FMT"] did not accept message (%m), kill it", worker->pid);
                         kill(worker->pid, SIGKILL);
                         worker->state = WORKER_KILLED;
                         continue;
@@ -581,7 +757,9 @@ static void event_run(Manager *manager, struct event *event) {
         }
 
         /* start new worker and pass initial device */
-        worker_spawn(manager, event);
+        r = worker_spawn(manager, event);
+        if (r < 0)
+                event->state = EVENT_QUEUED;
 }
 
 static int event_queue_insert(Manager *manager, struct udev_device *dev) {
@@ -606,13 +784,19 @@ static int event_queue_insert(Manager *manager, struct udev_device *dev) {
         event->dev = dev;
         event->dev_kernel = udev_device_shallow_clone(dev);
         udev_device_copy_properties(event->dev_kernel, dev);
-        event->seqnum = udev_device_get_seqnum(dev);
-        event->devpath = udev_device_get_devpath(dev);
-        event->devpath_len = strlen(event->devpath);
-        event->devpath_old = udev_device_get_devpath_old(dev);
-        event->devnum = udev_device_get_devnum(dev);
-        event->is_block = streq("block", udev_device_get_subsystem(dev));
-        event->ifindex = udev_device_get_ifindex(dev);
+        event->entry.seqnum = udev_device_get_seqnum(dev);
+        event->entry.devpath = udev_device_get_devpath(dev);
+        event->entry.devpath_old = udev_device_get_devpath_old(dev);
+        event->entry.devnum = udev_device_get_devnum(dev);
+        event->entry.is_block = streq("block", udev_device_get_subsystem(dev));
+        event->entry.ifindex = udev_device_get_ifindex(dev);
+
+        r = queue_index_add(manager->queue_index, &event->entry);
+        if (r < 0) {
+                udev_device_unref(event->dev_kernel);
+                free(event);
+                return r;
+        }
 
         log_debug("seq %llu queued, '%s' '%s'", udev_device_get_seqnum(dev),
              udev_device_get_action(dev), udev_device_get_subsystem(dev));
@@ -623,6 +807,8 @@ static int event_queue_insert(Manager *manager, struct udev_device *dev) {
                 r = touch("/run/udev/queue");
                 if (r < 0)
                         log_warning_errno(r, "could not touch /run/udev/queue: %m");
+
+                manager->queue_start_usec = now(clock_boottime_or_monotonic());
         }
 
         udev_list_node_append(&event->node, &manager->events);
@@ -630,8 +816,10 @@ static int event_queue_insert(Manager *manager, struct udev_device *dev) {
         return 0;
 }
 
-static void manager_kill_workers(Manager *manager) {
+/* kills all workers, except for 'keep' idle ones, and returns how many were killed */
+static unsigned manager_kill_workers(Manager *manager, unsigned keep) {
         struct worker *worker;
+        unsigned n = 0;
         Iterator i;
 
         assert(manager);
@@ -640,81 +828,67 @@ static void manager_kill_workers(Manager *manager) {
                 if (worker->state == WORKER_KILLED)
                         continue;
 
+                if (worker->state == WORKER_IDLE && keep > 0) {
+                        keep--;
+                        continue;
+                }
+
                 worker->state = WORKER_KILLED;
                 kill(worker->pid, SIGTERM);
+                n++;
         }
-}
 
-/* lookup event for identical, parent, child device */
-static bool is_devpath_busy(Manager *manager, struct event *event) {
-        struct udev_list_node *loop;
-        size_t common;
-
-        /* check if queue contains events we depend on */
-        udev_list_node_foreach(loop, &manager->events) {
-                struct event *loop_event = node_to_event(loop);
+        return n;
+}
 
-                /* we already found a later event, earlier can not block us, no need to check again */
-                if (loop_event->seqnum < event->delaying_seqnum)
-                        continue;
+static unsigned manager_warm_workers(void) {
+        return MIN(arg_children_warm, arg_children_max);
+}
 
-                /* event we checked earlier still exists, no need to check again */
-                if (loop_event->seqnum == event->delaying_seqnum)
-                        return true;
+/* keeps the configured number of idle workers around, so that events do not wait for a fork */
+static void manager_prespawn_workers(Manager *manager) {
+        struct worker *worker;
+        unsigned n = 0;
+        Iterator i;
 
-                /* found ourself, no later event can block us */
-                if (loop_event->seqnum >= event->seqnum)
-                        break;
+        assert(manager);
 
-                /* check major/minor */
-                if (major(event->devnum) != 0 && event->devnum == loop_event->devnum && event->is_block == loop_event->is_block)
-                        return true;
+        if (manager->exit)
+                return;
 
-                /* check network device ifindex */
-                if (event->ifindex != 0 && event->ifindex == loop_event->ifindex)
-                        return true;
+        HASHMAP_FOREACH(worker, manager->workers, i)
+                if (worker->state != WORKER_KILLED)
+                        n++;
 
-                /* check our old name */
-                if (event->devpath_old != NULL && streq(loop_event->devpath, event->devpath_old)) {
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
+        if (n >= manager_warm_workers())
+                return;
 
-                /* compare devpath */
-                common = MIN(loop_event->devpath_len, event->devpath_len);
+        if (manager_load_rules(manager) < 0)
+                return;
 
-                /* one devpath is contained in the other? */
-                if (memcmp(loop_event->devpath, event->devpath, common) != 0)
-                        continue;
+        for (; n < manager_warm_workers(); n++)
+                if (worker_spawn(manager, NULL) < 0)
+                        return;
+}
 
-                /* identical device event found */
-                if (loop_event->devpath_len == event->devpath_len) {
-                        /* devices names might have changed/swapped in the meantime */
-                        if (major(event->devnum) != 0 && (event->devnum != loop_event->devnum || event->is_block != loop_event->is_block))
-                                continue;
-                        if (event->ifindex != 0 && event->ifindex != loop_event->ifindex)
-                                continue;
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
+/* lookup earlier event for identical, parent, child device */
+static bool is_devpath_busy(Manager *manager, struct event *event) {
+        struct queue_entry *blocker;
 
-                /* parent device event found */
-                if (event->devpath[common] == '/') {
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
+        blocker = queue_index_find_blocker(manager->queue_index, &event->entry);
+        if (!blocker)
+                return false;
 
-                /* child device event found */
-                if (loop_event->devpath[common] == '/') {
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
+        /* remember since when, and behind which event, we are waiting */
+        if (event->delaying_seqnum == 0)
+                assert_se(sd_event_now(manager->event, clock_boottime_or_monotonic(), &event->delayed_since_usec) >= 0);
 
-                /* no matching device */
-                continue;
-        }
+        if (event->delaying_seqnum != blocker->seqnum)
+                log_debug("seq %llu '%s' is waiting for seq %llu '%s'",
+                          event->entry.seqnum, event->entry.devpath, blocker->seqnum, blocker->devpath);
 
-        return false;
+        event->delaying_seqnum = blocker->seqnum;
+        return true;
 }
 
 static int on_exit_timeout(sd_event_source *s, uint64_t usec, void *userdata) {
@@ -753,7 +927,7 @@ static void manager_exit(Manager *manager) {
 
         /* discard queued events and kill workers */
         event_queue_cleanup(manager, EVENT_QUEUED);
-        manager_kill_workers(manager);
+        manager_kill_workers(manager, 0);
 
         assert_se(sd_event_now(manager->event, clock_boottime_or_monotonic(), &usec) >= 0);
 
@@ -772,7 +946,8 @@ static void manager_reload(Manager *manager) {
                   "RELOADING=1\n"
                   "STATUS=Flushing configuration...");
 
-        manager_kill_workers(manager);
+        /* workers are kept, they reload the configuration before handling their next event */
+        manager->rules_generation++;
         manager->rules = udev_rules_unref(manager->rules);
         udev_builtin_exit(manager->udev);
 
@@ -782,7 +957,7 @@ static void manager_reload(Manager *manager) {
 }
 
 static void event_queue_start(Manager *manager) {
-        struct udev_list_node *loop;
+        struct udev_list_node *loop, *tmp;
         usec_t usec;
 
         assert(manager);
@@ -802,15 +977,10 @@ static void event_queue_start(Manager *manager) {
                 manager->last_usec = usec;
         }
 
-        udev_builtin_init(manager->udev);
-
-        if (!manager->rules) {
-                manager->rules = udev_rules_new(manager->udev, arg_resolve_names);
-                if (!manager->rules)
-                        return;
-        }
+        if (manager_load_rules(manager) < 0)
+                return;
 
-        udev_list_node_foreach(loop, &manager->events) {
+        udev_list_node_foreach_safe(loop, tmp, &manager->events) {
                 struct event *event = node_to_event(loop);
 
                 if (event->state != EVENT_QUEUED)
@@ -900,6 +1070,7 @@ static int on_worker(sd_event_source *s, int fd, uint32_t revents, void *userdat
                         worker->state = WORKER_IDLE;
 
                 /* worker returned */
+                manager->n_events_processed++;
                 event_free(worker->event);
         }
 
@@ -952,7 +1123,6 @@ static int on_ctrl_msg(sd_event_source *s, int fd, uint32_t revents, void *userd
         if (i >= 0) {
                 log_debug("udevd message (SET_LOG_LEVEL) received, log_priority=%i", i);
                 log_set_max_level(i);
-                manager_kill_workers(manager);
         }
 
         if (udev_ctrl_get_stop_exec_queue(ctrl_msg) > 0) {
@@ -993,7 +1163,7 @@ static int on_ctrl_msg(sd_event_source *s, int fd, uint32_t revents, void *userd
                         } else
                                 log_error("wrong key format '%s'", key);
                 }
-                manager_kill_workers(manager);
+                manager_kill_workers(manager, 0);
         }
 
         i = udev_ctrl_get_set_children_max(ctrl_msg);
@@ -1222,7 +1392,7 @@ static int on_sigchld(sd_event_source *s, const struct signalfd_siginfo *si, voi
 
                 if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
                         if (worker->event) {
-                                log_error("worker ["PID_FMT"] failed while handling '%s'", pid, worker->event->devpath);
+                                log_error("worker ["PID_FMT"] failed while handling '%s'", pid, worker->event->entry.devpath);
                                 /* delete state from disk */
                                 udev_device_delete_db(worker->event->dev);
                                 udev_device_tag_index(worker->event->dev, NULL, false);
@@ -1240,28 +1410,131 @@ static int on_sigchld(sd_event_source *s, const struct signalfd_siginfo *si, voi
         return 1;
 }
 
+static void manager_write_database_snapshot(Manager *manager) {
+        int r;
+
+        assert(manager);
+
+        if (!arg_database_snapshot || !manager->database_dirty)
+                return;
+
+        /* no event is running, so nothing writes to the database while we read it */
+        r = device_database_write(DEVICE_DATABASE_PATH, DEVICE_DATABASE_DATA_DIR, DEVICE_DATABASE_TAGS_DIR);
+        if (r < 0)
+                log_warning_errno(r, "could not write %s: %m", DEVICE_DATABASE_PATH);
+        else
+                log_debug("wrote %s", DEVICE_DATABASE_PATH);
+
+        /* do not retry after every loop iteration, the next event will */
+        manager->database_dirty = false;
+}
+
+static int on_database_snapshot(sd_event_source *s, uint64_t usec, void *userdata) {
+        Manager *manager = userdata;
+
+        assert(manager);
+
+        /* events came in since, the next time the queue is empty schedules it again */
+        if (!udev_list_node_is_empty(&manager->events))
+                return 1;
+
+        manager_write_database_snapshot(manager);
+
+        return 1;
+}
+
+/*
+ * Writing the snapshot reads the whole database, which takes a while with many devices, and blocks
+ * the dispatching of events meanwhile. Instead of doing it every time the queue is empty, it is
+ * done at most once per DATABASE_SNAPSHOT_DELAY_USEC, when the queue is still empty by then.
+ * Until it is written, readers fall back to the database files.
+ */
+static void manager_schedule_database_snapshot(Manager *manager) {
+        int enabled = SD_EVENT_OFF;
+        usec_t usec;
+        int r;
+
+        assert(manager);
+
+        if (!arg_database_snapshot || !manager->database_dirty)
+                return;
+
+        if (manager->database_event) {
+                r = sd_event_source_get_enabled(manager->database_event, &enabled);
+                if (r >= 0 && enabled != SD_EVENT_OFF)
+                        return;
+        }
+
+        r = sd_event_now(manager->event, CLOCK_MONOTONIC, &usec);
+        if (r < 0) {
+                log_warning_errno(r, "could not schedule writing %s: %m", DEVICE_DATABASE_PATH);
+                return;
+        }
+
+        usec = usec_add(usec, DATABASE_SNAPSHOT_DELAY_USEC);
+
+        if (manager->database_event) {
+                r = sd_event_source_set_time(manager->database_event, usec);
+                if (r >= 0)
+                        r = sd_event_source_set_enabled(manager->database_event, SD_EVENT_ONESHOT);
+        } else
+                r = sd_event_add_time(manager->event, &manager->database_event, CLOCK_MONOTONIC,
+                                      usec, USEC_PER_SEC, on_database_snapshot, manager);
+        if (r < 0)
+                log_warning_errno(r, "could not schedule writing %s: %m", DEVICE_DATABASE_PATH);
+}
+
 static int on_post(sd_event_source *s, void *userdata) {
         Manager *manager = userdata;
         int r;
 
         assert(manager);
 
-        if (udev_list_node_is_empty(&manager->events)) {
-                /* no pending events */
-                if (!hashmap_isempty(manager->workers)) {
-                        /* there are idle workers */
-                        log_debug("cleanup idle workers");
-                        manager_kill_workers(manager);
-                } else {
-                        /* we are idle */
-                        if (manager->exit) {
-                                r = sd_event_exit(manager->event, 0);
-                                if (r < 0)
-                                        return r;
-                        } else if (manager->cgroup)
-                                /* cleanup possible left-over processes in our cgroup */
-                                cg_kill(SYSTEMD_CGROUP_CONTROLLER, manager->cgroup, SIGKILL, CGROUP_IGNORE_SELF, NULL, NULL, NULL);
+        if (!udev_list_node_is_empty(&manager->events))
+                return 1;
+
+        /* no pending events */
+        if (manager->exit) {
+                if (!hashmap_isempty(manager->workers))
+                        manager_kill_workers(manager, 0);
+                else {
+                        r = sd_event_exit(manager->event, 0);
+                        if (r < 0)
+                                return r;
+                }
+
+                return 1;
+        }
+
+        /* cleanup idle workers, except for the ones we keep warm */
+        if (manager_kill_workers(manager, manager_warm_workers()) > 0)
+                log_debug("cleanup idle workers");
+
+        manager_prespawn_workers(manager);
+
+        manager_schedule_database_snapshot(manager);
+
+        if (manager->cgroup && hashmap_isempty(manager->workers))
+                /* cleanup possible left-over processes in our cgroup */
+                cg_kill(SYSTEMD_CGROUP_CONTROLLER, manager->cgroup, SIGKILL, CGROUP_IGNORE_SELF, NULL, NULL, NULL);
+        else if (manager->cgroup && ratelimit_test(&manager->cgroup_cleanup_ratelimit)) {
+                _cleanup_set_free_ Set *workers = NULL;
+                struct worker *worker;
+                Iterator i;
+
+                /* The warm workers might never go away, so look for left-over processes now and then, sparing
+                 * the workers. This walks the whole cgroup, hence not on every idle iteration. */
+                workers = set_new(NULL);
+                if (!workers)
+                        return log_oom();
+
+                HASHMAP_FOREACH(worker, manager->workers, i) {
+                        r = set_put(workers, PID_TO_PTR(worker->pid));
+                        if (r < 0)
+                                return log_oom();
                 }
+
+                cg_kill(SYSTEMD_CGROUP_CONTROLLER, manager->cgroup, SIGKILL, CGROUP_IGNORE_SELF, workers, NULL, NULL);
         }
 
         return 1;
@@ -1359,7 +1632,9 @@ static int listen_fds(int *rctrl, int *rnetlink) {
  * read the kernel command line, in case we need to get into debug mode
  *   udev.log-priority=<level>                 syslog priority
  *   udev.children-max=<number of workers>     events are fully serialized if set to 1
+ *   udev.children-warm=<number of workers>    idle workers to keep around
  *   udev.exec-delay=<number of seconds>       delay execution of every executed program
+ *   udev.database-snapshot=<boolean>          write a snapshot of the database when idle
  *   udev.event-timeout=<number of seconds>    seconds to wait before terminating an event
  */
 static int parse_proc_cmdline_item(const char *key, const char *value, void *data) {
@@ -1382,8 +1657,15 @@ static int parse_proc_cmdline_item(const char *key, const char *value, void *dat
                 }
         } else if (streq(key, "udev.children-max") && value)
                 r = safe_atou(value, &arg_children_max);
+        else if (streq(key, "udev.children-warm") && value)
+                r = safe_atou(value, &arg_children_warm);
         else if (streq(key, "udev.exec-delay") && value)
                 r = safe_atoi(value, &arg_exec_delay);
+        else if (streq(key, "udev.database-snapshot") && value) {
+                r = parse_boolean(value);
+                if (r >= 0)
+                        arg_database_snapshot = r;
+        }
         else if (startswith(key, "udev."))
                 log_warning("Unknown udev kernel command line option \"%s\"", key);
 
@@ -1400,10 +1682,12 @@ static void help(void) {
                "     --daemon                 Detach and run in the background\n"
                "     --debug                  Enable debug output\n"
                "     --children-max=INT       Set maximum number of workers\n"
+               "     --children-warm=INT      Set number of idle workers to keep around\n"
                "     --exec-delay=SECONDS     Seconds to wait before executing RUN=\n"
                "     --event-timeout=SECONDS  Seconds to wait before terminating an event\n"
                "     --resolve-names=early|late|never\n"
                "                              When to resolve users and groups\n"
+               "     --database-snapshot=BOOL Write a snapshot of the database when idle\n"
                , program_invocation_short_name);
 }
 
@@ -1412,9 +1696,11 @@ static int parse_argv(int argc, char *argv[]) {
                 { "daemon",             no_argument,            NULL, 'd' },
                 { "debug",              no_argument,            NULL, 'D' },
                 { "children-max",       required_argument,      NULL, 'c' },
+                { "children-warm",      required_argument,      NULL, 'w' },
                 { "exec-delay",         required_argument,      NULL, 'e' },
                 { "event-timeout",      required_argument,      NULL, 't' },
                 { "resolve-names",      required_argument,      NULL, 'N' },
+                { "database-snapshot",  required_argument,      NULL, 's' },
                 { "help",               no_argument,            NULL, 'h' },
                 { "version",            no_argument,            NULL, 'V' },
                 {}
@@ -1425,7 +1711,7 @@ static int parse_argv(int argc, char *argv[]) {
         assert(argc >= 0);
         assert(argv);
 
-        while ((c = getopt_long(argc, argv, "c:de:Dt:N:hV", options, NULL)) >= 0) {
+        while ((c = getopt_long(argc, argv, "c:w:de:Dt:N:s:hV", options, NULL)) >= 0) {
                 int r;
 
                 switch (c) {
@@ -1438,6 +1724,11 @@ static int parse_argv(int argc, char *argv[]) {
                         if (r < 0)
                                 log_warning("Invalid --children-max ignored: %s", optarg);
                         break;
+                case 'w':
+                        r = safe_atou(optarg, &arg_children_warm);
+                        if (r < 0)
+                                log_warning("Invalid --children-warm ignored: %s", optarg);
+                        break;
                 case 'e':
                         r = safe_atoi(optarg, &arg_exec_delay);
                         if (r < 0)
@@ -1455,6 +1746,13 @@ static int parse_argv(int argc, char *argv[]) {
                 case 'D':
                         arg_debug = true;
                         break;
+                case 's':
+                        r = parse_boolean(optarg);
+                        if (r < 0)
+                                log_warning("Invalid --database-snapshot ignored: %s", optarg);
+                        else
+                                arg_database_snapshot = r;
+                        break;
                 case 'N':
                         if (streq(optarg, "early")) {
                                 arg_resolve_names = 1;
@@ -1513,7 +1811,17 @@ static int manager_new(Manager **ret, int fd_ctrl, int fd_uevent, const char *cg
         udev_list_node_init(&manager->events);
         udev_list_init(manager->udev, &manager->properties, true);
 
+        manager->queue_index = queue_index_new();
+        if (!manager->queue_index)
+                return log_oom();
+
         manager->cgroup = cgroup;
+        RATELIMIT_INIT(manager->cgroup_cleanup_ratelimit, 30 * USEC_PER_SEC, 1);
+
+        /* write a snapshot of the database left from before, or remove a stale one */
+        manager->database_dirty = true;
+        if (!arg_database_snapshot)
+                (void) unlink(DEVICE_DATABASE_PATH);
 
         manager->ctrl = udev_ctrl_new_from_fd(manager->udev, fd_ctrl);
         if (!manager->ctrl)
@@ -1615,6 +1923,8 @@ static int run(int fd_ctrl, int fd_uevent, const char *cgroup) {
         if (r < 0)
                 log_error_errno(r, "failed to apply permissions on static device nodes: %m");
 
+        manager_prespawn_workers(manager);
+
         (void) sd_notifyf(false,
                           "READY=1\n"
                           "STATUS=Processing with %u children at max", arg_children_max);
@@ -0,0 +1,111 @@
+#!/bin/bash
+# -*- mode: shell-script; indent-tabs-mode: nil; sh-basic-offset: 4; -*-
+# ex: ts=8 sw=4 sts=4 et filetype=sh
+TEST_DESCRIPTION="cgroup empty notifications for many short-lived scopes"
+
+. $TEST_BASE_DIR/test-functions
+SKIP_INITRD=yes
+KERNEL_APPEND="$KERNEL_APPEND systemd.unified_cgroup_hierarchy=yes"
+
+check_result_qemu() {
+    ret=1
+    mkdir -p $TESTDIR/root
+    mount ${LOOPDEV}p1 $TESTDIR/root
+    [[ -e $TESTDIR/root/testok ]] && ret=0
+    [[ -f $TESTDIR/root/failed ]] && cp -a $TESTDIR/root/failed $TESTDIR
+    cp -a $TESTDIR/root/var/log/journal $TESTDIR
+    umount $TESTDIR/root
+    [[ -f $TESTDIR/failed ]] && cat $TESTDIR/failed
+    ls -l $TESTDIR/journal/*/*.journal
+    test -s $TESTDIR/failed && ret=$(($ret+1))
+    return $ret
+}
+
+test_run() {
+    if run_qemu; then
+        check_result_qemu || return 1
+    else
+        dwarn "can't run QEMU, skipping"
+    fi
+    return 0
+}
+
+test_setup() {
+    create_empty_image
+    mkdir -p $TESTDIR/root
+    mount ${LOOPDEV}p1 $TESTDIR/root
+
+    # Create what will eventually be our root filesystem onto an overlay
+    (
+        LOG_LEVEL=5
+        eval $(udevadm info --export --query=env --name=${LOOPDEV}p2)
+
+        setup_basic_environment
+        dracut_install sleep seq wc sysctl
+
+        # setup the testsuite service
+        cat >$initdir/etc/systemd/system/testsuite.service <<EOF
+[Unit]
+Description=Testsuite service
+After=multi-user.target
+
+[Service]
+ExecStart=/test-cgroup-empty.sh
+Type=oneshot
+TimeoutStartSec=10min
+EOF
+
+        cat >$initdir/test-cgroup-empty.sh <<'EOF'
+#!/bin/bash -x
+
+N=500
+
+wait_for_scopes() {
+    for i in $(seq 60); do
+        [[ $(systemctl list-units --no-legend 'cgroup-empty-*.scope' | wc -l) -eq 0 ]] && return 0
+        sleep 1
+    done
+    systemctl list-units --no-legend 'cgroup-empty-*.scope'
+    return 1
+}
+
+spawn_scopes() {
+    for i in $(seq $N); do
+        systemd-run --scope --unit=cgroup-empty-$1-$i sleep 0.$((RANDOM % 10)) &
+    done
+    wait
+}
+
+# Every scope must go away once its only process exited
+spawn_scopes inotify
+wait_for_scopes || exit 1
+
+# Same with too few inotify watches left, so that most cgroups are polled
+watches=$(sysctl -n fs.inotify.max_user_watches)
+sysctl -w fs.inotify.max_user_watches=64
+spawn_scopes poll
+wait_for_scopes || exit 1
+sysctl -w fs.inotify.max_user_watches=$watches
+
+# And once watches are available again
+spawn_scopes again
+wait_for_scopes || exit 1
+
+touch /testok
+EOF
+
+        chmod 0755 $initdir/test-cgroup-empty.sh
+        setup_testsuite
+    ) || return 1
+
+    ddebug "umount $TESTDIR/root"
+    umount $TESTDIR/root
+}
+
+test_cleanup() {
+    umount $TESTDIR/root 2>/dev/null
+    [[ $LOOPDEV ]] && losetup -d $LOOPDEV
+    return 0
+}
+
+do_test "$@"
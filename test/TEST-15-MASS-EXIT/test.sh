@@ -0,0 +1,128 @@
+#!/bin/bash
+# -*- mode: shell-script; indent-tabs-mode: nil; sh-basic-offset: 4; -*-
+# ex: ts=8 sw=4 sts=4 et filetype=sh
+TEST_DESCRIPTION="stopping units with many processes at once"
+
+. $TEST_BASE_DIR/test-functions
+SKIP_INITRD=yes
+
+check_result_qemu() {
+    ret=1
+    mkdir -p $TESTDIR/root
+    mount ${LOOPDEV}p1 $TESTDIR/root
+    [[ -e $TESTDIR/root/testok ]] && ret=0
+    [[ -f $TESTDIR/root/failed ]] && cp -a $TESTDIR/root/failed $TESTDIR
+    [[ -f $TESTDIR/root/benchmark ]] && cat $TESTDIR/root/benchmark
+    cp -a $TESTDIR/root/var/log/journal $TESTDIR
+    umount $TESTDIR/root
+    [[ -f $TESTDIR/failed ]] && cat $TESTDIR/failed
+    ls -l $TESTDIR/journal/*/*.journal
+    test -s $TESTDIR/failed && ret=$(($ret+1))
+    return $ret
+}
+
+test_run() {
+    if run_qemu; then
+        check_result_qemu || return 1
+    else
+        dwarn "can't run QEMU, skipping"
+    fi
+    return 0
+}
+
+test_setup() {
+    create_empty_image
+    mkdir -p $TESTDIR/root
+    mount ${LOOPDEV}p1 $TESTDIR/root
+
+    # Create what will eventually be our root filesystem onto an overlay
+    (
+        LOG_LEVEL=5
+        eval $(udevadm info --export --query=env --name=${LOOPDEV}p2)
+
+        setup_basic_environment
+        dracut_install sleep seq date
+
+        # setup the testsuite service
+        cat >$initdir/etc/systemd/system/testsuite.service <<EOF
+[Unit]
+Description=Testsuite service
+After=multi-user.target
+
+[Service]
+ExecStart=/test-mass-exit.sh
+Type=oneshot
+TimeoutStartSec=15min
+EOF
+
+        # Each instance forks off a thousand processes which all get killed when it is stopped
+        cat >$initdir/etc/systemd/system/mass-exit@.service <<EOF
+[Unit]
+Description=Mass exit %i
+
+[Service]
+ExecStart=/mass-exit-fork.sh 1000
+TasksMax=infinity
+EOF
+
+        cat >$initdir/mass-exit-fork.sh <<'EOF'
+#!/bin/bash
+for i in $(seq $1); do
+    sleep infinity &
+done
+wait
+EOF
+
+        cat >$initdir/test-mass-exit.sh <<'EOF'
+#!/bin/bash -x
+
+UNITS=10
+PROCESSES=$((UNITS * 1000))
+
+now_ms() {
+    echo $(($(date +%s%N) / 1000000))
+}
+
+systemctl start $(seq -f 'mass-exit@%g.service' $UNITS) || exit 1
+
+# Wait until all processes are forked off
+for i in $(seq 120); do
+    tasks=0
+    for u in $(seq $UNITS); do
+        t=$(systemctl show -p TasksCurrent --value mass-exit@$u.service)
+        tasks=$((tasks + t))
+    done
+    [[ $tasks -ge $PROCESSES ]] && break
+    sleep 1
+done
+[[ $tasks -ge $PROCESSES ]] || exit 1
+
+start=$(now_ms)
+systemctl stop $(seq -f 'mass-exit@%g.service' $UNITS) || exit 1
+end=$(now_ms)
+
+# Everything must be gone, not just stopped
+for u in $(seq $UNITS); do
+    systemctl is-active -q mass-exit@$u.service && exit 1
+done
+
+echo "Stopping $UNITS units with $PROCESSES processes took $((end - start))ms" | tee /benchmark
+
+touch /testok
+EOF
+
+        chmod 0755 $initdir/mass-exit-fork.sh $initdir/test-mass-exit.sh
+        setup_testsuite
+    ) || return 1
+
+    ddebug "umount $TESTDIR/root"
+    umount $TESTDIR/root
+}
+
+test_cleanup() {
+    umount $TESTDIR/root 2>/dev/null
+    [[ $LOOPDEV ]] && losetup -d $LOOPDEV
+    return 0
+}
+
+do_test "$@"
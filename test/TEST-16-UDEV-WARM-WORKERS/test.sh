@@ -0,0 +1,110 @@
+#!/bin/bash
+# -*- mode: shell-script; indent-tabs-mode: nil; sh-basic-offset: 4; -*-
+# ex: ts=8 sw=4 sts=4 et filetype=sh
+TEST_DESCRIPTION="warm udev workers stay around and take events"
+
+. $TEST_BASE_DIR/test-functions
+SKIP_INITRD=yes
+KERNEL_APPEND="$KERNEL_APPEND udev.children-warm=2"
+
+check_result_qemu() {
+    ret=1
+    mkdir -p $TESTDIR/root
+    mount ${LOOPDEV}p1 $TESTDIR/root
+    [[ -e $TESTDIR/root/testok ]] && ret=0
+    [[ -f $TESTDIR/root/failed ]] && cp -a $TESTDIR/root/failed $TESTDIR
+    cp -a $TESTDIR/root/var/log/journal $TESTDIR
+    umount $TESTDIR/root
+    [[ -f $TESTDIR/failed ]] && cat $TESTDIR/failed
+    ls -l $TESTDIR/journal/*/*.journal
+    test -s $TESTDIR/failed && ret=$(($ret+1))
+    return $ret
+}
+
+test_run() {
+    if run_qemu; then
+        check_result_qemu || return 1
+    else
+        dwarn "can't run QEMU, skipping"
+    fi
+    return 0
+}
+
+test_setup() {
+    create_empty_image
+    mkdir -p $TESTDIR/root
+    mount ${LOOPDEV}p1 $TESTDIR/root
+
+    # Create what will eventually be our root filesystem onto an overlay
+    (
+        LOG_LEVEL=5
+        eval $(udevadm info --export --query=env --name=${LOOPDEV}p2)
+
+        setup_basic_environment
+        dracut_install sleep sort grep wc cat
+
+        # setup the testsuite service
+        cat >$initdir/etc/systemd/system/testsuite.service <<EOF
+[Unit]
+Description=Testsuite service
+After=multi-user.target
+
+[Service]
+ExecStart=/test-warm-workers.sh
+Type=oneshot
+EOF
+
+        # RUN programs are forked off by the worker handling the event
+        mkdir -p $initdir/etc/udev/rules.d
+        cat >$initdir/etc/udev/rules.d/99-warm-workers.rules <<'EOF'
+ACTION=="change", SUBSYSTEM=="net", KERNEL=="lo", RUN+="/bin/sh -c 'echo $$PPID >>/run/udev-warm-workers'"
+EOF
+
+        cat >$initdir/test-warm-workers.sh <<'EOF'
+#!/bin/bash -x
+
+workers() {
+    local main p ppid
+
+    main=$(systemctl show -p MainPID --value systemd-udevd.service)
+    for p in /proc/[0-9]*; do
+        read -r _ _ _ ppid _ <$p/stat 2>/dev/null || continue
+        [[ $ppid == $main ]] && echo ${p#/proc/}
+    done | sort
+}
+
+udevadm settle || exit 1
+
+# The idle loop runs after every event and every exiting worker, the warm
+# workers must survive it instead of being killed and forked again
+sleep 5
+before=$(workers)
+[[ $(echo "$before" | wc -l) -eq 2 ]] || exit 1
+sleep 5
+[[ "$(workers)" == "$before" ]] || exit 1
+
+# The next event is handed to one of them, without forking another worker
+udevadm trigger --action=change /sys/class/net/lo || exit 1
+udevadm settle || exit 1
+worker=$(cat /run/udev-warm-workers)
+echo "$before" | grep -qx "$worker" || exit 1
+[[ "$(workers)" == "$before" ]] || exit 1
+
+touch /testok
+EOF
+
+        chmod 0755 $initdir/test-warm-workers.sh
+        setup_testsuite
+    ) || return 1
+
+    ddebug "umount $TESTDIR/root"
+    umount $TESTDIR/root
+}
+
+test_cleanup() {
+    umount $TESTDIR/root 2>/dev/null
+    [[ $LOOPDEV ]] && losetup -d $LOOPDEV
+    return 0
+}
+
+do_test "$@"
@@ -1190,6 +1190,20 @@ EOF
 KERNEL=="sda1", GOTO="does-not-exist"
 KERNEL=="sda1", SYMLINK+="right",
 LABEL="exists"
+EOF
+        },
+        {
+                desc            => "GOTO to a label in a rule which is skipped for the event",
+                devpath         => "/devices/pci0000:00/0000:00:1f.2/host0/target0:0:0/0:0:0:0/block/sda/sda1",
+                exp_name        => "right",
+                not_exp_name    => "wrong",
+                rules           => <<EOF
+SUBSYSTEM=="net", KERNEL=="sda1", SYMLINK+="wrong"
+KERNEL=="sdb*|hd*", SYMLINK+="wrong"
+KERNEL=="sd*", SUBSYSTEM=="blo*", GOTO="found"
+SYMLINK+="wrong"
+ACTION=="remove", LABEL="found"
+ACTION=="add|change", KERNEL=="sda[0-9]", SYMLINK+="right"
 EOF
         },
         {
@@ -1322,6 +1336,15 @@ EOF
                 rules           => <<EOF
 KERNEL=="sda", IMPORT{builtin}="path_id"
 KERNEL=="sda", ENV{ID_PATH}=="?*", SYMLINK+="disk/by-path/\$env{ID_PATH}"
+EOF
+        },
+        {
+                desc            => "builtin-cached path_id",
+                devpath         => "/devices/pci0000:00/0000:00:1f.2/host0/target0:0:0/0:0:0:0/block/sda",
+                exp_name        => "disk/by-path/pci-0000:00:1f.2-scsi-0:0:0:0",
+                rules           => <<EOF
+KERNEL=="sda", IMPORT{builtin-cached}="path_id"
+KERNEL=="sda", ENV{ID_PATH}=="?*", SYMLINK+="disk/by-path/\$env{ID_PATH}"
 EOF
         },
         {